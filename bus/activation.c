@@ -55,6 +55,7 @@ struct BusActivation
                               */
   DBusHashTable *directories;
   DBusHashTable *environment;
+  DBusMessage *list_names_reply; /**< cached ListActivatableNames reply, or NULL */
 };
 
 typedef struct
@@ -78,6 +79,8 @@ typedef struct
 
 typedef struct BusPendingActivationEntry BusPendingActivationEntry;
 
+static void bus_activation_names_changed (BusActivation *activation);
+
 struct BusPendingActivationEntry
 {
   DBusMessage *activation_message;
@@ -401,6 +404,8 @@ update_desktop_file_entry (BusActivation       *activation,
           goto failed;
         }
 
+      bus_activation_names_changed (activation);
+
       if (!_dbus_hash_table_insert_string (s_dir->entries, entry->filename, bus_activation_entry_ref (entry)))
         {
           /* Revert the insertion in the entries table */
@@ -415,6 +420,7 @@ update_desktop_file_entry (BusActivation       *activation,
     {
       bus_activation_entry_ref (entry);
       _dbus_hash_table_remove_string (activation->entries, entry->name);
+      bus_activation_names_changed (activation);
 
       if (_dbus_hash_table_lookup_string (activation->entries, name))
         {
@@ -502,6 +508,7 @@ check_service_file (BusActivation       *activation,
 
       _dbus_hash_table_remove_string (activation->entries, entry->name);
       _dbus_hash_table_remove_string (entry->s_dir->entries, entry->filename);
+      bus_activation_names_changed (activation);
 
       tmp_entry = NULL;
       retval = TRUE;
@@ -794,6 +801,7 @@ bus_activation_reload (BusActivation     *activation,
 
   if (activation->entries != NULL)
     _dbus_hash_table_unref (activation->entries);
+  bus_activation_names_changed (activation);
   activation->entries = _dbus_hash_table_new (DBUS_HASH_STRING, NULL,
                                              (DBusFreeFunction)bus_activation_entry_unref);
   if (activation->entries == NULL)
@@ -953,6 +961,8 @@ bus_activation_unref (BusActivation *activation)
   dbus_free (activation->server_address);
   if (activation->entries)
     _dbus_hash_table_unref (activation->entries);
+  if (activation->list_names_reply)
+    dbus_message_unref (activation->list_names_reply);
   if (activation->pending_activations)
     _dbus_hash_table_unref (activation->pending_activations);
   if (activation->directories)
@@ -2145,6 +2155,34 @@ bus_activation_list_services (BusActivation *activation,
   return FALSE;
 }
 
+/* Called whenever a name enters or leaves the entries table, since the
+ * cached ListActivatableNames reply no longer matches it
+ */
+static void
+bus_activation_names_changed (BusActivation *activation)
+{
+  if (activation->list_names_reply != NULL)
+    {
+      dbus_message_unref (activation->list_names_reply);
+      activation->list_names_reply = NULL;
+    }
+}
+
+DBusMessage*
+bus_activation_get_list_names_reply (BusActivation *activation)
+{
+  return activation->list_names_reply;
+}
+
+void
+bus_activation_set_list_names_reply (BusActivation *activation,
+                                     DBusMessage   *reply)
+{
+  dbus_message_ref (reply);
+  bus_activation_names_changed (activation);
+  activation->list_names_reply = reply;
+}
+
 dbus_bool_t
 dbus_activation_systemd_failure (BusActivation *activation,
                                  DBusMessage   *message)
@@ -2416,6 +2454,7 @@ do_service_reload_test (DBusString *dir, dbus_bool_t oom_test)
   BusActivation *activation;
   DBusString     address;
   DBusList      *directories;
+  DBusMessage   *reply;
   CheckData      d;
 
   directories = NULL;
@@ -2444,7 +2483,15 @@ do_service_reload_test (DBusString *dir, dbus_bool_t oom_test)
   if (!do_test ("Nonexisting service file", oom_test, &d))
     return FALSE;
 
-  /* Check for added service file */
+  /* Check for added service file, which must also drop any cached
+   * ListActivatableNames reply
+   */
+  reply = dbus_message_new (DBUS_MESSAGE_TYPE_METHOD_RETURN);
+  if (reply == NULL)
+    return FALSE;
+  bus_activation_set_list_names_reply (activation, reply);
+  dbus_message_unref (reply);
+
   if (!test_create_service_file (dir, SERVICE_FILE_2, SERVICE_NAME_2, "exec-2"))
     return FALSE;
 
@@ -2454,6 +2501,9 @@ do_service_reload_test (DBusString *dir, dbus_bool_t oom_test)
   if (!do_test ("Added service file", oom_test, &d))
     return FALSE;
 
+  if (bus_activation_get_list_names_reply (activation) != NULL)
+    _dbus_assert_not_reached ("cached ListActivatableNames reply outlived a new service");
+
   /* Check for removed service file */
   if (!test_remove_service_file (dir, SERVICE_FILE_2))
     return FALSE;
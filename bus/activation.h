@@ -57,6 +57,9 @@ dbus_bool_t    bus_activation_service_created  (BusActivation     *activation,
 dbus_bool_t    bus_activation_list_services    (BusActivation     *registry,
 						char            ***listp,
 						int               *array_len);
+DBusMessage*   bus_activation_get_list_names_reply (BusActivation *activation);
+void           bus_activation_set_list_names_reply (BusActivation *activation,
+                                                    DBusMessage   *reply);
 dbus_bool_t    dbus_activation_systemd_failure (BusActivation     *activation,
                                                 DBusMessage       *message);
 
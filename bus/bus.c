@@ -34,6 +34,8 @@
 #include "dir-watch.h"
 #include <dbus/dbus-list.h>
 #include <dbus/dbus-hash.h>
+#include <dbus/dbus-connection-internal.h>
+#include <dbus/dbus-server-protected.h>
 #include <dbus/dbus-credentials.h>
 #include <dbus/dbus-internals.h>
 #ifdef DBUS_CYGWIN
@@ -65,6 +67,7 @@ struct BusContext
   unsigned int syslog : 1;
   unsigned int keep_umask : 1;
   unsigned int allow_anonymous : 1;
+  unsigned int oneshot_connections : 1;
   unsigned int systemd_activation : 1;
 };
 
@@ -212,6 +215,20 @@ new_connection_callback (DBusServer     *server,
   /* on OOM, we won't have ref'd the connection so it will die. */
 }
 
+/* Never accept more clients at once than there is room for among the
+ * connections waiting for authentication, or we'd just drop the
+ * oldest of them again
+ */
+static int
+accept_limit_callback (DBusServer *server,
+                       void       *data)
+{
+  BusContext *context = data;
+
+  return context->limits.max_incomplete_connections -
+    bus_connections_get_n_incomplete (context->connections);
+}
+
 static void
 free_server_data (void *data)
 {
@@ -250,6 +267,10 @@ setup_server (BusContext *context,
                                            new_connection_callback,
                                            context, NULL);
 
+  _dbus_server_set_accept_limit_function (server,
+                                          accept_limit_callback,
+                                          context);
+
   if (!dbus_server_set_watch_functions (server,
                                         add_server_watch,
                                         remove_server_watch,
@@ -468,6 +489,7 @@ process_config_first_time_only (BusContext       *context,
   context->syslog = bus_config_parser_get_syslog (parser);
   context->keep_umask = bus_config_parser_get_keep_umask (parser);
   context->allow_anonymous = bus_config_parser_get_allow_anonymous (parser);
+  context->oneshot_connections = bus_config_parser_get_oneshot_connections (parser);
 
   _DBUS_ASSERT_ERROR_IS_CLEAR (error);
   retval = TRUE;
@@ -1139,6 +1161,12 @@ bus_context_get_systemd_activation (BusContext *context)
   return context->systemd_activation;
 }
 
+dbus_bool_t
+bus_context_get_oneshot_connections (BusContext *context)
+{
+  return context->oneshot_connections;
+}
+
 BusRegistry*
 bus_context_get_registry (BusContext  *context)
 {
@@ -1625,17 +1653,41 @@ bus_context_check_security_policy (BusContext     *context,
     }
 
   /* See if limits on size have been exceeded */
-  if (proposed_recipient &&
-      ((dbus_connection_get_outgoing_size (proposed_recipient) > context->limits.max_outgoing_bytes) ||
-       (dbus_connection_get_outgoing_unix_fds (proposed_recipient) > context->limits.max_outgoing_unix_fds)))
+  if (proposed_recipient)
     {
-      dbus_set_error (error, DBUS_ERROR_LIMITS_EXCEEDED,
-                      "The destination service \"%s\" has a full message queue",
-                      dest ? dest : (proposed_recipient ?
-                                     bus_connection_get_name (proposed_recipient) :
-                                     DBUS_SERVICE_DBUS));
-      _dbus_verbose ("security policy disallowing message due to full message queue\n");
-      return FALSE;
+      long outgoing_size;
+
+      outgoing_size = dbus_connection_get_outgoing_size (proposed_recipient);
+
+      if (outgoing_size > context->limits.max_outgoing_bytes ||
+          dbus_connection_get_outgoing_unix_fds (proposed_recipient) > context->limits.max_outgoing_unix_fds)
+        {
+          bus_connection_note_refused_message (proposed_recipient, FALSE);
+          dbus_set_error (error, DBUS_ERROR_LIMITS_EXCEEDED,
+                          "The destination service \"%s\" has a full message queue",
+                          dest ? dest : bus_connection_get_name (proposed_recipient));
+          _dbus_verbose ("security policy disallowing message due to full message queue\n");
+          return FALSE;
+        }
+
+      /* Only look the sender up once the queue is long enough for
+       * this sender to possibly be over its share
+       */
+      if (sender_name != NULL &&
+          outgoing_size > context->limits.max_outgoing_bytes_per_sender &&
+          _dbus_connection_get_outgoing_size_for_sender (proposed_recipient, sender_name) >
+          context->limits.max_outgoing_bytes_per_sender)
+        {
+          bus_connection_note_refused_message (proposed_recipient, TRUE);
+          dbus_set_error (error, DBUS_ERROR_LIMITS_EXCEEDED,
+                          "The destination service \"%s\" has too many messages from \"%s\" queued",
+                          dest ? dest : bus_connection_get_name (proposed_recipient),
+                          sender_name);
+          _dbus_verbose ("security policy disallowing message due to sender's share of message queue\n");
+          return FALSE;
+        }
+
+      bus_connection_note_outgoing_size (proposed_recipient, outgoing_size);
     }
 
   /* Record that we will allow a reply here in the future (don't
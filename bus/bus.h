@@ -50,6 +50,7 @@ typedef struct
   long max_incoming_unix_fds;       /**< How many incoming message unix fds for a single connection */
   long max_outgoing_bytes;          /**< How many outgoing bytes can be queued for a single connection */
   long max_outgoing_unix_fds;       /**< How many outgoing unix fds can be queued for a single connection */
+  long max_outgoing_bytes_per_sender; /**< How many of those outgoing bytes can come from a single sender */
   long max_message_size;            /**< Max size of a single message in bytes */
   long max_message_unix_fds;        /**< Max number of unix fds of a single message*/
   int activation_timeout;           /**< How long to wait for an activation to time out */
@@ -89,6 +90,7 @@ const char*       bus_context_get_type                           (BusContext
 const char*       bus_context_get_address                        (BusContext       *context);
 const char*       bus_context_get_servicehelper                  (BusContext       *context);
 dbus_bool_t       bus_context_get_systemd_activation             (BusContext       *context);
+dbus_bool_t       bus_context_get_oneshot_connections            (BusContext       *context);
 BusRegistry*      bus_context_get_registry                       (BusContext       *context);
 BusConnections*   bus_context_get_connections                    (BusContext       *context);
 BusActivation*    bus_context_get_activation                     (BusContext       *context);
@@ -127,6 +127,10 @@ bus_config_parser_element_name_to_type (const char *name)
     {
       return ELEMENT_ALLOW_ANONYMOUS;
     }
+  else if (strcmp (name, "oneshot_connections") == 0)
+    {
+      return ELEMENT_ONESHOT_CONNECTIONS;
+    }
   return ELEMENT_NONE;
 }
 
@@ -181,6 +185,8 @@ bus_config_parser_element_type_to_name (ElementType type)
       return "keep_umask";
     case ELEMENT_ALLOW_ANONYMOUS:
       return "allow_anonymous";
+    case ELEMENT_ONESHOT_CONNECTIONS:
+      return "oneshot_connections";
     }
 
   _dbus_assert_not_reached ("bad element type");
@@ -48,7 +48,8 @@ typedef enum
   ELEMENT_STANDARD_SYSTEM_SERVICEDIRS,
   ELEMENT_KEEP_UMASK,
   ELEMENT_SYSLOG,
-  ELEMENT_ALLOW_ANONYMOUS
+  ELEMENT_ALLOW_ANONYMOUS,
+  ELEMENT_ONESHOT_CONNECTIONS
 } ElementType;
 
 ElementType bus_config_parser_element_name_to_type (const char *element_name);
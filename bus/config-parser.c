@@ -119,6 +119,8 @@ struct BusConfigParser
   unsigned int is_toplevel : 1; /**< FALSE if we are a sub-config-file inside another one */
 
   unsigned int allow_anonymous : 1; /**< TRUE to allow anonymous connections */
+
+  unsigned int oneshot_connections : 1; /**< TRUE to announce unique names only when needed */
 };
 
 static Element*
@@ -316,6 +318,9 @@ merge_included (BusConfigParser *parser,
   if (included->keep_umask)
     parser->keep_umask = TRUE;
 
+  if (included->oneshot_connections)
+    parser->oneshot_connections = TRUE;
+
   if (included->pidfile != NULL)
     {
       dbus_free (parser->pidfile);
@@ -405,6 +410,8 @@ bus_config_parser_new (const DBusString      *basedir,
       /* Make up some numbers! woot! */
       parser->limits.max_incoming_bytes = _DBUS_ONE_MEGABYTE * 127;
       parser->limits.max_outgoing_bytes = _DBUS_ONE_MEGABYTE * 127;
+      /* Leave a slow recipient's queue room for other senders */
+      parser->limits.max_outgoing_bytes_per_sender = _DBUS_ONE_MEGABYTE * 32;
       parser->limits.max_message_size = _DBUS_ONE_MEGABYTE * 32;
 
       /* We set relatively conservative values here since due to the
@@ -878,6 +885,20 @@ start_busconfig_child (BusConfigParser   *parser,
       parser->allow_anonymous = TRUE;
       return TRUE;
     }
+  else if (element_type == ELEMENT_ONESHOT_CONNECTIONS)
+    {
+      if (!check_no_attributes (parser, "oneshot_connections", attribute_names, attribute_values, error))
+        return FALSE;
+
+      if (push_element (parser, ELEMENT_ONESHOT_CONNECTIONS) == NULL)
+        {
+          BUS_SET_OOM (error);
+          return FALSE;
+        }
+
+      parser->oneshot_connections = TRUE;
+      return TRUE;
+    }
   else if (element_type == ELEMENT_SERVICEDIR)
     {
       if (!check_no_attributes (parser, "servicedir", attribute_names, attribute_values, error))
@@ -1854,6 +1875,11 @@ set_limit (BusConfigParser *parser,
       must_be_positive = TRUE;
       parser->limits.max_outgoing_unix_fds = value;
     }
+  else if (strcmp (name, "max_outgoing_bytes_per_sender") == 0)
+    {
+      must_be_positive = TRUE;
+      parser->limits.max_outgoing_bytes_per_sender = value;
+    }
   else if (strcmp (name, "max_message_size") == 0)
     {
       must_be_positive = TRUE;
@@ -2037,6 +2063,7 @@ bus_config_parser_end_element (BusConfigParser   *parser,
     case ELEMENT_STANDARD_SESSION_SERVICEDIRS:
     case ELEMENT_STANDARD_SYSTEM_SERVICEDIRS:
     case ELEMENT_ALLOW_ANONYMOUS:
+    case ELEMENT_ONESHOT_CONNECTIONS:
       break;
     }
 
@@ -2323,6 +2350,7 @@ bus_config_parser_content (BusConfigParser   *parser,
     case ELEMENT_STANDARD_SESSION_SERVICEDIRS:    
     case ELEMENT_STANDARD_SYSTEM_SERVICEDIRS:    
     case ELEMENT_ALLOW_ANONYMOUS:
+    case ELEMENT_ONESHOT_CONNECTIONS:
     case ELEMENT_SELINUX:
     case ELEMENT_ASSOCIATE:
       if (all_whitespace (content))
@@ -2661,6 +2689,12 @@ bus_config_parser_get_allow_anonymous (BusConfigParser   *parser)
   return parser->allow_anonymous;
 }
 
+dbus_bool_t
+bus_config_parser_get_oneshot_connections (BusConfigParser   *parser)
+{
+  return parser->oneshot_connections;
+}
+
 const char *
 bus_config_parser_get_pidfile (BusConfigParser   *parser)
 {
@@ -3008,6 +3042,7 @@ limits_equal (const BusLimits *a,
      || a->max_incoming_unix_fds == b->max_incoming_unix_fds
      || a->max_outgoing_bytes == b->max_outgoing_bytes
      || a->max_outgoing_unix_fds == b->max_outgoing_unix_fds
+     || a->max_outgoing_bytes_per_sender == b->max_outgoing_bytes_per_sender
      || a->max_message_size == b->max_message_size
      || a->max_message_unix_fds == b->max_message_unix_fds
      || a->activation_timeout == b->activation_timeout
@@ -3060,6 +3095,9 @@ config_parsers_equal (const BusConfigParser *a,
   if (! bools_equal (a->keep_umask, b->keep_umask))
     return FALSE;
 
+  if (! bools_equal (a->oneshot_connections, b->oneshot_connections))
+    return FALSE;
+
   if (! bools_equal (a->is_toplevel, b->is_toplevel))
     return FALSE;
 
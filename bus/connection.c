@@ -24,6 +24,7 @@
 #include <config.h>
 #include "connection.h"
 #include "dispatch.h"
+#include "driver.h"
 #include "policy.h"
 #include "services.h"
 #include "utils.h"
@@ -32,7 +33,9 @@
 #include "selinux.h"
 #include <dbus/dbus-list.h>
 #include <dbus/dbus-hash.h>
+#include <dbus/dbus-mempool.h>
 #include <dbus/dbus-timeout.h>
+#include <dbus/dbus-connection-internal.h>
 
 /* Trim executed commands to this length; we want to keep logs readable */
 #define MAX_LOG_COMMAND_LEN 50
@@ -50,6 +53,13 @@ typedef struct
   
 } BusPendingReply;
 
+typedef struct
+{
+  BusTransaction *transaction;
+  DBusMessage    *message;
+  DBusPreallocatedSend *preallocated;
+} MessageToSend;
+
 struct BusConnections
 {
   int refcount;
@@ -62,6 +72,7 @@ struct BusConnections
   DBusTimeout *expire_timeout; /**< Timeout for expiring incomplete connections. */
   int stamp;                   /**< Incrementing number */
   BusExpireList *pending_replies; /**< List of pending replies */
+  DBusMemPool *message_to_send_pool; /**< Memory pool for MessageToSend, one per recipient of each message */
 };
 
 static dbus_int32_t connection_data_slot = -1;
@@ -87,6 +98,11 @@ typedef struct
   long connection_tv_sec;  /**< Time when we connected (seconds component) */
   long connection_tv_usec; /**< Time when we connected (microsec component) */
   int stamp;               /**< connections->stamp last time we were traversed */
+  dbus_bool_t unannounced; /**< NameOwnerChanged for our unique name not sent yet */
+
+  long peak_outgoing_bytes;           /**< Longest outgoing queue seen when queueing to us */
+  unsigned long n_refused_queue_full; /**< Messages to us refused for a full outgoing queue */
+  unsigned long n_refused_sender_share; /**< Messages to us refused for their sender's share of the queue */
 } BusConnectionData;
 
 static dbus_bool_t bus_pending_reply_expired (BusExpireList *list,
@@ -195,40 +211,62 @@ bus_connection_disconnected (DBusConnection *connection)
    * disconnecting a client, and preallocating a broadcast "service is
    * now gone" message for every client-service pair seems kind of
    * involved.
+   *
+   * All the names go in a single transaction, so a client dropping
+   * many names costs one round of sending rather than one per name.
+   * If we run out of memory part way, cancelling the transaction
+   * puts back the names it had already removed and we start over.
+   * Names we were primary owner of stay in services_owned until the
+   * transaction is executed, so walk the list rather than popping it;
+   * the base service comes first in it and so is dropped last.
    */
-  while ((service = _dbus_list_get_last (&d->services_owned)))
+  if (d->services_owned != NULL)
     {
       BusTransaction *transaction;
+      DBusList *link;
       DBusError error;
 
     retry:
-      
+
       dbus_error_init (&error);
-        
+
       while ((transaction = bus_transaction_new (d->connections->context)) == NULL)
         _dbus_wait_for_memory ();
-        
-      if (!bus_service_remove_owner (service, connection,
-                                     transaction, &error))
+
+      link = _dbus_list_get_last_link (&d->services_owned);
+      while (link != NULL)
         {
-          _DBUS_ASSERT_ERROR_CONTENT_IS_SET (&error);
-          
-          if (dbus_error_has_name (&error, DBUS_ERROR_NO_MEMORY))
-            {
-              dbus_error_free (&error);
-              bus_transaction_cancel_and_free (transaction);
-              _dbus_wait_for_memory ();
-              goto retry;
-            }
-          else
+          DBusList *prev;
+
+          /* Removing a queued owner frees its link right away */
+          prev = _dbus_list_get_prev_link (&d->services_owned, link);
+          service = link->data;
+          link = prev;
+
+          if (!bus_service_remove_owner (service, connection,
+                                         transaction, &error))
             {
-              _dbus_verbose ("Failed to remove service owner: %s %s\n",
-                             error.name, error.message);
-              _dbus_assert_not_reached ("Removing service owner failed for non-memory-related reason");
+              _DBUS_ASSERT_ERROR_CONTENT_IS_SET (&error);
+
+              if (dbus_error_has_name (&error, DBUS_ERROR_NO_MEMORY))
+                {
+                  dbus_error_free (&error);
+                  bus_transaction_cancel_and_free (transaction);
+                  _dbus_wait_for_memory ();
+                  goto retry;
+                }
+              else
+                {
+                  _dbus_verbose ("Failed to remove service owner: %s %s\n",
+                                 error.name, error.message);
+                  _dbus_assert_not_reached ("Removing service owner failed for non-memory-related reason");
+                }
             }
         }
-        
+
       bus_transaction_execute_and_free (transaction);
+
+      _dbus_assert (d->services_owned == NULL);
     }
 
   bus_dispatch_remove_connection (connection);
@@ -458,17 +496,27 @@ bus_connections_new (BusContext *context)
                                                       connections);
   if (connections->pending_replies == NULL)
     goto failed_4;
+
+  /* A broadcast signal needs one of these for each recipient, so keep
+   * them off the heap
+   */
+  connections->message_to_send_pool = _dbus_mem_pool_new (sizeof (MessageToSend),
+                                                          FALSE);
+  if (connections->message_to_send_pool == NULL)
+    goto failed_5;
   
   if (!_dbus_loop_add_timeout (bus_context_get_loop (context),
                                connections->expire_timeout,
                                call_timeout_callback, NULL, NULL))
-    goto failed_5;
+    goto failed_6;
   
   connections->refcount = 1;
   connections->context = context;
   
   return connections;
 
+ failed_6:
+  _dbus_mem_pool_free (connections->message_to_send_pool);
  failed_5:
   bus_expire_list_free (connections->pending_replies);
  failed_4:
@@ -538,6 +586,8 @@ bus_connections_unref (BusConnections *connections)
       _dbus_timeout_unref (connections->expire_timeout);
       
       _dbus_hash_table_unref (connections->completed_by_user);
+
+      _dbus_mem_pool_free (connections->message_to_send_pool);
       
       dbus_free (connections);
 
@@ -620,8 +670,9 @@ bus_connections_setup_connection (BusConnections *connections,
   d->connections = connections;
   d->connection = connection;
   
-  _dbus_get_current_time (&d->connection_tv_sec,
-                          &d->connection_tv_usec);
+  _dbus_loop_get_cached_time (bus_context_get_loop (connections->context),
+                              &d->connection_tv_sec,
+                              &d->connection_tv_usec);
   
   _dbus_assert (connection_data_slot >= 0);
   
@@ -666,6 +717,12 @@ bus_connections_setup_connection (BusConnections *connections,
                                               connection, NULL))
     goto out;
 
+  /* bus_context_check_security_policy() asks how much each sender
+   * has queued for this connection
+   */
+  if (!_dbus_connection_track_outgoing_senders (connection))
+    goto out;
+
   /* For now we don't need to set a Windows user function because
    * there are no policies in the config file controlling what
    * Windows users can connect. The default 'same user that owns the
@@ -790,7 +847,8 @@ bus_connections_expire_incomplete (BusConnections *connections)
       DBusList *link;
       int auth_timeout;
       
-      _dbus_get_current_time (&tv_sec, &tv_usec);
+      _dbus_loop_get_cached_time (bus_context_get_loop (connections->context),
+                                  &tv_sec, &tv_usec);
       auth_timeout = bus_context_get_auth_timeout (connections->context);
   
       link = _dbus_list_get_first_link (&connections->incomplete);
@@ -1020,6 +1078,12 @@ bus_connections_get_context (BusConnections *connections)
   return connections->context;
 }
 
+int
+bus_connections_get_n_incomplete (BusConnections *connections)
+{
+  return connections->n_incomplete;
+}
+
 /*
  * This is used to avoid covering the same connection twice when
  * traversing connections. Note that it assumes we will
@@ -1358,6 +1422,11 @@ bus_connection_complete (DBusConnection   *connection,
   
   _dbus_verbose ("Name %s assigned to %p\n", d->name, connection);
 
+  /* Hold back the unique name's NameOwnerChanged until the connection
+   * does something that makes it visible; see bus_connection_announce()
+   */
+  d->unannounced = bus_context_get_oneshot_connections (d->connections->context);
+
   d->policy = bus_context_create_client_policy (d->connections->context,
                                                 connection,
                                                 error);
@@ -1428,6 +1497,139 @@ bus_connection_get_name (DBusConnection *connection)
   return d->name;
 }
 
+/**
+ * Whether the connection's unique name has not been announced with
+ * NameOwnerChanged yet. Only ever the case with oneshot_connections
+ * enabled in the bus config.
+ */
+dbus_bool_t
+bus_connection_is_unannounced (DBusConnection *connection)
+{
+  BusConnectionData *d;
+  
+  d = BUS_CONNECTION_DATA (connection);
+  _dbus_assert (d != NULL);
+
+  return d->unannounced;
+}
+
+static void
+cancel_announce (void *data)
+{
+  DBusConnection *connection = data;
+  BusConnectionData *d;
+
+  d = BUS_CONNECTION_DATA (connection);
+  _dbus_assert (d != NULL);
+
+  d->unannounced = TRUE;
+}
+
+static void
+cancel_announce_data_free (void *data)
+{
+  dbus_connection_unref (data);
+}
+
+/**
+ * Broadcasts NameOwnerChanged for the connection's unique name as
+ * part of the transaction, if that was held back at Hello time.
+ * Called before the connection requests a name or adds a match rule,
+ * since from then on other applications may need to track it.
+ * Self-cancelling if the transaction is cancelled.
+ */
+dbus_bool_t
+bus_connection_announce (DBusConnection *connection,
+                         BusTransaction *transaction,
+                         DBusError      *error)
+{
+  BusConnectionData *d;
+
+  _DBUS_ASSERT_ERROR_IS_CLEAR (error);
+
+  d = BUS_CONNECTION_DATA (connection);
+  _dbus_assert (d != NULL);
+
+  if (!d->unannounced)
+    return TRUE;
+
+  _dbus_assert (d->name != NULL);
+
+  if (!bus_driver_send_service_owner_changed (d->name, NULL, d->name,
+                                              transaction, error))
+    return FALSE;
+
+  if (!bus_transaction_add_cancel_hook (transaction, cancel_announce,
+                                        connection,
+                                        cancel_announce_data_free))
+    {
+      BUS_SET_OOM (error);
+      return FALSE;
+    }
+
+  dbus_connection_ref (connection);
+  d->unannounced = FALSE;
+
+  return TRUE;
+}
+
+/**
+ * Records the size of the connection's outgoing queue at the time a
+ * message is about to be added to it, for the backlog statistics.
+ */
+void
+bus_connection_note_outgoing_size (DBusConnection *connection,
+                                   long            outgoing_size)
+{
+  BusConnectionData *d;
+
+  d = BUS_CONNECTION_DATA (connection);
+  _dbus_assert (d != NULL);
+
+  if (outgoing_size > d->peak_outgoing_bytes)
+    d->peak_outgoing_bytes = outgoing_size;
+}
+
+/**
+ * Counts a message that could not be queued for the connection,
+ * either because its outgoing queue was full or because the sender
+ * already had more than its share of the queue.
+ */
+void
+bus_connection_note_refused_message (DBusConnection *connection,
+                                     dbus_bool_t     over_sender_share)
+{
+  BusConnectionData *d;
+
+  d = BUS_CONNECTION_DATA (connection);
+  _dbus_assert (d != NULL);
+
+  if (over_sender_share)
+    d->n_refused_sender_share += 1;
+  else
+    d->n_refused_queue_full += 1;
+}
+
+/**
+ * Gets what bus_connection_note_outgoing_size() and
+ * bus_connection_note_refused_message() recorded for the connection.
+ */
+void
+bus_connection_get_backlog_stats (DBusConnection *connection,
+                                  long           *peak_outgoing_bytes,
+                                  unsigned long  *n_refused_queue_full,
+                                  unsigned long  *n_refused_sender_share)
+{
+  BusConnectionData *d;
+
+  d = BUS_CONNECTION_DATA (connection);
+  _dbus_assert (d != NULL);
+
+  *peak_outgoing_bytes = d->peak_outgoing_bytes;
+  *n_refused_queue_full = d->n_refused_queue_full;
+  *n_refused_sender_share = d->n_refused_sender_share;
+}
+
 /**
  * Check whether completing the passed-in connection would
  * exceed limits, and if so set error and return #FALSE
@@ -1610,10 +1812,9 @@ bus_connection_drop_pending_replies (BusConnections  *connections,
                          pending->reply_serial);
           
           pending->will_send_reply = NULL;
-          pending->expire_item.added_tv_sec = 0;
-          pending->expire_item.added_tv_usec = 0;
 
-          bus_expire_list_recheck_immediately (connections->pending_replies);
+          bus_expire_list_expire_link_now (connections->pending_replies,
+                                           link);
         }
       
       link = next;
@@ -1760,8 +1961,9 @@ bus_connections_expect_reply (BusConnections  *connections,
   cprd->pending = pending;
   cprd->connections = connections;
   
-  _dbus_get_current_time (&pending->expire_item.added_tv_sec,
-                          &pending->expire_item.added_tv_usec);
+  _dbus_loop_get_cached_time (bus_context_get_loop (connections->context),
+                              &pending->expire_item.added_tv_sec,
+                              &pending->expire_item.added_tv_usec);
 
   _dbus_verbose ("Added pending reply %p, replier %p receiver %p serial %u\n",
                  pending,
@@ -1891,13 +2093,6 @@ bus_connections_check_reply (BusConnections *connections,
  * one transaction across any main loop iterations.
  */
 
-typedef struct
-{
-  BusTransaction *transaction;
-  DBusMessage    *message;
-  DBusPreallocatedSend *preallocated;
-} MessageToSend;
-
 typedef struct
 {
   BusTransactionCancelFunction cancel_function;
@@ -1916,13 +2111,18 @@ static void
 message_to_send_free (DBusConnection *connection,
                       MessageToSend  *to_send)
 {
+  BusConnectionData *d;
+
+  d = BUS_CONNECTION_DATA (connection);
+  _dbus_assert (d != NULL);
+
   if (to_send->message)
     dbus_message_unref (to_send->message);
 
   if (to_send->preallocated)
     dbus_connection_free_preallocated_send (connection, to_send->preallocated);
 
-  dbus_free (to_send);
+  _dbus_mem_pool_dealloc (d->connections->message_to_send_pool, to_send);
 }
 
 static void
@@ -2055,7 +2255,7 @@ bus_transaction_send (BusTransaction *transaction,
   d = BUS_CONNECTION_DATA (connection);
   _dbus_assert (d != NULL);
   
-  to_send = dbus_new (MessageToSend, 1);
+  to_send = _dbus_mem_pool_alloc (d->connections->message_to_send_pool);
   if (to_send == NULL)
     {
       return FALSE;
@@ -2064,7 +2264,7 @@ bus_transaction_send (BusTransaction *transaction,
   to_send->preallocated = dbus_connection_preallocate_send (connection);
   if (to_send->preallocated == NULL)
     {
-      dbus_free (to_send);
+      _dbus_mem_pool_dealloc (d->connections->message_to_send_pool, to_send);
       return FALSE;
     }  
   
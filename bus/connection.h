@@ -44,6 +44,7 @@ void            bus_connections_foreach_active    (BusConnections
                                                    BusConnectionForeachFunction  function,
                                                    void                         *data);
 BusContext*     bus_connections_get_context       (BusConnections               *connections);
+int             bus_connections_get_n_incomplete  (BusConnections               *connections);
 void            bus_connections_increment_stamp   (BusConnections               *connections);
 BusContext*     bus_connection_get_context        (DBusConnection               *connection);
 BusConnections* bus_connection_get_connections    (DBusConnection               *connection);
@@ -74,6 +75,19 @@ dbus_bool_t     bus_connection_mark_stamp         (DBusConnection
 
 dbus_bool_t bus_connection_is_active (DBusConnection *connection);
 const char *bus_connection_get_name  (DBusConnection *connection);
+dbus_bool_t bus_connection_is_unannounced (DBusConnection *connection);
+dbus_bool_t bus_connection_announce  (DBusConnection *connection,
+                                      BusTransaction *transaction,
+                                      DBusError      *error);
+
+void bus_connection_note_outgoing_size   (DBusConnection *connection,
+                                          long            outgoing_size);
+void bus_connection_note_refused_message (DBusConnection *connection,
+                                          dbus_bool_t     over_sender_share);
+void bus_connection_get_backlog_stats    (DBusConnection *connection,
+                                          long           *peak_outgoing_bytes,
+                                          unsigned long  *n_refused_queue_full,
+                                          unsigned long  *n_refused_sender_share);
 
 dbus_bool_t bus_connection_preallocate_oom_error (DBusConnection *connection);
 void        bus_connection_send_oom_error        (DBusConnection *connection,
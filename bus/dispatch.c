@@ -32,8 +32,10 @@
 #include "utils.h"
 #include "bus.h"
 #include "signals.h"
+#include "stats.h"
 #include "test.h"
 #include <dbus/dbus-internals.h>
+#include <dbus/dbus-message-internal.h>
 #include <string.h>
 
 #ifdef HAVE_UNIX_FD_PASSING
@@ -271,7 +273,8 @@ bus_dispatch (DBusConnection *connection,
       /* We need to refetch the service name here, because
        * dbus_message_set_sender can cause the header to be
        * reallocated, and thus the service_name pointer will become
-       * invalid.
+       * invalid. Setting the sender keeps the header's field cache,
+       * so this is only a lookup.
        */
       service_name = dbus_message_get_destination (message);
     }
@@ -1570,6 +1573,287 @@ check_hello_connection (BusContext *context)
   return TRUE;
 }
 
+/* Sends Hello with dbus_bus_register_async() and runs the loops
+ * until the reply has been processed; NameAcquired is dropped.
+ */
+static dbus_bool_t
+register_async_and_wait (BusContext     *context,
+                         DBusConnection *connection)
+{
+  DBusError error;
+
+  dbus_error_init (&error);
+
+  if (!dbus_bus_register_async (connection, &error))
+    {
+      _dbus_warn ("Could not queue Hello: %s\n", error.message);
+      dbus_error_free (&error);
+      return FALSE;
+    }
+
+  if (dbus_bus_get_unique_name (connection) != NULL)
+    {
+      _dbus_warn ("Unique name set before the bus replied to Hello\n");
+      return FALSE;
+    }
+
+  /* The reply is processed by dispatching, NameAcquired is dropped */
+  while (dbus_bus_get_unique_name (connection) == NULL &&
+         dbus_connection_get_is_connected (connection))
+    {
+      bus_test_run_bus_loop (context, FALSE);
+      bus_test_run_clients_loop (FALSE);
+
+      while (dbus_connection_dispatch (connection) ==
+             DBUS_DISPATCH_DATA_REMAINS)
+        ;
+    }
+
+  if (dbus_bus_get_unique_name (connection) == NULL)
+    {
+      _dbus_warn ("Disconnected before the reply to Hello\n");
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Checks that a Hello queued by dbus_bus_register_async() on a
+ * connection from dbus_connection_open_private_async(), before
+ * authentication has even started, is sent once authenticated;
+ * or, if pipelined, right behind the auth commands.
+ */
+static dbus_bool_t
+check_hello_async_connection (BusContext *context,
+                              dbus_bool_t pipelined)
+{
+  DBusConnection *connection;
+  DBusError error;
+  CheckServiceOwnerChangedData socd;
+
+  dbus_error_init (&error);
+
+  connection = dbus_connection_open_private_async (TEST_CONNECTION, &error);
+  if (connection == NULL)
+    _dbus_assert_not_reached ("could not alloc connection");
+
+  if (!bus_setup_debug_client (connection))
+    _dbus_assert_not_reached ("could not set up connection");
+
+  dbus_connection_set_pipelined_auth (connection, pipelined);
+
+  if (!register_async_and_wait (context, connection))
+    return FALSE;
+
+  socd.expected_kind = SERVICE_CREATED;
+  socd.expected_service_name = dbus_bus_get_unique_name (connection);
+  socd.failed = FALSE;
+  socd.skip_connection = connection;
+  bus_test_clients_foreach (check_service_owner_changed_foreach,
+                            &socd);
+
+  if (socd.failed)
+    return FALSE;
+
+  if (!check_add_match_all (context, connection))
+    return FALSE;
+
+  kill_client_connection (context, connection);
+
+  return TRUE;
+}
+
+#define STREAMED_BODY_LEN (256 * 1024 + 1)
+
+typedef struct
+{
+  int received;
+  int n_pieces;
+  dbus_bool_t failed;
+} CheckBodyStreamData;
+
+static void
+check_body_stream_function (DBusConnection      *connection,
+                            DBusMessage         *message,
+                            const unsigned char *data,
+                            int                  n_bytes,
+                            int                  offset,
+                            int                  total,
+                            void                *user_data)
+{
+  CheckBodyStreamData *d = user_data;
+  int i;
+
+  if (offset != d->received || total != STREAMED_BODY_LEN ||
+      !dbus_message_is_signal (message, "org.freedesktop.TestSuite", "Blob"))
+    {
+      _dbus_warn ("Unexpected piece of %d bytes at %d of %d\n",
+                  n_bytes, offset, total);
+      d->failed = TRUE;
+      return;
+    }
+
+  for (i = 0; i < n_bytes; i++)
+    {
+      if (data[i] != (offset + i) % 251)
+        {
+          _dbus_warn ("Streamed byte %d is wrong\n", offset + i);
+          d->failed = TRUE;
+          return;
+        }
+    }
+
+  d->received += n_bytes;
+  d->n_pieces += 1;
+}
+
+static dbus_bool_t
+drain_messages_foreach (DBusConnection *connection,
+                        void           *data)
+{
+  DBusMessage *message;
+
+  while ((message = pop_message_waiting_for_memory (connection)) != NULL)
+    dbus_message_unref (message);
+
+  return TRUE;
+}
+
+static DBusMessage *
+new_blob_message (DBusConnection *receiver)
+{
+  DBusMessage *message;
+  unsigned char *blob;
+  int i;
+
+  blob = dbus_malloc (STREAMED_BODY_LEN);
+  if (blob == NULL)
+    _dbus_assert_not_reached ("no memory for blob");
+
+  for (i = 0; i < STREAMED_BODY_LEN; i++)
+    blob[i] = i % 251;
+
+  message = dbus_message_new_signal ("/org/freedesktop/TestSuite",
+                                     "org.freedesktop.TestSuite",
+                                     "Blob");
+  if (message == NULL ||
+      !dbus_message_set_destination (message,
+                                     dbus_bus_get_unique_name (receiver)) ||
+      !dbus_message_append_args (message,
+                                 DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+                                 &blob, STREAMED_BODY_LEN,
+                                 DBUS_TYPE_INVALID))
+    _dbus_assert_not_reached ("no memory for blob message");
+
+  dbus_free (blob);
+
+  return message;
+}
+
+/* Checks that a large byte array sent through the bus reaches a
+ * receiver that streams bodies in pieces, in order, and that the
+ * pieces can't be popped as messages
+ */
+static dbus_bool_t
+check_body_streaming (BusContext     *context,
+                      DBusConnection *sender,
+                      DBusConnection *receiver)
+{
+  CheckBodyStreamData d;
+  DBusMessage *message;
+  dbus_bool_t popped_blob_sent;
+  int i;
+
+  message = new_blob_message (receiver);
+  popped_blob_sent = FALSE;
+
+  d.received = 0;
+  d.n_pieces = 0;
+  d.failed = FALSE;
+  dbus_connection_set_body_stream_function (receiver, 64 * 1024,
+                                            check_body_stream_function,
+                                            &d, NULL);
+
+  if (!dbus_connection_send (sender, message, NULL))
+    _dbus_assert_not_reached ("no memory to send blob message");
+  dbus_message_unref (message);
+
+  for (i = 0; i < 1000 && d.received < STREAMED_BODY_LEN && !d.failed; i++)
+    {
+      bus_test_run_everything (context);
+
+      while (dbus_connection_dispatch (receiver) == DBUS_DISPATCH_DATA_REMAINS)
+        ;
+    }
+
+  /* Popping drops the pieces rather than returning their raw bytes
+   * as a message body; a signal sent after the blob tells us when
+   * all of them have arrived
+   */
+  message = new_blob_message (receiver);
+  if (!dbus_connection_send (sender, message, NULL))
+    _dbus_assert_not_reached ("no memory to send blob message");
+  dbus_message_unref (message);
+
+  message = dbus_message_new_signal ("/org/freedesktop/TestSuite",
+                                     "org.freedesktop.TestSuite",
+                                     "BlobSent");
+  if (message == NULL ||
+      !dbus_message_set_destination (message,
+                                     dbus_bus_get_unique_name (receiver)) ||
+      !dbus_connection_send (sender, message, NULL))
+    _dbus_assert_not_reached ("no memory for BlobSent message");
+  dbus_message_unref (message);
+
+  for (i = 0; i < 1000 && !d.failed && !popped_blob_sent; i++)
+    {
+      bus_test_run_everything (context);
+
+      while ((message = pop_message_waiting_for_memory (receiver)) != NULL)
+        {
+          const unsigned char *data;
+          int n_bytes, offset, total;
+
+          if (_dbus_message_get_body_stream_chunk (message, &data, &n_bytes,
+                                                   &offset, &total))
+            {
+              _dbus_warn ("Popped a piece of a streamed body\n");
+              d.failed = TRUE;
+            }
+          else if (dbus_message_is_signal (message, "org.freedesktop.TestSuite",
+                                           "BlobSent"))
+            {
+              popped_blob_sent = TRUE;
+            }
+
+          dbus_message_unref (message);
+        }
+    }
+
+  dbus_connection_set_body_stream_function (receiver, 0, NULL, NULL, NULL);
+
+  /* Everyone else eavesdropped the blobs whole */
+  bus_test_clients_foreach (drain_messages_foreach, NULL);
+
+  if (d.failed)
+    return FALSE;
+
+  if (d.received != STREAMED_BODY_LEN || d.n_pieces < 2)
+    {
+      _dbus_warn ("Received %d of %d bytes in %d pieces\n",
+                  d.received, STREAMED_BODY_LEN, d.n_pieces);
+      return FALSE;
+    }
+
+  if (!popped_blob_sent)
+    {
+      _dbus_warn ("Did not pop the signal sent after the blob\n");
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
 #define NONEXISTENT_SERVICE_NAME "test.this.service.does.not.exist.ewuoiurjdfxcvn"
 
 /* returns TRUE if the correct thing happens,
@@ -4569,6 +4853,18 @@ bus_dispatch_test_conf (const DBusString *test_data_dir,
       _dbus_assert_not_reached ("initial connection setup failed");
     }
 
+  if (!check_hello_async_connection (context, FALSE))
+    _dbus_assert_not_reached ("asynchronous Hello failed");
+
+  if (!check_hello_async_connection (context, TRUE))
+    _dbus_assert_not_reached ("pipelined Hello failed");
+
+  if (!check_body_streaming (context, foo, baz))
+    _dbus_assert_not_reached ("streaming a large body failed");
+
+  if (!check_no_leftovers (context))
+    _dbus_assert_not_reached ("streaming a large body left messages behind");
+
   check1_try_iterations (context, "create_and_hello",
                          check_hello_connection);
 
@@ -4764,6 +5060,968 @@ bus_dispatch_sha1_test (const DBusString *test_data_dir)
   return TRUE;
 }
 
+/* With oneshot_connections a client's unique name is only announced
+ * once it adds a match rule (or requests a name), and a client that
+ * never does comes and goes without any NameOwnerChanged.
+ */
+dbus_bool_t
+bus_dispatch_oneshot_test (const DBusString *test_data_dir)
+{
+  BusContext *context;
+  DBusConnection *foo, *bar, *baz;
+  DBusMessage *message;
+  DBusError error;
+  CheckServiceOwnerChangedData socd;
+  const char *match_all = "";
+
+  dbus_error_init (&error);
+
+  context = bus_context_new_test (test_data_dir,
+                                  "valid-config-files/debug-allow-all-oneshot.conf");
+  if (context == NULL)
+    return FALSE;
+
+  foo = dbus_connection_open_private (TEST_CONNECTION, &error);
+  if (foo == NULL)
+    _dbus_assert_not_reached ("could not alloc connection");
+
+  if (!bus_setup_debug_client (foo))
+    _dbus_assert_not_reached ("could not set up connection");
+
+  spin_connection_until_authenticated (context, foo);
+
+  if (!check_hello_message (context, foo))
+    _dbus_assert_not_reached ("hello message failed");
+
+  if (!check_add_match_all (context, foo))
+    _dbus_assert_not_reached ("AddMatch message failed");
+
+  if (!check_no_leftovers (context))
+    _dbus_assert_not_reached ("initial connection setup failed");
+
+  bar = dbus_connection_open_private (TEST_CONNECTION, &error);
+  if (bar == NULL)
+    _dbus_assert_not_reached ("could not alloc connection");
+
+  if (!bus_setup_debug_client (bar))
+    _dbus_assert_not_reached ("could not set up connection");
+
+  if (!register_async_and_wait (context, bar))
+    _dbus_assert_not_reached ("hello message failed");
+
+  bus_test_run_everything (context);
+
+  if (!check_no_leftovers (context))
+    _dbus_assert_not_reached ("unique name of a oneshot connection was announced");
+
+  /* Adding a match makes bar visible to everyone else */
+  message = dbus_message_new_method_call (DBUS_SERVICE_DBUS,
+                                          DBUS_PATH_DBUS,
+                                          DBUS_INTERFACE_DBUS,
+                                          "AddMatch");
+  if (message == NULL ||
+      !dbus_message_append_args (message,
+                                 DBUS_TYPE_STRING, &match_all,
+                                 DBUS_TYPE_INVALID) ||
+      !dbus_connection_send (bar, message, NULL))
+    _dbus_assert_not_reached ("could not send AddMatch");
+
+  dbus_message_unref (message);
+
+  bus_test_run_clients_loop (SEND_PENDING (bar));
+  block_connection_until_message_from_bus (context, bar, "reply to AddMatch");
+
+  message = pop_message_waiting_for_memory (bar);
+  if (message == NULL ||
+      dbus_message_get_type (message) != DBUS_MESSAGE_TYPE_METHOD_RETURN)
+    _dbus_assert_not_reached ("AddMatch message failed");
+
+  dbus_message_unref (message);
+
+  socd.expected_kind = SERVICE_CREATED;
+  socd.expected_service_name = dbus_bus_get_unique_name (bar);
+  socd.failed = FALSE;
+  socd.skip_connection = bar;
+  bus_test_clients_foreach (check_service_owner_changed_foreach,
+                            &socd);
+
+  if (socd.failed)
+    _dbus_assert_not_reached ("deferred NameOwnerChanged was not sent");
+
+  kill_client_connection (context, bar);
+
+  baz = dbus_connection_open_private (TEST_CONNECTION, &error);
+  if (baz == NULL)
+    _dbus_assert_not_reached ("could not alloc connection");
+
+  if (!bus_setup_debug_client (baz))
+    _dbus_assert_not_reached ("could not set up connection");
+
+  if (!register_async_and_wait (context, baz))
+    _dbus_assert_not_reached ("hello message failed");
+
+  kill_client_connection_unchecked (baz);
+  bus_test_run_everything (context);
+
+  if (!check_no_leftovers (context))
+    _dbus_assert_not_reached ("disconnection of a oneshot connection was announced");
+
+  kill_client_connection_unchecked (foo);
+
+  bus_context_unref (context);
+
+  return TRUE;
+}
+
+#ifdef DBUS_ENABLE_STATS
+/* Calls GetStats and picks the named statistic out of the reply */
+static dbus_bool_t
+get_bus_stat (BusContext     *context,
+              DBusConnection *connection,
+              const char     *name,
+              dbus_uint32_t  *value)
+{
+  DBusMessage *message;
+  DBusMessageIter iter, dict;
+  dbus_bool_t found;
+
+  message = dbus_message_new_method_call (DBUS_SERVICE_DBUS,
+                                          DBUS_PATH_DBUS,
+                                          BUS_INTERFACE_STATS,
+                                          "GetStats");
+  if (message == NULL ||
+      !dbus_connection_send (connection, message, NULL))
+    _dbus_assert_not_reached ("could not send GetStats");
+
+  dbus_message_unref (message);
+
+  bus_test_run_clients_loop (SEND_PENDING (connection));
+  block_connection_until_message_from_bus (context, connection, "reply to GetStats");
+
+  message = pop_message_waiting_for_memory (connection);
+  if (message == NULL ||
+      dbus_message_get_type (message) != DBUS_MESSAGE_TYPE_METHOD_RETURN ||
+      !dbus_message_has_signature (message, "a{sv}"))
+    {
+      _dbus_warn ("Unexpected reply to GetStats\n");
+      if (message != NULL)
+        dbus_message_unref (message);
+      return FALSE;
+    }
+
+  found = FALSE;
+  dbus_message_iter_init (message, &iter);
+  dbus_message_iter_recurse (&iter, &dict);
+
+  while (dbus_message_iter_get_arg_type (&dict) == DBUS_TYPE_DICT_ENTRY)
+    {
+      DBusMessageIter entry, variant;
+      const char *key;
+
+      dbus_message_iter_recurse (&dict, &entry);
+      dbus_message_iter_get_basic (&entry, &key);
+      dbus_message_iter_next (&entry);
+      dbus_message_iter_recurse (&entry, &variant);
+
+      if (strcmp (key, name) == 0 &&
+          dbus_message_iter_get_arg_type (&variant) == DBUS_TYPE_UINT32)
+        {
+          dbus_message_iter_get_basic (&variant, value);
+          found = TRUE;
+        }
+
+      dbus_message_iter_next (&dict);
+    }
+
+  dbus_message_unref (message);
+
+  if (!found)
+    _dbus_warn ("GetStats did not return %s\n", name);
+
+  return found;
+}
+#else /* !DBUS_ENABLE_STATS */
+/* Without the Stats interface, reads the numbers GetStats would
+ * return straight from the matchmaker
+ */
+static dbus_bool_t
+get_bus_stat (BusContext     *context,
+              DBusConnection *connection,
+              const char     *name,
+              dbus_uint32_t  *value)
+{
+  unsigned long n_checked, n_suppressed;
+  int n_rules, n_predicates;
+
+  bus_matchmaker_get_driver_signal_stats (bus_context_get_matchmaker (context),
+                                          &n_checked, &n_suppressed);
+  bus_matchmaker_get_rule_stats (bus_context_get_matchmaker (context),
+                                 &n_rules, &n_predicates);
+
+  if (strcmp (name, "DriverSignalsChecked") == 0)
+    *value = n_checked;
+  else if (strcmp (name, "DriverSignalsSuppressed") == 0)
+    *value = n_suppressed;
+  else if (strcmp (name, "MatchRules") == 0)
+    *value = n_rules;
+  else if (strcmp (name, "MatchRulePredicates") == 0)
+    *value = n_predicates;
+  else
+    {
+      _dbus_warn ("No bus statistic called %s\n", name);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+#endif /* !DBUS_ENABLE_STATS */
+
+/* Checks that NameOwnerChanged is only built when some match rule
+ * could receive it, and that GetStats counts the ones skipped.
+ */
+dbus_bool_t
+bus_dispatch_owner_changed_test (const DBusString *test_data_dir)
+{
+  BusContext *context;
+  DBusConnection *foo, *bar, *baz;
+  DBusError error;
+  dbus_uint32_t before, after;
+
+  dbus_error_init (&error);
+
+  context = bus_context_new_test (test_data_dir,
+                                  "valid-config-files/debug-allow-all.conf");
+  if (context == NULL)
+    return FALSE;
+
+  foo = dbus_connection_open_private (TEST_CONNECTION, &error);
+  if (foo == NULL)
+    _dbus_assert_not_reached ("could not alloc connection");
+
+  if (!bus_setup_debug_client (foo))
+    _dbus_assert_not_reached ("could not set up connection");
+
+  spin_connection_until_authenticated (context, foo);
+
+  if (!check_hello_message (context, foo))
+    _dbus_assert_not_reached ("hello message failed");
+
+  if (!get_bus_stat (context, foo, "DriverSignalsSuppressed", &before))
+    _dbus_assert_not_reached ("GetStats failed");
+
+  /* Nobody has a match rule, so bar's arrival isn't broadcast */
+  bar = dbus_connection_open_private (TEST_CONNECTION, &error);
+  if (bar == NULL)
+    _dbus_assert_not_reached ("could not alloc connection");
+
+  if (!bus_setup_debug_client (bar))
+    _dbus_assert_not_reached ("could not set up connection");
+
+  if (!register_async_and_wait (context, bar))
+    _dbus_assert_not_reached ("hello message failed");
+
+  if (!get_bus_stat (context, foo, "DriverSignalsSuppressed", &after))
+    _dbus_assert_not_reached ("GetStats failed");
+
+  if (after != before + 1)
+    _dbus_assert_not_reached ("NameOwnerChanged for bar was not suppressed");
+
+  /* ...and neither is its departure */
+  kill_client_connection_unchecked (bar);
+  bus_test_run_everything (context);
+
+  if (!get_bus_stat (context, foo, "DriverSignalsSuppressed", &after))
+    _dbus_assert_not_reached ("GetStats failed");
+
+  if (after != before + 2)
+    _dbus_assert_not_reached ("NameOwnerChanged for bar was not suppressed");
+
+  if (!check_no_leftovers (context))
+    _dbus_assert_not_reached ("suppressed NameOwnerChanged was delivered");
+
+  /* Once foo listens, baz's arrival is broadcast as usual */
+  if (!check_add_match_all (context, foo))
+    _dbus_assert_not_reached ("AddMatch message failed");
+
+  baz = dbus_connection_open_private (TEST_CONNECTION, &error);
+  if (baz == NULL)
+    _dbus_assert_not_reached ("could not alloc connection");
+
+  if (!bus_setup_debug_client (baz))
+    _dbus_assert_not_reached ("could not set up connection");
+
+  spin_connection_until_authenticated (context, baz);
+
+  if (!check_hello_message (context, baz))
+    _dbus_assert_not_reached ("hello message failed");
+
+  if (!get_bus_stat (context, foo, "DriverSignalsSuppressed", &before))
+    _dbus_assert_not_reached ("GetStats failed");
+
+  if (before != after)
+    _dbus_assert_not_reached ("NameOwnerChanged for baz was suppressed");
+
+  kill_client_connection (context, baz);
+  kill_client_connection_unchecked (foo);
+
+  bus_context_unref (context);
+
+  return TRUE;
+}
+
+/* Sends a method call with no reply expected and a payload of
+ * n_bytes bytes from one client to another
+ */
+static void
+send_bulk_message (DBusConnection *from,
+                   DBusConnection *to,
+                   int             n_bytes)
+{
+  DBusMessage *message;
+  DBusMessageIter iter, array;
+  char *payload;
+
+  payload = dbus_malloc0 (n_bytes);
+  message = dbus_message_new_method_call (dbus_bus_get_unique_name (to),
+                                          "/org/freedesktop/TestSuite",
+                                          "org.freedesktop.TestSuite",
+                                          "Bulk");
+  if (payload == NULL || message == NULL)
+    _dbus_assert_not_reached ("no memory");
+
+  dbus_message_set_no_reply (message, TRUE);
+
+  dbus_message_iter_init_append (message, &iter);
+  if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+                                         DBUS_TYPE_BYTE_AS_STRING, &array) ||
+      !dbus_message_iter_append_fixed_array (&array, DBUS_TYPE_BYTE,
+                                             &payload, n_bytes) ||
+      !dbus_message_iter_close_container (&iter, &array) ||
+      !dbus_connection_send (from, message, NULL))
+    _dbus_assert_not_reached ("no memory");
+
+  dbus_message_unref (message);
+  dbus_free (payload);
+}
+
+#ifdef DBUS_ENABLE_STATS
+/* Calls GetConnectionStats on the unique name of connection and picks
+ * the named statistic out of the reply
+ */
+static dbus_bool_t
+get_connection_stat (BusContext     *context,
+                     DBusConnection *caller,
+                     DBusConnection *connection,
+                     const char     *name,
+                     dbus_uint32_t  *value)
+{
+  DBusMessage *message;
+  DBusMessageIter iter, dict;
+  const char *unique_name;
+  dbus_bool_t found;
+
+  unique_name = dbus_bus_get_unique_name (connection);
+  message = dbus_message_new_method_call (DBUS_SERVICE_DBUS,
+                                          DBUS_PATH_DBUS,
+                                          BUS_INTERFACE_STATS,
+                                          "GetConnectionStats");
+  if (message == NULL ||
+      !dbus_message_append_args (message,
+                                 DBUS_TYPE_STRING, &unique_name,
+                                 DBUS_TYPE_INVALID) ||
+      !dbus_connection_send (caller, message, NULL))
+    _dbus_assert_not_reached ("could not send GetConnectionStats");
+
+  dbus_message_unref (message);
+
+  bus_test_run_clients_loop (SEND_PENDING (caller));
+  block_connection_until_message_from_bus (context, caller, "reply to GetConnectionStats");
+
+  message = pop_message_waiting_for_memory (caller);
+  if (message == NULL ||
+      dbus_message_get_type (message) != DBUS_MESSAGE_TYPE_METHOD_RETURN ||
+      !dbus_message_has_signature (message, "a{sv}"))
+    {
+      _dbus_warn ("Unexpected reply to GetConnectionStats\n");
+      if (message != NULL)
+        dbus_message_unref (message);
+      return FALSE;
+    }
+
+  found = FALSE;
+  dbus_message_iter_init (message, &iter);
+  dbus_message_iter_recurse (&iter, &dict);
+
+  while (dbus_message_iter_get_arg_type (&dict) == DBUS_TYPE_DICT_ENTRY)
+    {
+      DBusMessageIter entry, variant;
+      const char *key;
+
+      dbus_message_iter_recurse (&dict, &entry);
+      dbus_message_iter_get_basic (&entry, &key);
+      dbus_message_iter_next (&entry);
+      dbus_message_iter_recurse (&entry, &variant);
+
+      if (strcmp (key, name) == 0 &&
+          dbus_message_iter_get_arg_type (&variant) == DBUS_TYPE_UINT32)
+        {
+          dbus_message_iter_get_basic (&variant, value);
+          found = TRUE;
+        }
+
+      dbus_message_iter_next (&dict);
+    }
+
+  dbus_message_unref (message);
+
+  if (!found)
+    _dbus_warn ("GetConnectionStats did not return %s\n", name);
+
+  return found;
+}
+#else /* !DBUS_ENABLE_STATS */
+/* Without the Stats interface, reads the numbers GetConnectionStats
+ * would return straight from the bus's side of the connection
+ */
+static dbus_bool_t
+get_connection_stat (BusContext     *context,
+                     DBusConnection *caller,
+                     DBusConnection *connection,
+                     const char     *name,
+                     dbus_uint32_t  *value)
+{
+  DBusString unique_name;
+  BusService *service;
+  long peak_outgoing_bytes;
+  unsigned long n_refused_queue_full, n_refused_sender_share;
+
+  _dbus_string_init_const (&unique_name, dbus_bus_get_unique_name (connection));
+  service = bus_registry_lookup (bus_context_get_registry (context),
+                                 &unique_name);
+  if (service == NULL)
+    {
+      _dbus_warn ("%s is not on the bus\n",
+                  dbus_bus_get_unique_name (connection));
+      return FALSE;
+    }
+
+  bus_connection_get_backlog_stats (bus_service_get_primary_owners_connection (service),
+                                    &peak_outgoing_bytes,
+                                    &n_refused_queue_full,
+                                    &n_refused_sender_share);
+
+  if (strcmp (name, "PeakOutgoingBytes") == 0)
+    *value = peak_outgoing_bytes;
+  else if (strcmp (name, "MessagesRefusedQueueFull") == 0)
+    *value = n_refused_queue_full;
+  else if (strcmp (name, "MessagesRefusedSenderShare") == 0)
+    *value = n_refused_sender_share;
+  else
+    {
+      _dbus_warn ("No connection statistic called %s\n", name);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+#endif /* !DBUS_ENABLE_STATS */
+
+/* Checks that once one sender has more than
+ * max_outgoing_bytes_per_sender queued for a connection that isn't
+ * reading, its further messages are refused while another sender's
+ * still get through, and that GetConnectionStats counts the refusal.
+ */
+dbus_bool_t
+bus_dispatch_sender_share_test (const DBusString *test_data_dir)
+{
+  BusContext *context;
+  DBusConnection *foo, *bar, *baz;
+  DBusMessage *message;
+  DBusError error;
+  dbus_uint32_t n_refused;
+
+  dbus_error_init (&error);
+
+  context = bus_context_new_test (test_data_dir,
+                                  "valid-config-files/debug-allow-all-sender-share.conf");
+  if (context == NULL)
+    return FALSE;
+
+  foo = dbus_connection_open_private (TEST_CONNECTION, &error);
+  bar = dbus_connection_open_private (TEST_CONNECTION, &error);
+  baz = dbus_connection_open_private (TEST_CONNECTION, &error);
+  if (foo == NULL || bar == NULL || baz == NULL)
+    _dbus_assert_not_reached ("could not alloc connection");
+
+  if (!bus_setup_debug_client (foo) ||
+      !bus_setup_debug_client (bar) ||
+      !bus_setup_debug_client (baz))
+    _dbus_assert_not_reached ("could not set up connection");
+
+  if (!register_async_and_wait (context, foo) ||
+      !register_async_and_wait (context, bar) ||
+      !register_async_and_wait (context, baz))
+    _dbus_assert_not_reached ("hello message failed");
+
+  bus_test_run_everything (context);
+
+  /* From now on bar never reads, so its queue in the bus only grows
+   * once its socket buffer is full
+   */
+  if (!dbus_connection_set_watch_functions (bar, NULL, NULL, NULL, NULL, NULL))
+    _dbus_assert_not_reached ("could not remove watches");
+
+  send_bulk_message (foo, bar, _DBUS_ONE_MEGABYTE);
+  send_bulk_message (foo, bar, 1024);
+
+  while (SEND_PENDING (foo))
+    {
+      bus_test_run_bus_loop (context, FALSE);
+      bus_test_run_clients_loop (FALSE);
+    }
+
+  block_connection_until_message_from_bus (context, foo, "error for second message");
+
+  message = pop_message_waiting_for_memory (foo);
+  if (message == NULL ||
+      !dbus_message_is_error (message, DBUS_ERROR_LIMITS_EXCEEDED))
+    _dbus_assert_not_reached ("second message from foo was not refused");
+
+  dbus_message_unref (message);
+
+  /* baz has nothing queued for bar, so it still gets through */
+  send_bulk_message (baz, bar, 1024);
+  bus_test_run_clients_loop (SEND_PENDING (baz));
+  bus_test_run_everything (context);
+
+  if (dbus_connection_get_dispatch_status (baz) != DBUS_DISPATCH_COMPLETE)
+    _dbus_assert_not_reached ("message from baz was refused");
+
+  if (!get_connection_stat (context, baz, bar, "MessagesRefusedSenderShare",
+                            &n_refused))
+    _dbus_assert_not_reached ("GetConnectionStats failed");
+
+  if (n_refused != 1)
+    _dbus_assert_not_reached ("refused message was not counted");
+
+  kill_client_connection_unchecked (bar);
+  bus_test_run_everything (context);
+  kill_client_connection_unchecked (baz);
+  kill_client_connection_unchecked (foo);
+
+  bus_context_unref (context);
+
+  return TRUE;
+}
+
+/* Calls AddMatches or RemoveMatches and returns the name of the error
+ * it got back, or NULL if it succeeded
+ */
+static const char *
+call_match_batch (BusContext     *context,
+                  DBusConnection *connection,
+                  const char     *method,
+                  const char    **rules,
+                  int             n_rules)
+{
+  static char error_name[256];
+  DBusMessage *message;
+  const char *retval;
+
+  message = dbus_message_new_method_call (DBUS_SERVICE_DBUS,
+                                          DBUS_PATH_DBUS,
+                                          DBUS_INTERFACE_DBUS,
+                                          method);
+  if (message == NULL ||
+      !dbus_message_append_args (message,
+                                 DBUS_TYPE_ARRAY, DBUS_TYPE_STRING,
+                                 &rules, n_rules,
+                                 DBUS_TYPE_INVALID) ||
+      !dbus_connection_send (connection, message, NULL))
+    _dbus_assert_not_reached ("could not send match rule batch");
+
+  dbus_message_unref (message);
+
+  bus_test_run_clients_loop (SEND_PENDING (connection));
+  block_connection_until_message_from_bus (context, connection, method);
+
+  message = pop_message_waiting_for_memory (connection);
+  if (message == NULL)
+    _dbus_assert_not_reached ("no reply to match rule batch");
+
+  if (dbus_message_get_type (message) == DBUS_MESSAGE_TYPE_ERROR)
+    {
+      strncpy (error_name, dbus_message_get_error_name (message),
+               sizeof (error_name) - 1);
+      error_name[sizeof (error_name) - 1] = '\0';
+      retval = error_name;
+    }
+  else
+    {
+      if (dbus_message_get_type (message) != DBUS_MESSAGE_TYPE_METHOD_RETURN)
+        _dbus_assert_not_reached ("unexpected reply to match rule batch");
+      retval = NULL;
+    }
+
+  dbus_message_unref (message);
+
+  return retval;
+}
+
+/* Checks that AddMatches and RemoveMatches apply all of their rules,
+ * or none of them if one is bad.
+ */
+dbus_bool_t
+bus_dispatch_match_batch_test (const DBusString *test_data_dir)
+{
+  BusContext *context;
+  DBusConnection *foo;
+  DBusError error;
+  const char *error_name;
+  const char *good[] = {
+    "type='signal',member='A'",
+    "type='signal',interface='org.freedesktop.TestSuite',member='B'",
+    "type='method_call',path='/c'"
+  };
+  const char *with_bad[] = {
+    "type='signal',member='D'",
+    "type='nonsense'"
+  };
+  const char *twice[] = {
+    "type='signal',member='A'",
+    "type='signal',member='A'"
+  };
+
+  dbus_error_init (&error);
+
+  context = bus_context_new_test (test_data_dir,
+                                  "valid-config-files/debug-allow-all.conf");
+  if (context == NULL)
+    return FALSE;
+
+  foo = dbus_connection_open_private (TEST_CONNECTION, &error);
+  if (foo == NULL)
+    _dbus_assert_not_reached ("could not alloc connection");
+
+  if (!bus_setup_debug_client (foo))
+    _dbus_assert_not_reached ("could not set up connection");
+
+  if (!register_async_and_wait (context, foo))
+    _dbus_assert_not_reached ("hello message failed");
+
+  bus_test_run_everything (context);
+
+  if (call_match_batch (context, foo, "AddMatches", good, 0) != NULL)
+    _dbus_assert_not_reached ("AddMatches with no rules failed");
+
+  if (call_match_batch (context, foo, "AddMatches", good,
+                        _DBUS_N_ELEMENTS (good)) != NULL)
+    _dbus_assert_not_reached ("AddMatches failed");
+
+  /* One bad rule keeps the good one before it out */
+  error_name = call_match_batch (context, foo, "AddMatches", with_bad,
+                                 _DBUS_N_ELEMENTS (with_bad));
+  if (error_name == NULL ||
+      strcmp (error_name, DBUS_ERROR_MATCH_RULE_INVALID) != 0)
+    _dbus_assert_not_reached ("AddMatches accepted a bad rule");
+
+  error_name = call_match_batch (context, foo, "RemoveMatches", with_bad, 1);
+  if (error_name == NULL ||
+      strcmp (error_name, DBUS_ERROR_MATCH_RULE_NOT_FOUND) != 0)
+    _dbus_assert_not_reached ("AddMatches added some of a failed batch");
+
+  /* Removing A twice needs two of them, and failing leaves the one
+   * there is
+   */
+  error_name = call_match_batch (context, foo, "RemoveMatches", twice,
+                                 _DBUS_N_ELEMENTS (twice));
+  if (error_name == NULL ||
+      strcmp (error_name, DBUS_ERROR_MATCH_RULE_NOT_FOUND) != 0)
+    _dbus_assert_not_reached ("RemoveMatches removed a rule twice");
+
+  if (call_match_batch (context, foo, "RemoveMatches", good,
+                        _DBUS_N_ELEMENTS (good)) != NULL)
+    _dbus_assert_not_reached ("RemoveMatches failed");
+
+  error_name = call_match_batch (context, foo, "RemoveMatches", good, 1);
+  if (error_name == NULL ||
+      strcmp (error_name, DBUS_ERROR_MATCH_RULE_NOT_FOUND) != 0)
+    _dbus_assert_not_reached ("RemoveMatches left a rule behind");
+
+  kill_client_connection_unchecked (foo);
+
+  bus_context_unref (context);
+
+  return TRUE;
+}
+
+#define N_SHARED_MATCH_SUBSCRIBERS 3
+
+/* Broadcasts a Shared signal from emitter and returns how many of the
+ * subscribers got it
+ */
+static int
+count_shared_signal_receivers (BusContext      *context,
+                               DBusConnection  *emitter,
+                               DBusConnection **subscribers)
+{
+  DBusMessage *message;
+  int n_received;
+  int i;
+
+  message = dbus_message_new_signal ("/org/freedesktop/TestSuite",
+                                     "org.freedesktop.TestSuite",
+                                     "Shared");
+  if (message == NULL ||
+      !dbus_connection_send (emitter, message, NULL))
+    _dbus_assert_not_reached ("could not send Shared signal");
+
+  dbus_message_unref (message);
+
+  bus_test_run_clients_loop (SEND_PENDING (emitter));
+  bus_test_run_everything (context);
+
+  n_received = 0;
+  for (i = 0; i < N_SHARED_MATCH_SUBSCRIBERS; i++)
+    {
+      if (subscribers[i] == NULL)
+        continue;
+
+      message = pop_message_waiting_for_memory (subscribers[i]);
+      if (message == NULL)
+        continue;
+
+      if (!dbus_message_is_signal (message, "org.freedesktop.TestSuite",
+                                   "Shared"))
+        _dbus_assert_not_reached ("subscriber got something else");
+
+      dbus_message_unref (message);
+      n_received += 1;
+    }
+
+  return n_received;
+}
+
+/* Checks that connections adding the same match rule share its
+ * predicate, and each still gets what it subscribed to for as long
+ * as it has the rule.
+ */
+dbus_bool_t
+bus_dispatch_shared_match_test (const DBusString *test_data_dir)
+{
+  BusContext *context;
+  DBusConnection *emitter;
+  DBusConnection *subscribers[N_SHARED_MATCH_SUBSCRIBERS];
+  DBusError error;
+  dbus_uint32_t n_rules, n_predicates;
+  dbus_uint32_t n_rules_before, n_predicates_before;
+  const char *shared[] = {
+    "type='signal',interface='org.freedesktop.TestSuite',member='Shared'"
+  };
+  const char *other[] = {
+    "type='signal',interface='org.freedesktop.TestSuite',member='Other'"
+  };
+  int i;
+
+  dbus_error_init (&error);
+
+  context = bus_context_new_test (test_data_dir,
+                                  "valid-config-files/debug-allow-all.conf");
+  if (context == NULL)
+    return FALSE;
+
+  emitter = dbus_connection_open_private (TEST_CONNECTION, &error);
+  if (emitter == NULL)
+    _dbus_assert_not_reached ("could not alloc connection");
+
+  if (!bus_setup_debug_client (emitter) ||
+      !register_async_and_wait (context, emitter))
+    _dbus_assert_not_reached ("could not set up connection");
+
+  for (i = 0; i < N_SHARED_MATCH_SUBSCRIBERS; i++)
+    {
+      subscribers[i] = dbus_connection_open_private (TEST_CONNECTION, &error);
+      if (subscribers[i] == NULL)
+        _dbus_assert_not_reached ("could not alloc connection");
+
+      if (!bus_setup_debug_client (subscribers[i]) ||
+          !register_async_and_wait (context, subscribers[i]))
+        _dbus_assert_not_reached ("could not set up connection");
+    }
+
+  bus_test_run_everything (context);
+
+  if (!get_bus_stat (context, emitter, "MatchRules", &n_rules_before) ||
+      !get_bus_stat (context, emitter, "MatchRulePredicates",
+                     &n_predicates_before))
+    _dbus_assert_not_reached ("could not get match rule stats");
+
+  for (i = 0; i < N_SHARED_MATCH_SUBSCRIBERS; i++)
+    {
+      if (call_match_batch (context, subscribers[i], "AddMatches",
+                            shared, 1) != NULL)
+        _dbus_assert_not_reached ("AddMatches failed");
+    }
+
+  /* One more rule, different from the others, for the first one */
+  if (call_match_batch (context, subscribers[0], "AddMatches",
+                        other, 1) != NULL)
+    _dbus_assert_not_reached ("AddMatches failed");
+
+  if (!get_bus_stat (context, emitter, "MatchRules", &n_rules) ||
+      !get_bus_stat (context, emitter, "MatchRulePredicates", &n_predicates))
+    _dbus_assert_not_reached ("could not get match rule stats");
+
+  if (n_rules != n_rules_before + N_SHARED_MATCH_SUBSCRIBERS + 1 ||
+      n_predicates != n_predicates_before + 2)
+    _dbus_assert_not_reached ("identical match rules were not shared");
+
+  if (count_shared_signal_receivers (context, emitter, subscribers) !=
+      N_SHARED_MATCH_SUBSCRIBERS)
+    _dbus_assert_not_reached ("not every subscriber got the signal");
+
+  /* The first rule added was the one the others share; removing it
+   * leaves the rest working
+   */
+  if (call_match_batch (context, subscribers[0], "RemoveMatches",
+                        shared, 1) != NULL)
+    _dbus_assert_not_reached ("RemoveMatches failed");
+
+  if (count_shared_signal_receivers (context, emitter, subscribers) !=
+      N_SHARED_MATCH_SUBSCRIBERS - 1)
+    _dbus_assert_not_reached ("wrong subscribers got the signal");
+
+  if (call_match_batch (context, subscribers[0], "RemoveMatches",
+                        shared, 1) == NULL)
+    _dbus_assert_not_reached ("removed a rule the connection didn't have");
+
+  kill_client_connection_unchecked (subscribers[1]);
+  subscribers[1] = NULL;
+  bus_test_run_everything (context);
+
+  if (count_shared_signal_receivers (context, emitter, subscribers) != 1)
+    _dbus_assert_not_reached ("wrong subscribers got the signal");
+
+  kill_client_connection_unchecked (subscribers[2]);
+  subscribers[2] = NULL;
+  bus_test_run_everything (context);
+
+  if (!get_bus_stat (context, emitter, "MatchRules", &n_rules) ||
+      !get_bus_stat (context, emitter, "MatchRulePredicates", &n_predicates))
+    _dbus_assert_not_reached ("could not get match rule stats");
+
+  if (n_rules != n_rules_before + 1 ||
+      n_predicates != n_predicates_before + 1)
+    _dbus_assert_not_reached ("shared match rule outlived its subscribers");
+
+  kill_client_connection_unchecked (subscribers[0]);
+  kill_client_connection_unchecked (emitter);
+
+  bus_context_unref (context);
+
+  return TRUE;
+}
+
+/* Asks the bus for ListNames or ListActivatableNames and returns
+ * whether name was in the reply
+ */
+static dbus_bool_t
+bus_lists_name (BusContext     *context,
+                DBusConnection *connection,
+                const char     *method,
+                const char     *name)
+{
+  char **names;
+  int len;
+  dbus_bool_t found;
+
+  names = NULL;
+  if (!check_get_services (context, connection, method, &names, &len) ||
+      names == NULL)
+    _dbus_assert_not_reached ("could not list names");
+
+  found = _dbus_string_array_contains ((const char **) names, name);
+  dbus_free_string_array (names);
+
+  return found;
+}
+
+/* Checks that the ListNames reply the bus caches follows names as they
+ * come and go.
+ */
+dbus_bool_t
+bus_dispatch_list_names_test (const DBusString *test_data_dir)
+{
+  BusContext *context;
+  DBusConnection *foo, *bar;
+  DBusError error;
+  char *bar_name;
+
+  dbus_error_init (&error);
+
+  context = bus_context_new_test (test_data_dir,
+                                  "valid-config-files/debug-allow-all.conf");
+  if (context == NULL)
+    return FALSE;
+
+  foo = dbus_connection_open_private (TEST_CONNECTION, &error);
+  if (foo == NULL)
+    _dbus_assert_not_reached ("could not alloc connection");
+
+  if (!bus_setup_debug_client (foo) ||
+      !register_async_and_wait (context, foo))
+    _dbus_assert_not_reached ("could not set up connection");
+
+  bus_test_run_everything (context);
+
+  if (!bus_lists_name (context, foo, "ListNames", DBUS_SERVICE_DBUS) ||
+      !bus_lists_name (context, foo, "ListNames",
+                       dbus_bus_get_unique_name (foo)))
+    _dbus_assert_not_reached ("ListNames is missing a name");
+
+  if (!bus_lists_name (context, foo, "ListActivatableNames",
+                       DBUS_SERVICE_DBUS))
+    _dbus_assert_not_reached ("ListActivatableNames is missing the bus");
+
+  /* A name appearing after the last ListNames must show up in the next */
+  bar = dbus_connection_open_private (TEST_CONNECTION, &error);
+  if (bar == NULL)
+    _dbus_assert_not_reached ("could not alloc connection");
+
+  if (!bus_setup_debug_client (bar) ||
+      !register_async_and_wait (context, bar))
+    _dbus_assert_not_reached ("could not set up connection");
+
+  bus_test_run_everything (context);
+
+  bar_name = _dbus_strdup (dbus_bus_get_unique_name (bar));
+  if (bar_name == NULL)
+    _dbus_assert_not_reached ("no memory");
+
+  if (!bus_lists_name (context, foo, "ListNames", bar_name) ||
+      !bus_lists_name (context, foo, "ListNames", bar_name))
+    _dbus_assert_not_reached ("ListNames missed a new name");
+
+  /* ... and one that went away must not */
+  kill_client_connection_unchecked (bar);
+  bus_test_run_everything (context);
+
+  if (bus_lists_name (context, foo, "ListNames", bar_name))
+    _dbus_assert_not_reached ("ListNames kept a name that went away");
+
+  if (!bus_lists_name (context, foo, "ListNames",
+                       dbus_bus_get_unique_name (foo)))
+    _dbus_assert_not_reached ("ListNames lost a name");
+
+  dbus_free (bar_name);
+
+  kill_client_connection_unchecked (foo);
+
+  bus_context_unref (context);
+
+  return TRUE;
+}
+
 #ifdef HAVE_UNIX_FD_PASSING
 
 dbus_bool_t
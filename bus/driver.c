@@ -30,6 +30,7 @@
 #include "services.h"
 #include "selinux.h"
 #include "signals.h"
+#include "stats.h"
 #include "utils.h"
 #include <dbus/dbus-string.h>
 #include <dbus/dbus-internals.h>
@@ -52,6 +53,8 @@ bus_driver_send_service_owner_changed (const char     *service_name,
   DBusMessage *message;
   dbus_bool_t retval;
   const char *null_service;
+  const char *args[3];
+  BusMatchmaker *matchmaker;
 
   _DBUS_ASSERT_ERROR_IS_CLEAR (error);
 
@@ -61,6 +64,20 @@ bus_driver_send_service_owner_changed (const char     *service_name,
                  old_owner ? old_owner : null_service,
                  new_owner ? new_owner : null_service);
 
+  /* Most names come and go without anybody watching them, so don't
+   * build a signal that no match rule can select
+   */
+  args[0] = service_name;
+  args[1] = old_owner ? old_owner : null_service;
+  args[2] = new_owner ? new_owner : null_service;
+
+  matchmaker = bus_context_get_matchmaker (bus_transaction_get_context (transaction));
+  if (!bus_matchmaker_wants_driver_signal (matchmaker, DBUS_PATH_DBUS,
+                                           DBUS_INTERFACE_DBUS,
+                                           "NameOwnerChanged",
+                                           args, _DBUS_N_ELEMENTS (args)))
+    return TRUE;
+
   message = dbus_message_new_signal (DBUS_PATH_DBUS,
                                      DBUS_INTERFACE_DBUS,
                                      "NameOwnerChanged");
@@ -75,9 +92,9 @@ bus_driver_send_service_owner_changed (const char     *service_name,
     goto oom;
 
   if (!dbus_message_append_args (message,
-                                 DBUS_TYPE_STRING, &service_name,
-                                 DBUS_TYPE_STRING, old_owner ? &old_owner : &null_service,
-                                 DBUS_TYPE_STRING, new_owner ? &new_owner : &null_service,
+                                 DBUS_TYPE_STRING, &args[0],
+                                 DBUS_TYPE_STRING, &args[1],
+                                 DBUS_TYPE_STRING, &args[2],
                                  DBUS_TYPE_INVALID))
     goto oom;
 
@@ -367,82 +384,132 @@ bus_driver_send_welcome_message (DBusConnection *connection,
     }
 }
 
-static dbus_bool_t
-bus_driver_handle_list_services (DBusConnection *connection,
-                                 BusTransaction *transaction,
-                                 DBusMessage    *message,
-                                 DBusError      *error)
+/* Builds a method return carrying names as the string array that
+ * ListNames and ListActivatableNames reply with, the bus driver first.
+ * It has no destination or reply serial; see new_reply_from_template().
+ */
+static DBusMessage *
+new_list_names_template (char **names,
+                         int    len)
 {
-  DBusMessage *reply;
-  int len;
-  char **services;
-  BusRegistry *registry;
-  int i;
+  DBusMessage *template;
   DBusMessageIter iter;
   DBusMessageIter sub;
+  const char *v_STRING;
+  int i;
 
-  _DBUS_ASSERT_ERROR_IS_CLEAR (error);
+  template = dbus_message_new (DBUS_MESSAGE_TYPE_METHOD_RETURN);
+  if (template == NULL)
+    return NULL;
 
-  registry = bus_connection_get_registry (connection);
+  dbus_message_set_no_reply (template, TRUE);
 
-  reply = dbus_message_new_method_return (message);
-  if (reply == NULL)
+  dbus_message_iter_init_append (template, &iter);
+
+  if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+                                         DBUS_TYPE_STRING_AS_STRING,
+                                         &sub))
+    goto failed;
+
+  /* Include the bus driver in the list */
+  v_STRING = DBUS_SERVICE_DBUS;
+  if (!dbus_message_iter_append_basic (&sub, DBUS_TYPE_STRING, &v_STRING))
     {
-      BUS_SET_OOM (error);
-      return FALSE;
+      dbus_message_iter_abandon_container (&iter, &sub);
+      goto failed;
     }
 
-  if (!bus_registry_list_services (registry, &services, &len))
+  for (i = 0; i < len; i++)
     {
-      dbus_message_unref (reply);
-      BUS_SET_OOM (error);
-      return FALSE;
+      if (!dbus_message_iter_append_basic (&sub, DBUS_TYPE_STRING,
+                                           &names[i]))
+        {
+          dbus_message_iter_abandon_container (&iter, &sub);
+          goto failed;
+        }
     }
 
-  dbus_message_iter_init_append (reply, &iter);
+  if (!dbus_message_iter_close_container (&iter, &sub))
+    goto failed;
 
-  if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
-                                         DBUS_TYPE_STRING_AS_STRING,
-                                         &sub))
+  return template;
+
+ failed:
+  dbus_message_unref (template);
+  return NULL;
+}
+
+/* Copies a marshalled reply we keep around, addressing the copy to
+ * whoever sent method_call
+ */
+static DBusMessage *
+new_reply_from_template (DBusMessage *template,
+                         DBusMessage *method_call)
+{
+  DBusMessage *reply;
+  const char *sender;
+
+  reply = dbus_message_copy (template);
+  if (reply == NULL)
+    return NULL;
+
+  sender = dbus_message_get_sender (method_call);
+
+  if ((sender != NULL && !dbus_message_set_destination (reply, sender)) ||
+      !dbus_message_set_reply_serial (reply,
+                                      dbus_message_get_serial (method_call)))
     {
-      dbus_free_string_array (services);
       dbus_message_unref (reply);
-      BUS_SET_OOM (error);
-      return FALSE;
+      return NULL;
     }
 
-  {
-    /* Include the bus driver in the list */
-    const char *v_STRING = DBUS_SERVICE_DBUS;
-    if (!dbus_message_iter_append_basic (&sub, DBUS_TYPE_STRING,
-                                         &v_STRING))
-      {
-        dbus_free_string_array (services);
-        dbus_message_unref (reply);
-        BUS_SET_OOM (error);
-        return FALSE;
-      }
-  }
+  return reply;
+}
 
-  i = 0;
-  while (i < len)
+/* The registry drops its cached reply whenever a name comes or goes,
+ * so between changes every ListNames call is a copy of the same one.
+ */
+static dbus_bool_t
+bus_driver_handle_list_services (DBusConnection *connection,
+                                 BusTransaction *transaction,
+                                 DBusMessage    *message,
+                                 DBusError      *error)
+{
+  DBusMessage *template;
+  DBusMessage *reply;
+  int len;
+  char **services;
+  BusRegistry *registry;
+
+  _DBUS_ASSERT_ERROR_IS_CLEAR (error);
+
+  registry = bus_connection_get_registry (connection);
+
+  template = bus_registry_get_list_names_reply (registry);
+  if (template == NULL)
     {
-      if (!dbus_message_iter_append_basic (&sub, DBUS_TYPE_STRING,
-                                           &services[i]))
+      if (!bus_registry_list_services (registry, &services, &len))
         {
-          dbus_free_string_array (services);
-          dbus_message_unref (reply);
           BUS_SET_OOM (error);
           return FALSE;
         }
-      ++i;
-    }
 
-  dbus_free_string_array (services);
+      template = new_list_names_template (services, len);
+      dbus_free_string_array (services);
 
-  if (!dbus_message_iter_close_container (&iter, &sub))
+      if (template == NULL)
+        {
+          BUS_SET_OOM (error);
+          return FALSE;
+        }
+
+      bus_registry_set_list_names_reply (registry, template);
+      dbus_message_unref (template);
+    }
+
+  reply = new_reply_from_template (template, message);
+  if (reply == NULL)
     {
-      dbus_message_unref (reply);
       BUS_SET_OOM (error);
       return FALSE;
     }
@@ -466,76 +533,41 @@ bus_driver_handle_list_activatable_services (DBusConnection *connection,
 					     DBusMessage    *message,
 					     DBusError      *error)
 {
+  DBusMessage *template;
   DBusMessage *reply;
   int len;
   char **services;
   BusActivation *activation;
-  int i;
-  DBusMessageIter iter;
-  DBusMessageIter sub;
 
   _DBUS_ASSERT_ERROR_IS_CLEAR (error);
 
   activation = bus_connection_get_activation (connection);
 
-  reply = dbus_message_new_method_return (message);
-  if (reply == NULL)
+  template = bus_activation_get_list_names_reply (activation);
+  if (template == NULL)
     {
-      BUS_SET_OOM (error);
-      return FALSE;
-    }
-
-  if (!bus_activation_list_services (activation, &services, &len))
-    {
-      dbus_message_unref (reply);
-      BUS_SET_OOM (error);
-      return FALSE;
-    }
-
-  dbus_message_iter_init_append (reply, &iter);
+      if (!bus_activation_list_services (activation, &services, &len))
+        {
+          BUS_SET_OOM (error);
+          return FALSE;
+        }
 
-  if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
-					 DBUS_TYPE_STRING_AS_STRING,
-					 &sub))
-    {
+      template = new_list_names_template (services, len);
       dbus_free_string_array (services);
-      dbus_message_unref (reply);
-      BUS_SET_OOM (error);
-      return FALSE;
-    }
 
-  {
-    /* Include the bus driver in the list */
-    const char *v_STRING = DBUS_SERVICE_DBUS;
-    if (!dbus_message_iter_append_basic (&sub, DBUS_TYPE_STRING,
-					 &v_STRING))
-      {
-	dbus_free_string_array (services);
-	dbus_message_unref (reply);
-	BUS_SET_OOM (error);
-	return FALSE;
-      }
-  }
+      if (template == NULL)
+        {
+          BUS_SET_OOM (error);
+          return FALSE;
+        }
 
-  i = 0;
-  while (i < len)
-    {
-      if (!dbus_message_iter_append_basic (&sub, DBUS_TYPE_STRING,
-					   &services[i]))
-	{
-	  dbus_free_string_array (services);
-	  dbus_message_unref (reply);
-	  BUS_SET_OOM (error);
-	  return FALSE;
-	}
-      ++i;
+      bus_activation_set_list_names_reply (activation, template);
+      dbus_message_unref (template);
     }
 
-  dbus_free_string_array (services);
-
-  if (!dbus_message_iter_close_container (&iter, &sub))
+  reply = new_reply_from_template (template, message);
+  if (reply == NULL)
     {
-      dbus_message_unref (reply);
       BUS_SET_OOM (error);
       return FALSE;
     }
@@ -584,6 +616,10 @@ bus_driver_handle_acquire_service (DBusConnection *connection,
 
   _dbus_string_init_const (&service_name, name);
 
+  /* Owners of well-known names must be trackable by their unique name */
+  if (!bus_connection_announce (connection, transaction, error))
+    goto out;
+
   if (!bus_registry_acquire_service (registry, connection,
                                      &service_name, flags,
                                      &service_reply, transaction,
@@ -984,6 +1020,10 @@ bus_driver_handle_add_match (DBusConnection *connection,
   if (rule == NULL)
     goto failed;
 
+  /* A connection receiving broadcasts is no longer a oneshot client */
+  if (!bus_connection_announce (connection, transaction, error))
+    goto failed;
+
   matchmaker = bus_connection_get_matchmaker (connection);
 
   if (!bus_matchmaker_add_rule (matchmaker, rule))
@@ -1063,6 +1103,209 @@ bus_driver_handle_remove_match (DBusConnection *connection,
   return FALSE;
 }
 
+/* Parses every rule string in the message's array argument, so that
+ * callers can apply all of them or, on error, none
+ */
+static BusMatchRule **
+parse_match_rules (DBusConnection *connection,
+                   DBusMessage    *message,
+                   int            *n_rules_p,
+                   DBusError      *error)
+{
+  char **texts;
+  int n_texts;
+  BusMatchRule **rules;
+  int i;
+
+  texts = NULL;
+  rules = NULL;
+
+  if (!dbus_message_get_args (message, error,
+                              DBUS_TYPE_ARRAY, DBUS_TYPE_STRING,
+                              &texts, &n_texts,
+                              DBUS_TYPE_INVALID))
+    {
+      _dbus_verbose ("No memory to get arguments to %s\n",
+                     dbus_message_get_member (message));
+      return NULL;
+    }
+
+  /* one slot more, so that an empty array still gets us a non-NULL one */
+  rules = dbus_new0 (BusMatchRule *, n_texts + 1);
+  if (rules == NULL)
+    {
+      BUS_SET_OOM (error);
+      goto failed;
+    }
+
+  for (i = 0; i < n_texts; i++)
+    {
+      DBusString str;
+
+      _dbus_string_init_const (&str, texts[i]);
+
+      rules[i] = bus_match_rule_parse (connection, &str, error);
+      if (rules[i] == NULL)
+        goto failed;
+    }
+
+  dbus_free_string_array (texts);
+
+  *n_rules_p = n_texts;
+  return rules;
+
+ failed:
+  _DBUS_ASSERT_ERROR_IS_SET (error);
+  if (rules != NULL)
+    {
+      for (i = 0; i < n_texts && rules[i] != NULL; i++)
+        bus_match_rule_unref (rules[i]);
+      dbus_free (rules);
+    }
+  dbus_free_string_array (texts);
+  return NULL;
+}
+
+static void
+free_match_rules (BusMatchRule **rules,
+                  int            n_rules)
+{
+  int i;
+
+  for (i = 0; i < n_rules; i++)
+    bus_match_rule_unref (rules[i]);
+
+  dbus_free (rules);
+}
+
+static dbus_bool_t
+bus_driver_handle_add_matches (DBusConnection *connection,
+                               BusTransaction *transaction,
+                               DBusMessage    *message,
+                               DBusError      *error)
+{
+  BusMatchRule **rules;
+  int n_rules;
+  int n_added;
+  BusMatchmaker *matchmaker;
+
+  _DBUS_ASSERT_ERROR_IS_CLEAR (error);
+
+  n_added = 0;
+  matchmaker = bus_connection_get_matchmaker (connection);
+
+  rules = parse_match_rules (connection, message, &n_rules, error);
+  if (rules == NULL)
+    goto failed;
+
+  if (bus_connection_get_n_match_rules (connection) + n_rules >
+      bus_context_get_max_match_rules_per_connection (bus_transaction_get_context (transaction)))
+    {
+      dbus_set_error (error, DBUS_ERROR_LIMITS_EXCEEDED,
+                      "Connection \"%s\" is not allowed to add %d more match rules "
+                      "(increase limits in configuration file if required)",
+                      bus_connection_is_active (connection) ?
+                      bus_connection_get_name (connection) :
+                      "(inactive)", n_rules);
+      goto failed;
+    }
+
+  /* A connection receiving broadcasts is no longer a oneshot client */
+  if (n_rules > 0 &&
+      !bus_connection_announce (connection, transaction, error))
+    goto failed;
+
+  while (n_added < n_rules)
+    {
+      if (!bus_matchmaker_add_rule (matchmaker, rules[n_added]))
+        {
+          BUS_SET_OOM (error);
+          goto failed;
+        }
+      n_added += 1;
+    }
+
+  if (!send_ack_reply (connection, transaction,
+                       message, error))
+    goto failed;
+
+  free_match_rules (rules, n_rules);
+
+  return TRUE;
+
+ failed:
+  _DBUS_ASSERT_ERROR_IS_SET (error);
+  if (rules)
+    {
+      while (n_added > 0)
+        {
+          n_added -= 1;
+          bus_matchmaker_remove_rule (matchmaker, rules[n_added]);
+        }
+
+      free_match_rules (rules, n_rules);
+    }
+  return FALSE;
+}
+
+static dbus_bool_t
+bus_driver_handle_remove_matches (DBusConnection *connection,
+                                  BusTransaction *transaction,
+                                  DBusMessage    *message,
+                                  DBusError      *error)
+{
+  BusMatchRule **rules;
+  BusMatchRule **found;
+  int n_rules;
+  int i;
+  BusMatchmaker *matchmaker;
+
+  _DBUS_ASSERT_ERROR_IS_CLEAR (error);
+
+  found = NULL;
+
+  rules = parse_match_rules (connection, message, &n_rules, error);
+  if (rules == NULL)
+    goto failed;
+
+  found = dbus_new (BusMatchRule *, n_rules + 1);
+  if (found == NULL)
+    {
+      BUS_SET_OOM (error);
+      goto failed;
+    }
+
+  matchmaker = bus_connection_get_matchmaker (connection);
+
+  /* Unlike RemoveMatch, look for all the rules before sending the
+   * ack, so that a missing one only gets the caller an error reply.
+   * The ack still goes before the removal, since it is undone on
+   * transaction cancel, but rule removal isn't.
+   */
+  if (!bus_matchmaker_find_rules_by_value (matchmaker, rules, n_rules,
+                                           found, error))
+    goto failed;
+
+  if (!send_ack_reply (connection, transaction,
+                       message, error))
+    goto failed;
+
+  for (i = 0; i < n_rules; i++)
+    bus_matchmaker_remove_rule (matchmaker, found[i]);
+
+  dbus_free (found);
+  free_match_rules (rules, n_rules);
+
+  return TRUE;
+
+ failed:
+  _DBUS_ASSERT_ERROR_IS_SET (error);
+  dbus_free (found);
+  if (rules)
+    free_match_rules (rules, n_rules);
+  return FALSE;
+}
+
 static dbus_bool_t
 bus_driver_handle_get_service_owner (DBusConnection *connection,
 				     BusTransaction *transaction,
@@ -1648,7 +1891,7 @@ bus_driver_handle_get_id (DBusConnection *connection,
  * frequency of use (but doesn't matter with only a few items
  * anyhow)
  */
-static struct
+typedef struct
 {
   const char *name;
   const char *in_args;
@@ -1657,7 +1900,9 @@ static struct
                            BusTransaction *transaction,
                            DBusMessage    *message,
                            DBusError      *error);
-} message_handlers[] = {
+} MessageHandler;
+
+static const MessageHandler message_handlers[] = {
   { "Hello",
     "",
     DBUS_TYPE_STRING_AS_STRING,
@@ -1698,6 +1943,14 @@ static struct
     DBUS_TYPE_STRING_AS_STRING,
     "",
     bus_driver_handle_remove_match },
+  { "AddMatches",
+    DBUS_TYPE_ARRAY_AS_STRING DBUS_TYPE_STRING_AS_STRING,
+    "",
+    bus_driver_handle_add_matches },
+  { "RemoveMatches",
+    DBUS_TYPE_ARRAY_AS_STRING DBUS_TYPE_STRING_AS_STRING,
+    "",
+    bus_driver_handle_remove_matches },
   { "GetNameOwner",
     DBUS_TYPE_STRING_AS_STRING,
     DBUS_TYPE_STRING_AS_STRING,
@@ -1732,6 +1985,19 @@ static struct
     bus_driver_handle_get_id }
 };
 
+#ifdef DBUS_ENABLE_STATS
+static const MessageHandler stats_message_handlers[] = {
+  { "GetStats",
+    "",
+    DBUS_TYPE_ARRAY_AS_STRING DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING DBUS_TYPE_STRING_AS_STRING DBUS_TYPE_VARIANT_AS_STRING DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+    bus_stats_handle_get_stats },
+  { "GetConnectionStats",
+    DBUS_TYPE_STRING_AS_STRING,
+    DBUS_TYPE_ARRAY_AS_STRING DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING DBUS_TYPE_STRING_AS_STRING DBUS_TYPE_VARIANT_AS_STRING DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+    bus_stats_handle_get_connection_stats }
+};
+#endif
+
 static dbus_bool_t
 write_args_for_direction (DBusString *xml,
 			  const char *signature,
@@ -1767,10 +2033,38 @@ write_args_for_direction (DBusString *xml,
   return FALSE;
 }
 
+static dbus_bool_t
+write_methods (DBusString           *xml,
+               const MessageHandler *handlers,
+               int                   n_handlers)
+{
+  int i;
+
+  i = 0;
+  while (i < n_handlers)
+    {
+      if (!_dbus_string_append_printf (xml, "    <method name=\"%s\">\n",
+                                       handlers[i].name))
+        return FALSE;
+
+      if (!write_args_for_direction (xml, handlers[i].in_args, TRUE))
+	return FALSE;
+
+      if (!write_args_for_direction (xml, handlers[i].out_args, FALSE))
+	return FALSE;
+
+      if (!_dbus_string_append (xml, "    </method>\n"))
+	return FALSE;
+
+      ++i;
+    }
+
+  return TRUE;
+}
+
 dbus_bool_t
 bus_driver_generate_introspect_string (DBusString *xml)
 {
-  int i;
 
   if (!_dbus_string_append (xml, DBUS_INTROSPECT_1_0_XML_DOCTYPE_DECL_NODE))
     return FALSE;
@@ -1791,25 +2085,9 @@ bus_driver_generate_introspect_string (DBusString *xml)
                                    DBUS_INTERFACE_DBUS))
     return FALSE;
 
-  i = 0;
-  while (i < _DBUS_N_ELEMENTS (message_handlers))
-    {
-
-      if (!_dbus_string_append_printf (xml, "    <method name=\"%s\">\n",
-                                       message_handlers[i].name))
-        return FALSE;
-
-      if (!write_args_for_direction (xml, message_handlers[i].in_args, TRUE))
-	return FALSE;
-
-      if (!write_args_for_direction (xml, message_handlers[i].out_args, FALSE))
-	return FALSE;
-
-      if (!_dbus_string_append (xml, "    </method>\n"))
-	return FALSE;
-
-      ++i;
-    }
+  if (!write_methods (xml, message_handlers,
+                      _DBUS_N_ELEMENTS (message_handlers)))
+    return FALSE;
 
   if (!_dbus_string_append_printf (xml, "    <signal name=\"NameOwnerChanged\">\n"))
     return FALSE;
@@ -1851,28 +2129,108 @@ bus_driver_generate_introspect_string (DBusString *xml)
   if (!_dbus_string_append (xml, "  </interface>\n"))
     return FALSE;
 
+#ifdef DBUS_ENABLE_STATS
+  if (!_dbus_string_append_printf (xml, "  <interface name=\"%s\">\n",
+                                   BUS_INTERFACE_STATS))
+    return FALSE;
+
+  if (!write_methods (xml, stats_message_handlers,
+                      _DBUS_N_ELEMENTS (stats_message_handlers)))
+    return FALSE;
+
+  if (!_dbus_string_append (xml, "  </interface>\n"))
+    return FALSE;
+#endif
+
   if (!_dbus_string_append (xml, "</node>\n"))
     return FALSE;
 
   return TRUE;
 }
 
+/* The reply to Introspect never changes, so we marshal it once and
+ * hand out copies of that, with only the destination and reply serial
+ * filled in for each caller.
+ */
+static DBusMessage *introspect_reply_template = NULL;
+
+static void
+free_introspect_reply_template (void *data)
+{
+  dbus_message_unref (introspect_reply_template);
+  introspect_reply_template = NULL;
+}
+
+static DBusMessage *
+get_introspect_reply_template (void)
+{
+  DBusString xml;
+  DBusMessage *template;
+  const char *v_STRING;
+
+  if (introspect_reply_template != NULL)
+    return introspect_reply_template;
+
+  if (!_dbus_string_init (&xml))
+    return NULL;
+
+  template = NULL;
+
+  if (!bus_driver_generate_introspect_string (&xml))
+    goto failed;
+
+  template = dbus_message_new (DBUS_MESSAGE_TYPE_METHOD_RETURN);
+  if (template == NULL)
+    goto failed;
+
+  dbus_message_set_no_reply (template, TRUE);
+
+  v_STRING = _dbus_string_get_const_data (&xml);
+  if (!dbus_message_append_args (template,
+                                 DBUS_TYPE_STRING, &v_STRING,
+                                 DBUS_TYPE_INVALID))
+    goto failed;
+
+  if (!_dbus_register_shutdown_func (free_introspect_reply_template, NULL))
+    goto failed;
+
+  _dbus_string_free (&xml);
+
+  introspect_reply_template = template;
+  return introspect_reply_template;
+
+ failed:
+  if (template)
+    dbus_message_unref (template);
+  _dbus_string_free (&xml);
+
+  return NULL;
+}
+
+static DBusMessage *
+new_introspect_reply (DBusMessage *method_call)
+{
+  DBusMessage *template;
+
+  template = get_introspect_reply_template ();
+  if (template == NULL)
+    return NULL;
+
+  return new_reply_from_template (template, method_call);
+}
+
 static dbus_bool_t
 bus_driver_handle_introspect (DBusConnection *connection,
                               BusTransaction *transaction,
                               DBusMessage    *message,
                               DBusError      *error)
 {
-  DBusString xml;
   DBusMessage *reply;
-  const char *v_STRING;
 
   _dbus_verbose ("Introspect() on bus driver\n");
 
   _DBUS_ASSERT_ERROR_IS_CLEAR (error);
 
-  reply = NULL;
-
   if (! dbus_message_get_args (message, error,
 			       DBUS_TYPE_INVALID))
     {
@@ -1880,31 +2238,14 @@ bus_driver_handle_introspect (DBusConnection *connection,
       return FALSE;
     }
 
-  if (!_dbus_string_init (&xml))
-    {
-      BUS_SET_OOM (error);
-      return FALSE;
-    }
-
-  if (!bus_driver_generate_introspect_string (&xml))
-    goto oom;
-
-  v_STRING = _dbus_string_get_const_data (&xml);
-
-  reply = dbus_message_new_method_return (message);
+  reply = new_introspect_reply (message);
   if (reply == NULL)
     goto oom;
 
-  if (! dbus_message_append_args (reply,
-                                  DBUS_TYPE_STRING, &v_STRING,
-                                  DBUS_TYPE_INVALID))
-    goto oom;
-
   if (! bus_transaction_send_from_driver (transaction, connection, reply))
     goto oom;
 
   dbus_message_unref (reply);
-  _dbus_string_free (&xml);
 
   return TRUE;
 
@@ -1914,8 +2255,6 @@ bus_driver_handle_introspect (DBusConnection *connection,
   if (reply)
     dbus_message_unref (reply);
 
-  _dbus_string_free (&xml);
-
   return FALSE;
 }
 
@@ -1926,6 +2265,8 @@ bus_driver_handle_message (DBusConnection *connection,
                            DBusError      *error)
 {
   const char *name, *sender, *interface;
+  const MessageHandler *handlers;
+  int n_handlers;
   int i;
 
   _DBUS_ASSERT_ERROR_IS_CLEAR (error);
@@ -1958,8 +2299,22 @@ bus_driver_handle_message (DBusConnection *connection,
   name = dbus_message_get_member (message);
   sender = dbus_message_get_sender (message);
 
-  if (strcmp (interface,
-              DBUS_INTERFACE_DBUS) != 0)
+  if (strcmp (interface, DBUS_INTERFACE_DBUS) == 0)
+    {
+      handlers = message_handlers;
+      n_handlers = _DBUS_N_ELEMENTS (message_handlers);
+    }
+#ifdef DBUS_ENABLE_STATS
+  else if (strcmp (interface, BUS_INTERFACE_STATS) == 0)
+    {
+      if (!bus_stats_check_caller (connection, error))
+        return FALSE;
+
+      handlers = stats_message_handlers;
+      n_handlers = _DBUS_N_ELEMENTS (stats_message_handlers);
+    }
+#endif
+  else
     {
       _dbus_verbose ("Driver got message to unknown interface \"%s\"\n",
                      interface);
@@ -1973,28 +2328,28 @@ bus_driver_handle_message (DBusConnection *connection,
   _dbus_assert (sender != NULL || strcmp (name, "Hello") == 0);
 
   i = 0;
-  while (i < _DBUS_N_ELEMENTS (message_handlers))
+  while (i < n_handlers)
     {
-      if (strcmp (message_handlers[i].name, name) == 0)
+      if (strcmp (handlers[i].name, name) == 0)
         {
           _dbus_verbose ("Found driver handler for %s\n", name);
 
-          if (!dbus_message_has_signature (message, message_handlers[i].in_args))
+          if (!dbus_message_has_signature (message, handlers[i].in_args))
             {
               _DBUS_ASSERT_ERROR_IS_CLEAR (error);
               _dbus_verbose ("Call to %s has wrong args (%s, expected %s)\n",
                              name, dbus_message_get_signature (message),
-                             message_handlers[i].in_args);
+                             handlers[i].in_args);
 
               dbus_set_error (error, DBUS_ERROR_INVALID_ARGS,
                               "Call to %s has wrong args (%s, expected %s)\n",
                               name, dbus_message_get_signature (message),
-                              message_handlers[i].in_args);
+                              handlers[i].in_args);
               _DBUS_ASSERT_ERROR_IS_SET (error);
               return FALSE;
             }
 
-          if ((* message_handlers[i].handler) (connection, transaction, message, error))
+          if ((* handlers[i].handler) (connection, transaction, message, error))
             {
               _DBUS_ASSERT_ERROR_IS_CLEAR (error);
               _dbus_verbose ("Driver handler succeeded\n");
@@ -2029,3 +2384,89 @@ bus_driver_remove_connection (DBusConnection *connection)
    * with the bus driver.
    */
 }
+
+#ifdef DBUS_BUILD_TESTS
+#include "test.h"
+
+static dbus_bool_t
+check_introspect_reply (void *data)
+{
+  const DBusString *expected = data;
+  DBusMessage *method_call;
+  DBusMessage *reply;
+  const char *xml;
+  dbus_bool_t retval;
+
+  retval = FALSE;
+  reply = NULL;
+
+  method_call = dbus_message_new_method_call (DBUS_SERVICE_DBUS,
+                                              DBUS_PATH_DBUS,
+                                              DBUS_INTERFACE_INTROSPECTABLE,
+                                              "Introspect");
+  if (method_call == NULL)
+    return TRUE;
+
+  if (!dbus_message_set_sender (method_call, ":1.42"))
+    {
+      retval = TRUE;
+      goto out;
+    }
+  dbus_message_set_serial (method_call, 42);
+
+  reply = new_introspect_reply (method_call);
+  if (reply == NULL)
+    {
+      retval = TRUE;
+      goto out;
+    }
+
+  _dbus_assert (dbus_message_get_type (reply) == DBUS_MESSAGE_TYPE_METHOD_RETURN);
+  _dbus_assert (dbus_message_get_reply_serial (reply) == 42);
+  _dbus_assert (dbus_message_get_no_reply (reply));
+  _dbus_assert (strcmp (dbus_message_get_destination (reply), ":1.42") == 0);
+
+  if (!dbus_message_get_args (reply, NULL,
+                              DBUS_TYPE_STRING, &xml,
+                              DBUS_TYPE_INVALID))
+    _dbus_assert_not_reached ("Introspect reply has no XML");
+
+  if (!_dbus_string_equal_c_str (expected, xml))
+    _dbus_assert_not_reached ("cached Introspect reply differs from the generated XML");
+
+  /* The copy handed out must not have touched the cached one */
+  _dbus_assert (introspect_reply_template != NULL);
+  _dbus_assert (dbus_message_get_destination (introspect_reply_template) == NULL);
+  _dbus_assert (dbus_message_get_reply_serial (introspect_reply_template) == 0);
+
+  retval = TRUE;
+
+ out:
+  if (reply)
+    dbus_message_unref (reply);
+  dbus_message_unref (method_call);
+
+  return retval;
+}
+
+dbus_bool_t
+bus_driver_test (const DBusString *test_data_dir)
+{
+  DBusString expected;
+
+  if (!_dbus_string_init (&expected))
+    _dbus_assert_not_reached ("no memory");
+
+  if (!bus_driver_generate_introspect_string (&expected))
+    _dbus_assert_not_reached ("no memory");
+
+  if (!_dbus_test_oom_handling ("cached Introspect reply",
+                                check_introspect_reply, &expected))
+    _dbus_assert_not_reached ("Introspect reply test failed");
+
+  _dbus_string_free (&expected);
+
+  return TRUE;
+}
+
+#endif /* DBUS_BUILD_TESTS */
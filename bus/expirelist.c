@@ -28,9 +28,15 @@
 #include <dbus/dbus-mainloop.h>
 #include <dbus/dbus-timeout.h>
 
+/* Every item in a list expires the same expire_after milliseconds
+ * after it was added, so keeping the items in the order they were
+ * added also keeps them in the order they expire. Expiring then only
+ * has to look at the front of the list, rather than at every item
+ * each time the timeout fires.
+ */
 struct BusExpireList
 {
-  DBusList      *items; /**< List of BusExpireItem */
+  DBusList      *items; /**< List of BusExpireItem, oldest first */
   DBusTimeout   *timeout;
   DBusLoop      *loop;
   BusExpireFunc  expire_func;
@@ -139,11 +145,9 @@ do_expiration_with_current_time (BusExpireList *list,
                                  long           tv_usec)
 {
   DBusList *link;
-  int next_interval, min_wait_time, items_to_expire;
+  int next_interval;
 
   next_interval = -1;
-  min_wait_time = 3600 * 1000; /* this is reset anyway if used */
-  items_to_expire = 0;
   
   link = _dbus_list_get_first_link (&list->items);
   while (link != NULL)
@@ -175,22 +179,18 @@ do_expiration_with_current_time (BusExpireList *list,
               break;
             }
         }
-      else if (list->expire_after > 0)
+      else
         {
-          double to_wait;
+          /* We can end the loop, since the items are in oldest-first order */
+          if (list->expire_after > 0)
+            next_interval = (double) list->expire_after - elapsed;
 
-          items_to_expire = 1;
-          to_wait = (double) list->expire_after - elapsed;
-          if (min_wait_time > to_wait)
-            min_wait_time = to_wait;
+          break;
         }
 
       link = next;
     }
 
-  if (next_interval < 0 && items_to_expire)
-    next_interval = min_wait_time;
-
   return next_interval;
 }
 
@@ -205,7 +205,7 @@ bus_expirelist_expire (BusExpireList *list)
     {
       long tv_sec, tv_usec;
 
-      _dbus_get_current_time (&tv_sec, &tv_usec);
+      _dbus_loop_get_cached_time (list->loop, &tv_sec, &tv_usec);
 
       next_interval = do_expiration_with_current_time (list, tv_sec, tv_usec);
     }
@@ -237,7 +237,10 @@ dbus_bool_t
 bus_expire_list_remove (BusExpireList *list,
                         BusExpireItem *item)
 {
-  return _dbus_list_remove (&list->items, item);
+  /* Items are mostly removed soon after they were added, when the
+   * transaction that added them is cancelled, so look from the end
+   */
+  return _dbus_list_remove_last (&list->items, item);
 }
 
 void
@@ -253,25 +256,81 @@ bus_expire_list_add (BusExpireList *list,
 {
   dbus_bool_t ret;
 
-  ret = _dbus_list_prepend (&list->items, item);
+  ret = _dbus_list_append (&list->items, item);
   if (ret && !dbus_timeout_get_enabled (list->timeout))
     bus_expire_timeout_set_interval (list->timeout, 0);
 
   return ret;
 }
 
+static dbus_bool_t
+item_added_before (BusExpireItem *a,
+                   BusExpireItem *b)
+{
+  return a->added_tv_sec < b->added_tv_sec ||
+    (a->added_tv_sec == b->added_tv_sec && a->added_tv_usec < b->added_tv_usec);
+}
+
+/* Puts a link back in its place in the list, according to the
+ * time its item was added
+ */
+static void
+insert_link_in_order (BusExpireList *list,
+                      DBusList      *link)
+{
+  DBusList *after;
+
+  after = _dbus_list_get_first_link (&list->items);
+  if (after == NULL || !item_added_before (after->data, link->data))
+    {
+      _dbus_list_prepend_link (&list->items, link);
+      return;
+    }
+
+  /* Links that are put back were usually taken out of the list
+   * only recently, so search from the end
+   */
+  after = _dbus_list_get_last_link (&list->items);
+  while (item_added_before (link->data, after->data))
+    after = _dbus_list_get_prev_link (&list->items, after);
+
+  _dbus_list_insert_after_link (&list->items, after, link);
+}
+
 void
 bus_expire_list_add_link (BusExpireList *list,
                           DBusList      *link)
 {
   _dbus_assert (link->data != NULL);
   
-  _dbus_list_prepend_link (&list->items, link);
+  insert_link_in_order (list, link);
 
   if (!dbus_timeout_get_enabled (list->timeout))
     bus_expire_timeout_set_interval (list->timeout, 0);
 }
 
+/**
+ * Makes the item in the given link expire the next time the list is
+ * checked, whenever it was added.
+ *
+ * @param list the expire list
+ * @param link the link holding the item, which must be in the list
+ */
+void
+bus_expire_list_expire_link_now (BusExpireList *list,
+                                 DBusList      *link)
+{
+  BusExpireItem *item = link->data;
+
+  _dbus_list_unlink (&list->items, link);
+
+  item->added_tv_sec = 0;
+  item->added_tv_usec = 0;
+  _dbus_list_prepend_link (&list->items, link);
+
+  bus_expire_list_recheck_immediately (list);
+}
+
 DBusList*
 bus_expire_list_get_first_link (BusExpireList *list)
 {
@@ -328,6 +387,141 @@ time_add_milliseconds (long *tv_sec,
     }
 }
 
+static dbus_bool_t
+test_expire_and_remove_func (BusExpireList *list,
+                             DBusList      *link,
+                             void          *data)
+{
+  TestExpireItem *t;
+
+  t = (TestExpireItem*) link->data;
+
+  t->expire_count += 1;
+
+  bus_expire_list_remove_link (list, link);
+
+  return TRUE;
+}
+
+static void
+check_items_in_order (BusExpireList *list)
+{
+  DBusList *link;
+  BusExpireItem *prev;
+
+  prev = NULL;
+
+  link = bus_expire_list_get_first_link (list);
+  while (link != NULL)
+    {
+      if (prev != NULL)
+        _dbus_assert (!item_added_before (link->data, prev));
+
+      prev = link->data;
+      link = bus_expire_list_get_next_link (list, link);
+    }
+}
+
+#define EXPIRE_AFTER 100
+
+#define N_MANY_ITEMS 100000
+
+/* Items are added 10 milliseconds apart, so this many seconds pass
+ * while adding them all
+ */
+#define MANY_ITEMS_SECONDS (N_MANY_ITEMS / 100)
+
+static void
+test_many_items (DBusLoop *loop,
+                 long      tv_sec,
+                 long      tv_usec)
+{
+  BusExpireList *list;
+  TestExpireItem *items;
+  DBusList *link;
+  long start_sec, start_usec;
+  long end_sec, end_usec;
+  int next_interval;
+  int i;
+
+  list = bus_expire_list_new (loop, EXPIRE_AFTER,
+                              test_expire_and_remove_func, NULL);
+  _dbus_assert (list != NULL);
+
+  items = dbus_new0 (TestExpireItem, N_MANY_ITEMS);
+  _dbus_assert (items != NULL);
+
+  for (i = 0; i < N_MANY_ITEMS; i++)
+    {
+      items[i].item.added_tv_sec = tv_sec + i / 100;
+      items[i].item.added_tv_usec = tv_usec;
+      time_add_milliseconds (&items[i].item.added_tv_sec,
+                             &items[i].item.added_tv_usec,
+                             (i % 100) * 10);
+
+      if (!bus_expire_list_add (list, &items[i].item))
+        _dbus_assert_not_reached ("out of memory");
+    }
+
+  /* Taking an item out and putting it back keeps its place */
+  link = _dbus_list_find_last (&list->items, &items[N_MANY_ITEMS / 2].item);
+  _dbus_assert (link != NULL);
+  bus_expire_list_unlink (list, link);
+  bus_expire_list_add_link (list, link);
+  check_items_in_order (list);
+
+  /* Nothing has expired, so checking must not depend on the number of
+   * items. Run enough checks for a linear scan to stand out.
+   */
+  _dbus_get_monotonic_time (&start_sec, &start_usec);
+
+  for (i = 0; i < 1000; i++)
+    {
+      next_interval = do_expiration_with_current_time (list, tv_sec, tv_usec);
+      _dbus_assert (next_interval == EXPIRE_AFTER);
+    }
+
+  _dbus_get_monotonic_time (&end_sec, &end_usec);
+
+  _dbus_verbose ("1000 checks of %d unexpired items took %.0f milliseconds\n",
+                 N_MANY_ITEMS,
+                 ELAPSED_MILLISECONDS_SINCE (start_sec, start_usec,
+                                             end_sec, end_usec));
+
+  /* An item whose sender went away jumps the queue */
+  link = _dbus_list_find_last (&list->items, &items[N_MANY_ITEMS - 1].item);
+  _dbus_assert (link != NULL);
+  bus_expire_list_expire_link_now (list, link);
+
+  next_interval = do_expiration_with_current_time (list, tv_sec, tv_usec);
+  _dbus_assert (items[N_MANY_ITEMS - 1].expire_count == 1);
+  _dbus_assert (items[0].expire_count == 0);
+  _dbus_assert (next_interval == EXPIRE_AFTER);
+
+  /* Half way through, exactly the older half has expired */
+  next_interval =
+    do_expiration_with_current_time (list, tv_sec + MANY_ITEMS_SECONDS / 2,
+                                     tv_usec + (EXPIRE_AFTER - 1) * 1000);
+
+  for (i = 0; i < N_MANY_ITEMS - 1; i++)
+    _dbus_assert (items[i].expire_count == (i < N_MANY_ITEMS / 2 ? 1 : 0));
+
+  _dbus_assert (next_interval == 1);
+
+  /* Everything expires eventually */
+  next_interval =
+    do_expiration_with_current_time (list, tv_sec + MANY_ITEMS_SECONDS + 1,
+                                     tv_usec);
+  _dbus_assert (next_interval == -1);
+  _dbus_assert (bus_expire_list_get_first_link (list) == NULL);
+
+  for (i = 0; i < N_MANY_ITEMS; i++)
+    _dbus_assert (items[i].expire_count == 1);
+
+  dbus_free (items);
+  bus_expire_list_free (list);
+}
+
 dbus_bool_t
 bus_expire_list_test (const DBusString *test_data_dir)
 {
@@ -345,13 +539,11 @@ bus_expire_list_test (const DBusString *test_data_dir)
   loop = _dbus_loop_new ();
   _dbus_assert (loop != NULL);
 
-#define EXPIRE_AFTER 100
-  
   list = bus_expire_list_new (loop, EXPIRE_AFTER,
                               test_expire_func, NULL);
   _dbus_assert (list != NULL);
 
-  _dbus_get_current_time (&tv_sec, &tv_usec);
+  _dbus_get_monotonic_time (&tv_sec, &tv_usec);
 
   tv_sec_not_expired = tv_sec;
   tv_usec_not_expired = tv_usec;
@@ -402,6 +594,9 @@ bus_expire_list_test (const DBusString *test_data_dir)
   dbus_free (item);
   
   bus_expire_list_free (list);
+
+  test_many_items (loop, tv_sec, tv_usec);
+
   _dbus_loop_unref (loop);
   
   result = TRUE;
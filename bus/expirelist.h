@@ -64,6 +64,8 @@ dbus_bool_t    bus_expire_list_contains_item       (BusExpireList *list,
                                                     BusExpireItem *item);
 void           bus_expire_list_unlink              (BusExpireList *list,
                                                     DBusList      *link);
+void           bus_expire_list_expire_link_now     (BusExpireList *list,
+                                                    DBusList      *link);
 
 /* this macro and function are semi-related utility functions, not really part of the
  * BusExpireList API
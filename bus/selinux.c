@@ -59,6 +59,202 @@
 #define BUS_SID_FROM_SELINUX(sid)  ((BusSELinuxID*) (sid))
 #define SELINUX_SID_FROM_BUS(sid)  ((security_id_t) (sid))
 
+#if defined (HAVE_SELINUX) || defined (DBUS_BUILD_TESTS)
+/**
+ * What an audit record says about the message or service being
+ * checked. It only holds pointers; the text is put together if the
+ * AVC actually emits a record.
+ */
+typedef struct
+{
+  const char *service;     /**< Service being acquired, or #NULL */
+  const char *msgtype;     /**< Type of the message being sent, or #NULL */
+  const char *interface;   /**< Interface of the message, or #NULL */
+  const char *member;      /**< Member of the message, or #NULL */
+  const char *error_name;  /**< Error name of the message, or #NULL */
+  const char *destination; /**< Destination of the message, or #NULL */
+  unsigned long spid;      /**< Process ID of the sender, or 0 */
+  unsigned long tpid;      /**< Process ID of the recipient, or 0 */
+} BusSELinuxAuditData;
+
+/**
+ * Checks whether source may use the requested permissions on target,
+ * auditing the check. Sets *cacheable if the same check would be
+ * granted again without an audit record until the policy changes.
+ */
+typedef dbus_bool_t (* BusSELinuxCheckFunction) (const void          *source,
+                                                 const void          *target,
+                                                 unsigned int         target_class,
+                                                 unsigned int         requested,
+                                                 BusSELinuxAuditData *audit,
+                                                 dbus_bool_t         *cacheable);
+
+/*
+ * Grants the bus has already had from the AVC, keyed by source SID,
+ * target SID, class and permissions. The AVC has its own cache, but
+ * reaching it takes its lock and a hash lookup for every recipient of
+ * every message; this is a direct-mapped table only the main loop
+ * touches. Only grants the AVC would not audit are kept, so denials
+ * and auditallow rules still get a record every time. SIDs stay valid
+ * until the AVC is destroyed, so they can be compared as pointers.
+ */
+#define DECISION_CACHE_SIZE 256
+
+typedef struct
+{
+  const void   *source;       /**< Source SID, #NULL if the slot is empty */
+  const void   *target;       /**< Target SID */
+  unsigned int  target_class; /**< Target class */
+  unsigned int  requested;    /**< Permissions granted */
+} DecisionCacheEntry;
+
+static DecisionCacheEntry decision_cache[DECISION_CACHE_SIZE];
+
+/* Bumped when the policy may have changed, possibly from the AVC's
+ * netlink thread; the main loop flushes the cache when it notices.
+ */
+static DBusAtomic decision_cache_generation = { 0 };
+static dbus_int32_t decision_cache_seen_generation = 0;
+
+static void
+decision_cache_flush (void)
+{
+  memset (decision_cache, 0, sizeof (decision_cache));
+}
+
+static DecisionCacheEntry *
+decision_cache_slot (const void   *source,
+                     const void   *target,
+                     unsigned int  target_class,
+                     unsigned int  requested)
+{
+  uintptr_t hash;
+
+  /* SIDs are pointers to aligned structs, so their low bits say little */
+  hash = (uintptr_t) source >> 3;
+  hash = hash * 31 + ((uintptr_t) target >> 3);
+  hash = hash * 31 + target_class;
+  hash = hash * 31 + requested;
+  hash ^= hash >> 8;
+
+  return &decision_cache[hash % DECISION_CACHE_SIZE];
+}
+
+static dbus_bool_t
+check_with_decision_cache (BusSELinuxCheckFunction  check,
+                           const void              *source,
+                           const void              *target,
+                           unsigned int             target_class,
+                           unsigned int             requested,
+                           BusSELinuxAuditData     *audit)
+{
+  DecisionCacheEntry *entry;
+  dbus_bool_t cacheable;
+  dbus_int32_t generation;
+
+  generation = decision_cache_generation.value;
+  if (generation != decision_cache_seen_generation)
+    {
+      decision_cache_flush ();
+      decision_cache_seen_generation = generation;
+    }
+
+  entry = decision_cache_slot (source, target, target_class, requested);
+
+  if (source != NULL &&
+      entry->source == source &&
+      entry->target == target &&
+      entry->target_class == target_class &&
+      entry->requested == requested)
+    return TRUE;
+
+  cacheable = FALSE;
+  if (!(* check) (source, target, target_class, requested, audit, &cacheable))
+    return FALSE;
+
+  if (cacheable && source != NULL)
+    {
+      entry->source = source;
+      entry->target = target;
+      entry->target_class = target_class;
+      entry->requested = requested;
+    }
+
+  return TRUE;
+}
+
+static dbus_bool_t
+append_audit_data (DBusString                *str,
+                   const BusSELinuxAuditData *audit)
+{
+  if (audit->service)
+    {
+      if (!_dbus_string_append (str, "service="))
+        return FALSE;
+      if (!_dbus_string_append (str, audit->service))
+        return FALSE;
+    }
+
+  if (audit->msgtype)
+    {
+      if (!_dbus_string_append (str, "msgtype="))
+        return FALSE;
+      if (!_dbus_string_append (str, audit->msgtype))
+        return FALSE;
+    }
+
+  if (audit->interface)
+    {
+      if (!_dbus_string_append (str, " interface="))
+        return FALSE;
+      if (!_dbus_string_append (str, audit->interface))
+        return FALSE;
+    }
+
+  if (audit->member)
+    {
+      if (!_dbus_string_append (str, " member="))
+        return FALSE;
+      if (!_dbus_string_append (str, audit->member))
+        return FALSE;
+    }
+
+  if (audit->error_name)
+    {
+      if (!_dbus_string_append (str, " error_name="))
+        return FALSE;
+      if (!_dbus_string_append (str, audit->error_name))
+        return FALSE;
+    }
+
+  if (audit->destination)
+    {
+      if (!_dbus_string_append (str, " dest="))
+        return FALSE;
+      if (!_dbus_string_append (str, audit->destination))
+        return FALSE;
+    }
+
+  if (audit->spid)
+    {
+      if (!_dbus_string_append (str, " spid="))
+        return FALSE;
+      if (!_dbus_string_append_uint (str, audit->spid))
+        return FALSE;
+    }
+
+  if (audit->tpid)
+    {
+      if (!_dbus_string_append (str, " tpid="))
+        return FALSE;
+      if (!_dbus_string_append_uint (str, audit->tpid))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+#endif /* HAVE_SELINUX || DBUS_BUILD_TESTS */
+
 #ifdef HAVE_SELINUX
 /* Store the value telling us if SELinux is enabled in the kernel. */
 static dbus_bool_t selinux_enabled = FALSE;
@@ -178,22 +374,39 @@ policy_reload_callback (u_int32_t event, security_id_t ssid,
                         access_vector_t perms, access_vector_t *out_retained)
 {
   if (event == AVC_CALLBACK_RESET)
-    return raise (SIGHUP);
+    {
+      _dbus_atomic_inc (&decision_cache_generation);
+      return raise (SIGHUP);
+    }
   
   return 0;
 }
 
+static dbus_bool_t append_audit_data (DBusString                *str,
+                                       const BusSELinuxAuditData *audit);
+
 /**
- * Log any auxiliary data 
+ * Log any auxiliary data. The AVC only calls this when it emits an
+ * audit record, so this is where the text is put together.
  */
 static void
 log_audit_callback (void *data, security_class_t class, char *buf, size_t bufleft)
 {
-  DBusString *audmsg = data;
+  const BusSELinuxAuditData *audit = data;
+  DBusString audmsg;
+
+  if (!_dbus_string_init (&audmsg))
+    return;
+
+  if (!append_audit_data (&audmsg, audit))
+    {
+      _dbus_string_set_length (&audmsg, 0);
+      _dbus_string_append (&audmsg, "Out of memory for audit message");
+    }
 
-  if (bufleft > (size_t) _dbus_string_get_length(audmsg))
+  if (bufleft > (size_t) _dbus_string_get_length(&audmsg))
     {
-      _dbus_string_copy_to_buffer_with_nul (audmsg, buf, bufleft);
+      _dbus_string_copy_to_buffer_with_nul (&audmsg, buf, bufleft);
     }
   else
     {
@@ -204,6 +417,8 @@ log_audit_callback (void *data, security_class_t class, char *buf, size_t buflef
       if (bufleft > (size_t) _dbus_string_get_length(&s))
         _dbus_string_copy_to_buffer_with_nul (&s, buf, bufleft);
     }
+
+  _dbus_string_free (&audmsg);
 }
 
 /**
@@ -428,23 +643,31 @@ bus_selinux_id_ref (BusSELinuxID *sid)
  */
 #ifdef HAVE_SELINUX
 static dbus_bool_t
-bus_selinux_check (BusSELinuxID        *sender_sid,
-                   BusSELinuxID        *override_sid,
-                   security_class_t     target_class,
-                   access_vector_t      requested,
-		   DBusString          *auxdata)
+avc_check (const void          *source,
+           const void          *target,
+           unsigned int         target_class,
+           unsigned int         requested,
+           BusSELinuxAuditData *audit,
+           dbus_bool_t         *cacheable)
 {
-  if (!selinux_enabled)
-    return TRUE;
-
-  /* Make the security check.  AVC checks enforcing mode here as well. */
-  if (avc_has_perm (SELINUX_SID_FROM_BUS (sender_sid),
-                    override_sid ?
-                    SELINUX_SID_FROM_BUS (override_sid) :
-                    SELINUX_SID_FROM_BUS (bus_sid), 
-                    target_class, requested, &aeref, auxdata) < 0)
+  struct av_decision avd;
+  int rc;
+  int errsave;
+
+  /* This is avc_has_perm(), split so we can see whether the grant
+   * would be audited. AVC checks enforcing mode here as well.
+   */
+  memset (&avd, 0, sizeof (avd));
+  rc = avc_has_perm_noaudit (SELINUX_SID_FROM_BUS (source),
+                             SELINUX_SID_FROM_BUS (target),
+                             target_class, requested, &aeref, &avd);
+  errsave = errno;
+  avc_audit (SELINUX_SID_FROM_BUS (source), SELINUX_SID_FROM_BUS (target),
+             target_class, requested, &avd, rc, audit);
+
+  if (rc < 0)
     {
-    switch (errno)
+    switch (errsave)
       {
       case EACCES:
         _dbus_verbose ("SELinux denying due to security policy.\n");
@@ -453,12 +676,36 @@ bus_selinux_check (BusSELinuxID        *sender_sid,
         _dbus_verbose ("SELinux denying due to invalid security context.\n");
         return FALSE;
       default:
-        _dbus_verbose ("SELinux denying due to: %s\n", _dbus_strerror (errno));
+        _dbus_verbose ("SELinux denying due to: %s\n", _dbus_strerror (errsave));
         return FALSE;
       }
     }
-  else
+
+  /* A grant in permissive mode isn't in avd.allowed, and one matching
+   * an auditallow rule must be audited each time
+   */
+  *cacheable = (requested & ~avd.allowed) == 0 &&
+    (requested & avd.auditallow) == 0;
+
+  return TRUE;
+}
+
+static dbus_bool_t
+bus_selinux_check (BusSELinuxID        *sender_sid,
+                   BusSELinuxID        *override_sid,
+                   security_class_t     target_class,
+                   access_vector_t      requested,
+		   BusSELinuxAuditData *audit)
+{
+  if (!selinux_enabled)
     return TRUE;
+
+  return check_with_decision_cache (avc_check,
+                                    sender_sid,
+                                    override_sid ?
+                                    override_sid :
+                                    BUS_SID_FROM_SELINUX (bus_sid),
+                                    target_class, requested, audit);
 }
 #endif /* HAVE_SELINUX */
 
@@ -479,8 +726,7 @@ bus_selinux_allows_acquire_service (DBusConnection     *connection,
 #ifdef HAVE_SELINUX
   BusSELinuxID *connection_sid;
   unsigned long spid;
-  DBusString auxdata;
-  dbus_bool_t ret;
+  BusSELinuxAuditData audit;
   
   if (!selinux_enabled)
     return TRUE;
@@ -489,37 +735,15 @@ bus_selinux_allows_acquire_service (DBusConnection     *connection,
   if (!dbus_connection_get_unix_process_id (connection, &spid))
     spid = 0;
 
-  if (!_dbus_string_init (&auxdata))
-    goto oom;
- 
-  if (!_dbus_string_append (&auxdata, "service="))
-    goto oom;
-
-  if (!_dbus_string_append (&auxdata, service_name))
-    goto oom;
-
-  if (spid)
-    {
-      if (!_dbus_string_append (&auxdata, " spid="))
-	goto oom;
-
-      if (!_dbus_string_append_uint (&auxdata, spid))
-	goto oom;
-    }
+  _DBUS_ZERO (audit);
+  audit.service = service_name;
+  audit.spid = spid;
   
-  ret = bus_selinux_check (connection_sid,
-			   service_sid,
-			   SECCLASS_DBUS,
-			   DBUS__ACQUIRE_SVC,
-			   &auxdata);
-
-  _dbus_string_free (&auxdata);
-  return ret;
-
- oom:
-  _dbus_string_free (&auxdata);
-  BUS_SET_OOM (error);
-  return FALSE;
+  return bus_selinux_check (connection_sid,
+                            service_sid,
+                            SECCLASS_DBUS,
+                            DBUS__ACQUIRE_SVC,
+                            &audit);
 
 #else
   return TRUE;
@@ -550,9 +774,7 @@ bus_selinux_allows_send (DBusConnection     *sender,
   BusSELinuxID *recipient_sid;
   BusSELinuxID *sender_sid;
   unsigned long spid, tpid;
-  DBusString auxdata;
-  dbus_bool_t ret;
-  dbus_bool_t string_alloced;
+  BusSELinuxAuditData audit;
 
   if (!selinux_enabled)
     return TRUE;
@@ -562,66 +784,14 @@ bus_selinux_allows_send (DBusConnection     *sender,
   if (!proposed_recipient || !dbus_connection_get_unix_process_id (proposed_recipient, &tpid))
     tpid = 0;
 
-  string_alloced = FALSE;
-  if (!_dbus_string_init (&auxdata))
-    goto oom;
-  string_alloced = TRUE;
-
-  if (!_dbus_string_append (&auxdata, "msgtype="))
-    goto oom;
-
-  if (!_dbus_string_append (&auxdata, msgtype))
-    goto oom;
-
-  if (interface)
-    {
-      if (!_dbus_string_append (&auxdata, " interface="))
-	goto oom;
-      if (!_dbus_string_append (&auxdata, interface))
-	goto oom;
-    }
-
-  if (member)
-    {
-      if (!_dbus_string_append (&auxdata, " member="))
-	goto oom;
-      if (!_dbus_string_append (&auxdata, member))
-	goto oom;
-    }
-
-  if (error_name)
-    {
-      if (!_dbus_string_append (&auxdata, " error_name="))
-	goto oom;
-      if (!_dbus_string_append (&auxdata, error_name))
-	goto oom;
-    }
-
-  if (destination)
-    {
-      if (!_dbus_string_append (&auxdata, " dest="))
-	goto oom;
-      if (!_dbus_string_append (&auxdata, destination))
-	goto oom;
-    }
-
-  if (spid)
-    {
-      if (!_dbus_string_append (&auxdata, " spid="))
-	goto oom;
-
-      if (!_dbus_string_append_uint (&auxdata, spid))
-	goto oom;
-    }
-
-  if (tpid)
-    {
-      if (!_dbus_string_append (&auxdata, " tpid="))
-	goto oom;
-
-      if (!_dbus_string_append_uint (&auxdata, tpid))
-	goto oom;
-    }
+  _DBUS_ZERO (audit);
+  audit.msgtype = msgtype;
+  audit.interface = interface;
+  audit.member = member;
+  audit.error_name = error_name;
+  audit.destination = destination;
+  audit.spid = spid;
+  audit.tpid = tpid;
 
   sender_sid = bus_connection_get_selinux_id (sender);
   /* A NULL proposed_recipient means the bus itself. */
@@ -630,21 +800,11 @@ bus_selinux_allows_send (DBusConnection     *sender,
   else
     recipient_sid = BUS_SID_FROM_SELINUX (bus_sid);
 
-  ret = bus_selinux_check (sender_sid, 
-			   recipient_sid,
-			   SECCLASS_DBUS, 
-			   DBUS__SEND_MSG,
-			   &auxdata);
-
-  _dbus_string_free (&auxdata);
-
-  return ret;
-
- oom:
-  if (string_alloced)
-    _dbus_string_free (&auxdata);
-  BUS_SET_OOM (error);
-  return FALSE;
+  return bus_selinux_check (sender_sid, 
+                            recipient_sid,
+                            SECCLASS_DBUS, 
+                            DBUS__SEND_MSG,
+                            &audit);
   
 #else
   return TRUE;
@@ -1001,6 +1161,9 @@ bus_selinux_shutdown (void)
 
   _dbus_verbose ("AVC shutdown\n");
 
+  /* The SIDs it holds are about to go away */
+  decision_cache_flush ();
+
   if (bus_sid != SECSID_WILD)
     {
       sidput (bus_sid);
@@ -1092,3 +1255,165 @@ _dbus_change_to_daemon_user  (const char    *user,
  return TRUE;
 }
 #endif
+
+#ifdef DBUS_BUILD_TESTS
+#include "test.h"
+
+/* Stands in for the AVC, so the decision cache can be checked
+ * without an SELinux kernel
+ */
+static struct
+{
+  int n_checks;
+  dbus_bool_t deny;
+  dbus_bool_t audit_grants;
+  BusSELinuxAuditData *last_audit;
+} stub_avc;
+
+static dbus_bool_t
+stub_avc_check (const void          *source,
+                const void          *target,
+                unsigned int         target_class,
+                unsigned int         requested,
+                BusSELinuxAuditData *audit,
+                dbus_bool_t         *cacheable)
+{
+  stub_avc.n_checks += 1;
+  stub_avc.last_audit = audit;
+
+  if (stub_avc.deny)
+    return FALSE;
+
+  *cacheable = !stub_avc.audit_grants;
+  return TRUE;
+}
+
+static dbus_bool_t
+stub_check (const void   *source,
+            const void   *target,
+            unsigned int  target_class,
+            unsigned int  requested)
+{
+  BusSELinuxAuditData audit;
+
+  _DBUS_ZERO (audit);
+
+  return check_with_decision_cache (stub_avc_check, source, target,
+                                    target_class, requested, &audit);
+}
+
+static void
+check_audit_data (const BusSELinuxAuditData *audit,
+                  const char                *expected)
+{
+  DBusString str;
+
+  if (!_dbus_string_init (&str))
+    _dbus_assert_not_reached ("no memory");
+
+  if (!append_audit_data (&str, audit))
+    _dbus_assert_not_reached ("no memory");
+
+  if (!_dbus_string_equal_c_str (&str, expected))
+    {
+      _dbus_warn ("audit data was \"%s\", expected \"%s\"\n",
+                  _dbus_string_get_const_data (&str), expected);
+      _dbus_assert_not_reached ("wrong audit data");
+    }
+
+  _dbus_string_free (&str);
+}
+
+dbus_bool_t
+bus_selinux_test (const DBusString *test_data_dir)
+{
+  /* Stand-ins for SIDs, which are only ever compared */
+  static int sid_a, sid_b, sid_c;
+  BusSELinuxAuditData audit;
+  int i;
+
+  decision_cache_flush ();
+  _DBUS_ZERO (stub_avc);
+
+  /* A grant is only asked for once */
+  _dbus_assert (stub_check (&sid_a, &sid_b, 1, 2));
+  _dbus_assert (stub_check (&sid_a, &sid_b, 1, 2));
+  _dbus_assert (stub_avc.n_checks == 1);
+
+  /* Every part of the key counts */
+  _dbus_assert (stub_check (&sid_b, &sid_b, 1, 2));
+  _dbus_assert (stub_check (&sid_a, &sid_c, 1, 2));
+  _dbus_assert (stub_check (&sid_a, &sid_b, 3, 2));
+  _dbus_assert (stub_check (&sid_a, &sid_b, 1, 4));
+  _dbus_assert (stub_avc.n_checks == 5);
+
+  /* Denials go to the AVC each time, so each one is audited */
+  stub_avc.deny = TRUE;
+  _dbus_assert (!stub_check (&sid_c, &sid_a, 1, 2));
+  _dbus_assert (!stub_check (&sid_c, &sid_a, 1, 2));
+  _dbus_assert (stub_avc.n_checks == 7);
+  stub_avc.deny = FALSE;
+
+  /* So do grants the AVC audits */
+  stub_avc.audit_grants = TRUE;
+  _dbus_assert (stub_check (&sid_c, &sid_b, 1, 2));
+  _dbus_assert (stub_check (&sid_c, &sid_b, 1, 2));
+  _dbus_assert (stub_avc.n_checks == 9);
+  stub_avc.audit_grants = FALSE;
+
+  /* Cached grants last... */
+  _dbus_assert (stub_check (&sid_b, &sid_c, 5, 6));
+  _dbus_assert (stub_check (&sid_b, &sid_c, 5, 6));
+  _dbus_assert (stub_avc.n_checks == 10);
+
+  /* ...until the policy changes */
+  _dbus_atomic_inc (&decision_cache_generation);
+  stub_avc.deny = TRUE;
+  _dbus_assert (!stub_check (&sid_b, &sid_c, 5, 6));
+  _dbus_assert (stub_avc.n_checks == 11);
+  stub_avc.deny = FALSE;
+
+  /* Evicted entries are simply asked for again */
+  for (i = 0; i < DECISION_CACHE_SIZE * 4; i++)
+    _dbus_assert (stub_check (&sid_a, &sid_b, 1, i));
+  _dbus_assert (stub_check (&sid_a, &sid_b, 1, 0));
+  _dbus_assert (stub_avc.n_checks >= 11 + DECISION_CACHE_SIZE * 4);
+
+  /* The audit data reaches the AVC untouched, and is only put into
+   * words when a record needs it
+   */
+  _DBUS_ZERO (audit);
+  audit.msgtype = "method_call";
+  audit.interface = "org.freedesktop.TestSuite";
+  audit.member = "Echo";
+  audit.destination = "org.freedesktop.DBus.TestSuiteEchoService";
+  audit.spid = 42;
+  audit.tpid = 43;
+
+  decision_cache_flush ();
+  _dbus_assert (check_with_decision_cache (stub_avc_check, &sid_a, &sid_b,
+                                           1, 2, &audit));
+  _dbus_assert (stub_avc.last_audit == &audit);
+
+  check_audit_data (&audit,
+                    "msgtype=method_call interface=org.freedesktop.TestSuite "
+                    "member=Echo dest=org.freedesktop.DBus.TestSuiteEchoService "
+                    "spid=42 tpid=43");
+
+  _DBUS_ZERO (audit);
+  audit.msgtype = "error";
+  audit.error_name = "org.freedesktop.DBus.Error.Failed";
+  check_audit_data (&audit,
+                    "msgtype=error error_name=org.freedesktop.DBus.Error.Failed");
+
+  _DBUS_ZERO (audit);
+  audit.service = "org.freedesktop.DBus.TestSuiteEchoService";
+  audit.spid = 42;
+  check_audit_data (&audit,
+                    "service=org.freedesktop.DBus.TestSuiteEchoService spid=42");
+
+  decision_cache_flush ();
+
+  return TRUE;
+}
+#endif /* DBUS_BUILD_TESTS */
@@ -68,6 +68,8 @@ struct BusRegistry
   DBusMemPool   *owner_pool;
 
   DBusHashTable *service_sid_table;
+
+  DBusMessage *list_names_reply; /**< cached ListNames reply, or NULL */
 };
 
 BusRegistry*
@@ -133,11 +135,26 @@ bus_registry_unref  (BusRegistry *registry)
         _dbus_mem_pool_free (registry->owner_pool);
       if (registry->service_sid_table)
         _dbus_hash_table_unref (registry->service_sid_table);
+      if (registry->list_names_reply)
+        dbus_message_unref (registry->list_names_reply);
       
       dbus_free (registry);
     }
 }
 
+/* Called whenever a name enters or leaves service_hash, since the
+ * cached ListNames reply no longer matches it
+ */
+static void
+bus_registry_names_changed (BusRegistry *registry)
+{
+  if (registry->list_names_reply != NULL)
+    {
+      dbus_message_unref (registry->list_names_reply);
+      registry->list_names_reply = NULL;
+    }
+}
+
 BusService*
 bus_registry_lookup (BusRegistry      *registry,
                      const DBusString *service_name)
@@ -279,7 +296,11 @@ bus_registry_ensure (BusRegistry               *registry,
                  service_name, _dbus_string_get_const_data (service_name),
                  service->name);
 
-  if (!bus_driver_send_service_owner_changed (service->name, 
+  /* An unannounced owner is saying Hello; its unique name is only
+   * broadcast later, if ever, by bus_connection_announce()
+   */
+  if (!bus_connection_is_unannounced (owner_connection_if_created) &&
+      !bus_driver_send_service_owner_changed (service->name, 
 					      NULL,
 					      bus_connection_get_name (owner_connection_if_created),
 					      transaction, error))
@@ -310,6 +331,8 @@ bus_registry_ensure (BusRegistry               *registry,
       BUS_SET_OOM (error);
       return NULL;
     }
+
+  bus_registry_names_changed (registry);
   
   return service;
 }
@@ -374,6 +397,24 @@ bus_registry_list_services (BusRegistry *registry,
   return FALSE;
 }
 
+/* The driver keeps its marshalled ListNames reply here; we drop it as
+ * soon as a name comes or goes, so whatever is returned is current.
+ */
+DBusMessage*
+bus_registry_get_list_names_reply (BusRegistry *registry)
+{
+  return registry->list_names_reply;
+}
+
+void
+bus_registry_set_list_names_reply (BusRegistry *registry,
+                                   DBusMessage *reply)
+{
+  dbus_message_ref (reply);
+  bus_registry_names_changed (registry);
+  registry->list_names_reply = reply;
+}
+
 dbus_bool_t
 bus_registry_acquire_service (BusRegistry      *registry,
                               DBusConnection   *connection,
@@ -722,8 +763,9 @@ bus_service_unlink (BusService *service)
    * the failure causing transaction cancel
    * was in the right place, but that's OK
    */
-  _dbus_hash_table_remove_string (service->registry->service_hash,
-                                  service->name);
+  if (_dbus_hash_table_remove_string (service->registry->service_hash,
+                                      service->name))
+    bus_registry_names_changed (service->registry);
   
   bus_service_unref (service);
 }
@@ -739,6 +781,7 @@ bus_service_relink (BusService           *service,
                                                preallocated,
                                                service->name,
                                                service);
+  bus_registry_names_changed (service->registry);
   
   bus_service_ref (service);
 }
@@ -903,7 +946,6 @@ typedef struct
   BusService     *service;
   BusOwner       *before_owner; /* restore to position before this connection in owners list */
   DBusList       *owner_link;
-  DBusList       *service_link;
   DBusPreallocatedHash *hash_entry;
 } OwnershipRestoreData;
 
@@ -913,7 +955,6 @@ restore_ownership (void *data)
   OwnershipRestoreData *d = data;
   DBusList *link;
 
-  _dbus_assert (d->service_link != NULL);
   _dbus_assert (d->owner_link != NULL);
   
   if (d->service->owners == NULL)
@@ -941,16 +982,15 @@ restore_ownership (void *data)
   
   _dbus_list_insert_before_link (&d->service->owners, link, d->owner_link);
 
-  /* Note that removing then restoring this changes the order in which
-   * ServiceDeleted messages are sent on destruction of the
-   * connection.  This should be OK as the only guarantee there is
-   * that the base service is destroyed last, and we never even
-   * tentatively remove the base service.
+  /* The owners list holds a reference again. The reference we hold
+   * kept the owner alive since it was unlinked, so the connection
+   * still lists the service as owned and its position in that list
+   * (which decides the order names are dropped on disconnection,
+   * base service last) is unchanged.
    */
-  bus_connection_add_owned_service_link (d->owner->conn, d->service_link);
-  
+  bus_owner_ref (d->owner);
+
   d->hash_entry = NULL;
-  d->service_link = NULL;
   d->owner_link = NULL;
 }
 
@@ -959,8 +999,6 @@ free_ownership_restore_data (void *data)
 {
   OwnershipRestoreData *d = data;
 
-  if (d->service_link)
-    _dbus_list_free_link (d->service_link);
   if (d->owner_link)
     _dbus_list_free_link (d->owner_link);
   if (d->hash_entry)
@@ -988,7 +1026,6 @@ add_restore_ownership_to_transaction (BusTransaction *transaction,
   
   d->service = service;
   d->owner = owner;
-  d->service_link = _dbus_list_alloc_link (service);
   d->owner_link = _dbus_list_alloc_link (owner);
   d->hash_entry = _dbus_hash_table_preallocate_entry (service->registry->service_hash);
   
@@ -1013,8 +1050,7 @@ add_restore_ownership_to_transaction (BusTransaction *transaction,
       link = _dbus_list_get_next_link (&service->owners, link);
     }
   
-  if (d->service_link == NULL ||
-      d->owner_link == NULL ||
+  if (d->owner_link == NULL ||
       d->hash_entry == NULL ||
       !bus_transaction_add_cancel_hook (transaction, restore_ownership, d,
                                         free_ownership_restore_data))
@@ -1147,7 +1183,11 @@ bus_service_remove_owner (BusService     *service,
     }
   else if (_dbus_list_length_is_one (&service->owners))
     {
-      if (!bus_driver_send_service_owner_changed (service->name,
+      /* Nobody was told about an unannounced connection's unique
+       * name (the only name it can own), so don't tell them it's gone
+       */
+      if (!bus_connection_is_unannounced (connection) &&
+          !bus_driver_send_service_owner_changed (service->name,
  						  bus_connection_get_name (connection),
  						  NULL,
  						  transaction, error))
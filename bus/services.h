@@ -50,6 +50,9 @@ void         bus_registry_foreach         (BusRegistry                 *registry
 dbus_bool_t  bus_registry_list_services   (BusRegistry                 *registry,
                                            char                      ***listp,
                                            int                         *array_len);
+DBusMessage* bus_registry_get_list_names_reply (BusRegistry           *registry);
+void         bus_registry_set_list_names_reply (BusRegistry           *registry,
+                                                DBusMessage           *reply);
 dbus_bool_t  bus_registry_acquire_service (BusRegistry                 *registry,
                                            DBusConnection              *connection,
                                            const DBusString            *service_name,
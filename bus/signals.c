@@ -27,12 +27,16 @@
 #include "utils.h"
 #include <dbus/dbus-marshal-validate.h>
 
+typedef struct BusMatchGroup BusMatchGroup;
+
 struct BusMatchRule
 {
   int refcount;       /**< reference count */
 
   DBusConnection *matches_go_to; /**< Owner of the rule */
 
+  BusMatchGroup *group; /**< Group of equal rules, once in a matchmaker */
+
   unsigned int flags; /**< BusMatchFlags */
 
   int   message_type;
@@ -1023,13 +1027,29 @@ bus_match_rule_parse (DBusConnection   *matches_go_to,
 typedef struct RulePool RulePool;
 struct RulePool
 {
-  /* Maps non-NULL interface names to non-NULL (DBusList **)s */
+  /* Maps non-NULL interface names to non-NULL (DBusList **)s of
+   * BusMatchGroups
+   */
   DBusHashTable *rules_by_iface;
 
-  /* List of BusMatchRules which don't specify an interface */
+  /* List of BusMatchGroups whose rules don't specify an interface */
   DBusList *rules_without_iface;
 };
 
+/* Rules that only differ in the connection they belong to, such as the
+ * NameOwnerChanged or PropertiesChanged watches of many clients, share
+ * a group: the group's predicate is checked once per message, and then
+ * every connection with a rule in the group gets it. The first rule
+ * added to a group serves as the predicate; the ones added after it
+ * give up their copies of its strings.
+ */
+struct BusMatchGroup
+{
+  BusMatchRule *predicate; /**< what all rules in the group match; ref'd */
+  unsigned int hash;       /**< match_rule_hash() of the predicate */
+  DBusList *rules;         /**< the rules in the group, each ref'd */
+};
+
 struct BusMatchmaker
 {
   int refcount;
@@ -1039,18 +1059,42 @@ struct BusMatchmaker
    * type.
    */
   RulePool rules_by_type[DBUS_NUM_MESSAGE_TYPES];
+
+  /* How many rules there are, and how many distinct predicates
+   * (BusMatchGroups) they make up
+   */
+  int n_rules;
+  int n_groups;
+
+  /* How many bus driver signals were checked for interested rules
+   * before being built, and how many of those nobody could receive
+   */
+  unsigned long n_driver_signals_checked;
+  unsigned long n_driver_signals_suppressed;
 };
 
 static void
-rule_list_free (DBusList **rules)
+rule_list_free (DBusList **groups)
 {
-  while (*rules != NULL)
+  while (*groups != NULL)
     {
-      BusMatchRule *rule;
+      BusMatchGroup *group;
 
-      rule = (*rules)->data;
-      bus_match_rule_unref (rule);
-      _dbus_list_remove_link (rules, *rules);
+      group = (*groups)->data;
+
+      while (group->rules != NULL)
+        {
+          BusMatchRule *rule;
+
+          rule = group->rules->data;
+          rule->group = NULL;
+          bus_match_rule_unref (rule);
+          _dbus_list_remove_link (&group->rules, group->rules);
+        }
+
+      bus_match_rule_unref (group->predicate);
+      dbus_free (group);
+      _dbus_list_remove_link (groups, *groups);
     }
 }
 
@@ -1221,61 +1265,46 @@ bus_matchmaker_unref (BusMatchmaker *matchmaker)
     }
 }
 
-/* The rule can't be modified after it's added. */
-dbus_bool_t
-bus_matchmaker_add_rule (BusMatchmaker   *matchmaker,
-                         BusMatchRule    *rule)
+static unsigned int
+hash_string (unsigned int  hash,
+             const char   *str)
 {
-  DBusList **rules;
-
-  _dbus_assert (bus_connection_is_active (rule->matches_go_to));
-
-  _dbus_verbose ("Adding rule with message_type %d, interface %s\n",
-                 rule->message_type,
-                 rule->interface != NULL ? rule->interface : "<null>");
-
-  rules = bus_matchmaker_get_rules (matchmaker, rule->message_type,
-                                    rule->interface, TRUE);
+  if (str == NULL)
+    return hash * 31;
 
-  if (rules == NULL)
-    return FALSE;
+  while (*str != '\0')
+    hash = hash * 31 + (unsigned char) *str++;
 
-  if (!_dbus_list_append (rules, rule))
-    return FALSE;
+  return hash;
+}
 
-  if (!bus_connection_add_match_rule (rule->matches_go_to, rule))
-    {
-      _dbus_list_remove_last (rules, rule);
-      bus_matchmaker_gc_rules (matchmaker, rule->message_type,
-                               rule->interface, rules);
-      return FALSE;
-    }
+/* Hashes everything match_rule_equal_predicate() looks at */
+static unsigned int
+match_rule_hash (BusMatchRule *rule)
+{
+  unsigned int hash;
+  int i;
 
-  bus_match_rule_ref (rule);
+  hash = rule->flags * 31 + rule->message_type;
+  hash = hash_string (hash, rule->interface);
+  hash = hash_string (hash, rule->member);
+  hash = hash_string (hash, rule->sender);
+  hash = hash_string (hash, rule->destination);
+  hash = hash_string (hash, rule->path);
 
-#ifdef DBUS_ENABLE_VERBOSE_MODE
-  {
-    char *s = match_rule_to_string (rule);
+  for (i = 0; i < rule->args_len; i++)
+    hash = hash_string (hash, rule->args[i]) * 31 + rule->arg_lens[i];
 
-    _dbus_verbose ("Added match rule %s to connection %p\n",
-                   s, rule->matches_go_to);
-    dbus_free (s);
-  }
-#endif
-  
-  return TRUE;
+  return hash;
 }
 
 static dbus_bool_t
-match_rule_equal (BusMatchRule *a,
-                  BusMatchRule *b)
+match_rule_equal_predicate (BusMatchRule *a,
+                            BusMatchRule *b)
 {
   if (a->flags != b->flags)
     return FALSE;
 
-  if (a->matches_go_to != b->matches_go_to)
-    return FALSE;
-
   if ((a->flags & BUS_MATCH_MESSAGE_TYPE) &&
       a->message_type != b->message_type)
     return FALSE;
@@ -1334,18 +1363,194 @@ match_rule_equal (BusMatchRule *a,
   return TRUE;
 }
 
+static dbus_bool_t
+match_rule_equal (BusMatchRule *a,
+                  BusMatchRule *b)
+{
+  return a->matches_go_to == b->matches_go_to &&
+    match_rule_equal_predicate (a, b);
+}
+
+/* Frees what a rule matches once it is in a group whose predicate
+ * says the same, leaving only which connection it is for. Whatever
+ * needs to know more about the rule goes through rule->group.
+ */
+static void
+match_rule_release_predicate (BusMatchRule *rule)
+{
+  int i;
+
+  dbus_free (rule->interface);
+  dbus_free (rule->member);
+  dbus_free (rule->sender);
+  dbus_free (rule->destination);
+  dbus_free (rule->path);
+  dbus_free (rule->arg_lens);
+
+  for (i = 0; i < rule->args_len; i++)
+    dbus_free (rule->args[i]);
+  dbus_free (rule->args);
+
+  rule->flags = 0;
+  rule->message_type = DBUS_MESSAGE_TYPE_INVALID;
+  rule->interface = NULL;
+  rule->member = NULL;
+  rule->sender = NULL;
+  rule->destination = NULL;
+  rule->path = NULL;
+  rule->arg_lens = NULL;
+  rule->args = NULL;
+  rule->args_len = 0;
+}
+
+static BusMatchGroup *
+find_group (DBusList     **groups,
+            BusMatchRule  *value,
+            unsigned int   hash)
+{
+  DBusList *link;
+
+  link = _dbus_list_get_first_link (groups);
+  while (link != NULL)
+    {
+      BusMatchGroup *group = link->data;
+
+      if (group->hash == hash &&
+          match_rule_equal_predicate (group->predicate, value))
+        return group;
+
+      link = _dbus_list_get_next_link (groups, link);
+    }
+
+  return NULL;
+}
+
+static void
+free_group (BusMatchmaker *matchmaker,
+            BusMatchGroup *group)
+{
+  _dbus_assert (group->rules == NULL);
+
+  bus_match_rule_unref (group->predicate);
+  dbus_free (group);
+
+  matchmaker->n_groups -= 1;
+  _dbus_assert (matchmaker->n_groups >= 0);
+}
+
+/* The rule can't be modified after it's added. */
+dbus_bool_t
+bus_matchmaker_add_rule (BusMatchmaker   *matchmaker,
+                         BusMatchRule    *rule)
+{
+  DBusList **groups;
+  BusMatchGroup *group;
+  dbus_bool_t new_group;
+  unsigned int hash;
+
+  _dbus_assert (bus_connection_is_active (rule->matches_go_to));
+  _dbus_assert (rule->group == NULL);
+
+  _dbus_verbose ("Adding rule with message_type %d, interface %s\n",
+                 rule->message_type,
+                 rule->interface != NULL ? rule->interface : "<null>");
+
+  groups = bus_matchmaker_get_rules (matchmaker, rule->message_type,
+                                     rule->interface, TRUE);
+
+  if (groups == NULL)
+    return FALSE;
+
+  hash = match_rule_hash (rule);
+  group = find_group (groups, rule, hash);
+  new_group = (group == NULL);
+
+  if (new_group)
+    {
+      group = dbus_new0 (BusMatchGroup, 1);
+      if (group == NULL)
+        goto failed;
+
+      group->predicate = rule;
+      group->hash = hash;
+
+      if (!_dbus_list_append (groups, group))
+        {
+          dbus_free (group);
+          goto failed;
+        }
+    }
+
+  if (!_dbus_list_append (&group->rules, rule))
+    goto failed_in_group;
+
+  if (!bus_connection_add_match_rule (rule->matches_go_to, rule))
+    {
+      _dbus_list_remove_last (&group->rules, rule);
+      goto failed_in_group;
+    }
+
+  bus_match_rule_ref (rule);
+  rule->group = group;
+  matchmaker->n_rules += 1;
+
+  if (new_group)
+    {
+      bus_match_rule_ref (rule);
+      matchmaker->n_groups += 1;
+    }
+  else
+    {
+      match_rule_release_predicate (rule);
+    }
+
+#ifdef DBUS_ENABLE_VERBOSE_MODE
+  {
+    char *s = match_rule_to_string (group->predicate);
+
+    _dbus_verbose ("Added match rule %s to connection %p%s\n",
+                   s, rule->matches_go_to,
+                   new_group ? "" : ", sharing an existing one");
+    dbus_free (s);
+  }
+#endif
+  
+  return TRUE;
+
+ failed_in_group:
+  if (new_group)
+    {
+      _dbus_list_remove_last (groups, group);
+      dbus_free (group);
+    }
+ failed:
+  bus_matchmaker_gc_rules (matchmaker, rule->message_type,
+                           rule->interface, groups);
+  return FALSE;
+}
+
+/* Takes the rule at link out of its group; the caller has to get rid
+ * of the group if that leaves it empty
+ */
 static void
-bus_matchmaker_remove_rule_link (DBusList       **rules,
-                                 DBusList        *link)
+bus_matchmaker_remove_rule_link (BusMatchmaker  *matchmaker,
+                                 BusMatchGroup  *group,
+                                 DBusList       *link)
 {
   BusMatchRule *rule = link->data;
   
+  _dbus_assert (rule->group == group);
+
   bus_connection_remove_match_rule (rule->matches_go_to, rule);
-  _dbus_list_remove_link (rules, link);
+  _dbus_list_remove_link (&group->rules, link);
+  rule->group = NULL;
+
+  matchmaker->n_rules -= 1;
+  _dbus_assert (matchmaker->n_rules >= 0);
 
 #ifdef DBUS_ENABLE_VERBOSE_MODE
   {
-    char *s = match_rule_to_string (rule);
+    char *s = match_rule_to_string (group->predicate);
 
     _dbus_verbose ("Removed match rule %s for connection %p\n",
                    s, rule->matches_go_to);
@@ -1356,41 +1561,109 @@ bus_matchmaker_remove_rule_link (DBusList       **rules,
   bus_match_rule_unref (rule);  
 }
 
+/* Takes a group out of its list and frees it, if it has no rules left */
+static void
+bus_matchmaker_gc_group (BusMatchmaker   *matchmaker,
+                         DBusList       **groups,
+                         BusMatchGroup   *group)
+{
+  if (group->rules != NULL)
+    return;
+
+  _dbus_list_remove (groups, group);
+  bus_matchmaker_gc_rules (matchmaker, group->predicate->message_type,
+                           group->predicate->interface, groups);
+  free_group (matchmaker, group);
+}
+
 void
 bus_matchmaker_remove_rule (BusMatchmaker   *matchmaker,
                             BusMatchRule    *rule)
 {
-  DBusList **rules;
+  BusMatchGroup *group;
+  DBusList **groups;
+  DBusList *link;
+
+  group = rule->group;
+
+  /* We should only be asked to remove a rule by identity right after it was
+   * added, or after finding it with bus_matchmaker_find_rules_by_value(),
+   * so it should be in a group.
+   */
+  _dbus_assert (group != NULL);
 
   _dbus_verbose ("Removing rule with message_type %d, interface %s\n",
-                 rule->message_type,
-                 rule->interface != NULL ? rule->interface : "<null>");
+                 group->predicate->message_type,
+                 group->predicate->interface != NULL ?
+                 group->predicate->interface : "<null>");
 
-  bus_connection_remove_match_rule (rule->matches_go_to, rule);
+  groups = bus_matchmaker_get_rules (matchmaker,
+                                     group->predicate->message_type,
+                                     group->predicate->interface, FALSE);
+  _dbus_assert (groups != NULL);
 
-  rules = bus_matchmaker_get_rules (matchmaker, rule->message_type,
-                                    rule->interface, FALSE);
+  link = _dbus_list_find_last (&group->rules, rule);
+  _dbus_assert (link != NULL);
 
-  /* We should only be asked to remove a rule by identity right after it was
-   * added, so there should be a list for it.
+  bus_matchmaker_remove_rule_link (matchmaker, group, link);
+  bus_matchmaker_gc_group (matchmaker, groups, group);
+}
+
+/* Finds the most recently added rule of the value's connection in the
+ * group for the value's predicate, skipping those in the exclude array
+ */
+static DBusList *
+find_rule_link_by_value (BusMatchmaker   *matchmaker,
+                         BusMatchRule    *value,
+                         BusMatchRule   **exclude,
+                         int              n_exclude,
+                         DBusList      ***groups_p,
+                         BusMatchGroup  **group_p)
+{
+  DBusList **groups;
+  BusMatchGroup *group;
+  DBusList *link;
+
+  groups = bus_matchmaker_get_rules (matchmaker, value->message_type,
+                                     value->interface, FALSE);
+  if (groups == NULL)
+    return NULL;
+
+  group = find_group (groups, value, match_rule_hash (value));
+  if (group == NULL)
+    return NULL;
+
+  /* we traverse backward because bus_connection_remove_match_rule()
+   * removes the most-recently-added rule
    */
-  _dbus_assert (rules != NULL);
+  link = _dbus_list_get_last_link (&group->rules);
+  while (link != NULL)
+    {
+      BusMatchRule *rule = link->data;
 
-  _dbus_list_remove (rules, rule);
-  bus_matchmaker_gc_rules (matchmaker, rule->message_type, rule->interface,
-      rules);
+      if (rule->matches_go_to == value->matches_go_to)
+        {
+          int i;
 
-#ifdef DBUS_ENABLE_VERBOSE_MODE
-  {
-    char *s = match_rule_to_string (rule);
+          for (i = 0; i < n_exclude; i++)
+            {
+              if (exclude[i] == rule)
+                break;
+            }
 
-    _dbus_verbose ("Removed match rule %s for connection %p\n",
-                   s, rule->matches_go_to);
-    dbus_free (s);
-  }
-#endif
-  
-  bus_match_rule_unref (rule);
+          if (i == n_exclude)
+            break;
+        }
+
+      link = _dbus_list_get_prev_link (&group->rules, link);
+    }
+
+  if (groups_p != NULL)
+    *groups_p = groups;
+  if (group_p != NULL)
+    *group_p = group;
+
+  return link;
 }
 
 /* Remove a single rule which is equal to the given rule by value */
@@ -1399,39 +1672,16 @@ bus_matchmaker_remove_rule_by_value (BusMatchmaker   *matchmaker,
                                      BusMatchRule    *value,
                                      DBusError       *error)
 {
-  DBusList **rules;
-  DBusList *link = NULL;
+  DBusList **groups;
+  BusMatchGroup *group;
+  DBusList *link;
 
   _dbus_verbose ("Removing rule by value with message_type %d, interface %s\n",
                  value->message_type,
                  value->interface != NULL ? value->interface : "<null>");
 
-  rules = bus_matchmaker_get_rules (matchmaker, value->message_type,
-      value->interface, FALSE);
-
-  if (rules != NULL)
-    {
-      /* we traverse backward because bus_connection_remove_match_rule()
-       * removes the most-recently-added rule
-       */
-      link = _dbus_list_get_last_link (rules);
-      while (link != NULL)
-        {
-          BusMatchRule *rule;
-          DBusList *prev;
-
-          rule = link->data;
-          prev = _dbus_list_get_prev_link (rules, link);
-
-          if (match_rule_equal (rule, value))
-            {
-              bus_matchmaker_remove_rule_link (rules, link);
-              break;
-            }
-
-          link = prev;
-        }
-    }
+  link = find_rule_link_by_value (matchmaker, value, NULL, 0,
+                                  &groups, &group);
 
   if (link == NULL)
     {
@@ -1440,35 +1690,71 @@ bus_matchmaker_remove_rule_by_value (BusMatchmaker   *matchmaker,
       return FALSE;
     }
 
-  bus_matchmaker_gc_rules (matchmaker, value->message_type, value->interface,
-      rules);
+  bus_matchmaker_remove_rule_link (matchmaker, group, link);
+  bus_matchmaker_gc_group (matchmaker, groups, group);
+
+  return TRUE;
+}
+
+/* Find, for each of the given rules, a distinct rule equal to it by
+ * value, so that they can all be removed once we know none is missing.
+ * found must have room for n_values rules.
+ */
+dbus_bool_t
+bus_matchmaker_find_rules_by_value (BusMatchmaker   *matchmaker,
+                                    BusMatchRule   **values,
+                                    int              n_values,
+                                    BusMatchRule   **found,
+                                    DBusError       *error)
+{
+  int i;
+
+  for (i = 0; i < n_values; i++)
+    {
+      DBusList *link;
+
+      /* a rule given twice has to match two different rules */
+      link = find_rule_link_by_value (matchmaker, values[i], found, i,
+                                      NULL, NULL);
+      if (link == NULL)
+        {
+          dbus_set_error (error, DBUS_ERROR_MATCH_RULE_NOT_FOUND,
+                          "Match rule %d of %d wasn't found, so none were removed",
+                          i + 1, n_values);
+          return FALSE;
+        }
+
+      found[i] = link->data;
+    }
 
   return TRUE;
 }
 
 static void
-rule_list_remove_by_connection (DBusList       **rules,
+rule_list_remove_by_connection (BusMatchmaker   *matchmaker,
+                                DBusList       **groups,
                                 DBusConnection  *connection)
 {
   DBusList *link;
 
-  link = _dbus_list_get_first_link (rules);
+  link = _dbus_list_get_first_link (groups);
   while (link != NULL)
     {
-      BusMatchRule *rule;
+      BusMatchGroup *group;
+      BusMatchRule *predicate;
       DBusList *next;
+      dbus_bool_t remove_all;
 
-      rule = link->data;
-      next = _dbus_list_get_next_link (rules, link);
+      group = link->data;
+      predicate = group->predicate;
+      next = _dbus_list_get_next_link (groups, link);
 
-      if (rule->matches_go_to == connection)
-        {
-          bus_matchmaker_remove_rule_link (rules, link);
-        }
-      else if (((rule->flags & BUS_MATCH_SENDER) && *rule->sender == ':') ||
-               ((rule->flags & BUS_MATCH_DESTINATION) && *rule->destination == ':'))
+      remove_all = FALSE;
+
+      if (((predicate->flags & BUS_MATCH_SENDER) && *predicate->sender == ':') ||
+          ((predicate->flags & BUS_MATCH_DESTINATION) && *predicate->destination == ':'))
         {
-          /* The rule matches to/from a base service, see if it's the
+          /* The rules match to/from a base service, see if it's the
            * one being disconnected, since we know this service name
            * will never be recycled.
            */
@@ -1477,13 +1763,36 @@ rule_list_remove_by_connection (DBusList       **rules,
           name = bus_connection_get_name (connection);
           _dbus_assert (name != NULL); /* because we're an active connection */
 
-          if (((rule->flags & BUS_MATCH_SENDER) &&
-               strcmp (rule->sender, name) == 0) ||
-              ((rule->flags & BUS_MATCH_DESTINATION) &&
-               strcmp (rule->destination, name) == 0))
-            {
-              bus_matchmaker_remove_rule_link (rules, link);
-            }
+          remove_all =
+            ((predicate->flags & BUS_MATCH_SENDER) &&
+             strcmp (predicate->sender, name) == 0) ||
+            ((predicate->flags & BUS_MATCH_DESTINATION) &&
+             strcmp (predicate->destination, name) == 0);
+        }
+
+      {
+        DBusList *rule_link;
+
+        rule_link = _dbus_list_get_first_link (&group->rules);
+        while (rule_link != NULL)
+          {
+            BusMatchRule *rule = rule_link->data;
+            DBusList *rule_next;
+
+            rule_next = _dbus_list_get_next_link (&group->rules, rule_link);
+
+            if (remove_all || rule->matches_go_to == connection)
+              bus_matchmaker_remove_rule_link (matchmaker, group, rule_link);
+
+            rule_link = rule_next;
+          }
+      }
+
+      /* The caller takes care of the list itself if it becomes empty */
+      if (group->rules == NULL)
+        {
+          _dbus_list_remove_link (groups, link);
+          free_group (matchmaker, group);
         }
 
       link = next;
@@ -1513,14 +1822,15 @@ bus_matchmaker_disconnected (BusMatchmaker   *matchmaker,
       RulePool *p = matchmaker->rules_by_type + i;
       DBusHashIter iter;
 
-      rule_list_remove_by_connection (&p->rules_without_iface, connection);
+      rule_list_remove_by_connection (matchmaker, &p->rules_without_iface,
+                                      connection);
 
       _dbus_hash_iter_init (p->rules_by_iface, &iter);
       while (_dbus_hash_iter_next (&iter))
         {
           DBusList **items = _dbus_hash_iter_get_value (&iter);
 
-          rule_list_remove_by_connection (items, connection);
+          rule_list_remove_by_connection (matchmaker, items, connection);
 
           if (*items == NULL)
             _dbus_hash_iter_remove_entry (&iter);
@@ -1528,6 +1838,24 @@ bus_matchmaker_disconnected (BusMatchmaker   *matchmaker,
     }
 }
 
+/**
+ * Gets the number of match rules in the matchmaker, and how many
+ * distinct predicates they make up; rules of different connections
+ * that match the same messages share a predicate.
+ *
+ * @param matchmaker the matchmaker
+ * @param n_rules return location for the number of rules
+ * @param n_predicates return location for the number of predicates
+ */
+void
+bus_matchmaker_get_rule_stats (BusMatchmaker *matchmaker,
+                               int           *n_rules,
+                               int           *n_predicates)
+{
+  *n_rules = matchmaker->n_rules;
+  *n_predicates = matchmaker->n_groups;
+}
+
 static dbus_bool_t
 connection_is_primary_owner (DBusConnection *connection,
                              const char     *service_name)
@@ -1549,6 +1877,49 @@ connection_is_primary_owner (DBusConnection *connection,
   return bus_service_get_primary_owners_connection (service) == connection;
 }
 
+/* Compares string argument number i of a message with what the rule
+ * expects of it; the rule must have an expectation for that argument.
+ */
+static dbus_bool_t
+match_rule_arg_matches (BusMatchRule *rule,
+                        int           i,
+                        const char   *actual_arg)
+{
+  const char *expected_arg;
+  int expected_length;
+  int actual_length;
+
+  _dbus_assert (i < rule->args_len);
+  _dbus_assert (rule->args[i] != NULL);
+
+  expected_arg = rule->args[i];
+  expected_length = rule->arg_lens[i] & ~BUS_MATCH_ARG_IS_PATH;
+  actual_length = strlen (actual_arg);
+
+  if (rule->arg_lens[i] & BUS_MATCH_ARG_IS_PATH)
+    {
+      if (actual_length < expected_length &&
+          actual_arg[actual_length - 1] != '/')
+        return FALSE;
+
+      if (expected_length < actual_length &&
+          expected_arg[expected_length - 1] != '/')
+        return FALSE;
+
+      if (memcmp (actual_arg, expected_arg,
+                  MIN (actual_length, expected_length)) != 0)
+        return FALSE;
+    }
+  else
+    {
+      if (expected_length != actual_length ||
+          memcmp (expected_arg, actual_arg, expected_length) != 0)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
 static dbus_bool_t
 match_rule_matches (BusMatchRule    *rule,
                     DBusConnection  *sender,
@@ -1673,21 +2044,13 @@ match_rule_matches (BusMatchRule    *rule,
       while (i < rule->args_len)
         {
           int current_type;
-          const char *expected_arg;
-          int expected_length;
-          dbus_bool_t is_path;
 
-          expected_arg = rule->args[i];
-          expected_length = rule->arg_lens[i] & ~BUS_MATCH_ARG_IS_PATH;
-          is_path = (rule->arg_lens[i] & BUS_MATCH_ARG_IS_PATH) != 0;
-          
           current_type = dbus_message_iter_get_arg_type (&iter);
 
-          if (expected_arg != NULL)
+          if (rule->args[i] != NULL)
             {
               const char *actual_arg;
-              int actual_length;
-              
+
               if (current_type != DBUS_TYPE_STRING)
                 return FALSE;
 
@@ -1695,29 +2058,8 @@ match_rule_matches (BusMatchRule    *rule,
               dbus_message_iter_get_basic (&iter, &actual_arg);
               _dbus_assert (actual_arg != NULL);
 
-              actual_length = strlen (actual_arg);
-
-              if (is_path)
-                {
-                  if (actual_length < expected_length &&
-                      actual_arg[actual_length - 1] != '/')
-                    return FALSE;
-
-                  if (expected_length < actual_length &&
-                      expected_arg[expected_length - 1] != '/')
-                    return FALSE;
-
-                  if (memcmp (actual_arg, expected_arg,
-                              MIN (actual_length, expected_length)) != 0)
-                    return FALSE;
-                }
-              else
-                {
-                  if (expected_length != actual_length ||
-                      memcmp (expected_arg, actual_arg, expected_length) != 0)
-                    return FALSE;
-                }
-
+              if (!match_rule_arg_matches (rule, i, actual_arg))
+                return FALSE;
             }
           
           if (current_type != DBUS_TYPE_INVALID)
@@ -1731,7 +2073,7 @@ match_rule_matches (BusMatchRule    *rule,
 }
 
 static dbus_bool_t
-get_recipients_from_list (DBusList       **rules,
+get_recipients_from_list (DBusList       **groups,
                           DBusConnection  *sender,
                           DBusConnection  *addressed_recipient,
                           DBusMessage     *message,
@@ -1739,47 +2081,56 @@ get_recipients_from_list (DBusList       **rules,
 {
   DBusList *link;
 
-  if (rules == NULL)
+  if (groups == NULL)
     return TRUE;
 
-  link = _dbus_list_get_first_link (rules);
+  link = _dbus_list_get_first_link (groups);
   while (link != NULL)
     {
-      BusMatchRule *rule;
+      BusMatchGroup *group;
+      DBusList *rule_link;
 
-      rule = link->data;
+      group = link->data;
 
 #ifdef DBUS_ENABLE_VERBOSE_MODE
       {
-        char *s = match_rule_to_string (rule);
+        char *s = match_rule_to_string (group->predicate);
 
-        _dbus_verbose ("Checking whether message matches rule %s for connection %p\n",
-                       s, rule->matches_go_to);
+        _dbus_verbose ("Checking whether message matches rule %s\n", s);
         dbus_free (s);
       }
 #endif
 
-      if (match_rule_matches (rule,
+      if (match_rule_matches (group->predicate,
                               sender, addressed_recipient, message,
                               BUS_MATCH_MESSAGE_TYPE | BUS_MATCH_INTERFACE))
         {
           _dbus_verbose ("Rule matched\n");
 
-          /* Append to the list if we haven't already */
-          if (bus_connection_mark_stamp (rule->matches_go_to))
+          rule_link = _dbus_list_get_first_link (&group->rules);
+          while (rule_link != NULL)
             {
-              if (!_dbus_list_append (recipients_p, rule->matches_go_to))
-                return FALSE;
-            }
+              BusMatchRule *rule = rule_link->data;
+
+              /* Append to the list if we haven't already */
+              if (bus_connection_mark_stamp (rule->matches_go_to))
+                {
+                  if (!_dbus_list_append (recipients_p, rule->matches_go_to))
+                    return FALSE;
+                }
 #ifdef DBUS_ENABLE_VERBOSE_MODE
-          else
-            {
-              _dbus_verbose ("Connection already receiving this message, so not adding again\n");
-            }
+              else
+                {
+                  _dbus_verbose ("Connection %p already receiving this message, so not adding again\n",
+                                 rule->matches_go_to);
+                }
 #endif /* DBUS_ENABLE_VERBOSE_MODE */
+
+              rule_link = _dbus_list_get_next_link (&group->rules, rule_link);
+            }
         }
 
-      link = _dbus_list_get_next_link (rules, link);
+      link = _dbus_list_get_next_link (groups, link);
     }
 
   return TRUE;
@@ -1847,6 +2198,146 @@ bus_matchmaker_get_recipients (BusMatchmaker   *matchmaker,
   return TRUE;
 }
 
+static dbus_bool_t
+driver_signal_matches_rule (BusMatchRule  *rule,
+                            const char    *path,
+                            const char    *member,
+                            const char   **args,
+                            int            n_args)
+{
+  int i;
+
+  /* Message type and interface are implied by the list the rule is in */
+
+  if ((rule->flags & BUS_MATCH_MEMBER) &&
+      strcmp (rule->member, member) != 0)
+    return FALSE;
+
+  if ((rule->flags & BUS_MATCH_SENDER) &&
+      strcmp (rule->sender, DBUS_SERVICE_DBUS) != 0)
+    return FALSE;
+
+  /* Broadcast signals have no destination */
+  if (rule->flags & BUS_MATCH_DESTINATION)
+    return FALSE;
+
+  if ((rule->flags & BUS_MATCH_PATH) &&
+      strcmp (rule->path, path) != 0)
+    return FALSE;
+
+  if (rule->flags & BUS_MATCH_ARGS)
+    {
+      for (i = 0; i < rule->args_len; i++)
+        {
+          if (rule->args[i] == NULL)
+            continue;
+
+          if (i >= n_args)
+            return FALSE;
+
+          if (!match_rule_arg_matches (rule, i, args[i]))
+            return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+static dbus_bool_t
+driver_signal_matches_list (DBusList   **groups,
+                            const char  *path,
+                            const char  *member,
+                            const char **args,
+                            int          n_args)
+{
+  DBusList *link;
+
+  if (groups == NULL)
+    return FALSE;
+
+  link = _dbus_list_get_first_link (groups);
+  while (link != NULL)
+    {
+      BusMatchGroup *group = link->data;
+
+      if (driver_signal_matches_rule (group->predicate, path, member,
+                                      args, n_args))
+        return TRUE;
+
+      link = _dbus_list_get_next_link (groups, link);
+    }
+
+  return FALSE;
+}
+
+/**
+ * Checks whether any match rule could select a signal the bus driver
+ * is about to broadcast, before the driver goes to the trouble of
+ * building it. The signal is described by its path, interface, member
+ * and its arguments, which must all be strings. Security policy is not
+ * taken into account, so a TRUE return only means the signal might be
+ * delivered to somebody.
+ *
+ * The result is counted in the statistics returned by
+ * bus_matchmaker_get_driver_signal_stats().
+ *
+ * @param matchmaker the matchmaker
+ * @param path object path the signal would be emitted from
+ * @param interface interface of the signal
+ * @param member name of the signal
+ * @param args the string arguments of the signal
+ * @param n_args number of arguments
+ * @returns #TRUE if the signal should be built and dispatched
+ */
+dbus_bool_t
+bus_matchmaker_wants_driver_signal (BusMatchmaker  *matchmaker,
+                                    const char     *path,
+                                    const char     *interface,
+                                    const char     *member,
+                                    const char    **args,
+                                    int             n_args)
+{
+  matchmaker->n_driver_signals_checked += 1;
+
+  if (driver_signal_matches_list (bus_matchmaker_get_rules (matchmaker,
+                                      DBUS_MESSAGE_TYPE_INVALID, NULL, FALSE),
+                                  path, member, args, n_args) ||
+      driver_signal_matches_list (bus_matchmaker_get_rules (matchmaker,
+                                      DBUS_MESSAGE_TYPE_INVALID, interface, FALSE),
+                                  path, member, args, n_args) ||
+      driver_signal_matches_list (bus_matchmaker_get_rules (matchmaker,
+                                      DBUS_MESSAGE_TYPE_SIGNAL, NULL, FALSE),
+                                  path, member, args, n_args) ||
+      driver_signal_matches_list (bus_matchmaker_get_rules (matchmaker,
+                                      DBUS_MESSAGE_TYPE_SIGNAL, interface, FALSE),
+                                  path, member, args, n_args))
+    return TRUE;
+
+  _dbus_verbose ("No rule can match %s.%s from the bus driver, not sending it\n",
+                 interface, member);
+
+  matchmaker->n_driver_signals_suppressed += 1;
+  return FALSE;
+}
+
+/**
+ * Gets the number of bus driver signals checked with
+ * bus_matchmaker_wants_driver_signal(), and how many of them
+ * were never built because no rule could match them.
+ *
+ * @param matchmaker the matchmaker
+ * @param n_checked return location for the number of signals checked
+ * @param n_suppressed return location for the number of signals skipped
+ */
+void
+bus_matchmaker_get_driver_signal_stats (BusMatchmaker *matchmaker,
+                                        unsigned long *n_checked,
+                                        unsigned long *n_suppressed)
+{
+  *n_checked = matchmaker->n_driver_signals_checked;
+  *n_suppressed = matchmaker->n_driver_signals_suppressed;
+}
+
 #ifdef DBUS_BUILD_TESTS
 #include "test.h"
 #include <stdlib.h>
@@ -2272,6 +2763,78 @@ test_matching (void)
   dbus_message_unref (message1);
 }
 
+/* Rules that land in the lists bus_matchmaker_wants_driver_signal()
+ * looks at for a NameOwnerChanged signal; the answer it gives for each
+ * of them must agree with matching the real message.
+ */
+static const char*
+driver_signal_rules[] = {
+  "type='signal'",
+  "interface='org.freedesktop.DBus'",
+  "type='signal',interface='org.freedesktop.DBus',member='NameOwnerChanged'",
+  "type='signal',member='NameAcquired'",
+  "sender='org.freedesktop.DBus'",
+  "sender='org.example.Other'",
+  "destination=':1.5'",
+  "path='/org/freedesktop/DBus'",
+  "path='/org/example'",
+  "arg0='com.example.Foo'",
+  "arg0='com.example.Bar'",
+  "arg1=':1.5'",
+  "arg1=':1.6'",
+  "arg2=''",
+  "arg3=''",
+  "arg0path='com.example.Foo'",
+  "type='signal',member='NameOwnerChanged',arg0='com.example.Foo',arg2='x'",
+  NULL
+};
+
+static void
+test_driver_signal_matching (void)
+{
+  DBusMessage *message;
+  const char *args[3];
+  int i;
+
+  args[0] = "com.example.Foo";
+  args[1] = ":1.5";
+  args[2] = "";
+
+  message = dbus_message_new_signal (DBUS_PATH_DBUS, DBUS_INTERFACE_DBUS,
+                                     "NameOwnerChanged");
+  if (message == NULL ||
+      !dbus_message_set_sender (message, DBUS_SERVICE_DBUS) ||
+      !dbus_message_append_args (message,
+                                 DBUS_TYPE_STRING, &args[0],
+                                 DBUS_TYPE_STRING, &args[1],
+                                 DBUS_TYPE_STRING, &args[2],
+                                 DBUS_TYPE_INVALID))
+    _dbus_assert_not_reached ("oom");
+
+  for (i = 0; driver_signal_rules[i] != NULL; i++)
+    {
+      BusMatchRule *rule;
+      dbus_bool_t matched;
+
+      rule = check_parse (TRUE, driver_signal_rules[i]);
+      _dbus_assert (rule != NULL);
+
+      matched = match_rule_matches (rule, NULL, NULL, message, 0);
+
+      if (driver_signal_matches_rule (rule, DBUS_PATH_DBUS,
+                                      "NameOwnerChanged", args, 3) != matched)
+        {
+          _dbus_warn ("Rule %s should %s the NameOwnerChanged signal\n",
+                      driver_signal_rules[i], matched ? "match" : "not match");
+          exit (1);
+        }
+
+      bus_match_rule_unref (rule);
+    }
+
+  dbus_message_unref (message);
+}
+
 dbus_bool_t
 bus_signals_test (const DBusString *test_data_dir)
 {
@@ -2288,7 +2851,9 @@ bus_signals_test (const DBusString *test_data_dir)
   test_equality ();
 
   test_matching ();
-  
+
+  test_driver_signal_matching ();
+
   return TRUE;
 }
 
@@ -74,6 +74,11 @@ dbus_bool_t bus_matchmaker_add_rule             (BusMatchmaker   *matchmaker,
 dbus_bool_t bus_matchmaker_remove_rule_by_value (BusMatchmaker   *matchmaker,
                                                  BusMatchRule    *value,
                                                  DBusError       *error);
+dbus_bool_t bus_matchmaker_find_rules_by_value  (BusMatchmaker   *matchmaker,
+                                                 BusMatchRule   **values,
+                                                 int              n_values,
+                                                 BusMatchRule   **found,
+                                                 DBusError       *error);
 void        bus_matchmaker_remove_rule          (BusMatchmaker   *matchmaker,
                                                  BusMatchRule    *rule);
 void        bus_matchmaker_disconnected         (BusMatchmaker   *matchmaker,
@@ -84,5 +89,17 @@ dbus_bool_t bus_matchmaker_get_recipients       (BusMatchmaker   *matchmaker,
                                                  DBusConnection  *addressed_recipient,
                                                  DBusMessage     *message,
                                                  DBusList       **recipients_p);
+dbus_bool_t bus_matchmaker_wants_driver_signal  (BusMatchmaker   *matchmaker,
+                                                 const char      *path,
+                                                 const char      *interface,
+                                                 const char      *member,
+                                                 const char     **args,
+                                                 int              n_args);
+void        bus_matchmaker_get_driver_signal_stats (BusMatchmaker *matchmaker,
+                                                    unsigned long *n_checked,
+                                                    unsigned long *n_suppressed);
+void        bus_matchmaker_get_rule_stats       (BusMatchmaker   *matchmaker,
+                                                 int             *n_rules,
+                                                 int             *n_predicates);
 
 #endif /* BUS_SIGNALS_H */
@@ -0,0 +1,235 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* stats.c  Bus driver statistics interface
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <config.h>
+#include "stats.h"
+#include "bus.h"
+#include "services.h"
+#include "signals.h"
+#include "utils.h"
+
+#include <dbus/dbus-sysdeps.h>
+
+#ifdef DBUS_ENABLE_STATS
+
+/* The statistics describe every connection on the bus, so only the
+ * user the bus runs as and root may read them
+ */
+dbus_bool_t
+bus_stats_check_caller (DBusConnection *connection,
+                        DBusError      *error)
+{
+  unsigned long uid;
+
+  if (dbus_connection_get_unix_user (connection, &uid) &&
+      (uid == 0 || _dbus_unix_user_is_process_owner (uid)))
+    return TRUE;
+
+  dbus_set_error (error, DBUS_ERROR_ACCESS_DENIED,
+                  "Only root and the user running the bus may call %s methods",
+                  BUS_INTERFACE_STATS);
+  return FALSE;
+}
+
+static dbus_bool_t
+stats_append_uint32 (DBusMessageIter *dict,
+                     const char      *key,
+                     dbus_uint32_t    value)
+{
+  DBusMessageIter entry, variant;
+
+  if (!dbus_message_iter_open_container (dict, DBUS_TYPE_DICT_ENTRY,
+                                         NULL, &entry))
+    return FALSE;
+
+  if (!dbus_message_iter_append_basic (&entry, DBUS_TYPE_STRING, &key))
+    goto abandon_entry;
+
+  if (!dbus_message_iter_open_container (&entry, DBUS_TYPE_VARIANT,
+                                         DBUS_TYPE_UINT32_AS_STRING,
+                                         &variant))
+    goto abandon_entry;
+
+  if (!dbus_message_iter_append_basic (&variant, DBUS_TYPE_UINT32, &value))
+    {
+      dbus_message_iter_abandon_container (&entry, &variant);
+      goto abandon_entry;
+    }
+
+  if (!dbus_message_iter_close_container (&entry, &variant))
+    goto abandon_entry;
+
+  return dbus_message_iter_close_container (dict, &entry);
+
+ abandon_entry:
+  dbus_message_iter_abandon_container (dict, &entry);
+  return FALSE;
+}
+
+dbus_bool_t
+bus_stats_handle_get_stats (DBusConnection *connection,
+                            BusTransaction *transaction,
+                            DBusMessage    *message,
+                            DBusError      *error)
+{
+  BusContext *context;
+  DBusMessage *reply;
+  DBusMessageIter iter, dict;
+  unsigned long n_checked, n_suppressed;
+  int n_rules, n_predicates;
+
+  _DBUS_ASSERT_ERROR_IS_CLEAR (error);
+
+  context = bus_connection_get_context (connection);
+
+  reply = dbus_message_new_method_return (message);
+  if (reply == NULL)
+    goto oom;
+
+  dbus_message_iter_init_append (reply, &iter);
+
+  if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+                                         DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+                                         DBUS_TYPE_STRING_AS_STRING
+                                         DBUS_TYPE_VARIANT_AS_STRING
+                                         DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+                                         &dict))
+    goto oom;
+
+  bus_matchmaker_get_driver_signal_stats (bus_context_get_matchmaker (context),
+                                          &n_checked, &n_suppressed);
+
+  bus_matchmaker_get_rule_stats (bus_context_get_matchmaker (context),
+                                 &n_rules, &n_predicates);
+
+  if (!stats_append_uint32 (&dict, "DriverSignalsChecked", n_checked) ||
+      !stats_append_uint32 (&dict, "DriverSignalsSuppressed", n_suppressed) ||
+      !stats_append_uint32 (&dict, "MatchRules", n_rules) ||
+      !stats_append_uint32 (&dict, "MatchRulePredicates", n_predicates))
+    {
+      dbus_message_iter_abandon_container (&iter, &dict);
+      goto oom;
+    }
+
+  if (!dbus_message_iter_close_container (&iter, &dict))
+    goto oom;
+
+  if (!bus_transaction_send_from_driver (transaction, connection, reply))
+    goto oom;
+
+  dbus_message_unref (reply);
+  return TRUE;
+
+ oom:
+  if (reply != NULL)
+    dbus_message_unref (reply);
+
+  BUS_SET_OOM (error);
+  return FALSE;
+}
+
+dbus_bool_t
+bus_stats_handle_get_connection_stats (DBusConnection *connection,
+                                       BusTransaction *transaction,
+                                       DBusMessage    *message,
+                                       DBusError      *error)
+{
+  const char *name;
+  DBusString str;
+  BusService *service;
+  DBusConnection *stats_connection;
+  DBusMessage *reply;
+  DBusMessageIter iter, dict;
+  long peak_outgoing_bytes;
+  unsigned long n_refused_queue_full, n_refused_sender_share;
+
+  _DBUS_ASSERT_ERROR_IS_CLEAR (error);
+
+  reply = NULL;
+
+  if (!dbus_message_get_args (message, error,
+                              DBUS_TYPE_STRING, &name,
+                              DBUS_TYPE_INVALID))
+    return FALSE;
+
+  _dbus_string_init_const (&str, name);
+  service = bus_registry_lookup (bus_connection_get_registry (connection),
+                                 &str);
+  if (service == NULL)
+    {
+      dbus_set_error (error, DBUS_ERROR_NAME_HAS_NO_OWNER,
+                      "Could not get statistics for name '%s': no such name",
+                      name);
+      return FALSE;
+    }
+
+  stats_connection = bus_service_get_primary_owners_connection (service);
+
+  bus_connection_get_backlog_stats (stats_connection, &peak_outgoing_bytes,
+                                    &n_refused_queue_full,
+                                    &n_refused_sender_share);
+
+  reply = dbus_message_new_method_return (message);
+  if (reply == NULL)
+    goto oom;
+
+  dbus_message_iter_init_append (reply, &iter);
+
+  if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+                                         DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+                                         DBUS_TYPE_STRING_AS_STRING
+                                         DBUS_TYPE_VARIANT_AS_STRING
+                                         DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+                                         &dict))
+    goto oom;
+
+  if (!stats_append_uint32 (&dict, "OutgoingBytes",
+                            dbus_connection_get_outgoing_size (stats_connection)) ||
+      !stats_append_uint32 (&dict, "OutgoingUnixFds",
+                            dbus_connection_get_outgoing_unix_fds (stats_connection)) ||
+      !stats_append_uint32 (&dict, "PeakOutgoingBytes", peak_outgoing_bytes) ||
+      !stats_append_uint32 (&dict, "MessagesRefusedQueueFull",
+                            n_refused_queue_full) ||
+      !stats_append_uint32 (&dict, "MessagesRefusedSenderShare",
+                            n_refused_sender_share))
+    {
+      dbus_message_iter_abandon_container (&iter, &dict);
+      goto oom;
+    }
+
+  if (!dbus_message_iter_close_container (&iter, &dict))
+    goto oom;
+
+  if (!bus_transaction_send_from_driver (transaction, connection, reply))
+    goto oom;
+
+  dbus_message_unref (reply);
+  return TRUE;
+
+ oom:
+  if (reply != NULL)
+    dbus_message_unref (reply);
+
+  BUS_SET_OOM (error);
+  return FALSE;
+}
+
+#endif /* DBUS_ENABLE_STATS */
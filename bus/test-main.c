@@ -117,6 +117,18 @@ main (int argc, char **argv)
     die ("policy");
   test_post_hook ();
 
+  test_pre_hook ();
+  printf ("%s: Running SELinux decision cache test\n", argv[0]);
+  if (!bus_selinux_test (&test_data_dir))
+    die ("selinux");
+  test_post_hook ();
+
+  test_pre_hook ();
+  printf ("%s: Running driver Introspect test\n", argv[0]);
+  if (!bus_driver_test (&test_data_dir))
+    die ("driver");
+  test_post_hook ();
+
   test_pre_hook ();
   printf ("%s: Running signals test\n", argv[0]);
   if (!bus_signals_test (&test_data_dir))
@@ -129,6 +141,42 @@ main (int argc, char **argv)
     die ("sha1");
   test_post_hook ();
 
+  test_pre_hook ();
+  printf ("%s: Running oneshot connection test\n", argv[0]);
+  if (!bus_dispatch_oneshot_test (&test_data_dir))
+    die ("oneshot");
+  test_post_hook ();
+
+  test_pre_hook ();
+  printf ("%s: Running NameOwnerChanged suppression test\n", argv[0]);
+  if (!bus_dispatch_owner_changed_test (&test_data_dir))
+    die ("NameOwnerChanged suppression");
+  test_post_hook ();
+
+  test_pre_hook ();
+  printf ("%s: Running sender share test\n", argv[0]);
+  if (!bus_dispatch_sender_share_test (&test_data_dir))
+    die ("sender share");
+  test_post_hook ();
+
+  test_pre_hook ();
+  printf ("%s: Running match rule batch test\n", argv[0]);
+  if (!bus_dispatch_match_batch_test (&test_data_dir))
+    die ("match rule batch");
+  test_post_hook ();
+
+  test_pre_hook ();
+  printf ("%s: Running shared match rule test\n", argv[0]);
+  if (!bus_dispatch_shared_match_test (&test_data_dir))
+    die ("shared match rule");
+  test_post_hook ();
+
+  test_pre_hook ();
+  printf ("%s: Running ListNames cache test\n", argv[0]);
+  if (!bus_dispatch_list_names_test (&test_data_dir))
+    die ("ListNames cache");
+  test_post_hook ();
+
   test_pre_hook ();
   printf ("%s: Running message dispatch test\n", argv[0]);
   if (!bus_dispatch_test (&test_data_dir)) 
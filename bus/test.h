@@ -32,7 +32,15 @@
 
 dbus_bool_t bus_dispatch_test         (const DBusString             *test_data_dir);
 dbus_bool_t bus_dispatch_sha1_test    (const DBusString             *test_data_dir);
+dbus_bool_t bus_dispatch_oneshot_test (const DBusString             *test_data_dir);
+dbus_bool_t bus_dispatch_owner_changed_test (const DBusString       *test_data_dir);
+dbus_bool_t bus_dispatch_sender_share_test (const DBusString        *test_data_dir);
+dbus_bool_t bus_dispatch_match_batch_test (const DBusString         *test_data_dir);
+dbus_bool_t bus_dispatch_shared_match_test (const DBusString        *test_data_dir);
+dbus_bool_t bus_dispatch_list_names_test (const DBusString          *test_data_dir);
 dbus_bool_t bus_policy_test           (const DBusString             *test_data_dir);
+dbus_bool_t bus_selinux_test          (const DBusString             *test_data_dir);
+dbus_bool_t bus_driver_test           (const DBusString             *test_data_dir);
 dbus_bool_t bus_config_parser_test    (const DBusString             *test_data_dir);
 dbus_bool_t bus_config_parser_trivial_test (const DBusString        *test_data_dir);
 dbus_bool_t bus_signals_test          (const DBusString             *test_data_dir);
@@ -1,4 +1,5 @@
 include(CheckIncludeFile)
+include(CheckFunctionExists)
 include(CheckSymbolExists)
 include(CheckStructMember)
 include(CheckTypeSize)
@@ -38,6 +39,10 @@ check_symbol_exists(localeconv   "locale.h"         HAVE_LOCALECONV)         #
 check_symbol_exists(strtoll      "stdlib.h"         HAVE_STRTOLL)            #  dbus-send.c
 check_symbol_exists(strtoull     "stdlib.h"         HAVE_STRTOULL)           #  dbus-send.c
 
+check_function_exists(memfd_create HAVE_MEMFD_CREATE)                        #  dbus-sysdeps-unix.c, dbus-message-private.h
+check_function_exists(posix_spawn  HAVE_POSIX_SPAWN)                         #  dbus-spawn.c
+check_function_exists(close_range  HAVE_CLOSE_RANGE)                         #  dbus-spawn.c
+
 check_struct_member(cmsgcred cmcred_pid "sys/types.h sys/socket.h" HAVE_CMSGCRED)   #  dbus-sysdeps.c
 
 # missing:
@@ -45,12 +45,16 @@
 /* Full path to test file test/test-sleep-forever in builddir */
 #define TEST_SLEEP_FOREVER_BINARY "@TEST_SLEEP_FOREVER_BINARY@"
 
+/* Full path to test file test/data/valid-config-files/tmp-session-like-system.conf in builddir */
+#define TEST_SESSION_LIKE_SYSTEM_CONFIG "@TEST_SESSION_LIKE_SYSTEM_CONFIG@"
+
 /* Some dbus features */
 #cmakedefine DBUS_BUILD_TESTS 1
 #cmakedefine DBUS_ENABLE_ANSI 1
 #cmakedefine DBUS_ENABLE_VERBOSE_MODE 1
 #cmakedefine DBUS_DISABLE_ASSERTS 1
 #cmakedefine DBUS_DISABLE_CHECKS 1
+#cmakedefine DBUS_ENABLE_STATS 1
 /* xmldocs */
 /* doxygen */
 #cmakedefine DBUS_GCOV_ENABLED 1
@@ -195,6 +199,15 @@
 /* Define to 1 if you have strtoull */
 #cmakedefine   HAVE_STRTOULL 1
 
+/* Define to 1 if you have memfd_create */
+#cmakedefine   HAVE_MEMFD_CREATE 1
+
+/* Define to 1 if you have posix_spawn */
+#cmakedefine   HAVE_POSIX_SPAWN 1
+
+/* Define to 1 if you have close_range */
+#cmakedefine   HAVE_CLOSE_RANGE 1
+
 // structs
 /* Define to 1 if you have struct cmsgred */
 #cmakedefine    HAVE_CMSGCRED 1
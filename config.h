@@ -277,6 +277,9 @@
 /* Full path to test file test/data/valid-service-files in builddir */
 #define TEST_SERVICE_DIR "/etc/dbus-test-data/valid-service-files"
 
+/* Full path to test file test/data/valid-config-files/tmp-session-like-system.conf in builddir */
+#define TEST_SESSION_LIKE_SYSTEM_CONFIG "/etc/dbus-test-data/valid-config-files/tmp-session-like-system.conf"
+
 /* Full path to test file test/test-shell-service in builddir */
 #define TEST_SHELL_SERVICE_BINARY "/system/bin/dbus-shell-service"
 
@@ -472,6 +472,11 @@ _dbus_auth_script_run (const DBusString *filename)
           _dbus_auth_set_mechanisms (auth, (const char **) mechs);
           dbus_free_string_array (mechs);
         }
+      else if (_dbus_string_starts_with_c_str (&line,
+                                               "PIPELINED"))
+        {
+          _dbus_auth_set_pipelined (auth, TRUE);
+        }
       else if (_dbus_string_starts_with_c_str (&line,
                                                "SEND"))
         {
@@ -48,9 +48,6 @@
  * from the other end, e.g. if there's an error during
  * DBUS_COOKIE_SHA1.
  *
- * @todo the cookie keyring needs to be cached globally not just
- * per-auth (which raises threadsafety issues too)
- * 
  * @todo grep FIXME in dbus-auth.c
  */
 
@@ -191,6 +188,8 @@ struct DBusAuth
 
   unsigned int unix_fd_possible : 1;  /**< This side could do unix fd passing */
   unsigned int unix_fd_negotiated : 1; /**< Unix fd was successfully negotiated */
+
+  unsigned int pipelined : 1; /**< Client may send BEGIN before the server's OK */
 };
 
 /**
@@ -234,6 +233,7 @@ static dbus_bool_t send_begin                (DBusAuth *auth);
 static dbus_bool_t send_cancel               (DBusAuth *auth);
 static dbus_bool_t send_negotiate_unix_fd    (DBusAuth *auth);
 static dbus_bool_t send_agree_unix_fd        (DBusAuth *auth);
+static dbus_bool_t send_pipelined_begin      (DBusAuth *auth);
 
 /**
  * Client states
@@ -275,6 +275,12 @@ static dbus_bool_t handle_client_state_waiting_for_reject (DBusAuth         *aut
 static dbus_bool_t handle_client_state_waiting_for_agree_unix_fd (DBusAuth         *auth,
                                                            DBusAuthCommand   command,
                                                            const DBusString *args);
+static dbus_bool_t handle_client_state_pipelined_waiting_for_ok (DBusAuth         *auth,
+                                                           DBusAuthCommand   command,
+                                                           const DBusString *args);
+static dbus_bool_t handle_client_state_pipelined_waiting_for_agree_unix_fd (DBusAuth         *auth,
+                                                           DBusAuthCommand   command,
+                                                           const DBusString *args);
 
 static const DBusAuthStateData client_state_need_send_auth = {
   "NeedSendAuth", NULL
@@ -291,6 +297,12 @@ static const DBusAuthStateData client_state_waiting_for_reject = {
 static const DBusAuthStateData client_state_waiting_for_agree_unix_fd = {
   "WaitingForAgreeUnixFD", handle_client_state_waiting_for_agree_unix_fd
 };
+static const DBusAuthStateData client_state_pipelined_waiting_for_ok = {
+  "PipelinedWaitingForOK", handle_client_state_pipelined_waiting_for_ok
+};
+static const DBusAuthStateData client_state_pipelined_waiting_for_agree_unix_fd = {
+  "PipelinedWaitingForAgreeUnixFD", handle_client_state_pipelined_waiting_for_agree_unix_fd
+};
 
 /**
  * Common terminal states.  Terminal states have handler == NULL.
@@ -564,9 +576,9 @@ sha1_handle_first_client_response (DBusAuth         *auth,
       return FALSE;
     }
 
-  /* we cache the keyring for speed, so here we drop it if it's the
-   * wrong one. FIXME caching the keyring here is useless since we use
-   * a different DBusAuth for every connection.
+  /* we hold on to the keyring, so here we drop it if it's the
+   * wrong one. Keyrings are shared within the process, so getting
+   * it again is cheap.
    */
   if (auth->keyring &&
       !_dbus_keyring_is_for_credentials (auth->keyring,
@@ -1547,10 +1559,13 @@ send_begin (DBusAuth         *auth)
   return TRUE;
 }
 
+/* Records the server GUID sent along with OK; a malformed GUID moves
+ * us to the need-disconnect state. Returns FALSE if no memory.
+ */
 static dbus_bool_t
-process_ok(DBusAuth *auth,
-          const DBusString *args_from_ok) {
-
+record_guid_from_server (DBusAuth         *auth,
+                         const DBusString *args_from_ok)
+{
   int end_of_hex;
   
   /* "args_from_ok" should be the GUID, whitespace already pulled off the front */
@@ -1583,6 +1598,19 @@ process_ok(DBusAuth *auth,
   _dbus_verbose ("Got GUID '%s' from the server\n",
                  _dbus_string_get_const_data (& DBUS_AUTH_CLIENT (auth)->guid_from_server));
 
+  return TRUE;
+}
+
+static dbus_bool_t
+process_ok(DBusAuth *auth,
+          const DBusString *args_from_ok) {
+
+  if (!record_guid_from_server (auth, args_from_ok))
+    return FALSE;
+
+  if (auth->state == &common_state_need_disconnect)
+    return TRUE;
+
   if (auth->unix_fd_possible)
     return send_negotiate_unix_fd(auth);
 
@@ -1673,6 +1701,33 @@ send_agree_unix_fd (DBusAuth *auth)
   return TRUE;
 }
 
+/* With EXTERNAL the server's answer to our AUTH is predictable, so a
+ * pipelined client queues the rest of the handshake right behind it
+ * instead of waiting a round trip for OK. Anything but OK (and the
+ * unix fd answer) then means disconnecting, since BEGIN and possibly
+ * messages are already on the wire.
+ */
+static dbus_bool_t
+send_pipelined_begin (DBusAuth *auth)
+{
+  int orig_len;
+
+  orig_len = _dbus_string_get_length (&auth->outgoing);
+
+  if (auth->unix_fd_possible &&
+      !_dbus_string_append (&auth->outgoing, "NEGOTIATE_UNIX_FD\r\n"))
+    return FALSE;
+
+  if (!_dbus_string_append (&auth->outgoing, "BEGIN\r\n"))
+    {
+      _dbus_string_set_length (&auth->outgoing, orig_len);
+      return FALSE;
+    }
+
+  goto_state (auth, &client_state_pipelined_waiting_for_ok);
+  return TRUE;
+}
+
 static dbus_bool_t
 handle_auth (DBusAuth *auth, const DBusString *args)
 {
@@ -2101,6 +2156,81 @@ handle_client_state_waiting_for_agree_unix_fd(DBusAuth         *auth,
     }
 }
 
+static dbus_bool_t
+handle_client_state_pipelined_waiting_for_ok (DBusAuth         *auth,
+                                              DBusAuthCommand   command,
+                                              const DBusString *args)
+{
+  switch (command)
+    {
+    case DBUS_AUTH_COMMAND_OK:
+      if (!record_guid_from_server (auth, args))
+        return FALSE;
+
+      if (auth->state == &common_state_need_disconnect)
+        return TRUE;
+
+      /* We sent NEGOTIATE_UNIX_FD iff this was set, and the server
+       * always answers it after OK
+       */
+      if (auth->unix_fd_possible)
+        goto_state (auth, &client_state_pipelined_waiting_for_agree_unix_fd);
+      else
+        goto_state (auth, &common_state_authenticated);
+      return TRUE;
+
+    case DBUS_AUTH_COMMAND_REJECTED:
+    case DBUS_AUTH_COMMAND_DATA:
+    case DBUS_AUTH_COMMAND_ERROR:
+    case DBUS_AUTH_COMMAND_AUTH:
+    case DBUS_AUTH_COMMAND_CANCEL:
+    case DBUS_AUTH_COMMAND_BEGIN:
+    case DBUS_AUTH_COMMAND_UNKNOWN:
+    case DBUS_AUTH_COMMAND_NEGOTIATE_UNIX_FD:
+    case DBUS_AUTH_COMMAND_AGREE_UNIX_FD:
+    default:
+      _dbus_verbose ("%s: Disconnecting because pipelined authentication was not accepted\n",
+                     DBUS_AUTH_NAME (auth));
+      goto_state (auth, &common_state_need_disconnect);
+      return TRUE;
+    }
+}
+
+static dbus_bool_t
+handle_client_state_pipelined_waiting_for_agree_unix_fd (DBusAuth         *auth,
+                                                         DBusAuthCommand   command,
+                                                         const DBusString *args)
+{
+  switch (command)
+    {
+    case DBUS_AUTH_COMMAND_AGREE_UNIX_FD:
+      _dbus_assert(auth->unix_fd_possible);
+      auth->unix_fd_negotiated = TRUE;
+      _dbus_verbose("Sucessfully negotiated UNIX FD passing\n");
+      goto_state (auth, &common_state_authenticated);
+      return TRUE;
+
+    case DBUS_AUTH_COMMAND_ERROR:
+      _dbus_assert(auth->unix_fd_possible);
+      auth->unix_fd_negotiated = FALSE;
+      _dbus_verbose("Failed to negotiate UNIX FD passing\n");
+      goto_state (auth, &common_state_authenticated);
+      return TRUE;
+
+    case DBUS_AUTH_COMMAND_OK:
+    case DBUS_AUTH_COMMAND_DATA:
+    case DBUS_AUTH_COMMAND_REJECTED:
+    case DBUS_AUTH_COMMAND_AUTH:
+    case DBUS_AUTH_COMMAND_CANCEL:
+    case DBUS_AUTH_COMMAND_BEGIN:
+    case DBUS_AUTH_COMMAND_UNKNOWN:
+    case DBUS_AUTH_COMMAND_NEGOTIATE_UNIX_FD:
+    default:
+      goto_state (auth, &common_state_need_disconnect);
+      return TRUE;
+    }
+}
+
 /**
  * Mapping from command name to enum
  */
@@ -2444,6 +2574,18 @@ _dbus_auth_do_work (DBusAuth *auth)
 {
   auth->needed_memory = FALSE;
 
+  /* Nothing has been heard back about our initial AUTH yet, so the
+   * rest of the handshake can still be queued behind it.
+   */
+  if (auth->pipelined &&
+      auth->state == &client_state_waiting_for_data &&
+      auth->mech->client_initial_response_func ==
+      handle_client_initial_response_external_mech)
+    {
+      if (!send_pipelined_begin (auth))
+        return DBUS_AUTH_STATE_WAITING_FOR_MEMORY;
+    }
+
   /* Max amount we'll buffer up before deciding someone's on crack */
 #define MAX_BUFFER (16 * _DBUS_ONE_KILOBYTE)
 
@@ -2805,6 +2947,43 @@ _dbus_auth_set_unix_fd_possible(DBusAuth *auth, dbus_bool_t b)
   auth->unix_fd_possible = b;
 }
 
+/**
+ * Sets whether a client conversation using EXTERNAL may send BEGIN
+ * (and NEGOTIATE_UNIX_FD) right after AUTH instead of waiting for
+ * the server's OK. Has no effect once the server has answered, or
+ * for other mechanisms. A pipelined conversation disconnects rather
+ * than trying another mechanism if EXTERNAL is rejected.
+ *
+ * @param auth the auth conversation
+ * @param pipelined #TRUE to pipeline the handshake
+ */
+void
+_dbus_auth_set_pipelined (DBusAuth   *auth,
+                          dbus_bool_t pipelined)
+{
+  _dbus_assert (DBUS_AUTH_IS_CLIENT (auth));
+
+  auth->pipelined = pipelined != FALSE;
+}
+
+/**
+ * Queries whether the client has already queued BEGIN ahead of the
+ * server's OK and flushed all of its auth bytes, so that messages may
+ * follow on the wire before authentication completes.
+ *
+ * @param auth the auth conversation
+ * @returns #TRUE if messages may be sent early
+ */
+dbus_bool_t
+_dbus_auth_get_can_send_early (DBusAuth *auth)
+{
+  if (_dbus_string_get_length (&auth->outgoing) > 0)
+    return FALSE;
+
+  return auth->state == &client_state_pipelined_waiting_for_ok ||
+    auth->state == &client_state_pipelined_waiting_for_agree_unix_fd;
+}
+
 /**
  * Queries whether unix fd passing was sucessfully negotiated.
  *
@@ -27,6 +27,7 @@
 #include "dbus-protocol.h"
 #include "dbus-internals.h"
 #include "dbus-message.h"
+#include "dbus-pending-call.h"
 #include "dbus-marshal-validate.h"
 #include "dbus-threads-internal.h"
 #include "dbus-connection-internal.h"
@@ -77,6 +78,7 @@ typedef struct
 {
   DBusConnection *connection; /**< Connection we're associated with */
   char *unique_name; /**< Unique name of this connection */
+  DBusPendingCall *hello_pending; /**< Hello sent by dbus_bus_register_async(), not yet answered */
 
   unsigned int is_well_known : 1; /**< Is one of the well-known connections in our global array */
 } BusData;
@@ -681,6 +683,32 @@ dbus_bus_register (DBusConnection *connection,
       /* Success! */
       return TRUE;
     }
+
+  if (bd->hello_pending != NULL)
+    {
+      DBusPendingCall *pending;
+
+      /* Wait for the Hello from dbus_bus_register_async() instead of
+       * sending a second one, which the bus would reject.
+       */
+      pending = dbus_pending_call_ref (bd->hello_pending);
+      _DBUS_UNLOCK (bus_datas);
+
+      dbus_pending_call_block (pending);
+      dbus_pending_call_unref (pending);
+
+      _DBUS_LOCK (bus_datas);
+
+      if (bd->unique_name != NULL)
+        {
+          _DBUS_UNLOCK (bus_datas);
+          return TRUE;
+        }
+
+      /* The asynchronous Hello failed; retry it synchronously so the
+       * caller gets the error.
+       */
+    }
   
   message = dbus_message_new_method_call (DBUS_SERVICE_DBUS,
                                           DBUS_PATH_DBUS,
@@ -729,6 +757,160 @@ dbus_bus_register (DBusConnection *connection,
   return retval;
 }
 
+static void
+hello_reply_notify (DBusPendingCall *pending,
+                    void            *user_data)
+{
+  DBusConnection *connection = user_data;
+  DBusMessage *reply;
+  DBusError error = DBUS_ERROR_INIT;
+  char *name;
+  BusData *bd;
+
+  reply = dbus_pending_call_steal_reply (pending);
+
+  _DBUS_LOCK (bus_datas);
+
+  bd = dbus_connection_get_data (connection, bus_data_slot);
+  _dbus_assert (bd != NULL);
+
+  if (reply == NULL)
+    _dbus_verbose ("Hello completed without a reply\n");
+  else if (dbus_set_error_from_message (&error, reply) ||
+           !dbus_message_get_args (reply, &error,
+                                   DBUS_TYPE_STRING, &name,
+                                   DBUS_TYPE_INVALID))
+    _dbus_verbose ("Hello failed: %s: %s\n", error.name, error.message);
+  else if (bd->unique_name == NULL)
+    {
+      bd->unique_name = _dbus_strdup (name);
+      if (bd->unique_name == NULL)
+        _dbus_verbose ("No memory to store unique name %s\n", name);
+    }
+
+  _DBUS_UNLOCK (bus_datas);
+
+  dbus_error_free (&error);
+  if (reply)
+    dbus_message_unref (reply);
+}
+
+/* Called when the Hello pending call is finalized, whether or not it
+ * completed; a call dropped because the connection was disconnected
+ * never invokes hello_reply_notify().
+ */
+static void
+hello_pending_free (void *data)
+{
+  DBusConnection *connection = data;
+  BusData *bd;
+
+  _DBUS_LOCK (bus_datas);
+
+  bd = dbus_connection_get_data (connection, bus_data_slot);
+  if (bd != NULL)
+    bd->hello_pending = NULL;
+
+  _DBUS_UNLOCK (bus_datas);
+}
+
+/**
+ * Like dbus_bus_register(), but does not wait for the reply to the
+ * Hello call. The call is queued on the connection and, if the
+ * connection is still authenticating (see
+ * dbus_connection_open_async()), is sent as soon as authentication
+ * completes, without an extra round trip.
+ *
+ * When the reply is processed (during dispatch, or by any blocking
+ * call on the connection), the unique name becomes available from
+ * dbus_bus_get_unique_name(). Messages sent to the bus after this call
+ * are ordered after the Hello, so they may be sent right away.
+ *
+ * If the Hello fails, dbus_bus_get_unique_name() keeps returning
+ * #NULL; a later dbus_bus_register() retries and reports the error.
+ *
+ * @param connection the connection
+ * @param error place to store errors
+ * @returns #TRUE if the Hello was queued or the connection is already registered
+ */
+dbus_bool_t
+dbus_bus_register_async (DBusConnection *connection,
+                         DBusError      *error)
+{
+  DBusMessage *message;
+  DBusPendingCall *pending;
+  BusData *bd;
+
+  _dbus_return_val_if_fail (connection != NULL, FALSE);
+  _dbus_return_val_if_error_is_set (error, FALSE);
+
+  _DBUS_LOCK (bus_datas);
+
+  bd = ensure_bus_data (connection);
+  if (bd == NULL)
+    {
+      _DBUS_SET_OOM (error);
+      _DBUS_UNLOCK (bus_datas);
+      return FALSE;
+    }
+
+  if (bd->unique_name != NULL || bd->hello_pending != NULL)
+    {
+      _dbus_verbose ("Ignoring attempt to register the same DBusConnection with the message bus a second time.\n");
+      _DBUS_UNLOCK (bus_datas);
+      return TRUE;
+    }
+
+  message = dbus_message_new_method_call (DBUS_SERVICE_DBUS,
+                                          DBUS_PATH_DBUS,
+                                          DBUS_INTERFACE_DBUS,
+                                          "Hello");
+  if (message == NULL)
+    {
+      _DBUS_SET_OOM (error);
+      _DBUS_UNLOCK (bus_datas);
+      return FALSE;
+    }
+
+  if (!dbus_connection_send_with_reply (connection, message, &pending, -1))
+    {
+      dbus_message_unref (message);
+      _DBUS_SET_OOM (error);
+      _DBUS_UNLOCK (bus_datas);
+      return FALSE;
+    }
+
+  dbus_message_unref (message);
+
+  if (pending == NULL)
+    {
+      dbus_set_error (error, DBUS_ERROR_DISCONNECTED,
+                      "Connection is closed");
+      _DBUS_UNLOCK (bus_datas);
+      return FALSE;
+    }
+
+  if (!dbus_pending_call_set_notify (pending, hello_reply_notify,
+                                     connection, hello_pending_free))
+    {
+      dbus_pending_call_cancel (pending);
+      dbus_pending_call_unref (pending);
+      _DBUS_SET_OOM (error);
+      _DBUS_UNLOCK (bus_datas);
+      return FALSE;
+    }
+
+  /* The connection holds a reference until the reply is processed;
+   * hello_pending_free() clears this pointer when it is dropped.
+   */
+  bd->hello_pending = pending;
+  dbus_pending_call_unref (pending);
+
+  _DBUS_UNLOCK (bus_datas);
+
+  return TRUE;
+}
+
 
 /**
  * Sets the unique name of the connection, as assigned by the message
@@ -1584,4 +1766,101 @@ dbus_bus_remove_match (DBusConnection *connection,
   dbus_message_unref (msg);
 }
 
+static void
+send_match_rules (DBusConnection  *connection,
+                  const char      *method,
+                  const char     **rules,
+                  int              n_rules,
+                  DBusError       *error)
+{
+  DBusMessage *msg;
+
+  msg = dbus_message_new_method_call (DBUS_SERVICE_DBUS,
+                                      DBUS_PATH_DBUS,
+                                      DBUS_INTERFACE_DBUS,
+                                      method);
+
+  if (msg == NULL)
+    {
+      _DBUS_SET_OOM (error);
+      return;
+    }
+
+  if (!dbus_message_append_args (msg,
+                                 DBUS_TYPE_ARRAY, DBUS_TYPE_STRING,
+                                 &rules, n_rules,
+                                 DBUS_TYPE_INVALID))
+    {
+      dbus_message_unref (msg);
+      _DBUS_SET_OOM (error);
+      return;
+    }
+
+  send_no_return_values (connection, msg, error);
+
+  dbus_message_unref (msg);
+}
+
+/**
+ * Adds several match rules at once, in a single round trip to the
+ * bus. Each element of "rules" is the string form of a match rule,
+ * as for dbus_bus_add_match().
+ *
+ * The rules are added atomically: if any of them can't be parsed,
+ * or together they would take the connection over its match rule
+ * limit, the bus adds none of them.
+ *
+ * As with dbus_bus_add_match(), this function only blocks if you
+ * pass non-#NULL for the error.
+ *
+ * The AddMatches method is only implemented by newer message bus
+ * daemons; older ones reply with #DBUS_ERROR_UNKNOWN_METHOD, in
+ * which case you have to add the rules one at a time.
+ *
+ * @param connection connection to the message bus
+ * @param rules array of textual match rules
+ * @param n_rules number of elements in rules
+ * @param error location to store any errors
+ */
+void
+dbus_bus_add_matches (DBusConnection *connection,
+                      const char    **rules,
+                      int             n_rules,
+                      DBusError      *error)
+{
+  _dbus_return_if_fail (rules != NULL || n_rules == 0);
+  _dbus_return_if_fail (n_rules >= 0);
+
+  send_match_rules (connection, "AddMatches", rules, n_rules, error);
+}
+
+/**
+ * Removes several previously-added match rules "by value" at once,
+ * as if by calling dbus_bus_remove_match() on each of them, but in
+ * a single round trip to the bus.
+ *
+ * The rules are removed atomically: if any of them isn't found,
+ * the bus removes none of them.
+ *
+ * As with dbus_bus_remove_match(), this function only blocks if you
+ * pass non-#NULL for the error, and it needs a bus daemon that
+ * implements the RemoveMatches method.
+ *
+ * @param connection connection to the message bus
+ * @param rules array of textual match rules
+ * @param n_rules number of elements in rules
+ * @param error location to store any errors
+ */
+void
+dbus_bus_remove_matches (DBusConnection *connection,
+                         const char    **rules,
+                         int             n_rules,
+                         DBusError      *error)
+{
+  _dbus_return_if_fail (rules != NULL || n_rules == 0);
+  _dbus_return_if_fail (n_rules >= 0);
+
+  send_match_rules (connection, "RemoveMatches", rules, n_rules, error);
+}
+
 /** @} */
@@ -47,6 +47,9 @@ DBUS_EXPORT
 dbus_bool_t     dbus_bus_register         (DBusConnection *connection,
 					   DBusError      *error);
 DBUS_EXPORT
+dbus_bool_t     dbus_bus_register_async   (DBusConnection *connection,
+					   DBusError      *error);
+DBUS_EXPORT
 dbus_bool_t     dbus_bus_set_unique_name  (DBusConnection *connection,
 					   const char     *unique_name);
 DBUS_EXPORT
@@ -87,6 +90,16 @@ DBUS_EXPORT
 void            dbus_bus_remove_match     (DBusConnection *connection,
                                            const char     *rule,
                                            DBusError      *error);
+DBUS_EXPORT
+void            dbus_bus_add_matches      (DBusConnection *connection,
+                                           const char    **rules,
+                                           int             n_rules,
+                                           DBusError      *error);
+DBUS_EXPORT
+void            dbus_bus_remove_matches   (DBusConnection *connection,
+                                           const char    **rules,
+                                           int             n_rules,
+                                           DBusError      *error);
 
 /** @} */
 
@@ -56,6 +56,9 @@ dbus_bool_t       _dbus_connection_has_messages_to_send_unlocked (DBusConnection
 DBusMessage*      _dbus_connection_get_message_to_send         (DBusConnection     *connection);
 void              _dbus_connection_message_sent                (DBusConnection     *connection,
                                                                 DBusMessage        *message);
+dbus_bool_t       _dbus_connection_track_outgoing_senders      (DBusConnection     *connection);
+long              _dbus_connection_get_outgoing_size_for_sender (DBusConnection     *connection,
+                                                                const char         *sender);
 dbus_bool_t       _dbus_connection_add_watch_unlocked          (DBusConnection     *connection,
                                                                 DBusWatch          *watch);
 void              _dbus_connection_remove_watch_unlocked       (DBusConnection     *connection,
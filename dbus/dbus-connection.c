@@ -223,6 +223,15 @@ struct DBusMessageFilter
 };
 
 
+/**
+ * The number of bytes queued on a connection from one sender.
+ */
+typedef struct
+{
+  long size;                                 /**< Bytes queued, counted like the outgoing counter */
+  char sender[DBUS_MAXIMUM_NAME_LENGTH + 1]; /**< The sender, also the key in outgoing_senders */
+} DBusSenderSize;
+
 /**
  * Internals of DBusPreallocatedSend
  */
@@ -231,6 +240,8 @@ struct DBusPreallocatedSend
   DBusConnection *connection; /**< Connection we'd send the message to */
   DBusList *queue_link;       /**< Preallocated link in the queue */
   DBusList *counter_link;     /**< Preallocated link in the resource counter */
+  DBusPreallocatedHash *sender_entry; /**< Preallocated entry in outgoing_senders, if tracked */
+  DBusSenderSize *sender_size;        /**< Preallocated size for a sender not queued yet, if tracked */
 };
 
 #ifdef HAVE_DECL_MSG_NOSIGNAL
@@ -264,6 +275,9 @@ struct DBusConnection
   int n_incoming;              /**< Length of incoming queue. */
 
   DBusCounter *outgoing_counter; /**< Counts size of outgoing messages. */
+  DBusHashTable *outgoing_senders; /**< Maps sender to #DBusSenderSize, #NULL unless
+                                    *   _dbus_connection_track_outgoing_senders() was called
+                                    */
   
   DBusTransport *transport;    /**< Object that sends/receives messages over network. */
   DBusWatchList *watches;      /**< Stores active watches. */
@@ -289,9 +303,18 @@ struct DBusConnection
 
   DBusDispatchStatus last_dispatch_status; /**< The last dispatch status we reported to the application. */
 
+  DBusBodyStreamFunction body_stream_function; /**< Function for pieces of streamed bodies */
+  void *body_stream_data; /**< Application data for body_stream_function */
+  DBusFreeFunction free_body_stream_data; /**< free body_stream_data */
+
   DBusList *link_cache; /**< A cache of linked list links to prevent contention
                          *   for the global linked list mempool lock
                          */
+  DBusPreallocatedSend *spare_preallocated; /**< A used preallocated send kept to
+                                             *   be filled again, so senders that
+                                             *   preallocate for every message
+                                             *   (like the bus) don't malloc
+                                             */
   DBusObjectTree *objects; /**< Object path handlers registered with this connection */
 
   char *server_guid; /**< GUID of server if we are in shared_connections, #NULL if server GUID is unknown or connection is private */
@@ -575,6 +598,100 @@ dbus_connection_has_messages_to_send (DBusConnection *connection)
   return v;
 }
 
+/* Returns the message's sender if it is counted in outgoing_senders */
+static const char *
+get_tracked_sender (DBusConnection *connection,
+                    DBusMessage    *message)
+{
+  const char *sender;
+
+  if (connection->outgoing_senders == NULL)
+    return NULL;
+
+  sender = dbus_message_get_sender (message);
+  if (sender == NULL || strlen (sender) > DBUS_MAXIMUM_NAME_LENGTH)
+    return NULL;
+
+  return sender;
+}
+
+/* Counts a newly queued message against its sender, using the
+ * preallocated entry if this is the sender's first queued message
+ */
+static void
+sender_size_add_message_unlocked (DBusConnection       *connection,
+                                  DBusPreallocatedSend *preallocated,
+                                  DBusMessage          *message)
+{
+  DBusSenderSize *sender_size;
+  const char *sender;
+
+  HAVE_LOCK_CHECK (connection);
+
+  sender = get_tracked_sender (connection, message);
+  if (sender == NULL)
+    return;
+
+  sender_size = _dbus_hash_table_lookup_string (connection->outgoing_senders,
+                                                sender);
+  if (sender_size == NULL)
+    {
+      _dbus_assert (preallocated->sender_entry != NULL);
+      _dbus_assert (preallocated->sender_size != NULL);
+
+      sender_size = preallocated->sender_size;
+      preallocated->sender_size = NULL;
+
+      strcpy (sender_size->sender, sender);
+      sender_size->size = 0;
+
+      _dbus_hash_table_insert_string_preallocated (connection->outgoing_senders,
+                                                   preallocated->sender_entry,
+                                                   sender_size->sender,
+                                                   sender_size);
+      preallocated->sender_entry = NULL;
+    }
+
+  sender_size->size += message->size_counter_delta;
+}
+
+/* Stops counting a message that left the queue against its sender */
+static void
+sender_size_remove_message_unlocked (DBusConnection *connection,
+                                     DBusMessage    *message)
+{
+  DBusSenderSize *sender_size;
+  const char *sender;
+
+  HAVE_LOCK_CHECK (connection);
+
+  sender = get_tracked_sender (connection, message);
+  if (sender == NULL)
+    return;
+
+  sender_size = _dbus_hash_table_lookup_string (connection->outgoing_senders,
+                                                sender);
+  _dbus_assert (sender_size != NULL);
+  _dbus_assert (sender_size->size >= message->size_counter_delta);
+
+  sender_size->size -= message->size_counter_delta;
+
+  if (sender_size->size == 0)
+    _dbus_hash_table_remove_string (connection->outgoing_senders, sender);
+}
+
+/* Frees a preallocated send whose links were used or freed already */
+static void
+free_preallocated_unlocked (DBusConnection       *connection,
+                            DBusPreallocatedSend *preallocated)
+{
+  if (preallocated->sender_entry != NULL)
+    _dbus_hash_table_free_preallocated_entry (connection->outgoing_senders,
+                                              preallocated->sender_entry);
+  dbus_free (preallocated->sender_size);
+  dbus_free (preallocated);
+}
+
 /**
  * Gets the next outgoing message. The message remains in the
  * queue, and the caller does not own a reference to it.
@@ -637,6 +754,8 @@ _dbus_connection_message_sent (DBusConnection *connection,
                  dbus_message_get_signature (message),
                  connection, connection->n_outgoing);
 
+  sender_size_remove_message_unlocked (connection, message);
+
   /* Save this link in the link cache also */
   _dbus_message_remove_counter (message, connection->outgoing_counter,
                                 &link);
@@ -645,6 +764,74 @@ _dbus_connection_message_sent (DBusConnection *connection,
   dbus_message_unref (message);
 }
 
+/**
+ * Starts counting the bytes queued on the connection from each
+ * sender, so _dbus_connection_get_outgoing_size_for_sender() can
+ * answer. Must be called before anything is sent on the connection.
+ * Once this is on, preallocating a send also preallocates room for
+ * one more sender.
+ *
+ * @param connection the connection
+ * @returns #FALSE if no memory
+ */
+dbus_bool_t
+_dbus_connection_track_outgoing_senders (DBusConnection *connection)
+{
+  dbus_bool_t retval;
+
+  CONNECTION_LOCK (connection);
+
+  _dbus_assert (connection->n_outgoing == 0);
+
+  if (connection->outgoing_senders == NULL)
+    connection->outgoing_senders = _dbus_hash_table_new (DBUS_HASH_STRING,
+                                                         NULL, dbus_free);
+
+  retval = connection->outgoing_senders != NULL;
+
+  CONNECTION_UNLOCK (connection);
+
+  return retval;
+}
+
+/**
+ * Gets the size in bytes of the messages in the outgoing queue that
+ * carry the given sender, counted the same way as
+ * dbus_connection_get_outgoing_size(). This is a hash lookup, e.g.
+ * for the message bus deciding whether one sender is taking more
+ * than its share of a slow recipient's queue.
+ *
+ * @param connection the connection
+ * @param sender the sender field to look for
+ * @returns the number of bytes queued from that sender, or 0 if
+ *   _dbus_connection_track_outgoing_senders() was not called
+ */
+long
+_dbus_connection_get_outgoing_size_for_sender (DBusConnection *connection,
+                                               const char     *sender)
+{
+  DBusSenderSize *sender_size;
+  long res;
+
+  _dbus_assert (sender != NULL);
+
+  res = 0;
+
+  CONNECTION_LOCK (connection);
+
+  if (connection->outgoing_senders != NULL)
+    {
+      sender_size = _dbus_hash_table_lookup_string (connection->outgoing_senders,
+                                                    sender);
+      if (sender_size != NULL)
+        res = sender_size->size;
+    }
+
+  CONNECTION_UNLOCK (connection);
+
+  return res;
+}
+
 /** Function to be called in protected_change_watch() with refcount held */
 typedef dbus_bool_t (* DBusWatchAddFunction)     (DBusWatchList *list,
                                                   DBusWatch     *watch);
@@ -1756,12 +1943,13 @@ connection_forget_shared_unlocked (DBusConnection *connection)
 
 static DBusConnection*
 connection_try_from_address_entry (DBusAddressEntry *entry,
+                                   dbus_bool_t       nonblocking,
                                    DBusError        *error)
 {
   DBusTransport *transport;
   DBusConnection *connection;
 
-  transport = _dbus_transport_open (entry, error);
+  transport = _dbus_transport_open (entry, nonblocking, error);
 
   if (transport == NULL)
     {
@@ -1792,14 +1980,19 @@ connection_try_from_address_entry (DBusAddressEntry *entry,
  * connection will always be created, and the new connection will
  * never be returned to other callers.
  *
+ * If the nonblocking parameter is true, the connection may be
+ * returned before the underlying connect() has completed.
+ *
  * @param address the address
  * @param shared whether the connection is shared or private
+ * @param nonblocking whether to avoid waiting for connect() to complete
  * @param error error return
  * @returns the connection or #NULL on error
  */
 static DBusConnection*
 _dbus_connection_open_internal (const char     *address,
                                 dbus_bool_t     shared,
+                                dbus_bool_t     nonblocking,
                                 DBusError      *error)
 {
   DBusConnection *connection;
@@ -1831,6 +2024,7 @@ _dbus_connection_open_internal (const char     *address,
       if (connection == NULL)
         {
           connection = connection_try_from_address_entry (entries[i],
+                                                          nonblocking,
                                                           &tmp_error);
 
           if (connection != NULL && shared)
@@ -1909,9 +2103,32 @@ _dbus_connection_preallocate_send_unlocked (DBusConnection *connection)
   
   _dbus_assert (connection != NULL);
   
-  preallocated = dbus_new (DBusPreallocatedSend, 1);
-  if (preallocated == NULL)
-    return NULL;
+  if (connection->spare_preallocated != NULL)
+    {
+      preallocated = connection->spare_preallocated;
+      connection->spare_preallocated = NULL;
+    }
+  else
+    {
+      preallocated = dbus_new0 (DBusPreallocatedSend, 1);
+      if (preallocated == NULL)
+        return NULL;
+    }
+
+  /* A spare may still hold these if its message's sender was queued already */
+  if (connection->outgoing_senders != NULL)
+    {
+      if (preallocated->sender_entry == NULL)
+        preallocated->sender_entry =
+          _dbus_hash_table_preallocate_entry (connection->outgoing_senders);
+
+      if (preallocated->sender_size == NULL)
+        preallocated->sender_size = dbus_new (DBusSenderSize, 1);
+
+      if (preallocated->sender_entry == NULL ||
+          preallocated->sender_size == NULL)
+        goto failed_0;
+    }
 
   if (connection->link_cache != NULL)
     {
@@ -1948,7 +2165,7 @@ _dbus_connection_preallocate_send_unlocked (DBusConnection *connection)
  failed_1:
   _dbus_list_free_link (preallocated->queue_link);
  failed_0:
-  dbus_free (preallocated);
+  free_preallocated_unlocked (connection, preallocated);
   
   return NULL;
 }
@@ -1970,7 +2187,12 @@ _dbus_connection_send_preallocated_unlocked_no_update (DBusConnection       *con
   _dbus_message_add_counter_link (message,
                                   preallocated->counter_link);
 
-  dbus_free (preallocated);
+  sender_size_add_message_unlocked (connection, preallocated, message);
+
+  if (connection->spare_preallocated == NULL)
+    connection->spare_preallocated = preallocated;
+  else
+    free_preallocated_unlocked (connection, preallocated);
   preallocated = NULL;
   
   dbus_message_ref (message);
@@ -2381,7 +2603,7 @@ _dbus_connection_block_pending_call (DBusPendingCall *pending)
   if (timeout)
     {
       timeout_milliseconds = dbus_timeout_get_interval (timeout);
-      _dbus_get_current_time (&start_tv_sec, &start_tv_usec);
+      _dbus_get_monotonic_time (&start_tv_sec, &start_tv_usec);
 
       _dbus_verbose ("dbus_connection_send_with_reply_and_block(): will block %d milliseconds for reply serial %u from %ld sec %ld usec\n",
                      timeout_milliseconds,
@@ -2435,7 +2657,7 @@ _dbus_connection_block_pending_call (DBusPendingCall *pending)
         return;
     }
   
-  _dbus_get_current_time (&tv_sec, &tv_usec);
+  _dbus_get_monotonic_time (&tv_sec, &tv_usec);
   elapsed_milliseconds = (tv_sec - start_tv_sec) * 1000 +
 	  (tv_usec - start_tv_usec) / 1000;
   
@@ -2569,6 +2791,7 @@ dbus_connection_open (const char     *address,
 
   connection = _dbus_connection_open_internal (address,
                                                TRUE,
+                                               FALSE,
                                                error);
 
   return connection;
@@ -2612,6 +2835,73 @@ dbus_connection_open_private (const char     *address,
 
   connection = _dbus_connection_open_internal (address,
                                                FALSE,
+                                               FALSE,
+                                               error);
+
+  return connection;
+}
+
+/**
+ * Like dbus_connection_open(), but returns without waiting for the
+ * connection to the remote address to be established. The connection
+ * is returned in a connecting state; connecting and then
+ * authenticating are driven by the main loop (see
+ * dbus_connection_set_watch_functions()) or by any blocking call on
+ * the connection, such as dbus_connection_flush().
+ *
+ * Messages may be queued with dbus_connection_send() immediately;
+ * they are written once authentication completes, so for example
+ * dbus_bus_register_async() can be used to pipeline the Hello call
+ * behind authentication.
+ *
+ * If the connection cannot be established, the connection is
+ * disconnected later rather than the error being returned here.
+ * Only TCP addresses without a nonce file actually avoid blocking;
+ * connecting to a local socket never involves a network round trip.
+ * The host name lookup for TCP addresses is still synchronous.
+ *
+ * @param address the address.
+ * @param error address where an error can be returned.
+ * @returns new connection, or #NULL on failure.
+ */
+DBusConnection*
+dbus_connection_open_async (const char     *address,
+                            DBusError      *error)
+{
+  DBusConnection *connection;
+
+  _dbus_return_val_if_fail (address != NULL, NULL);
+  _dbus_return_val_if_error_is_set (error, NULL);
+
+  connection = _dbus_connection_open_internal (address,
+                                               TRUE,
+                                               TRUE,
+                                               error);
+
+  return connection;
+}
+
+/**
+ * Like dbus_connection_open_private(), but returns without waiting
+ * for the connection to the remote address to be established. See
+ * dbus_connection_open_async() for details.
+ *
+ * @param address the address.
+ * @param error address where an error can be returned.
+ * @returns new connection, or #NULL on failure.
+ */
+DBusConnection*
+dbus_connection_open_private_async (const char     *address,
+                                    DBusError      *error)
+{
+  DBusConnection *connection;
+
+  _dbus_return_val_if_fail (address != NULL, NULL);
+  _dbus_return_val_if_error_is_set (error, NULL);
+
+  connection = _dbus_connection_open_internal (address,
+                                               FALSE,
+                                               TRUE,
                                                error);
 
   return connection;
@@ -2671,6 +2961,7 @@ _dbus_connection_last_unref (DBusConnection *connection)
   
   dbus_connection_set_dispatch_status_function (connection, NULL, NULL, NULL);
   dbus_connection_set_wakeup_main_function (connection, NULL, NULL, NULL);
+  dbus_connection_set_body_stream_function (connection, 0, NULL, NULL, NULL);
   dbus_connection_set_unix_user_function (connection, NULL, NULL, NULL);
   
   _dbus_watch_list_free (connection->watches);
@@ -2726,6 +3017,11 @@ _dbus_connection_last_unref (DBusConnection *connection)
     }
 
   _dbus_list_clear (&connection->link_cache);
+  if (connection->spare_preallocated != NULL)
+    free_preallocated_unlocked (connection, connection->spare_preallocated);
+
+  if (connection->outgoing_senders != NULL)
+    _dbus_hash_table_unref (connection->outgoing_senders);
   
   _dbus_condvar_free_at_location (&connection->dispatch_cond);
   _dbus_condvar_free_at_location (&connection->io_path_cond);
@@ -3141,7 +3437,10 @@ dbus_connection_free_preallocated_send (DBusConnection       *connection,
   _dbus_list_free_link (preallocated->queue_link);
   _dbus_counter_unref (preallocated->counter_link->data);
   _dbus_list_free_link (preallocated->counter_link);
-  dbus_free (preallocated);
+
+  CONNECTION_LOCK (connection);
+  free_preallocated_unlocked (connection, preallocated);
+  CONNECTION_UNLOCK (connection);
 }
 
 /**
@@ -3803,6 +4102,34 @@ check_disconnected_message_arrived_unlocked (DBusConnection *connection,
     }
 }
 
+/* Pieces of a streamed body are only for the body stream function,
+ * which only dispatching calls; their body is not a marshaled body
+ * and must not reach code that would read it as one. Drops any at
+ * the head of the incoming queue.
+ */
+static void
+drop_body_stream_chunks_unlocked (DBusConnection *connection)
+{
+  HAVE_LOCK_CHECK (connection);
+
+  while (connection->n_incoming > 0)
+    {
+      DBusMessage *message;
+
+      message = _dbus_list_get_first (&connection->incoming_messages);
+      if (!message->stream_chunk)
+        break;
+
+      _dbus_list_pop_first (&connection->incoming_messages);
+      connection->n_incoming -= 1;
+
+      _dbus_verbose ("Dropping streamed body piece %p, it can only be dispatched\n",
+                     message);
+
+      dbus_message_unref (message);
+    }
+}
+
 /**
  * Returns the first-received message from the incoming message queue,
  * leaving it in the queue. If the queue is empty, returns #NULL.
@@ -3846,6 +4173,8 @@ dbus_connection_borrow_message (DBusConnection *connection)
   /* While a message is outstanding, the dispatch lock is held */
   _dbus_assert (connection->message_borrowed == NULL);
 
+  drop_body_stream_chunks_unlocked (connection);
+
   connection->message_borrowed = _dbus_list_get_first (&connection->incoming_messages);
   
   message = connection->message_borrowed;
@@ -4067,7 +4396,9 @@ dbus_connection_pop_message (DBusConnection *connection)
   CONNECTION_LOCK (connection);
   _dbus_connection_acquire_dispatch (connection);
   HAVE_LOCK_CHECK (connection);
-  
+
+  drop_body_stream_chunks_unlocked (connection);
+
   message = _dbus_connection_pop_message_unlocked (connection);
 
   _dbus_verbose ("Returning popped message %p\n", message);    
@@ -4517,6 +4848,8 @@ dbus_connection_dispatch (DBusConnection *connection)
   DBusPendingCall *pending;
   dbus_int32_t reply_serial;
   DBusDispatchStatus status;
+  const unsigned char *stream_data;
+  int stream_n_bytes, stream_offset, stream_total;
 
   _dbus_return_val_if_fail (connection != NULL, DBUS_DISPATCH_COMPLETE);
 
@@ -4571,6 +4904,42 @@ dbus_connection_dispatch (DBusConnection *connection)
                  dbus_message_get_signature (message));
 
   result = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  /* Pieces of a streamed body are never replies and are not messages
+   * filters or handlers could make sense of
+   */
+  if (_dbus_message_get_body_stream_chunk (message, &stream_data,
+                                           &stream_n_bytes, &stream_offset,
+                                           &stream_total))
+    {
+      DBusBodyStreamFunction function;
+      void *user_data;
+
+      function = connection->body_stream_function;
+      user_data = connection->body_stream_data;
+
+      if (function != NULL)
+        {
+          /* We're still protected from dispatch() reentrancy here
+           * since we acquired the dispatcher
+           */
+          CONNECTION_UNLOCK (connection);
+
+          _dbus_verbose ("  streaming %d bytes at %d of %d\n",
+                         stream_n_bytes, stream_offset, stream_total);
+          (* function) (connection, message, stream_data, stream_n_bytes,
+                        stream_offset, stream_total, user_data);
+
+          CONNECTION_LOCK (connection);
+        }
+      else
+        {
+          _dbus_verbose ("  dropping streamed body piece, nobody is streaming\n");
+        }
+
+      result = DBUS_HANDLER_RESULT_HANDLED;
+      goto out;
+    }
   
   /* Pending call handling must be first, because if you do
    * dbus_connection_send_with_reply_and_block() or
@@ -5392,6 +5761,38 @@ dbus_connection_set_allow_anonymous (DBusConnection             *connection,
   CONNECTION_UNLOCK (connection);
 }
 
+/**
+ * This function may be called on the client side of a connection
+ * right after opening it, before any I/O has been done. If set to
+ * #TRUE (the default is #FALSE), and the EXTERNAL mechanism is the
+ * one being tried, the client sends BEGIN right behind its AUTH
+ * command and starts writing queued messages (such as the bus Hello)
+ * without waiting a round trip for the server to accept it.
+ *
+ * This saves one round trip per connection, but the client can no
+ * longer fall back to another mechanism: if the server rejects
+ * EXTERNAL the connection is simply disconnected. Messages are also
+ * written before the server GUID has been checked against the
+ * address, and messages carrying unix fds are held back until unix
+ * fd passing has been negotiated.
+ *
+ * Has no effect on the server side of a connection, or once the
+ * server has answered the initial AUTH.
+ *
+ * @param connection the connection
+ * @param value whether to pipeline the authentication handshake
+ */
+void
+dbus_connection_set_pipelined_auth (DBusConnection             *connection,
+                                    dbus_bool_t                 value)
+{
+  _dbus_return_if_fail (connection != NULL);
+  
+  CONNECTION_LOCK (connection);
+  _dbus_transport_set_pipelined_auth (connection->transport, value);
+  CONNECTION_UNLOCK (connection);
+}
+
 /**
  *
  * Normally #DBusConnection automatically handles all messages to the
@@ -6170,6 +6571,73 @@ dbus_connection_get_max_received_unix_fds (DBusConnection *connection)
   return res;
 }
 
+/**
+ * Asks for the body of large messages to be handed over piece by
+ * piece as it arrives, rather than buffered and dispatched whole. This
+ * keeps the memory used by the connection bounded no matter how large
+ * the messages are, and lets the application process the data while
+ * the rest of it is still being received.
+ *
+ * Only method calls and signals whose signature is "ay" and whose body
+ * is at least min_body_size bytes long are streamed; all other
+ * messages are dispatched as usual. The array length is checked
+ * before the first piece is delivered, and a sender claiming the
+ * wrong length is disconnected like for any other invalid message.
+ *
+ * dbus_connection_dispatch() calls the function for each piece in
+ * order, in place of running filters and object path handlers, with
+ * the offset of the piece in the array and the length of the whole
+ * array; the last piece ends at that length. The message passed to
+ * the function has the header of the streamed message, so it can be
+ * used to check the member or to create a reply, but its body holds
+ * only the piece and must not be read with iterators or
+ * dbus_message_get_args(). Streamed messages are only delivered
+ * through dispatching: dbus_connection_pop_message() and
+ * dbus_connection_borrow_message() drop the pieces.
+ *
+ * Passing a #NULL function or a min_body_size of 0 turns streaming off
+ * again. Pieces of a message that started streaming before that are
+ * dropped.
+ *
+ * @param connection the connection
+ * @param min_body_size the smallest body to stream, in bytes
+ * @param function function to call with each piece of a streamed body
+ * @param user_data data to pass to the function
+ * @param free_data_function function to free the user data, or #NULL
+ */
+void
+dbus_connection_set_body_stream_function (DBusConnection         *connection,
+                                          long                    min_body_size,
+                                          DBusBodyStreamFunction  function,
+                                          void                   *user_data,
+                                          DBusFreeFunction        free_data_function)
+{
+  void *old_data;
+  DBusFreeFunction old_free_data;
+
+  _dbus_return_if_fail (connection != NULL);
+  _dbus_return_if_fail (min_body_size >= 0);
+
+  if (function == NULL)
+    min_body_size = 0;
+
+  CONNECTION_LOCK (connection);
+  old_data = connection->body_stream_data;
+  old_free_data = connection->free_body_stream_data;
+
+  connection->body_stream_function = function;
+  connection->body_stream_data = user_data;
+  connection->free_body_stream_data = free_data_function;
+
+  _dbus_transport_set_body_stream_threshold (connection->transport,
+                                             min_body_size);
+  CONNECTION_UNLOCK (connection);
+
+  /* Callback outside the lock */
+  if (old_free_data)
+    (*old_free_data) (old_data);
+}
+
 /**
  * Gets the approximate size in bytes of all messages in the outgoing
  * message queue. The size is approximate in that you shouldn't use
@@ -168,6 +168,20 @@ typedef void (* DBusPendingCallNotifyFunction) (DBusPendingCall *pending,
 typedef DBusHandlerResult (* DBusHandleMessageFunction) (DBusConnection     *connection,
                                                          DBusMessage        *message,
                                                          void               *user_data);
+
+/**
+ * Called with each piece of a large byte array body as it arrives,
+ * in order. The message has the header of the streamed message but
+ * its body must not be read. Set with
+ * dbus_connection_set_body_stream_function().
+ */
+typedef void (* DBusBodyStreamFunction) (DBusConnection      *connection,
+                                         DBusMessage         *message,
+                                         const unsigned char *data,
+                                         int                  n_bytes,
+                                         int                  offset,
+                                         int                  total,
+                                         void                *user_data);
 DBUS_EXPORT
 DBusConnection*    dbus_connection_open                         (const char                 *address,
                                                                  DBusError                  *error);
@@ -175,6 +189,12 @@ DBUS_EXPORT
 DBusConnection*    dbus_connection_open_private                 (const char                 *address,
                                                                  DBusError                  *error);
 DBUS_EXPORT
+DBusConnection*    dbus_connection_open_async                   (const char                 *address,
+                                                                 DBusError                  *error);
+DBUS_EXPORT
+DBusConnection*    dbus_connection_open_private_async           (const char                 *address,
+                                                                 DBusError                  *error);
+DBUS_EXPORT
 DBusConnection*    dbus_connection_ref                          (DBusConnection             *connection);
 DBUS_EXPORT
 void               dbus_connection_unref                        (DBusConnection             *connection);
@@ -287,6 +307,9 @@ DBUS_EXPORT
 void               dbus_connection_set_allow_anonymous          (DBusConnection             *connection,
                                                                  dbus_bool_t                 value);
 DBUS_EXPORT
+void               dbus_connection_set_pipelined_auth           (DBusConnection             *connection,
+                                                                 dbus_bool_t                 value);
+DBUS_EXPORT
 void               dbus_connection_set_route_peer_messages      (DBusConnection             *connection,
                                                                  dbus_bool_t                 value);
 
@@ -343,6 +366,13 @@ void dbus_connection_set_max_received_unix_fds(DBusConnection *connection,
 DBUS_EXPORT
 long dbus_connection_get_max_received_unix_fds(DBusConnection *connection);
 
+DBUS_EXPORT
+void dbus_connection_set_body_stream_function (DBusConnection         *connection,
+                                               long                    min_body_size,
+                                               DBusBodyStreamFunction  function,
+                                               void                   *user_data,
+                                               DBusFreeFunction        free_data_function);
+
 DBUS_EXPORT
 long dbus_connection_get_outgoing_size     (DBusConnection *connection);
 DBUS_EXPORT
@@ -32,6 +32,7 @@
 #include "dbus-sysdeps-unix.h"
 
 #include <sys/stat.h>
+#include <sys/file.h>
 #include <stdio.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -387,6 +388,155 @@ _dbus_create_file_exclusively (const DBusString *filename,
   return TRUE;
 }
 
+/**
+ * Creates a lock file, failing if the file already exists, like
+ * _dbus_create_file_exclusively(). The file is kept open and flock()ed
+ * until _dbus_release_lock_file(), so that anyone waiting for it in
+ * _dbus_wait_for_lock_file() wakes up as soon as it is released.
+ *
+ * @param filename the filename
+ * @param fd_p return location for the lock file descriptor
+ * @param error error location
+ * @returns #TRUE if we created the file and it didn't exist
+ */
+dbus_bool_t
+_dbus_create_lock_file (const DBusString *filename,
+                        int              *fd_p,
+                        DBusError        *error)
+{
+  int fd;
+  const char *filename_c;
+
+  _DBUS_ASSERT_ERROR_IS_CLEAR (error);
+
+  filename_c = _dbus_string_get_const_data (filename);
+
+  fd = open (filename_c, O_WRONLY | O_BINARY | O_EXCL | O_CREAT,
+             0600);
+  if (fd < 0)
+    {
+      dbus_set_error (error,
+                      _dbus_error_from_errno (errno),
+                      "Could not create file %s: %s\n",
+                      filename_c,
+                      _dbus_strerror (errno));
+      return FALSE;
+    }
+
+  _dbus_fd_set_close_on_exec (fd);
+
+  /* Nobody else can have the new file locked yet. If the filesystem
+   * doesn't do flock(), waiters just fall back to polling.
+   */
+  if (flock (fd, LOCK_EX | LOCK_NB) < 0)
+    _dbus_verbose ("Could not flock() %s: %s\n",
+                   filename_c, _dbus_strerror (errno));
+
+  _dbus_verbose ("lock file fd %d opened\n", fd);
+
+  *fd_p = fd;
+  return TRUE;
+}
+
+/**
+ * Releases a lock file created with _dbus_create_lock_file(), deleting
+ * it and waking up anyone waiting for it.
+ *
+ * @param filename the filename
+ * @param fd the lock file descriptor
+ * @param error error location
+ * @returns #TRUE if the lock file was deleted
+ */
+dbus_bool_t
+_dbus_release_lock_file (const DBusString *filename,
+                         int               fd,
+                         DBusError        *error)
+{
+  dbus_bool_t retval;
+
+  _DBUS_ASSERT_ERROR_IS_CLEAR (error);
+
+  /* Delete before unlocking, so a waiter that wakes up finds
+   * the name free
+   */
+  retval = _dbus_delete_file (filename, error);
+
+  _dbus_close (fd, NULL);
+
+  return retval;
+}
+
+/** How often _dbus_wait_for_lock_file() checks whether the lock is gone */
+#define LOCK_POLL_MILLISECONDS 10
+
+/**
+ * Waits at most timeout_milliseconds for the holder of a lock file
+ * created by _dbus_create_lock_file() to release it. Returns #TRUE
+ * as soon as it has been released; otherwise returns #FALSE once the
+ * whole timeout has passed, also when the lock file isn't held that
+ * way, for example because it was left behind by a process that
+ * crashed, was created by an older version that doesn't flock() it,
+ * or lives on a filesystem without flock().
+ *
+ * The flock() is only ever tried without blocking, so a holder that
+ * is stopped or stuck can't keep the caller waiting past the timeout.
+ *
+ * @param filename the filename
+ * @param timeout_milliseconds how long to wait
+ * @returns #TRUE if the lock file was released and can be retried now
+ */
+dbus_bool_t
+_dbus_wait_for_lock_file (const DBusString *filename,
+                          int               timeout_milliseconds)
+{
+  int fd;
+  int waited;
+  struct stat sb;
+  dbus_bool_t released;
+
+  released = FALSE;
+  waited = 0;
+
+  /* If it's gone already, whatever kept us from creating it wasn't
+   * the lock being held; that is the caller's problem to report.
+   */
+  fd = open (_dbus_string_get_const_data (filename), O_RDONLY | O_BINARY);
+  if (fd < 0)
+    goto out;
+
+  _dbus_fd_set_close_on_exec (fd);
+
+  while (TRUE)
+    {
+      if (flock (fd, LOCK_SH | LOCK_NB) == 0)
+        {
+          /* If the holder released it properly the file is gone by
+           * now; if it's still there, nobody held the flock in the
+           * first place
+           */
+          released = fstat (fd, &sb) == 0 && sb.st_nlink == 0;
+          break;
+        }
+
+      if (errno != EINTR && !_dbus_get_is_errno_eagain_or_ewouldblock ())
+        break;
+
+      if (waited >= timeout_milliseconds)
+        break;
+
+      _dbus_sleep_milliseconds (LOCK_POLL_MILLISECONDS);
+      waited += LOCK_POLL_MILLISECONDS;
+    }
+
+  _dbus_close (fd, NULL);
+
+ out:
+  if (!released && waited < timeout_milliseconds)
+    _dbus_sleep_milliseconds (timeout_milliseconds - waited);
+
+  return released;
+}
+
 /**
  * Deletes the given file.
  *
@@ -402,3 +402,54 @@ _dbus_create_file_exclusively (const DBusString *filename,
   return TRUE;
 }
 
+
+/**
+ * Creates a lock file, failing if the file already exists. There is
+ * no way to wait for a lock file here, so this is just
+ * _dbus_create_file_exclusively().
+ *
+ * @param filename the filename
+ * @param fd_p return location for the lock file descriptor, always -1
+ * @param error error location
+ * @returns #TRUE if we created the file and it didn't exist
+ */
+dbus_bool_t
+_dbus_create_lock_file (const DBusString *filename,
+                        int              *fd_p,
+                        DBusError        *error)
+{
+  *fd_p = -1;
+  return _dbus_create_file_exclusively (filename, error);
+}
+
+/**
+ * Releases a lock file created with _dbus_create_lock_file().
+ *
+ * @param filename the filename
+ * @param fd the lock file descriptor
+ * @param error error location
+ * @returns #TRUE if the lock file was deleted
+ */
+dbus_bool_t
+_dbus_release_lock_file (const DBusString *filename,
+                         int               fd,
+                         DBusError        *error)
+{
+  return _dbus_delete_file (filename, error);
+}
+
+/**
+ * Waits for a lock file to be released. Not supported here, so this
+ * just sleeps for the whole timeout.
+ *
+ * @param filename the filename
+ * @param timeout_milliseconds how long to wait
+ * @returns #FALSE
+ */
+dbus_bool_t
+_dbus_wait_for_lock_file (const DBusString *filename,
+                          int               timeout_milliseconds)
+{
+  _dbus_sleep_milliseconds (timeout_milliseconds);
+  return FALSE;
+}
@@ -55,6 +55,14 @@ dbus_bool_t    _dbus_create_file_exclusively (const DBusString *filename,
                                               DBusError        *error);
 dbus_bool_t    _dbus_delete_file             (const DBusString *filename,
                                               DBusError        *error);
+dbus_bool_t    _dbus_create_lock_file        (const DBusString *filename,
+                                              int              *fd_p,
+                                              DBusError        *error);
+dbus_bool_t    _dbus_release_lock_file       (const DBusString *filename,
+                                              int               fd,
+                                              DBusError        *error);
+dbus_bool_t    _dbus_wait_for_lock_file      (const DBusString *filename,
+                                              int               timeout_milliseconds);
                                               
 /** @} */
 
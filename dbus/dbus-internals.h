@@ -319,17 +319,20 @@ _DBUS_DECLARE_GLOBAL_LOCK (bus_datas);
 _DBUS_DECLARE_GLOBAL_LOCK (shutdown_funcs);
 _DBUS_DECLARE_GLOBAL_LOCK (system_users);
 _DBUS_DECLARE_GLOBAL_LOCK (message_cache);
-/* 10-14 */
+/* 10-15 */
 _DBUS_DECLARE_GLOBAL_LOCK (shared_connections);
 _DBUS_DECLARE_GLOBAL_LOCK (win_fds);
 _DBUS_DECLARE_GLOBAL_LOCK (sid_atom_cache);
 _DBUS_DECLARE_GLOBAL_LOCK (machine_uuid);
+_DBUS_DECLARE_GLOBAL_LOCK (keyrings);
+/* 15-20 */
+_DBUS_DECLARE_GLOBAL_LOCK (compiled_signatures);
 
 #if !DBUS_USE_SYNC
 _DBUS_DECLARE_GLOBAL_LOCK (atomic);
-#define _DBUS_N_GLOBAL_LOCKS (15)
+#define _DBUS_N_GLOBAL_LOCKS (17)
 #else
-#define _DBUS_N_GLOBAL_LOCKS (14)
+#define _DBUS_N_GLOBAL_LOCKS (16)
 #endif
 
 dbus_bool_t _dbus_threads_init_debug (void);
@@ -119,6 +119,15 @@ struct DBusKeyring
   DBusCredentials *credentials; /**< Credentials containing user the keyring is for */
 };
 
+/* Keyrings are shared by everyone in the process who uses the same
+ * keyring file, so that authenticating a connection doesn't mean
+ * reading the file again. Keys never change once written, so the file
+ * is only read again when we need a key we don't have. The list holds
+ * no references; keyrings remove themselves when finalized.
+ */
+_DBUS_DEFINE_GLOBAL_LOCK (keyrings);
+static DBusList *keyrings = NULL;
+
 static DBusKeyring*
 _dbus_keyring_new (void)
 {
@@ -187,6 +196,13 @@ free_keys (DBusKey *keys,
  * filesystem is running really slowly.  Stuff might break in corner
  * cases but as long as it's not a security-level breakage it should
  * be OK.
+ *
+ * The lock file itself is what excludes other processes. Holders
+ * also flock() it while they have it, purely so that waiters can
+ * notice within a few milliseconds that it was released instead of
+ * sleeping out a whole timeout; where that doesn't work we poll as
+ * before. Either way each timeout counts towards deciding the lock
+ * is stale.
  */
 
 /** Maximum number of timeouts waiting for lock before we decide it's stale */
@@ -195,7 +211,8 @@ free_keys (DBusKey *keys,
 #define LOCK_TIMEOUT_MILLISECONDS 250
 
 static dbus_bool_t
-_dbus_keyring_lock (DBusKeyring *keyring)
+_dbus_keyring_lock (DBusKeyring *keyring,
+                    int         *lock_fd)
 {
   int n_timeouts;
   
@@ -204,16 +221,34 @@ _dbus_keyring_lock (DBusKeyring *keyring)
     {
       DBusError error = DBUS_ERROR_INIT;
 
-      if (_dbus_create_file_exclusively (&keyring->filename_lock,
-                                         &error))
+      if (_dbus_create_lock_file (&keyring->filename_lock,
+                                  lock_fd, &error))
         break;
 
-      _dbus_verbose ("Did not get lock file, sleeping %d milliseconds (%s)\n",
-                     LOCK_TIMEOUT_MILLISECONDS, error.message);
-      dbus_error_free (&error);
+      /* Only a lock file that exists can be waited for; anything
+       * else, like a read-only home directory, would never be
+       * released, so sleep and count it like a timeout.
+       */
+      if (!dbus_error_has_name (&error, DBUS_ERROR_FILE_EXISTS))
+        {
+          _dbus_verbose ("Could not create lock file, sleeping %d milliseconds\n",
+                         LOCK_TIMEOUT_MILLISECONDS);
+          _dbus_sleep_milliseconds (LOCK_TIMEOUT_MILLISECONDS);
+        }
+      else if (_dbus_wait_for_lock_file (&keyring->filename_lock,
+                                         LOCK_TIMEOUT_MILLISECONDS))
+        {
+          _dbus_verbose ("Lock file was released, trying again\n");
+          dbus_error_free (&error);
+          continue;
+        }
+      else
+        {
+          _dbus_verbose ("Lock file not released within %d milliseconds\n",
+                         LOCK_TIMEOUT_MILLISECONDS);
+        }
 
-      _dbus_sleep_milliseconds (LOCK_TIMEOUT_MILLISECONDS);
-      
+      dbus_error_free (&error);
       ++n_timeouts;
     }
 
@@ -232,8 +267,8 @@ _dbus_keyring_lock (DBusKeyring *keyring)
           return FALSE;
         }
 
-      if (!_dbus_create_file_exclusively (&keyring->filename_lock,
-                                          &error))
+      if (!_dbus_create_lock_file (&keyring->filename_lock,
+                                   lock_fd, &error))
         {
           _dbus_verbose ("Couldn't create lock file after deleting stale one: %s\n",
                          error.message);
@@ -246,11 +281,13 @@ _dbus_keyring_lock (DBusKeyring *keyring)
 }
 
 static void
-_dbus_keyring_unlock (DBusKeyring *keyring)
+_dbus_keyring_unlock (DBusKeyring *keyring,
+                      int          lock_fd)
 {
   DBusError error = DBUS_ERROR_INIT;
 
-  if (!_dbus_delete_file (&keyring->filename_lock, &error))
+  if (!_dbus_release_lock_file (&keyring->filename_lock,
+                                lock_fd, &error))
     {
       _dbus_warn ("Failed to delete lock file: %s\n",
                   error.message);
@@ -277,6 +314,32 @@ find_key_by_id (DBusKey *keys,
   return NULL;
 }
 
+static DBusKey*
+find_recent_key (DBusKey *keys,
+                 int      n_keys)
+{
+  int i;
+  long tv_sec, tv_usec;
+
+  _dbus_get_real_time (&tv_sec, &tv_usec);
+  
+  i = 0;
+  while (i < n_keys)
+    {
+      DBusKey *key = &keys[i];
+
+      _dbus_verbose ("Key %d is %ld seconds old\n",
+                     i, tv_sec - key->creation_time);
+      
+      if ((tv_sec - NEW_KEY_TIMEOUT_SECONDS) < key->creation_time)
+        return key;
+      
+      ++i;
+    }
+
+  return NULL;
+}
+
 static dbus_bool_t
 add_new_key (DBusKey  **keys_p,
              int       *n_keys_p,
@@ -355,7 +418,7 @@ add_new_key (DBusKey  **keys_p,
       goto out;
     }
 
-  _dbus_get_current_time (&timestamp, NULL);
+  _dbus_get_real_time (&timestamp, NULL);
       
   keys[n_keys-1].id = id;
   keys[n_keys-1].creation_time = timestamp;
@@ -387,6 +450,10 @@ add_new_key (DBusKey  **keys_p,
  * lock it, which avoids a lot of lock contention at login time and
  * such.
  *
+ * Called without the keyrings lock, which is only taken to swap in
+ * the new keys, so other threads aren't held up by the file I/O or
+ * by waiting for the lock file.
+ *
  * @param keyring the keyring
  * @param add_new #TRUE to add a new key to the file, expire keys, and resave
  * @param error return location for errors
@@ -401,8 +468,11 @@ _dbus_keyring_reload (DBusKeyring *keyring,
   DBusString line;
   dbus_bool_t retval;
   dbus_bool_t have_lock;
+  int lock_fd;
   DBusKey *keys;
   int n_keys;
+  DBusKey *old_keys;
+  int n_old_keys;
   int i;
   long now;
   DBusError tmp_error;
@@ -429,12 +499,13 @@ _dbus_keyring_reload (DBusKeyring *keyring,
   n_keys = 0;
   retval = FALSE;
   have_lock = FALSE;
+  lock_fd = -1;
 
-  _dbus_get_current_time (&now, NULL);
+  _dbus_get_real_time (&now, NULL);
   
   if (add_new)
     {
-      if (!_dbus_keyring_lock (keyring))
+      if (!_dbus_keyring_lock (keyring, &lock_fd))
         {
           dbus_set_error (error, DBUS_ERROR_FAILED,
                           "Could not lock keyring file to add to it");
@@ -560,7 +631,10 @@ _dbus_keyring_reload (DBusKeyring *keyring,
   _dbus_verbose ("Successfully loaded %d existing keys\n",
                  n_keys);
 
-  if (add_new)
+  /* Someone else may have added a key while we were waiting for
+   * the lock, in which case there's no need for another one
+   */
+  if (add_new && find_recent_key (keys, n_keys) == NULL)
     {
       if (!add_new_key (&keys, &n_keys, error))
         {
@@ -609,18 +683,22 @@ _dbus_keyring_reload (DBusKeyring *keyring,
         goto out;
     }
 
-  if (keyring->keys)
-    free_keys (keyring->keys, keyring->n_keys);
+  /* Swap in the new keys and leave the old ones to be freed below */
+  _DBUS_LOCK (keyrings);
+  old_keys = keyring->keys;
+  n_old_keys = keyring->n_keys;
   keyring->keys = keys;
   keyring->n_keys = n_keys;
-  keys = NULL;
-  n_keys = 0;
+  _DBUS_UNLOCK (keyrings);
+
+  keys = old_keys;
+  n_keys = n_old_keys;
   
   retval = TRUE;  
   
  out:
   if (have_lock)
-    _dbus_keyring_unlock (keyring);
+    _dbus_keyring_unlock (keyring, lock_fd);
   
   if (! ((retval == TRUE && (error == NULL || error->name == NULL)) ||
          (retval == FALSE && (error == NULL || error->name != NULL))))
@@ -651,71 +729,30 @@ _dbus_keyring_reload (DBusKeyring *keyring,
   return retval;
 }
 
-/** @} */ /* end of internals */
-
-/**
- * @addtogroup DBusKeyring
- *
- * @{
- */
-
-/**
- * Increments reference count of the keyring
- *
- * @param keyring the keyring
- * @returns the keyring
- */
-DBusKeyring *
-_dbus_keyring_ref (DBusKeyring *keyring)
+static void
+_dbus_keyring_finalize (DBusKeyring *keyring)
 {
-  keyring->refcount += 1;
+  if (keyring->credentials)
+    _dbus_credentials_unref (keyring->credentials);
 
-  return keyring;
+  _dbus_string_free (&keyring->filename);
+  _dbus_string_free (&keyring->filename_lock);
+  _dbus_string_free (&keyring->directory);
+  free_keys (keyring->keys, keyring->n_keys);
+  dbus_free (keyring);
 }
 
-/**
- * Decrements refcount and finalizes if it reaches
- * zero.
- *
- * @param keyring the keyring
+/* Sets up a keyring object for the given credentials and context,
+ * without loading it or looking in the cache.
  */
-void
-_dbus_keyring_unref (DBusKeyring *keyring)
-{
-  keyring->refcount -= 1;
-
-  if (keyring->refcount == 0)
-    {
-      if (keyring->credentials)
-        _dbus_credentials_unref (keyring->credentials);
-
-      _dbus_string_free (&keyring->filename);
-      _dbus_string_free (&keyring->filename_lock);
-      _dbus_string_free (&keyring->directory);
-      free_keys (keyring->keys, keyring->n_keys);
-      dbus_free (keyring);      
-    }
-}
-
-/**
- * Creates a new keyring that lives in the ~/.dbus-keyrings directory
- * of the given user credentials. If the credentials are #NULL or
- * empty, uses those of the current process.
- *
- * @param username username to get keyring for, or #NULL
- * @param context which keyring to get
- * @param error return location for errors
- * @returns the keyring or #NULL on error
- */
-DBusKeyring*
-_dbus_keyring_new_for_credentials (DBusCredentials  *credentials,
-                                   const DBusString *context,
-                                   DBusError        *error)
+static DBusKeyring*
+keyring_new_uncached (DBusCredentials  *credentials,
+                      const DBusString *context,
+                      DBusError        *error)
 {
   DBusString ringdir;
   DBusKeyring *keyring;
   dbus_bool_t error_set;
-  DBusError tmp_error;
   DBusCredentials *our_credentials;
   
   _DBUS_ASSERT_ERROR_IS_CLEAR (error);
@@ -792,7 +829,199 @@ _dbus_keyring_new_for_credentials (DBusCredentials  *credentials,
   if (!_dbus_string_append (&keyring->filename_lock, ".lock"))
     goto failed;
 
-  /* Reload keyring */
+  _dbus_string_free (&ringdir);
+  
+  return keyring;
+  
+ failed:
+  if (!error_set)
+    dbus_set_error_const (error,
+                          DBUS_ERROR_NO_MEMORY,
+                          NULL);
+  if (our_credentials)
+    _dbus_credentials_unref (our_credentials);
+  if (keyring)
+    _dbus_keyring_finalize (keyring);
+  _dbus_string_free (&ringdir);
+  return NULL;
+}
+
+/* Must be called with the keyrings lock held */
+static DBusKeyring*
+find_cached_keyring (DBusKeyring *like)
+{
+  DBusList *link;
+
+  link = _dbus_list_get_first_link (&keyrings);
+  while (link != NULL)
+    {
+      DBusKeyring *keyring = link->data;
+
+      if (_dbus_string_equal (&keyring->filename, &like->filename) &&
+          _dbus_credentials_same_user (keyring->credentials,
+                                       like->credentials))
+        return keyring;
+
+      link = _dbus_list_get_next_link (&keyrings, link);
+    }
+
+  return NULL;
+}
+
+/* Takes a reference to the cached keyring for the same file as like,
+ * returning TRUE, or otherwise optionally caches like. Only holds the
+ * keyrings lock for the list lookup.
+ */
+static dbus_bool_t
+ref_cached_keyring (DBusKeyring  *like,
+                    dbus_bool_t   add_if_missing,
+                    DBusKeyring **cached_p)
+{
+  DBusKeyring *cached;
+
+  _DBUS_LOCK (keyrings);
+
+  cached = find_cached_keyring (like);
+  if (cached != NULL)
+    cached->refcount += 1;
+  else if (add_if_missing)
+    _dbus_list_append (&keyrings, like); /* if this fails it just isn't shared */
+
+  _DBUS_UNLOCK (keyrings);
+
+  *cached_p = cached;
+  return cached != NULL;
+}
+
+/* Gets the ID of a key recent enough to use, or -1 */
+static int
+get_recent_key_id (DBusKeyring *keyring)
+{
+  DBusKey *key;
+  int id;
+
+  _DBUS_LOCK (keyrings);
+  key = find_recent_key (keyring->keys, keyring->n_keys);
+  id = key ? key->id : -1;
+  _DBUS_UNLOCK (keyrings);
+
+  return id;
+}
+
+/* Appends the hex-encoded key if we have it loaded, setting *found.
+ * Returns FALSE if not enough memory.
+ */
+static dbus_bool_t
+append_hex_key (DBusKeyring *keyring,
+                int          key_id,
+                DBusString  *hex_key,
+                dbus_bool_t *found)
+{
+  DBusKey *key;
+  dbus_bool_t retval;
+
+  _DBUS_LOCK (keyrings);
+
+  key = find_key_by_id (keyring->keys,
+                        keyring->n_keys,
+                        key_id);
+  *found = key != NULL;
+
+  if (key == NULL)
+    retval = TRUE;
+  else
+    retval = _dbus_string_hex_encode (&key->secret, 0,
+                                      hex_key,
+                                      _dbus_string_get_length (hex_key));
+
+  _DBUS_UNLOCK (keyrings);
+
+  return retval;
+}
+
+/** @} */ /* end of internals */
+
+/**
+ * @addtogroup DBusKeyring
+ *
+ * @{
+ */
+
+/**
+ * Increments reference count of the keyring
+ *
+ * @param keyring the keyring
+ * @returns the keyring
+ */
+DBusKeyring *
+_dbus_keyring_ref (DBusKeyring *keyring)
+{
+  _DBUS_LOCK (keyrings);
+  keyring->refcount += 1;
+  _DBUS_UNLOCK (keyrings);
+
+  return keyring;
+}
+
+/**
+ * Decrements refcount and finalizes if it reaches
+ * zero.
+ *
+ * @param keyring the keyring
+ */
+void
+_dbus_keyring_unref (DBusKeyring *keyring)
+{
+  dbus_bool_t last_unref;
+
+  _DBUS_LOCK (keyrings);
+  keyring->refcount -= 1;
+  last_unref = (keyring->refcount == 0);
+
+  if (last_unref)
+    _dbus_list_remove (&keyrings, keyring);
+  _DBUS_UNLOCK (keyrings);
+
+  if (last_unref)
+    _dbus_keyring_finalize (keyring);
+}
+
+/**
+ * Creates a new keyring that lives in the ~/.dbus-keyrings directory
+ * of the given user credentials. If the credentials are #NULL or
+ * empty, uses those of the current process.
+ *
+ * Keyrings are shared within the process, so if someone already has
+ * the same keyring open this returns a new reference to it rather
+ * than loading the file again.
+ *
+ * @param username username to get keyring for, or #NULL
+ * @param context which keyring to get
+ * @param error return location for errors
+ * @returns the keyring or #NULL on error
+ */
+DBusKeyring*
+_dbus_keyring_new_for_credentials (DBusCredentials  *credentials,
+                                   const DBusString *context,
+                                   DBusError        *error)
+{
+  DBusKeyring *keyring;
+  DBusKeyring *cached;
+  DBusError tmp_error;
+
+  _DBUS_ASSERT_ERROR_IS_CLEAR (error);
+
+  keyring = keyring_new_uncached (credentials, context, error);
+  if (keyring == NULL)
+    return NULL;
+
+  if (ref_cached_keyring (keyring, FALSE, &cached))
+    {
+      _dbus_keyring_finalize (keyring);
+      return cached;
+    }
+
+  /* Reload keyring, without the keyrings lock since it may take a while */
   dbus_error_init (&tmp_error);
   if (!_dbus_keyring_reload (keyring, FALSE, &tmp_error))
     {
@@ -814,22 +1043,14 @@ _dbus_keyring_new_for_credentials (DBusCredentials  *credentials,
       dbus_error_free (&tmp_error);
     }
 
-  _dbus_string_free (&ringdir);
-  
-  return keyring;
-  
- failed:
-  if (!error_set)
-    dbus_set_error_const (error,
-                          DBUS_ERROR_NO_MEMORY,
-                          NULL);
-  if (our_credentials)
-    _dbus_credentials_unref (our_credentials);
-  if (keyring)
-    _dbus_keyring_unref (keyring);
-  _dbus_string_free (&ringdir);
-  return NULL;
+  /* Someone else may have loaded the same keyring meanwhile */
+  if (ref_cached_keyring (keyring, TRUE, &cached))
+    {
+      _dbus_keyring_finalize (keyring);
+      return cached;
+    }
 
+  return keyring;
 }
 
 /**
@@ -904,31 +1125,6 @@ _dbus_keyring_validate_context (const DBusString *context)
   return TRUE;
 }
 
-static DBusKey*
-find_recent_key (DBusKeyring *keyring)
-{
-  int i;
-  long tv_sec, tv_usec;
-
-  _dbus_get_current_time (&tv_sec, &tv_usec);
-  
-  i = 0;
-  while (i < keyring->n_keys)
-    {
-      DBusKey *key = &keyring->keys[i];
-
-      _dbus_verbose ("Key %d is %ld seconds old\n",
-                     i, tv_sec - key->creation_time);
-      
-      if ((tv_sec - NEW_KEY_TIMEOUT_SECONDS) < key->creation_time)
-        return key;
-      
-      ++i;
-    }
-
-  return NULL;
-}
-
 /**
  * Gets a recent key to use for authentication.
  * If no recent key exists, creates one. Returns
@@ -944,13 +1140,25 @@ int
 _dbus_keyring_get_best_key (DBusKeyring  *keyring,
                             DBusError    *error)
 {
-  DBusKey *key;
+  DBusError tmp_error;
+  int id;
 
   _DBUS_ASSERT_ERROR_IS_CLEAR (error);
-  
-  key = find_recent_key (keyring);
-  if (key)
-    return key->id;
+
+  id = get_recent_key_id (keyring);
+  if (id >= 0)
+    return id;
+
+  /* Another process may have created one since we last read the
+   * file, which is cheaper to pick up than locking the file.
+   */
+  dbus_error_init (&tmp_error);
+  if (!_dbus_keyring_reload (keyring, FALSE, &tmp_error))
+    dbus_error_free (&tmp_error);
+
+  id = get_recent_key_id (keyring);
+  if (id >= 0)
+    return id;
 
   /* All our keys are too old, or we've never loaded the
    * keyring. Create a new one.
@@ -959,16 +1167,13 @@ _dbus_keyring_get_best_key (DBusKeyring  *keyring,
                              error))
     return -1;
 
-  key = find_recent_key (keyring);
-  if (key)
-    return key->id;
-  else
-    {
-      dbus_set_error_const (error,
-                            DBUS_ERROR_FAILED,
-                            "No recent-enough key found in keyring, and unable to create a new key");
-      return -1;
-    }
+  id = get_recent_key_id (keyring);
+  if (id < 0)
+    dbus_set_error_const (error,
+                          DBUS_ERROR_FAILED,
+                          "No recent-enough key found in keyring, and unable to create a new key");
+
+  return id;
 }
 
 /**
@@ -1003,17 +1208,23 @@ _dbus_keyring_get_hex_key (DBusKeyring       *keyring,
                            int                key_id,
                            DBusString        *hex_key)
 {
-  DBusKey *key;
+  DBusError error = DBUS_ERROR_INIT;
+  dbus_bool_t found;
 
-  key = find_key_by_id (keyring->keys,
-                        keyring->n_keys,
-                        key_id);
-  if (key == NULL)
-    return TRUE; /* had enough memory, so TRUE */
+  if (!append_hex_key (keyring, key_id, hex_key, &found))
+    return FALSE;
+
+  if (found)
+    return TRUE;
+
+  /* Keys are never changed once written, so the only reason to
+   * read the file again is a key we haven't seen yet.
+   */
+  if (!_dbus_keyring_reload (keyring, FALSE, &error))
+    dbus_error_free (&error);
 
-  return _dbus_string_hex_encode (&key->secret, 0,
-                                  hex_key,
-                                  _dbus_string_get_length (hex_key));
+  /* If it's still missing we had enough memory, so TRUE */
+  return append_hex_key (keyring, key_id, hex_key, &found);
 }
 
 /** @} */ /* end of exposed API */
@@ -1021,6 +1232,111 @@ _dbus_keyring_get_hex_key (DBusKeyring       *keyring,
 #ifdef DBUS_BUILD_TESTS
 #include "dbus-test.h"
 #include <stdio.h>
+#ifdef DBUS_UNIX
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#ifdef DBUS_UNIX
+#define N_CONTENDING_CLIENTS 200
+
+/* Lots of processes asking for a key in a keyring that doesn't
+ * exist yet, like clients of a freshly started bus, must agree on a
+ * single new key.
+ */
+static dbus_bool_t
+check_contention (void)
+{
+  DBusString context;
+  DBusKeyring *ring;
+  DBusError error;
+  pid_t children[N_CONTENDING_CLIENTS];
+  dbus_bool_t retval;
+  int i;
+
+  _dbus_string_init_const (&context, "org_freedesktop_dbus_testsuite_contention");
+  dbus_error_init (&error);
+
+  ring = keyring_new_uncached (NULL, &context, &error);
+  _dbus_assert (ring != NULL);
+
+  if (!_dbus_delete_file (&ring->filename, &error))
+    dbus_error_free (&error);
+
+  for (i = 0; i < N_CONTENDING_CLIENTS; i++)
+    {
+      children[i] = fork ();
+      if (children[i] < 0)
+        _dbus_assert_not_reached ("fork failed");
+
+      if (children[i] == 0)
+        {
+          DBusKeyring *child_ring;
+          DBusString hex_key;
+          int id;
+
+          child_ring = _dbus_keyring_new_for_credentials (NULL, &context,
+                                                          &error);
+          if (child_ring == NULL)
+            _exit (1);
+
+          id = _dbus_keyring_get_best_key (child_ring, &error);
+          if (id < 0)
+            _exit (1);
+
+          if (!_dbus_string_init (&hex_key) ||
+              !_dbus_keyring_get_hex_key (child_ring, id, &hex_key) ||
+              _dbus_string_get_length (&hex_key) == 0)
+            _exit (1);
+
+          _exit (0);
+        }
+    }
+
+  retval = TRUE;
+
+  for (i = 0; i < N_CONTENDING_CLIENTS; i++)
+    {
+      int status;
+
+      if (waitpid (children[i], &status, 0) != children[i] ||
+          !WIFEXITED (status) || WEXITSTATUS (status) != 0)
+        {
+          fprintf (stderr, "Contending client %d failed to get a key\n", i);
+          retval = FALSE;
+        }
+    }
+
+  if (!_dbus_keyring_reload (ring, FALSE, &error))
+    {
+      fprintf (stderr, "Could not load contended keyring: %s\n", error.message);
+      dbus_error_free (&error);
+      retval = FALSE;
+    }
+  else if (ring->n_keys != 1)
+    {
+      fprintf (stderr, "%d contending clients created %d keys\n",
+               N_CONTENDING_CLIENTS, ring->n_keys);
+      retval = FALSE;
+    }
+
+  if (_dbus_delete_file (&ring->filename_lock, &error))
+    {
+      fprintf (stderr, "Lock file left behind by contending clients\n");
+      retval = FALSE;
+    }
+  else
+    dbus_error_free (&error);
+
+  if (!_dbus_delete_file (&ring->filename, &error))
+    dbus_error_free (&error);
+
+  _dbus_keyring_finalize (ring);
+
+  return retval;
+}
+#endif /* DBUS_UNIX */
 
 dbus_bool_t
 _dbus_keyring_test (void)
@@ -1028,12 +1344,14 @@ _dbus_keyring_test (void)
   DBusString context;
   DBusKeyring *ring1;
   DBusKeyring *ring2;
+  DBusKeyring *ring3;
   int id;
   DBusError error;
   int i;
 
   ring1 = NULL;
   ring2 = NULL;
+  ring3 = NULL;
   
   /* Context validation */
   
@@ -1069,7 +1387,7 @@ _dbus_keyring_test (void)
   _dbus_string_free (&context);
 
   /* Now verify that if we create a key in keyring 1,
-   * it is properly loaded in keyring 2
+   * it is properly loaded in keyring 3
    */
 
   _dbus_string_init_const (&context, "org_freedesktop_dbus_testsuite");
@@ -1087,11 +1405,29 @@ _dbus_keyring_test (void)
       goto failure;
     }
 
+  /* The same keyring again comes from the cache */
   ring2 = _dbus_keyring_new_for_credentials (NULL, &context, &error);
   _dbus_assert (ring2 != NULL);
   _dbus_assert (error.name == NULL);
+
+  if (ring2 != ring1)
+    {
+      fprintf (stderr, "Keyring was not shared\n");
+      goto failure;
+    }
+
+  /* Bypass the cache to check what made it to the file */
+  ring3 = keyring_new_uncached (NULL, &context, &error);
+  _dbus_assert (ring3 != NULL);
+
+  if (!_dbus_keyring_reload (ring3, FALSE, &error))
+    {
+      fprintf (stderr, "Could not reload keyring: %s\n", error.message);
+      dbus_error_free (&error);
+      goto failure;
+    }
   
-  if (ring1->n_keys != ring2->n_keys)
+  if (ring1->n_keys != ring3->n_keys)
     {
       fprintf (stderr, "Different number of keys in keyrings\n");
       goto failure;
@@ -1103,24 +1439,24 @@ _dbus_keyring_test (void)
   i = 0;
   while (i < ring1->n_keys)
     {
-      if (ring1->keys[i].id != ring2->keys[i].id)
+      if (ring1->keys[i].id != ring3->keys[i].id)
         {
-          fprintf (stderr, "Keyring 1 has first key ID %d and keyring 2 has %d\n",
-                   ring1->keys[i].id, ring2->keys[i].id);
+          fprintf (stderr, "Keyring 1 has first key ID %d and keyring 3 has %d\n",
+                   ring1->keys[i].id, ring3->keys[i].id);
           goto failure;
         }      
 
-      if (ring1->keys[i].creation_time != ring2->keys[i].creation_time)
+      if (ring1->keys[i].creation_time != ring3->keys[i].creation_time)
         {
-          fprintf (stderr, "Keyring 1 has first key time %ld and keyring 2 has %ld\n",
-                   ring1->keys[i].creation_time, ring2->keys[i].creation_time);
+          fprintf (stderr, "Keyring 1 has first key time %ld and keyring 3 has %ld\n",
+                   ring1->keys[i].creation_time, ring3->keys[i].creation_time);
           goto failure;
         }
 
       if (!_dbus_string_equal (&ring1->keys[i].secret,
-                               &ring2->keys[i].secret))
+                               &ring3->keys[i].secret))
         {
-          fprintf (stderr, "Keyrings 1 and 2 have different secrets for same ID/timestamp\n");
+          fprintf (stderr, "Keyrings 1 and 3 have different secrets for same ID/timestamp\n");
           goto failure;
         }
       
@@ -1139,6 +1475,12 @@ _dbus_keyring_test (void)
   /* really unref */
   _dbus_keyring_unref (ring1);
   _dbus_keyring_unref (ring2);
+  _dbus_keyring_finalize (ring3);
+
+#ifdef DBUS_UNIX
+  if (!check_contention ())
+    return FALSE;
+#endif
   
   return TRUE;
 
@@ -1147,6 +1489,8 @@ _dbus_keyring_test (void)
     _dbus_keyring_unref (ring1);
   if (ring2)
     _dbus_keyring_unref (ring2);
+  if (ring3)
+    _dbus_keyring_finalize (ring3);
 
   return FALSE;
 }
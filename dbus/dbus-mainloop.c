@@ -61,6 +61,9 @@ struct DBusLoop
   int timeout_count;
   int depth; /**< number of recursive runs */
   DBusList *need_dispatch;
+  int next_ready_fd; /**< where to start handling ready watches next time */
+  long now_tv_sec;  /**< monotonic time when the loop last woke up */
+  long now_tv_usec; /**< monotonic time when the loop last woke up */
 };
 
 typedef enum
@@ -135,8 +138,8 @@ timeout_callback_new (DBusTimeout         *timeout,
 
   cb->timeout = timeout;
   cb->function = function;
-  _dbus_get_current_time (&cb->last_tv_sec,
-                          &cb->last_tv_usec);
+  _dbus_get_monotonic_time (&cb->last_tv_sec,
+                            &cb->last_tv_usec);
   cb->callback.refcount = 1;    
   cb->callback.type = CALLBACK_TIMEOUT;
   cb->callback.data = data;
@@ -224,6 +227,8 @@ _dbus_loop_new (void)
     return NULL;
 
   loop->refcount = 1;
+
+  _dbus_get_monotonic_time (&loop->now_tv_sec, &loop->now_tv_usec);
   
   return loop;
 }
@@ -644,7 +649,9 @@ _dbus_loop_iterate (DBusLoop     *loop,
       unsigned long tv_sec;
       unsigned long tv_usec;
       
-      _dbus_get_current_time (&tv_sec, &tv_usec);
+      _dbus_get_monotonic_time (&loop->now_tv_sec, &loop->now_tv_usec);
+      tv_sec = loop->now_tv_sec;
+      tv_usec = loop->now_tv_usec;
           
       link = _dbus_list_get_first_link (&loop->callbacks);
       while (link != NULL)
@@ -707,6 +714,11 @@ _dbus_loop_iterate (DBusLoop     *loop,
   
   n_ready = _dbus_poll (fds, n_fds, timeout);
 
+  /* Everything we call from here on can get the time from the loop
+   * rather than asking the system again
+   */
+  _dbus_get_monotonic_time (&loop->now_tv_sec, &loop->now_tv_usec);
+
   initial_serial = loop->callback_list_serial;
 
   if (loop->timeout_count > 0)
@@ -714,7 +726,8 @@ _dbus_loop_iterate (DBusLoop     *loop,
       unsigned long tv_sec;
       unsigned long tv_usec;
 
-      _dbus_get_current_time (&tv_sec, &tv_usec);
+      tv_sec = loop->now_tv_sec;
+      tv_usec = loop->now_tv_usec;
 
       /* It'd be nice to avoid this O(n) thingy here */
       link = _dbus_list_get_first_link (&loop->callbacks);
@@ -771,13 +784,22 @@ _dbus_loop_iterate (DBusLoop     *loop,
       
   if (n_ready > 0)
     {
-      i = 0;
-      while (i < n_fds)
+      int start;
+      int j;
+
+      /* We have to restart if a callback changes the watches. Begin
+       * each time just past the last watch we handled rather than at
+       * the front of the list, so that a busy connection early in the
+       * list can't keep the ones after it from being read or written.
+       */
+      start = loop->next_ready_fd % n_fds;
+
+      j = 0;
+      while (j < n_fds)
         {
-          /* FIXME I think this "restart if we change the watches"
-           * approach could result in starving watches
-           * toward the end of the list.
-           */
+          i = (start + j) % n_fds;
+          ++j;
+
           if (initial_serial != loop->callback_list_serial)
             goto next_iteration;
 
@@ -808,6 +830,8 @@ _dbus_loop_iterate (DBusLoop     *loop,
               if (condition != 0 &&
                   dbus_watch_get_enabled (wcb->watch))
                 {
+                  loop->next_ready_fd = i + 1;
+
                   if (!(* wcb->function) (wcb->watch,
                                           condition,
                                           ((Callback*)wcb)->data))
@@ -821,8 +845,6 @@ _dbus_loop_iterate (DBusLoop     *loop,
                   retval = TRUE;
                 }
             }
-              
-          ++i;
         }
     }
       
@@ -877,6 +899,21 @@ _dbus_loop_run (DBusLoop *loop)
   _dbus_loop_unref (loop);
 }
 
+/* Gets the monotonic time as of when the loop last woke up. Timeout
+ * and expiry code run from the loop can use this rather than asking
+ * the system every time; it is at most one iteration out of date.
+ */
+void
+_dbus_loop_get_cached_time (DBusLoop *loop,
+                            long     *tv_sec,
+                            long     *tv_usec)
+{
+  if (tv_sec)
+    *tv_sec = loop->now_tv_sec;
+  if (tv_usec)
+    *tv_usec = loop->now_tv_usec;
+}
+
 void
 _dbus_loop_quit (DBusLoop *loop)
 {
@@ -66,6 +66,9 @@ void        _dbus_loop_quit           (DBusLoop            *loop);
 dbus_bool_t _dbus_loop_iterate        (DBusLoop            *loop,
                                        dbus_bool_t          block);
 dbus_bool_t _dbus_loop_dispatch       (DBusLoop            *loop);
+void        _dbus_loop_get_cached_time (DBusLoop           *loop,
+                                        long               *tv_sec,
+                                        long               *tv_usec);
 
 int  _dbus_get_oom_wait    (void);
 void _dbus_wait_for_memory (void);
@@ -143,6 +143,29 @@ _dbus_header_cache_invalidate_all (DBusHeader *header)
     }
 }
 
+/**
+ * Invalidates the fields in the cache that are stored after the given
+ * position, which is where those that move live when a field changes
+ * length. Fields before it keep their positions.
+ *
+ * @param header the header
+ * @param pos value position of the field that changed length
+ */
+static void
+_dbus_header_cache_invalidate_after (DBusHeader *header,
+                                     int         pos)
+{
+  int i;
+
+  i = 0;
+  while (i <= DBUS_HEADER_FIELD_LAST)
+    {
+      if (header->fields[i].value_pos > pos)
+        header->fields[i].value_pos = _DBUS_HEADER_FIELD_VALUE_UNKNOWN;
+      ++i;
+    }
+}
+
 /**
  * Caches one field
  *
@@ -264,13 +287,15 @@ _dbus_header_cache_known_nonexistent (DBusHeader    *header,
  * @param writer the writer (should be ready to write a struct)
  * @param type the type of the value
  * @param value the value as for _dbus_marshal_set_basic()
+ * @param value_pos return location for the position of the value as the fields cache stores it, or #NULL
  * @returns #FALSE if no memory
  */
 static dbus_bool_t
 write_basic_field (DBusTypeWriter *writer,
                    int             field,
                    int             type,
-                   const void     *value)
+                   const void     *value,
+                   int            *value_pos)
 {
   DBusTypeWriter sub;
   DBusTypeWriter variant;
@@ -300,6 +325,9 @@ write_basic_field (DBusTypeWriter *writer,
                                   &contained_type, 0, &variant))
     goto append_failed;
 
+  if (value_pos)
+    *value_pos = variant.value_pos;
+
   if (!_dbus_type_writer_write_basic (&variant, type, value))
     goto append_failed;
 
@@ -582,7 +610,8 @@ _dbus_header_create (DBusHeader  *header,
       if (!write_basic_field (&array,
                               DBUS_HEADER_FIELD_PATH,
                               DBUS_TYPE_OBJECT_PATH,
-                              &path))
+                              &path,
+                              NULL))
         goto oom;
     }
 
@@ -591,7 +620,8 @@ _dbus_header_create (DBusHeader  *header,
       if (!write_basic_field (&array,
                               DBUS_HEADER_FIELD_DESTINATION,
                               DBUS_TYPE_STRING,
-                              &destination))
+                              &destination,
+                              NULL))
         goto oom;
     }
 
@@ -600,7 +630,8 @@ _dbus_header_create (DBusHeader  *header,
       if (!write_basic_field (&array,
                               DBUS_HEADER_FIELD_INTERFACE,
                               DBUS_TYPE_STRING,
-                              &interface))
+                              &interface,
+                              NULL))
         goto oom;
     }
 
@@ -609,7 +640,8 @@ _dbus_header_create (DBusHeader  *header,
       if (!write_basic_field (&array,
                               DBUS_HEADER_FIELD_MEMBER,
                               DBUS_TYPE_STRING,
-                              &member))
+                              &member,
+                              NULL))
         goto oom;
     }
 
@@ -618,7 +650,8 @@ _dbus_header_create (DBusHeader  *header,
       if (!write_basic_field (&array,
                               DBUS_HEADER_FIELD_ERROR_NAME,
                               DBUS_TYPE_STRING,
-                              &error_name))
+                              &error_name,
+                              NULL))
         goto oom;
     }
 
@@ -1247,6 +1280,8 @@ _dbus_header_set_field_basic (DBusHeader       *header,
                               int               type,
                               const void       *value)
 {
+  int value_pos;
+
   _dbus_assert (field <= DBUS_HEADER_FIELD_LAST);
 
   if (!reserve_header_padding (header))
@@ -1257,13 +1292,23 @@ _dbus_header_set_field_basic (DBusHeader       *header,
     {
       DBusTypeReader reader;
       DBusTypeReader realign_root;
+      int old_len;
 
       if (!find_field_for_modification (header, field,
                                         &reader, &realign_root))
         _dbus_assert_not_reached ("field was marked present in cache but wasn't found");
 
+      value_pos = header->fields[field].value_pos;
+      old_len = HEADER_END_BEFORE_PADDING (header);
+
       if (!set_basic_field (&reader, field, type, value, &realign_root))
         return FALSE;
+
+      /* A value of the same length is overwritten in place. Otherwise
+       * the fields after it are realigned, and only they can move.
+       */
+      if (HEADER_END_BEFORE_PADDING (header) != old_len)
+        _dbus_header_cache_invalidate_after (header, value_pos);
     }
   else
     {
@@ -1291,21 +1336,20 @@ _dbus_header_set_field_basic (DBusHeader       *header,
       _dbus_assert (array.value_pos == HEADER_END_BEFORE_PADDING (header));
 
       if (!write_basic_field (&array,
-                              field, type, value))
+                              field, type, value, &value_pos))
         return FALSE;
 
       if (!_dbus_type_writer_unrecurse (&writer, &array))
         _dbus_assert_not_reached ("unrecurse from ARRAY should not have used memory");
+
+      /* Appending moves nothing else, so the bus stamping the sender
+       * on each message it routes keeps the cache of the others
+       */
+      header->fields[field].value_pos = value_pos;
     }
 
   correct_header_padding (header);
 
-  /* We could be smarter about this (only invalidate fields after the
-   * one we modified, or even only if the one we modified changed
-   * length). But this hack is a start.
-   */
-  _dbus_header_cache_invalidate_all (header);
-
   return TRUE;
 }
 
@@ -1483,11 +1527,196 @@ _dbus_header_byteswap (DBusHeader *header,
 
 #ifdef DBUS_BUILD_TESTS
 #include "dbus-test.h"
+#include "dbus-sysdeps.h"
 #include <stdio.h>
+#include <string.h>
+
+/* Checks that every field the cache still claims to know is where a
+ * full rescan finds it
+ */
+static void
+check_cache_consistent (DBusHeader *header)
+{
+  DBusHeaderField cached[DBUS_HEADER_FIELD_LAST + 1];
+  int i;
+
+  memcpy (cached, header->fields, sizeof (cached));
+
+  _dbus_header_cache_revalidate (header);
+
+  for (i = 0; i <= DBUS_HEADER_FIELD_LAST; i++)
+    {
+      if (cached[i].value_pos != _DBUS_HEADER_FIELD_VALUE_UNKNOWN &&
+          cached[i].value_pos != header->fields[i].value_pos)
+        _dbus_assert_not_reached ("header field cache out of date after setting a field");
+    }
+
+  memcpy (header->fields, cached, sizeof (cached));
+}
+
+static dbus_bool_t
+cache_fully_known (DBusHeader *header)
+{
+  int i;
+
+  for (i = 0; i <= DBUS_HEADER_FIELD_LAST; i++)
+    {
+      if (header->fields[i].value_pos == _DBUS_HEADER_FIELD_VALUE_UNKNOWN)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+set_string_field (DBusHeader *header,
+                  int         field,
+                  const char *value)
+{
+  if (!_dbus_header_set_field_basic (header, field, DBUS_TYPE_STRING, &value))
+    _dbus_assert_not_reached ("no memory");
+}
+
+static void
+check_string_field (DBusHeader *header,
+                    int         field,
+                    const char *expected)
+{
+  const char *value;
+
+  if (!_dbus_header_get_field_basic (header, field, DBUS_TYPE_STRING, &value))
+    _dbus_assert_not_reached ("field missing");
+
+  _dbus_assert (strcmp (value, expected) == 0);
+}
+
+/* Makes dest a copy of template, with all of the template's cache,
+ * the way the loader hands the bus a freshly validated header
+ */
+static void
+reload_header (DBusHeader       *dest,
+               const DBusHeader *template)
+{
+  _dbus_string_set_length (&dest->data, 0);
+  if (!_dbus_string_copy (&template->data, 0, &dest->data, 0))
+    _dbus_assert_not_reached ("no memory");
+
+  memcpy (dest->fields, template->fields, sizeof (dest->fields));
+  dest->padding = template->padding;
+  dest->byte_order = template->byte_order;
+}
+
+/* What the bus does to a method call it routes: stamp the sender,
+ * then look up the fields used for routing and matching. None of
+ * that should need to rescan the header.
+ */
+static void
+check_routing (const DBusHeader *template,
+               const char       *sender,
+               int               n_messages)
+{
+  DBusHeader header;
+  int fields[] = {
+    DBUS_HEADER_FIELD_DESTINATION,
+    DBUS_HEADER_FIELD_SENDER,
+    DBUS_HEADER_FIELD_INTERFACE,
+    DBUS_HEADER_FIELD_MEMBER,
+    DBUS_HEADER_FIELD_PATH
+  };
+  int i;
+
+  if (!_dbus_header_init (&header, DBUS_COMPILER_BYTE_ORDER))
+    _dbus_assert_not_reached ("no memory");
+
+  /* More than one, so each reload starts from a stamped header */
+  for (i = 0; i < n_messages; i++)
+    {
+      int j;
+
+      reload_header (&header, template);
+      set_string_field (&header, DBUS_HEADER_FIELD_SENDER, sender);
+      _dbus_assert (cache_fully_known (&header));
+      check_cache_consistent (&header);
+
+      for (j = 0; j < (int) _DBUS_N_ELEMENTS (fields); j++)
+        {
+          const char *value;
+
+          if (!_dbus_header_get_field_basic (&header, fields[j],
+                                             EXPECTED_TYPE_OF_FIELD (fields[j]),
+                                             &value))
+            _dbus_assert_not_reached ("routed message lacks a field");
+        }
+
+      check_string_field (&header, DBUS_HEADER_FIELD_SENDER, sender);
+    }
+
+  _dbus_header_free (&header);
+}
 
 dbus_bool_t
 _dbus_marshal_header_test (void)
 {
+  DBusHeader header;
+  DBusHeader template;
+
+  if (!_dbus_header_init (&header, DBUS_COMPILER_BYTE_ORDER))
+    _dbus_assert_not_reached ("no memory");
+
+  if (!_dbus_header_create (&header, DBUS_MESSAGE_TYPE_METHOD_CALL,
+                            "org.freedesktop.DBus.TestSuiteEchoService",
+                            "/org/freedesktop/TestSuite",
+                            "org.freedesktop.TestSuite",
+                            "Echo", NULL))
+    _dbus_assert_not_reached ("no memory");
+
+  _dbus_header_cache_revalidate (&header);
+  if (!_dbus_header_copy (&header, &template))
+    _dbus_assert_not_reached ("no memory");
+
+  /* Appending the sender, as the bus does to messages from clients,
+   * keeps everything cached
+   */
+  set_string_field (&header, DBUS_HEADER_FIELD_SENDER, ":1.5");
+  _dbus_assert (cache_fully_known (&header));
+  check_cache_consistent (&header);
+  check_string_field (&header, DBUS_HEADER_FIELD_SENDER, ":1.5");
+
+  /* So does replacing it, whether or not it fits the old space */
+  set_string_field (&header, DBUS_HEADER_FIELD_SENDER, ":1.6");
+  _dbus_assert (cache_fully_known (&header));
+  check_cache_consistent (&header);
+  check_string_field (&header, DBUS_HEADER_FIELD_SENDER, ":1.6");
+
+  set_string_field (&header, DBUS_HEADER_FIELD_SENDER, ":1.4294967295");
+  _dbus_assert (cache_fully_known (&header));
+  check_cache_consistent (&header);
+  check_string_field (&header, DBUS_HEADER_FIELD_SENDER, ":1.4294967295");
+
+  /* A field in the middle that keeps its length moves nothing */
+  set_string_field (&header, DBUS_HEADER_FIELD_DESTINATION,
+                    "org.freedesktop.DBus.TestSuiteEchoServicf");
+  _dbus_assert (cache_fully_known (&header));
+  check_cache_consistent (&header);
+
+  /* One that changes length moves the fields after it, and only those
+   * need looking up again
+   */
+  set_string_field (&header, DBUS_HEADER_FIELD_DESTINATION, ":1.7");
+  _dbus_assert (header.fields[DBUS_HEADER_FIELD_PATH].value_pos !=
+                _DBUS_HEADER_FIELD_VALUE_UNKNOWN);
+  check_cache_consistent (&header);
+  check_string_field (&header, DBUS_HEADER_FIELD_DESTINATION, ":1.7");
+  check_string_field (&header, DBUS_HEADER_FIELD_INTERFACE,
+                      "org.freedesktop.TestSuite");
+  check_string_field (&header, DBUS_HEADER_FIELD_MEMBER, "Echo");
+  check_string_field (&header, DBUS_HEADER_FIELD_SENDER, ":1.4294967295");
+
+  _dbus_header_free (&header);
+
+  check_routing (&template, ":1.42", 3);
+
+  _dbus_header_free (&template);
 
   return TRUE;
 }
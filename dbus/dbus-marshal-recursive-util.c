@@ -2039,6 +2039,354 @@ _dbus_marshal_recursive_test (void)
   return TRUE;
 }
 
+static const char *compiled_signature_samples[] = {
+  "",
+  "i",
+  "ybnqiuxtdsogvh",
+  "as",
+  "aai",
+  "a{sv}",
+  "a{oa{sa{sv}}}",
+  "a(ii)",
+  "(yi)",
+  "(ud)",
+  "(du)",
+  "(i(ud)s)",
+  "a(isai(ud))",
+  "(((i)))b",
+  "a{s(ii)}aai",
+  "(ta(yv))",
+  "yyyyuua(yv)"
+};
+
+/* Checks the compiled form of sig against the generic signature walking
+ * functions, at every position in the signature
+ */
+static void
+check_ops_against_signature (const DBusString *sig)
+{
+  DBusTypeOp ops[DBUS_MAXIMUM_SIGNATURE_LENGTH + 1];
+  const char *s;
+  int len;
+  int pos;
+
+  s = _dbus_string_get_const_data (sig);
+  len = _dbus_string_get_length (sig);
+
+  _dbus_type_ops_compile (sig, 0, len, ops);
+
+  for (pos = 0; pos < len; pos++)
+    {
+      if (s[pos] == DBUS_STRUCT_END_CHAR ||
+          s[pos] == DBUS_DICT_ENTRY_END_CHAR)
+        {
+          _dbus_assert (ops[pos].type == DBUS_TYPE_INVALID);
+          _dbus_assert (ops[pos].next == pos + 1);
+        }
+      else
+        {
+          int type;
+          int next;
+
+          type = _dbus_first_type_in_signature (sig, pos);
+          next = pos;
+          _dbus_type_signature_next (s, &next);
+
+          _dbus_assert (ops[pos].type == type);
+          _dbus_assert (ops[pos].alignment == _dbus_type_get_alignment (type));
+          _dbus_assert (ops[pos].next == next);
+
+          if (dbus_type_is_fixed (type))
+            _dbus_assert (ops[pos].fixed_size == ops[pos].alignment);
+          else if (type != DBUS_TYPE_STRUCT && type != DBUS_TYPE_DICT_ENTRY)
+            _dbus_assert (ops[pos].fixed_size == -1);
+        }
+    }
+
+  _dbus_assert (ops[len].type == DBUS_TYPE_INVALID);
+  _dbus_assert (ops[len].next == len);
+}
+
+static void
+check_struct_layout (const char  *signature,
+                     int          fixed_size,
+                     dbus_bool_t  opaque)
+{
+  DBusString sig;
+  DBusTypeOp ops[DBUS_MAXIMUM_SIGNATURE_LENGTH + 1];
+
+  _dbus_string_init_const (&sig, signature);
+  _dbus_type_ops_compile (&sig, 0, _dbus_string_get_length (&sig), ops);
+
+  if (ops[0].fixed_size != fixed_size || ops[0].opaque != opaque)
+    {
+      _dbus_warn ("%s compiled to size %d opaque %d, expected %d %d\n",
+                  signature, ops[0].fixed_size, ops[0].opaque,
+                  fixed_size, opaque);
+      _dbus_assert_not_reached ("wrong struct layout");
+    }
+}
+
+static void
+check_signature_cache (void)
+{
+  DBusString sig;
+  DBusString str;
+  DBusCompiledSignature *first;
+  DBusCompiledSignature *again;
+  int i;
+
+  _dbus_string_init_const (&sig, "a{oa{sa{sv}}}");
+
+  first = _dbus_compiled_signature_get (&sig, 0, _dbus_string_get_length (&sig));
+  if (first == NULL)
+    _dbus_assert_not_reached ("oom");
+  again = _dbus_compiled_signature_get (&sig, 0, _dbus_string_get_length (&sig));
+  if (again == NULL)
+    _dbus_assert_not_reached ("oom");
+
+  _dbus_assert (first == again);
+  _dbus_assert (strcmp (first->signature, "a{oa{sa{sv}}}") == 0);
+  _dbus_assert (first->len == _dbus_string_get_length (&sig));
+
+  _dbus_compiled_signature_unref (again);
+
+  /* Push it out of the cache; the reference we hold keeps it alive */
+  if (!_dbus_string_init (&str))
+    _dbus_assert_not_reached ("oom");
+
+  for (i = 0; i < 200; i++)
+    {
+      DBusCompiledSignature *compiled;
+
+      _dbus_string_set_length (&str, 0);
+      if (!_dbus_string_append_byte (&str, DBUS_STRUCT_BEGIN_CHAR) ||
+          !_dbus_string_insert_bytes (&str, 1, i + 1, DBUS_TYPE_INT32) ||
+          !_dbus_string_append_byte (&str, DBUS_STRUCT_END_CHAR))
+        _dbus_assert_not_reached ("oom");
+
+      compiled = _dbus_compiled_signature_get (&str, 0, _dbus_string_get_length (&str));
+      if (compiled == NULL)
+        _dbus_assert_not_reached ("oom");
+
+      _dbus_assert (compiled->ops[0].type == DBUS_TYPE_STRUCT);
+      _dbus_assert (compiled->ops[0].fixed_size == 4 * (i + 1));
+      _dbus_assert (compiled->ops[0].next == i + 3);
+
+      _dbus_compiled_signature_unref (compiled);
+    }
+
+  _dbus_string_free (&str);
+
+  _dbus_assert (first->ops[0].type == DBUS_TYPE_ARRAY);
+  _dbus_compiled_signature_unref (first);
+}
+
+/* Writes an array of n_elements elements of the given kind, with
+ * element_sig being "(ii)", "(yi)", "(bi)" or "{sv}"
+ */
+static void
+write_test_array (DBusString *signature,
+                  DBusString *body,
+                  const char *element_sig,
+                  int         n_elements)
+{
+  DBusTypeWriter writer;
+  DBusTypeWriter array;
+  DBusString element;
+  int i;
+
+  _dbus_string_init_const (&element, element_sig);
+  _dbus_type_writer_init (&writer, DBUS_COMPILER_BYTE_ORDER,
+                          signature, 0, body, 0);
+
+  if (!_dbus_type_writer_recurse (&writer, DBUS_TYPE_ARRAY, &element, 0, &array))
+    _dbus_assert_not_reached ("oom");
+
+  for (i = 0; i < n_elements; i++)
+    {
+      DBusTypeWriter entry;
+      dbus_int32_t v;
+
+      if (!_dbus_type_writer_recurse (&array,
+                                      element_sig[0] == DBUS_DICT_ENTRY_BEGIN_CHAR ?
+                                      DBUS_TYPE_DICT_ENTRY : DBUS_TYPE_STRUCT,
+                                      NULL, 0, &entry))
+        _dbus_assert_not_reached ("oom");
+
+      v = i % 2;
+
+      if (element_sig[1] == DBUS_TYPE_STRING)
+        {
+          DBusTypeWriter variant;
+          DBusString contained;
+          const char *key = "key";
+
+          _dbus_string_init_const (&contained, DBUS_TYPE_INT32_AS_STRING);
+
+          if (!_dbus_type_writer_write_basic (&entry, DBUS_TYPE_STRING, &key) ||
+              !_dbus_type_writer_recurse (&entry, DBUS_TYPE_VARIANT,
+                                          &contained, 0, &variant) ||
+              !_dbus_type_writer_write_basic (&variant, DBUS_TYPE_INT32, &v) ||
+              !_dbus_type_writer_unrecurse (&entry, &variant))
+            _dbus_assert_not_reached ("oom");
+        }
+      else
+        {
+          unsigned char y = i;
+
+          if (element_sig[1] == DBUS_TYPE_BYTE)
+            {
+              if (!_dbus_type_writer_write_basic (&entry, DBUS_TYPE_BYTE, &y))
+                _dbus_assert_not_reached ("oom");
+            }
+          else if (!_dbus_type_writer_write_basic (&entry, element_sig[1], &v))
+            _dbus_assert_not_reached ("oom");
+
+          if (!_dbus_type_writer_write_basic (&entry, DBUS_TYPE_INT32, &v))
+            _dbus_assert_not_reached ("oom");
+        }
+
+      if (!_dbus_type_writer_unrecurse (&array, &entry))
+        _dbus_assert_not_reached ("oom");
+    }
+
+  if (!_dbus_type_writer_unrecurse (&writer, &array))
+    _dbus_assert_not_reached ("oom");
+}
+
+static DBusValidity
+validate_test_body (const DBusString *signature,
+                    const DBusString *body)
+{
+  return _dbus_validate_body_with_reason (signature, 0,
+                                          DBUS_COMPILER_BYTE_ORDER,
+                                          NULL, body, 0,
+                                          _dbus_string_get_length (body));
+}
+
+/* The struct arrays that can skip the per-element walk must still
+ * catch a length that isn't a whole number of elements, and the ones
+ * that can't skip it must still look inside each element
+ */
+static void
+check_struct_array_validation (void)
+{
+  DBusString signature;
+  DBusString body;
+  dbus_uint32_t *claimed_len;
+
+  if (!_dbus_string_init (&signature) || !_dbus_string_init (&body))
+    _dbus_assert_not_reached ("oom");
+
+  write_test_array (&signature, &body, "(ii)", 10);
+  _dbus_assert (validate_test_body (&signature, &body) == DBUS_VALID);
+
+  /* the last element now sticks out of the array */
+  claimed_len = (dbus_uint32_t *) _dbus_string_get_data (&body);
+  *claimed_len -= 4;
+  _dbus_assert (validate_test_body (&signature, &body) ==
+                DBUS_INVALID_ARRAY_LENGTH_INCORRECT);
+
+  _dbus_string_set_length (&signature, 0);
+  _dbus_string_set_length (&body, 0);
+  write_test_array (&signature, &body, "(bi)", 10);
+  _dbus_assert (validate_test_body (&signature, &body) == DBUS_VALID);
+
+  /* the first element's boolean */
+  _dbus_string_set_byte (&body, 8, 2);
+  _dbus_assert (validate_test_body (&signature, &body) ==
+                DBUS_INVALID_BOOLEAN_NOT_ZERO_OR_ONE);
+
+  _dbus_string_set_length (&signature, 0);
+  _dbus_string_set_length (&body, 0);
+  write_test_array (&signature, &body, "(yi)", 10);
+  _dbus_assert (validate_test_body (&signature, &body) == DBUS_VALID);
+
+  /* the padding after the first element's byte */
+  _dbus_string_set_byte (&body, 9, 1);
+  _dbus_assert (validate_test_body (&signature, &body) ==
+                DBUS_INVALID_ALIGNMENT_PADDING_NOT_NUL);
+
+  _dbus_string_free (&signature);
+  _dbus_string_free (&body);
+}
+
+#define LARGE_ARRAY_ELEMENTS 1000
+
+/* Arrays long enough that the compiled form's per-element loop, not
+ * the setup around it, does nearly all of the work
+ */
+static void
+check_large_array_validation (const char *element_sig)
+{
+  DBusString signature;
+  DBusString body;
+
+  if (!_dbus_string_init (&signature) || !_dbus_string_init (&body))
+    _dbus_assert_not_reached ("oom");
+
+  write_test_array (&signature, &body, element_sig, LARGE_ARRAY_ELEMENTS);
+  _dbus_assert (validate_test_body (&signature, &body) == DBUS_VALID);
+
+  _dbus_string_free (&signature);
+  _dbus_string_free (&body);
+}
+
+dbus_bool_t
+_dbus_compiled_signature_test (void)
+{
+  DBusString signature;
+  DBusString body;
+  int sequence;
+  int i;
+
+  for (i = 0; i < _DBUS_N_ELEMENTS (compiled_signature_samples); i++)
+    {
+      DBusString sig;
+
+      _dbus_string_init_const (&sig, compiled_signature_samples[i]);
+      check_ops_against_signature (&sig);
+    }
+
+  if (!_dbus_string_init (&signature) || !_dbus_string_init (&body))
+    _dbus_assert_not_reached ("oom");
+
+  sequence = 0;
+  while (dbus_internal_do_not_use_generate_bodies (sequence,
+                                                   DBUS_LITTLE_ENDIAN,
+                                                   &signature, &body))
+    {
+      check_ops_against_signature (&signature);
+
+      _dbus_string_set_length (&signature, 0);
+      _dbus_string_set_length (&body, 0);
+      ++sequence;
+    }
+
+  _dbus_string_free (&signature);
+  _dbus_string_free (&body);
+
+  check_struct_layout ("(ii)", 8, TRUE);
+  check_struct_layout ("(yi)", 8, FALSE);
+  check_struct_layout ("(bi)", 8, FALSE);
+  check_struct_layout ("(ud)", 16, FALSE);
+  check_struct_layout ("(du)", 12, TRUE);
+  check_struct_layout ("(i(ud))", 24, FALSE);
+  check_struct_layout ("(tt(ii))", 24, TRUE);
+  check_struct_layout ("(is)", -1, FALSE);
+  check_struct_layout ("{sv}", -1, FALSE);
+
+  check_signature_cache ();
+  check_struct_array_validation ();
+
+  check_large_array_validation ("(ii)");
+  check_large_array_validation ("(yi)");
+  check_large_array_validation ("{sv}");
+
+  return TRUE;
+}
+
 /*
  *
  *
@@ -26,6 +26,8 @@
 #include "dbus-marshal-basic.h"
 #include "dbus-signature.h"
 #include "dbus-internals.h"
+#include "dbus-hash.h"
+#include <string.h>
 
 /**
  * @addtogroup DBusMarshal
@@ -421,6 +423,521 @@ find_len_of_complete_type (const DBusString *type_str,
   return end - type_pos;
 }
 
+/* Fills in ops[pos] for the complete type starting at pos, and the ops
+ * of everything inside it, returning the position after it.
+ */
+static int
+compile_complete_type (const unsigned char *sig,
+                       int                  pos,
+                       DBusTypeOp          *ops)
+{
+  DBusTypeOp *op;
+  int next;
+
+  op = &ops[pos];
+
+  switch (sig[pos])
+    {
+    case DBUS_TYPE_ARRAY:
+      next = compile_complete_type (sig, pos + 1, ops);
+      op->type = DBUS_TYPE_ARRAY;
+      op->alignment = 4;
+      op->opaque = FALSE;
+      op->fixed_size = -1;
+      break;
+
+    case DBUS_STRUCT_BEGIN_CHAR:
+    case DBUS_DICT_ENTRY_BEGIN_CHAR:
+      {
+        dbus_bool_t fixed;
+        dbus_bool_t opaque;
+        int offset;
+
+        /* Lay the fields out from an 8-aligned start to see whether
+         * every value has the same size, and whether there is any
+         * padding in between
+         */
+        fixed = TRUE;
+        opaque = TRUE;
+        offset = 0;
+
+        next = pos + 1;
+        while (sig[next] != DBUS_STRUCT_END_CHAR &&
+               sig[next] != DBUS_DICT_ENTRY_END_CHAR)
+          {
+            const DBusTypeOp *field = &ops[next];
+
+            next = compile_complete_type (sig, next, ops);
+
+            if (fixed && field->fixed_size >= 0)
+              {
+                if (_DBUS_ALIGN_VALUE (offset, field->alignment) != (unsigned) offset)
+                  opaque = FALSE;
+
+                offset = _DBUS_ALIGN_VALUE (offset, field->alignment) + field->fixed_size;
+                opaque = opaque && field->opaque;
+              }
+            else
+              fixed = FALSE;
+          }
+
+        ops[next].type = DBUS_TYPE_INVALID;
+        ops[next].alignment = 1;
+        ops[next].next = next + 1;
+        ops[next].opaque = FALSE;
+        ops[next].fixed_size = -1;
+        next += 1;
+
+        op->type = sig[pos] == DBUS_STRUCT_BEGIN_CHAR ?
+          DBUS_TYPE_STRUCT : DBUS_TYPE_DICT_ENTRY;
+        op->alignment = 8;
+        op->opaque = fixed && opaque;
+        op->fixed_size = fixed ? offset : -1;
+      }
+      break;
+
+    default:
+      next = pos + 1;
+      op->type = sig[pos];
+      op->alignment = _dbus_type_get_alignment (sig[pos]);
+      if (dbus_type_is_fixed (sig[pos]))
+        {
+          /* fixed-size basic types are as big as their alignment */
+          op->fixed_size = op->alignment;
+          op->opaque = sig[pos] != DBUS_TYPE_BOOLEAN;
+        }
+      else
+        {
+          op->fixed_size = -1;
+          op->opaque = FALSE;
+        }
+      break;
+    }
+
+  op->next = next;
+
+  return next;
+}
+
+/**
+ * Compiles a signature into the given array of len + 1 ops, one for
+ * each byte of the signature plus a terminating #DBUS_TYPE_INVALID.
+ * The signature must be valid.
+ *
+ * @param type_str string containing the signature
+ * @param type_pos where the signature starts
+ * @param len length of the signature
+ * @param ops array to fill in
+ */
+void
+_dbus_type_ops_compile (const DBusString *type_str,
+                        int               type_pos,
+                        int               len,
+                        DBusTypeOp       *ops)
+{
+  const unsigned char *sig;
+  int pos;
+
+  _dbus_assert (len <= DBUS_MAXIMUM_SIGNATURE_LENGTH);
+
+  sig = _dbus_string_get_const_data_len (type_str, type_pos, len);
+
+  pos = 0;
+  while (pos < len)
+    pos = compile_complete_type (sig, pos, ops);
+
+  _dbus_assert (pos == len);
+
+  ops[len].type = DBUS_TYPE_INVALID;
+  ops[len].alignment = 1;
+  ops[len].next = len;
+  ops[len].opaque = FALSE;
+  ops[len].fixed_size = -1;
+}
+
+/* Upper bound on the cache; past it an arbitrary entry is dropped */
+#define MAX_COMPILED_SIGNATURES 128
+
+_DBUS_DEFINE_GLOBAL_LOCK (compiled_signatures);
+static DBusHashTable *compiled_signatures = NULL;
+
+static void
+compiled_signature_free (void *data)
+{
+  DBusCompiledSignature *compiled = data;
+
+  /* the hash table frees a new entry's NULL value when filling it in */
+  if (compiled == NULL)
+    return;
+
+  /* the cache lock is held */
+  compiled->refcount -= 1;
+  if (compiled->refcount == 0)
+    dbus_free (compiled);
+}
+
+static void
+compiled_signatures_shutdown (void *data)
+{
+  _DBUS_LOCK (compiled_signatures);
+
+  if (compiled_signatures != NULL)
+    {
+      _dbus_hash_table_unref (compiled_signatures);
+      compiled_signatures = NULL;
+    }
+
+  _DBUS_UNLOCK (compiled_signatures);
+}
+
+static DBusCompiledSignature *
+compiled_signature_new (const DBusString *type_str,
+                        int               type_pos,
+                        int               len)
+{
+  DBusCompiledSignature *compiled;
+
+  /* ops[0] is already in the struct; the signature goes after ops[len] */
+  compiled = dbus_malloc (sizeof (DBusCompiledSignature) +
+                          len * sizeof (DBusTypeOp) + len + 1);
+  if (compiled == NULL)
+    return NULL;
+
+  compiled->refcount = 1;
+  compiled->len = len;
+  compiled->signature = (char *) &compiled->ops[len + 1];
+  memcpy (compiled->signature,
+          _dbus_string_get_const_data_len (type_str, type_pos, len), len);
+  compiled->signature[len] = '\0';
+
+  _dbus_type_ops_compile (type_str, type_pos, len, compiled->ops);
+
+  return compiled;
+}
+
+/* Must be called with the cache lock held. Returns FALSE if out of
+ * memory, in which case the signature just isn't cached.
+ */
+static dbus_bool_t
+cache_compiled_signature (DBusCompiledSignature *compiled)
+{
+  if (compiled_signatures == NULL)
+    {
+      compiled_signatures = _dbus_hash_table_new (DBUS_HASH_STRING,
+                                                   NULL,
+                                                   compiled_signature_free);
+      if (compiled_signatures == NULL)
+        return FALSE;
+
+      if (!_dbus_register_shutdown_func (compiled_signatures_shutdown, NULL))
+        {
+          _dbus_hash_table_unref (compiled_signatures);
+          compiled_signatures = NULL;
+          return FALSE;
+        }
+    }
+
+  if (_dbus_hash_table_get_n_entries (compiled_signatures) >= MAX_COMPILED_SIGNATURES)
+    {
+      DBusHashIter iter;
+
+      _dbus_hash_iter_init (compiled_signatures, &iter);
+      if (_dbus_hash_iter_next (&iter))
+        _dbus_hash_iter_remove_entry (&iter);
+    }
+
+  if (!_dbus_hash_table_insert_string (compiled_signatures,
+                                       compiled->signature, compiled))
+    return FALSE;
+
+  /* the cache's reference */
+  compiled->refcount += 1;
+
+  return TRUE;
+}
+
+/**
+ * Gets the compiled form of a signature, compiling it if it isn't
+ * in the cache yet. The signature must be valid. Long signatures are
+ * the ones worth caching; short ones can be compiled onto the stack
+ * with _dbus_type_ops_compile() for less than the cost of a lookup.
+ *
+ * @param type_str string containing the signature
+ * @param type_pos where the signature starts
+ * @param len length of the signature
+ * @returns the compiled signature, or #NULL if out of memory
+ */
+DBusCompiledSignature *
+_dbus_compiled_signature_get (const DBusString *type_str,
+                              int               type_pos,
+                              int               len)
+{
+  DBusCompiledSignature *compiled;
+  char key[DBUS_MAXIMUM_SIGNATURE_LENGTH + 1];
+
+  _dbus_assert (len <= DBUS_MAXIMUM_SIGNATURE_LENGTH);
+
+  memcpy (key, _dbus_string_get_const_data_len (type_str, type_pos, len), len);
+  key[len] = '\0';
+
+  _DBUS_LOCK (compiled_signatures);
+
+  if (compiled_signatures != NULL)
+    {
+      compiled = _dbus_hash_table_lookup_string (compiled_signatures, key);
+      if (compiled != NULL)
+        {
+          compiled->refcount += 1;
+          _DBUS_UNLOCK (compiled_signatures);
+          return compiled;
+        }
+    }
+
+  compiled = compiled_signature_new (type_str, type_pos, len);
+  if (compiled != NULL)
+    cache_compiled_signature (compiled);
+
+  _DBUS_UNLOCK (compiled_signatures);
+
+  return compiled;
+}
+
+/**
+ * Drops a reference to a compiled signature.
+ *
+ * @param compiled the compiled signature
+ */
+void
+_dbus_compiled_signature_unref (DBusCompiledSignature *compiled)
+{
+  _DBUS_LOCK (compiled_signatures);
+  compiled_signature_free (compiled);
+  _DBUS_UNLOCK (compiled_signatures);
+}
+
+/*
+ * How the elements of an array of structs read or written in bulk map
+ * between the wire and the caller's C structs. The steps are the
+ * signature's basic-typed fields in order, plus a step at the start of
+ * each struct or dict entry for its alignment.
+ */
+typedef struct
+{
+  unsigned char type; /* a basic type, or DBUS_TYPE_STRUCT to align to 8 */
+  int offset;         /* where a field is in the C struct */
+  int wire_offset;    /* where it is in an element, if elements are fixed-size */
+} StructMultiStep;
+
+typedef struct
+{
+  int n_steps;
+  int fixed_size;         /* wire size of every element, or -1 */
+  dbus_bool_t copy_as_is; /* C structs are byte-for-byte the wire format */
+  StructMultiStep steps[DBUS_MAXIMUM_SIGNATURE_LENGTH];
+} StructMultiLayout;
+
+static dbus_bool_t
+struct_multi_layout_init (StructMultiLayout *layout,
+                          const DBusString  *type_str,
+                          int                type_pos,
+                          int                byte_order,
+                          int                element_size,
+                          const int         *field_offsets)
+{
+  DBusTypeOp ops[DBUS_MAXIMUM_SIGNATURE_LENGTH + 1];
+  dbus_bool_t same_layout;
+  int wire_pos;
+  int n_fields;
+  int len;
+  int i;
+
+  if (!_dbus_type_struct_multi_supported (type_str, type_pos))
+    return FALSE;
+
+  len = find_len_of_complete_type (type_str, type_pos);
+  _dbus_type_ops_compile (type_str, type_pos, len, ops);
+
+  same_layout = TRUE;
+  wire_pos = 0;
+  n_fields = 0;
+  layout->n_steps = 0;
+
+  for (i = 0; i < len; i++)
+    {
+      StructMultiStep *step;
+
+      /* nothing to do at the closing chars */
+      if (ops[i].type == DBUS_TYPE_INVALID)
+        continue;
+
+      step = &layout->steps[layout->n_steps];
+      layout->n_steps += 1;
+
+      wire_pos = _DBUS_ALIGN_VALUE (wire_pos, ops[i].alignment);
+      step->wire_offset = wire_pos;
+
+      if (ops[i].type == DBUS_TYPE_STRUCT ||
+          ops[i].type == DBUS_TYPE_DICT_ENTRY)
+        {
+          step->type = DBUS_TYPE_STRUCT;
+          step->offset = -1;
+        }
+      else
+        {
+          step->type = ops[i].type;
+          step->offset = field_offsets[n_fields];
+          n_fields += 1;
+
+          if (step->offset != wire_pos)
+            same_layout = FALSE;
+
+          /* wire_pos only matters while every field is fixed-size */
+          if (ops[i].fixed_size > 0)
+            wire_pos += ops[i].fixed_size;
+        }
+    }
+
+  layout->fixed_size = ops[0].fixed_size;
+
+  /* Elements then follow each other without padding, so the
+   * whole block can be copied
+   */
+  layout->copy_as_is = same_layout && ops[0].opaque &&
+    byte_order == DBUS_COMPILER_BYTE_ORDER &&
+    layout->fixed_size % 8 == 0 &&
+    layout->fixed_size == element_size;
+
+  return TRUE;
+}
+
+/* Copies size bytes, reversing them if byte_order is not ours */
+static void
+copy_fixed_bytes (unsigned char       *dest,
+                  const unsigned char *src,
+                  int                  size,
+                  int                  byte_order)
+{
+  int i;
+
+  if (byte_order == DBUS_COMPILER_BYTE_ORDER)
+    {
+      memcpy (dest, src, size);
+      return;
+    }
+
+  for (i = 0; i < size; i++)
+    dest[i] = src[size - 1 - i];
+}
+
+static int
+fixed_field_size (int type)
+{
+  switch (type)
+    {
+    case DBUS_TYPE_BYTE:
+      return 1;
+
+    case DBUS_TYPE_INT16:
+    case DBUS_TYPE_UINT16:
+      return 2;
+
+    case DBUS_TYPE_BOOLEAN:
+    case DBUS_TYPE_INT32:
+    case DBUS_TYPE_UINT32:
+      return 4;
+
+    default:
+      _dbus_assert (_dbus_type_get_alignment (type) == 8);
+      return 8;
+    }
+}
+
+/* Copies a fixed-size field of a C struct into an element on the wire */
+static void
+write_fixed_field (unsigned char       *wire,
+                   const unsigned char *field,
+                   int                  type,
+                   int                  byte_order)
+{
+  if (type == DBUS_TYPE_BOOLEAN)
+    {
+      dbus_uint32_t v;
+
+      /* canonicalized like _dbus_marshal_write_basic() does, while
+       * still in our byte order
+       */
+      memcpy (&v, field, 4);
+      v = v != FALSE;
+      copy_fixed_bytes (wire, (const unsigned char *) &v, 4, byte_order);
+      return;
+    }
+
+  copy_fixed_bytes (wire, field, fixed_field_size (type), byte_order);
+}
+
+/* Copies a fixed-size field of an element on the wire into a C struct */
+static void
+read_fixed_field (unsigned char       *field,
+                  const unsigned char *wire,
+                  int                  type,
+                  int                  byte_order)
+{
+  if (type == DBUS_TYPE_BOOLEAN)
+    {
+      dbus_uint32_t v;
+
+      /* swapped into our byte order before it is canonicalized */
+      copy_fixed_bytes ((unsigned char *) &v, wire, 4, byte_order);
+      v = v != FALSE;
+      memcpy (field, &v, 4);
+      return;
+    }
+
+  copy_fixed_bytes (field, wire, fixed_field_size (type), byte_order);
+}
+
+/**
+ * Checks whether arrays with the element type at type_pos can be read
+ * and written in bulk with _dbus_type_reader_read_struct_multi() and
+ * _dbus_type_writer_write_struct_multi(): the elements must be structs
+ * or dict entries containing only basic types (other than Unix file
+ * descriptors) and further such structs.
+ *
+ * @param type_str the signature
+ * @param type_pos where the element type starts
+ * @returns #TRUE if the element type can be handled in bulk
+ */
+dbus_bool_t
+_dbus_type_struct_multi_supported (const DBusString *type_str,
+                                   int               type_pos)
+{
+  int len;
+  int i;
+
+  if (type_str == NULL)
+    return FALSE;
+
+  if (_dbus_first_type_in_signature (type_str, type_pos) != DBUS_TYPE_STRUCT &&
+      _dbus_first_type_in_signature (type_str, type_pos) != DBUS_TYPE_DICT_ENTRY)
+    return FALSE;
+
+  len = find_len_of_complete_type (type_str, type_pos);
+
+  for (i = 0; i < len; i++)
+    {
+      int c = _dbus_string_get_byte (type_str, type_pos + i);
+
+      if (c == DBUS_STRUCT_BEGIN_CHAR || c == DBUS_STRUCT_END_CHAR ||
+          c == DBUS_DICT_ENTRY_BEGIN_CHAR || c == DBUS_DICT_ENTRY_END_CHAR)
+        continue;
+
+      if (!dbus_type_is_basic (c) || c == DBUS_TYPE_UNIX_FD)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
 static void
 base_reader_next (DBusTypeReader *reader,
                   int             current_type)
@@ -960,6 +1477,121 @@ _dbus_type_reader_read_fixed_multi (const DBusTypeReader  *reader,
 #endif
 }
 
+/**
+ * Reads elements of an array of structs into an array of C structs,
+ * starting at the current element, and moves the reader past the
+ * elements read. Each basic-typed field in the element signature, in
+ * order and including those in nested structs, is stored at its offset
+ * from field_offsets within the C struct; strings, object paths and
+ * signatures are stored as pointers into the message, as with
+ * _dbus_type_reader_read_basic(). When the C structs have exactly the
+ * wire layout the elements are copied as one block.
+ *
+ * The element type must satisfy _dbus_type_struct_multi_supported().
+ *
+ * @param reader the reader, which must be inside the array
+ * @param elements where to store the elements
+ * @param max_elements how many elements there is room for
+ * @param element_size size of each C struct
+ * @param field_offsets offset of each field within the C struct
+ * @returns the number of elements read, 0 at the end of the array
+ */
+int
+_dbus_type_reader_read_struct_multi (DBusTypeReader *reader,
+                                     void           *elements,
+                                     int             max_elements,
+                                     int             element_size,
+                                     const int      *field_offsets)
+{
+  StructMultiLayout layout;
+  int end_pos;
+  int pos;
+  int n;
+
+  _dbus_assert (!reader->klass->types_only);
+  _dbus_assert (reader->klass == &array_reader_class);
+  _dbus_assert (max_elements >= 0);
+
+  if (!struct_multi_layout_init (&layout, reader->type_str, reader->type_pos,
+                                 reader->byte_order, element_size,
+                                 field_offsets))
+    _dbus_assert_not_reached ("array elements can't be read in bulk");
+
+  end_pos = reader->u.array.start_pos + array_reader_get_array_len (reader);
+  pos = reader->value_pos;
+  n = 0;
+
+  if (layout.copy_as_is)
+    {
+      n = (end_pos - pos) / element_size;
+      if (n > max_elements)
+        n = max_elements;
+
+      memcpy (elements,
+              _dbus_string_get_const_data_len (reader->value_str, pos,
+                                               n * element_size),
+              n * element_size);
+      pos += n * element_size;
+    }
+  else if (layout.fixed_size > 0)
+    {
+      const unsigned char *data;
+
+      data = _dbus_string_get_const_data (reader->value_str);
+
+      while (n < max_elements && pos < end_pos)
+        {
+          unsigned char *element;
+          int i;
+
+          element = (unsigned char *) elements + n * element_size;
+          pos = _DBUS_ALIGN_VALUE (pos, 8);
+
+          for (i = 0; i < layout.n_steps; i++)
+            {
+              const StructMultiStep *step = &layout.steps[i];
+
+              if (step->type != DBUS_TYPE_STRUCT)
+                read_fixed_field (element + step->offset,
+                                  data + pos + step->wire_offset,
+                                  step->type, reader->byte_order);
+            }
+
+          pos += layout.fixed_size;
+          n += 1;
+        }
+    }
+  else
+    {
+      while (n < max_elements && pos < end_pos)
+        {
+          unsigned char *element;
+          int i;
+
+          element = (unsigned char *) elements + n * element_size;
+
+          for (i = 0; i < layout.n_steps; i++)
+            {
+              const StructMultiStep *step = &layout.steps[i];
+
+              if (step->type == DBUS_TYPE_STRUCT)
+                pos = _DBUS_ALIGN_VALUE (pos, 8);
+              else
+                _dbus_marshal_read_basic (reader->value_str, pos, step->type,
+                                          element + step->offset,
+                                          reader->byte_order, &pos);
+            }
+
+          n += 1;
+        }
+    }
+
+  _dbus_assert (pos <= end_pos);
+  reader->value_pos = pos;
+
+  return n;
+}
+
 /**
  * Initialize a new reader pointing to the first type and
  * corresponding value that's a child of the current container. It's
@@ -2379,6 +3011,147 @@ _dbus_type_writer_write_fixed_multi (DBusTypeWriter        *writer,
   return TRUE;
 }
 
+/**
+ * Writes a block of structs, each from a C struct, into an array. The
+ * array's element type must satisfy _dbus_type_struct_multi_supported().
+ * Each basic-typed field in the element signature, in order and
+ * including those in nested structs, is taken from its offset in
+ * field_offsets within the C struct; strings, object paths and
+ * signatures are given as const char* fields. When the C structs
+ * have exactly the wire layout they are copied as one block.
+ *
+ * @param writer the writer, which must be inside the array
+ * @param elements the C structs
+ * @param n_elements number of elements
+ * @param element_size size of each C struct
+ * @param field_offsets offset of each field within the C struct
+ * @returns #FALSE if no memory
+ */
+dbus_bool_t
+_dbus_type_writer_write_struct_multi (DBusTypeWriter *writer,
+                                      const void     *elements,
+                                      int             n_elements,
+                                      int             element_size,
+                                      const int      *field_offsets)
+{
+  StructMultiLayout layout;
+  int pos;
+  int n;
+
+  _dbus_assert (writer->container_type == DBUS_TYPE_ARRAY);
+  _dbus_assert (writer->type_pos_is_expectation);
+  _dbus_assert (n_elements >= 0);
+
+  if (!struct_multi_layout_init (&layout, writer->type_str, writer->type_pos,
+                                 writer->byte_order, element_size,
+                                 field_offsets))
+    _dbus_assert_not_reached ("array elements can't be written in bulk");
+
+  if (!writer->enabled || n_elements == 0)
+    return TRUE;
+
+  /* Room for every element and the padding between them */
+  if (layout.fixed_size > 0 &&
+      !_dbus_string_alloc_space (writer->value_str,
+                                 n_elements * _DBUS_ALIGN_VALUE (layout.fixed_size, 8)))
+    return FALSE;
+
+  pos = writer->value_pos;
+
+  if (layout.copy_as_is)
+    {
+      DBusString block;
+
+      if (!_dbus_string_insert_alignment (writer->value_str, &pos, 8))
+        goto oom;
+
+      _dbus_string_init_const_len (&block, elements,
+                                   n_elements * element_size);
+      if (!_dbus_string_copy (&block, 0, writer->value_str, pos))
+        goto oom;
+
+      pos += n_elements * element_size;
+    }
+  else if (layout.fixed_size > 0)
+    {
+      unsigned char *data;
+      int stride;
+      int total;
+
+      /* the last element has no padding after it */
+      stride = _DBUS_ALIGN_VALUE (layout.fixed_size, 8);
+      total = (n_elements - 1) * stride + layout.fixed_size;
+
+      if (!_dbus_string_insert_alignment (writer->value_str, &pos, 8))
+        goto oom;
+
+      if (!_dbus_string_insert_bytes (writer->value_str, pos, total, '\0'))
+        goto oom;
+
+      data = _dbus_string_get_data_len (writer->value_str, pos, total);
+
+      for (n = 0; n < n_elements; n++)
+        {
+          const unsigned char *element;
+          int i;
+
+          element = (const unsigned char *) elements + n * element_size;
+
+          for (i = 0; i < layout.n_steps; i++)
+            {
+              const StructMultiStep *step = &layout.steps[i];
+
+              if (step->type != DBUS_TYPE_STRUCT)
+                write_fixed_field (data + n * stride + step->wire_offset,
+                                   element + step->offset,
+                                   step->type, writer->byte_order);
+            }
+        }
+
+      pos += total;
+    }
+  else
+    {
+      for (n = 0; n < n_elements; n++)
+        {
+          const unsigned char *element;
+          int i;
+
+          element = (const unsigned char *) elements + n * element_size;
+
+          for (i = 0; i < layout.n_steps; i++)
+            {
+              const StructMultiStep *step = &layout.steps[i];
+
+              if (step->type == DBUS_TYPE_STRUCT)
+                {
+                  if (!_dbus_string_insert_alignment (writer->value_str, &pos, 8))
+                    goto oom;
+                }
+              else if (!_dbus_marshal_write_basic (writer->value_str, pos,
+                                                   step->type,
+                                                   element + step->offset,
+                                                   writer->byte_order, &pos))
+                goto oom;
+            }
+        }
+    }
+
+#if RECURSIVE_MARSHAL_WRITE_TRACE
+  _dbus_verbose ("  type writer %p struct multi written new value_pos = %d n_elements %d\n",
+                 writer, pos, n_elements);
+#endif
+
+  writer->value_pos = pos;
+
+  return TRUE;
+
+ oom:
+  _dbus_string_delete (writer->value_str, writer->value_pos,
+                       pos - writer->value_pos);
+  return FALSE;
+}
+
 static void
 enable_if_after (DBusTypeWriter       *writer,
                  DBusTypeReader       *reader,
@@ -31,6 +31,8 @@ typedef struct DBusTypeReader      DBusTypeReader;
 typedef struct DBusTypeWriter      DBusTypeWriter;
 typedef struct DBusTypeReaderClass DBusTypeReaderClass;
 typedef struct DBusArrayLenFixup   DBusArrayLenFixup;
+typedef struct DBusTypeOp          DBusTypeOp;
+typedef struct DBusCompiledSignature DBusCompiledSignature;
 
 /**
  * The type reader is an iterator for reading values from a block of
@@ -114,6 +116,11 @@ int         _dbus_type_reader_get_array_length          (const DBusTypeReader  *
 void        _dbus_type_reader_read_fixed_multi          (const DBusTypeReader  *reader,
                                                          void                  *value,
                                                          int                   *n_elements);
+int         _dbus_type_reader_read_struct_multi         (DBusTypeReader        *reader,
+                                                         void                  *elements,
+                                                         int                    max_elements,
+                                                         int                    element_size,
+                                                         const int             *field_offsets);
 void        _dbus_type_reader_read_raw                  (const DBusTypeReader  *reader,
                                                          const unsigned char  **value_location);
 void        _dbus_type_reader_recurse                   (DBusTypeReader        *reader,
@@ -138,6 +145,43 @@ dbus_bool_t _dbus_type_reader_equal_values              (const DBusTypeReader *l
 void        _dbus_type_signature_next                   (const char            *signature,
 							 int                   *type_pos);
 
+/**
+ * What a compiled signature knows about the type starting at one
+ * position of the signature, so that walking it needs no parsing.
+ */
+struct DBusTypeOp
+{
+  unsigned char type;      /**< type starting here, #DBUS_TYPE_STRUCT or #DBUS_TYPE_DICT_ENTRY
+                            * for the opening char, #DBUS_TYPE_INVALID at closing chars and the end */
+  unsigned char alignment; /**< alignment of values of the type */
+  unsigned char next;      /**< position just past the complete type starting here */
+  unsigned char opaque;    /**< #TRUE if any fixed_size bytes are a valid value (no padding or booleans) */
+  int fixed_size;          /**< size of every value of the type, or -1 if values vary in size */
+};
+
+/**
+ * A signature parsed once into one #DBusTypeOp per byte, shared
+ * through a process-wide cache.
+ */
+struct DBusCompiledSignature
+{
+  int refcount;        /**< Reference count, protected by the cache lock */
+  int len;             /**< Length of the signature, not counting the nul */
+  char *signature;     /**< The signature, stored after the ops */
+  DBusTypeOp ops[1];   /**< len + 1 ops, the last being #DBUS_TYPE_INVALID */
+};
+
+void                   _dbus_type_ops_compile           (const DBusString      *type_str,
+                                                         int                    type_pos,
+                                                         int                    len,
+                                                         DBusTypeOp            *ops);
+DBusCompiledSignature *_dbus_compiled_signature_get     (const DBusString      *type_str,
+                                                         int                    type_pos,
+                                                         int                    len);
+void                   _dbus_compiled_signature_unref   (DBusCompiledSignature *compiled);
+dbus_bool_t            _dbus_type_struct_multi_supported (const DBusString     *type_str,
+                                                          int                   type_pos);
+
 void        _dbus_type_writer_init                 (DBusTypeWriter        *writer,
                                                     int                    byte_order,
                                                     DBusString            *type_str,
@@ -165,6 +209,11 @@ dbus_bool_t _dbus_type_writer_write_fixed_multi    (DBusTypeWriter        *write
                                                     int                    element_type,
                                                     const void            *value,
                                                     int                    n_elements);
+dbus_bool_t _dbus_type_writer_write_struct_multi   (DBusTypeWriter        *writer,
+                                                    const void            *elements,
+                                                    int                    n_elements,
+                                                    int                    element_size,
+                                                    const int             *field_offsets);
 dbus_bool_t _dbus_type_writer_recurse              (DBusTypeWriter        *writer,
                                                     int                    container_type,
                                                     const DBusString      *contained_type,
@@ -60,17 +60,15 @@ _dbus_validate_signature_with_reason (const DBusString *type_str,
   int dict_entry_depth;
   DBusValidity result;
 
-  int element_count;
-  DBusList *element_count_stack;
+  /* Number of complete types seen so far at each level of struct or
+   * dict entry nesting; the depth limits below keep this in bounds.
+   */
+  int element_count[DBUS_MAXIMUM_TYPE_RECURSION_DEPTH * 2 + 1];
+  int n_levels;
 
   result = DBUS_VALID;
-  element_count_stack = NULL;
-
-  if (!_dbus_list_append (&element_count_stack, _DBUS_INT_TO_POINTER (0)))
-    {
-      result = DBUS_VALIDITY_UNKNOWN_OOM_ERROR;
-      goto out;
-    }
+  element_count[0] = 0;
+  n_levels = 1;
 
   _dbus_assert (type_str != NULL);
   _dbus_assert (type_pos < _DBUS_INT32_MAX - len);
@@ -129,13 +127,8 @@ _dbus_validate_signature_with_reason (const DBusString *type_str,
               goto out;
             }
           
-          if (!_dbus_list_append (&element_count_stack, 
-                             _DBUS_INT_TO_POINTER (0)))
-            {
-              result = DBUS_VALIDITY_UNKNOWN_OOM_ERROR;
-              goto out;
-            }
-
+          element_count[n_levels] = 0;
+          n_levels += 1;
           break;
 
         case DBUS_STRUCT_END_CHAR:
@@ -151,7 +144,7 @@ _dbus_validate_signature_with_reason (const DBusString *type_str,
               goto out;
             }
 
-          _dbus_list_pop_last (&element_count_stack);
+          n_levels -= 1;
 
           struct_depth -= 1;
           break;
@@ -171,13 +164,8 @@ _dbus_validate_signature_with_reason (const DBusString *type_str,
               goto out;
             }
 
-          if (!_dbus_list_append (&element_count_stack, 
-                             _DBUS_INT_TO_POINTER (0)))
-            {
-              result = DBUS_VALIDITY_UNKNOWN_OOM_ERROR;
-              goto out;
-            }
-
+          element_count[n_levels] = 0;
+          n_levels += 1;
           break;
 
         case DBUS_DICT_ENTRY_END_CHAR:
@@ -189,14 +177,13 @@ _dbus_validate_signature_with_reason (const DBusString *type_str,
             
           dict_entry_depth -= 1;
 
-          element_count = 
-            _DBUS_POINTER_TO_INT (_dbus_list_pop_last (&element_count_stack));
+          n_levels -= 1;
 
-          if (element_count != 2)
+          if (element_count[n_levels] != 2)
             {
-              if (element_count == 0)
+              if (element_count[n_levels] == 0)
                 result = DBUS_INVALID_DICT_ENTRY_HAS_NO_FIELDS;
-              else if (element_count == 1)
+              else if (element_count[n_levels] == 1)
                 result = DBUS_INVALID_DICT_ENTRY_HAS_ONLY_ONE_FIELD;
               else
                 result = DBUS_INVALID_DICT_ENTRY_HAS_TOO_MANY_FIELDS;
@@ -215,19 +202,7 @@ _dbus_validate_signature_with_reason (const DBusString *type_str,
       if (*p != DBUS_TYPE_ARRAY && 
           *p != DBUS_DICT_ENTRY_BEGIN_CHAR && 
 	  *p != DBUS_STRUCT_BEGIN_CHAR) 
-        {
-          element_count = 
-            _DBUS_POINTER_TO_INT (_dbus_list_pop_last (&element_count_stack));
-
-          ++element_count;
-
-          if (!_dbus_list_append (&element_count_stack, 
-                             _DBUS_INT_TO_POINTER (element_count)))
-            {
-              result = DBUS_VALIDITY_UNKNOWN_OOM_ERROR;
-              goto out;
-            }
-        }
+        element_count[n_levels - 1] += 1;
       
       if (array_depth > 0)
         {
@@ -287,17 +262,33 @@ _dbus_validate_signature_with_reason (const DBusString *type_str,
   result = DBUS_VALID;
 
 out:
-  _dbus_list_clear (&element_count_stack);
   return result;
 }
 
+/* Signatures up to this long are compiled onto the stack, which is
+ * cheaper than a trip through the cache for the header signature and
+ * for typical variants.
+ */
+#define MAX_STACK_COMPILED_SIGNATURE 16
+
+static DBusValidity validate_variant (int                   byte_order,
+                                      int                   total_depth,
+                                      const unsigned char  *p,
+                                      const unsigned char  *end,
+                                      const unsigned char **new_p);
+
 /* note: this function is also used to validate the header's values,
  * since the header is a valid body with a particular signature.
+ *
+ * The signature is walked as compiled ops rather than with a
+ * types-only DBusTypeReader, since this runs once per element of
+ * every array in every message the bus receives.
  */
 static DBusValidity
-validate_body_helper (DBusTypeReader       *reader,
+validate_body_helper (const DBusTypeOp     *ops,
+                      int                   pos,
                       int                   byte_order,
-                      dbus_bool_t           walk_reader_to_end,
+                      dbus_bool_t           walk_to_end,
                       int                   total_depth,
                       const unsigned char  *p,
                       const unsigned char  *end,
@@ -315,14 +306,14 @@ validate_body_helper (DBusTypeReader       *reader,
       return DBUS_INVALID_NESTED_TOO_DEEPLY;
     }
 
-  while ((current_type = _dbus_type_reader_get_current_type (reader)) != DBUS_TYPE_INVALID)
+  while ((current_type = ops[pos].type) != DBUS_TYPE_INVALID)
     {
       const unsigned char *a;
       int alignment;
 
 #if 0
-      _dbus_verbose ("   validating value of type %s type reader %p type_pos %d p %p end %p %d remain\n",
-                     _dbus_type_to_string (current_type), reader, reader->type_pos, p, end,
+      _dbus_verbose ("   validating value of type %s type_pos %d p %p end %p %d remain\n",
+                     _dbus_type_to_string (current_type), pos, p, end,
                      (int) (end - p));
 #endif
 
@@ -345,7 +336,7 @@ validate_body_helper (DBusTypeReader       *reader,
         case DBUS_TYPE_INT64:
         case DBUS_TYPE_UINT64:
         case DBUS_TYPE_DOUBLE:
-          alignment = _dbus_type_get_alignment (current_type);
+          alignment = ops[pos].alignment;
           a = _DBUS_ALIGN_ADDRESS (p, alignment);
           if (a >= end)
             return DBUS_INVALID_NOT_ENOUGH_DATA;
@@ -391,14 +382,14 @@ validate_body_helper (DBusTypeReader       *reader,
 
             if (current_type == DBUS_TYPE_ARRAY)
               {
-                int array_elem_type = _dbus_type_reader_get_element_type (reader);
+                int array_elem_type = ops[pos + 1].type;
 
                 if (!_dbus_type_is_valid (array_elem_type))
                   {
                     return DBUS_INVALID_UNKNOWN_TYPECODE;
                   }
 
-                alignment = _dbus_type_get_alignment (array_elem_type);
+                alignment = ops[pos + 1].alignment;
 
                 a = _DBUS_ALIGN_ADDRESS (p, alignment);
 
@@ -439,7 +430,7 @@ validate_body_helper (DBusTypeReader       *reader,
               }
             else if (current_type == DBUS_TYPE_ARRAY && claimed_len > 0)
               {
-                DBusTypeReader sub;
+                const DBusTypeOp *elem;
                 DBusValidity validity;
                 const unsigned char *array_end;
                 int array_elem_type;
@@ -447,15 +438,10 @@ validate_body_helper (DBusTypeReader       *reader,
                 if (claimed_len > DBUS_MAXIMUM_ARRAY_LENGTH)
                   return DBUS_INVALID_ARRAY_LENGTH_EXCEEDS_MAXIMUM;
                 
-                /* Remember that the reader is types only, so we can't
-                 * use it to iterate over elements. It stays the same
-                 * for all elements.
-                 */
-                _dbus_type_reader_recurse (reader, &sub);
-
                 array_end = p + claimed_len;
 
-                array_elem_type = _dbus_type_reader_get_element_type (reader);
+                elem = &ops[pos + 1];
+                array_elem_type = elem->type;
 
                 /* avoid recursive call to validate_body_helper if this is an array
                  * of fixed-size elements
@@ -487,11 +473,22 @@ validate_body_helper (DBusTypeReader       *reader,
                       }
                   }
 
+                /* Structs of fixed-size fields, where any bytes at all
+                 * make a valid value and no padding falls between or
+                 * after the elements, also need no per-element walk
+                 */
+                else if (elem->opaque && elem->fixed_size % 8 == 0 &&
+                         claimed_len % elem->fixed_size == 0)
+                  {
+                    p = array_end;
+                  }
+
                 else
                   {
                     while (p < array_end)
                       {
-                        validity = validate_body_helper (&sub, byte_order, FALSE,
+                        validity = validate_body_helper (ops, pos + 1,
+                                                         byte_order, FALSE,
                                                          total_depth + 1,
                                                          p, end, &p);
                         if (validity != DBUS_VALID)
@@ -551,82 +548,17 @@ validate_body_helper (DBusTypeReader       *reader,
 
         case DBUS_TYPE_VARIANT:
           {
-            /* 1 byte sig len, sig typecodes, align to
-             * contained-type-boundary, values.
-             */
-
-            /* In addition to normal signature validation, we need to be sure
-             * the signature contains only a single (possibly container) type.
-             */
-            dbus_uint32_t claimed_len;
-            DBusString sig;
-            DBusTypeReader sub;
             DBusValidity validity;
-            int contained_alignment;
-            int contained_type;
-            DBusValidity reason;
-
-            claimed_len = *p;
-            ++p;
-
-            /* + 1 for nul */
-            if (claimed_len + 1 > (unsigned long) (end - p))
-              return DBUS_INVALID_VARIANT_SIGNATURE_LENGTH_OUT_OF_BOUNDS;
-
-            _dbus_string_init_const_len (&sig, p, claimed_len);
-            reason = _dbus_validate_signature_with_reason (&sig, 0,
-                                           _dbus_string_get_length (&sig));
-            if (!(reason == DBUS_VALID))
-              {
-                if (reason == DBUS_VALIDITY_UNKNOWN_OOM_ERROR)
-                  return reason;
-                else 
-                  return DBUS_INVALID_VARIANT_SIGNATURE_BAD;
-              }
-
-            p += claimed_len;
-            
-            if (*p != DBUS_TYPE_INVALID)
-              return DBUS_INVALID_VARIANT_SIGNATURE_MISSING_NUL;
-            ++p;
-
-            contained_type = _dbus_first_type_in_signature (&sig, 0);
-            if (contained_type == DBUS_TYPE_INVALID)
-              return DBUS_INVALID_VARIANT_SIGNATURE_EMPTY;
-            
-            contained_alignment = _dbus_type_get_alignment (contained_type);
-            
-            a = _DBUS_ALIGN_ADDRESS (p, contained_alignment);
-            if (a > end)
-              return DBUS_INVALID_NOT_ENOUGH_DATA;
-            while (p != a)
-              {
-                if (*p != '\0')
-                  return DBUS_INVALID_ALIGNMENT_PADDING_NOT_NUL;
-                ++p;
-              }
 
-            _dbus_type_reader_init_types_only (&sub, &sig, 0);
-
-            _dbus_assert (_dbus_type_reader_get_current_type (&sub) != DBUS_TYPE_INVALID);
-
-            validity = validate_body_helper (&sub, byte_order, FALSE,
-                                             total_depth + 1,
-                                             p, end, &p);
+            validity = validate_variant (byte_order, total_depth, p, end, &p);
             if (validity != DBUS_VALID)
               return validity;
-
-            if (_dbus_type_reader_next (&sub))
-              return DBUS_INVALID_VARIANT_SIGNATURE_SPECIFIES_MULTIPLE_VALUES;
-
-            _dbus_assert (_dbus_type_reader_get_current_type (&sub) == DBUS_TYPE_INVALID);
           }
           break;
 
         case DBUS_TYPE_DICT_ENTRY:
         case DBUS_TYPE_STRUCT:
           {
-            DBusTypeReader sub;
             DBusValidity validity;
 
             a = _DBUS_ALIGN_ADDRESS (p, 8);
@@ -639,9 +571,7 @@ validate_body_helper (DBusTypeReader       *reader,
                 ++p;
               }
 
-            _dbus_type_reader_recurse (reader, &sub);
-
-            validity = validate_body_helper (&sub, byte_order, TRUE,
+            validity = validate_body_helper (ops, pos + 1, byte_order, TRUE,
                                              total_depth + 1,
                                              p, end, &p);
             if (validity != DBUS_VALID)
@@ -655,8 +585,8 @@ validate_body_helper (DBusTypeReader       *reader,
         }
 
 #if 0
-      _dbus_verbose ("   validated value of type %s type reader %p type_pos %d p %p end %p %d remain\n",
-                     _dbus_type_to_string (current_type), reader, reader->type_pos, p, end,
+      _dbus_verbose ("   validated value of type %s type_pos %d p %p end %p %d remain\n",
+                     _dbus_type_to_string (current_type), pos, p, end,
                      (int) (end - p));
 #endif
 
@@ -667,8 +597,8 @@ validate_body_helper (DBusTypeReader       *reader,
           return DBUS_INVALID_NOT_ENOUGH_DATA;
         }
 
-      if (walk_reader_to_end)
-        _dbus_type_reader_next (reader);
+      if (walk_to_end)
+        pos = ops[pos].next;
       else
         break;
     }
@@ -679,6 +609,108 @@ validate_body_helper (DBusTypeReader       *reader,
   return DBUS_VALID;
 }
 
+/* Validates a variant's signature and then its single value */
+static DBusValidity
+validate_variant (int                   byte_order,
+                  int                   total_depth,
+                  const unsigned char  *p,
+                  const unsigned char  *end,
+                  const unsigned char **new_p)
+{
+  /* 1 byte sig len, sig typecodes, align to
+   * contained-type-boundary, values.
+   */
+
+  /* In addition to normal signature validation, we need to be sure
+   * the signature contains only a single (possibly container) type.
+   */
+  dbus_uint32_t claimed_len;
+  DBusString sig;
+  DBusTypeOp stack_ops[MAX_STACK_COMPILED_SIGNATURE + 1];
+  DBusCompiledSignature *compiled;
+  const DBusTypeOp *sub_ops;
+  DBusValidity validity;
+  DBusValidity reason;
+  const unsigned char *a;
+
+  claimed_len = *p;
+  ++p;
+
+  /* + 1 for nul */
+  if (claimed_len + 1 > (unsigned long) (end - p))
+    return DBUS_INVALID_VARIANT_SIGNATURE_LENGTH_OUT_OF_BOUNDS;
+
+  _dbus_string_init_const_len (&sig, p, claimed_len);
+  reason = _dbus_validate_signature_with_reason (&sig, 0,
+                                                 _dbus_string_get_length (&sig));
+  if (!(reason == DBUS_VALID))
+    {
+      if (reason == DBUS_VALIDITY_UNKNOWN_OOM_ERROR)
+        return reason;
+      else 
+        return DBUS_INVALID_VARIANT_SIGNATURE_BAD;
+    }
+
+  p += claimed_len;
+  
+  if (*p != DBUS_TYPE_INVALID)
+    return DBUS_INVALID_VARIANT_SIGNATURE_MISSING_NUL;
+  ++p;
+
+  if (claimed_len == 0)
+    return DBUS_INVALID_VARIANT_SIGNATURE_EMPTY;
+
+  if (claimed_len <= MAX_STACK_COMPILED_SIGNATURE)
+    {
+      compiled = NULL;
+      _dbus_type_ops_compile (&sig, 0, claimed_len, stack_ops);
+      sub_ops = stack_ops;
+    }
+  else
+    {
+      compiled = _dbus_compiled_signature_get (&sig, 0, claimed_len);
+      if (compiled == NULL)
+        return DBUS_VALIDITY_UNKNOWN_OOM_ERROR;
+      sub_ops = compiled->ops;
+    }
+
+  a = _DBUS_ALIGN_ADDRESS (p, sub_ops[0].alignment);
+  if (a > end)
+    {
+      validity = DBUS_INVALID_NOT_ENOUGH_DATA;
+      goto out;
+    }
+  while (p != a)
+    {
+      if (*p != '\0')
+        {
+          validity = DBUS_INVALID_ALIGNMENT_PADDING_NOT_NUL;
+          goto out;
+        }
+      ++p;
+    }
+
+  validity = validate_body_helper (sub_ops, 0, byte_order, FALSE,
+                                   total_depth + 1,
+                                   p, end, &p);
+  if (validity != DBUS_VALID)
+    goto out;
+
+  if (sub_ops[sub_ops[0].next].type != DBUS_TYPE_INVALID)
+    {
+      validity = DBUS_INVALID_VARIANT_SIGNATURE_SPECIFIES_MULTIPLE_VALUES;
+      goto out;
+    }
+
+  *new_p = p;
+
+ out:
+  if (compiled != NULL)
+    _dbus_compiled_signature_unref (compiled);
+
+  return validity;
+}
+
 /**
  * Verifies that the range of value_str from value_pos to value_end is
  * a legitimate value of type expected_signature.  If this function
@@ -708,7 +740,10 @@ _dbus_validate_body_with_reason (const DBusString *expected_signature,
                                  int               value_pos,
                                  int               len)
 {
-  DBusTypeReader reader;
+  DBusTypeOp stack_ops[MAX_STACK_COMPILED_SIGNATURE + 1];
+  DBusCompiledSignature *compiled;
+  const DBusTypeOp *ops;
+  DBusString sig;
   const unsigned char *p;
   const unsigned char *end;
   DBusValidity validity;
@@ -722,13 +757,35 @@ _dbus_validate_body_with_reason (const DBusString *expected_signature,
                                                                   expected_signature_start,
                                                                   0));
 
-  _dbus_type_reader_init_types_only (&reader,
-                                     expected_signature, expected_signature_start);
+  _dbus_string_init_const (&sig,
+                           _dbus_string_get_const_data_len (expected_signature,
+                                                            expected_signature_start,
+                                                            0));
+
+  if (_dbus_string_get_length (&sig) <= MAX_STACK_COMPILED_SIGNATURE)
+    {
+      compiled = NULL;
+      _dbus_type_ops_compile (&sig, 0, _dbus_string_get_length (&sig),
+                              stack_ops);
+      ops = stack_ops;
+    }
+  else
+    {
+      compiled = _dbus_compiled_signature_get (&sig, 0,
+                                               _dbus_string_get_length (&sig));
+      if (compiled == NULL)
+        return DBUS_VALIDITY_UNKNOWN_OOM_ERROR;
+      ops = compiled->ops;
+    }
 
   p = _dbus_string_get_const_data_len (value_str, value_pos, len);
   end = p + len;
 
-  validity = validate_body_helper (&reader, byte_order, TRUE, 0, p, end, &p);
+  validity = validate_body_helper (ops, 0, byte_order, TRUE, 0, p, end, &p);
+
+  if (compiled != NULL)
+    _dbus_compiled_signature_unref (compiled);
+
   if (validity != DBUS_VALID)
     return validity;
   
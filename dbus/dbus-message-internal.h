@@ -38,6 +38,11 @@ void _dbus_message_get_network_data  (DBusMessage       *message,
 void _dbus_message_get_unix_fds      (DBusMessage *message,
                                       const int **fds,
                                       unsigned *n_fds);
+dbus_bool_t _dbus_message_get_body_stream_chunk (DBusMessage          *message,
+                                                 const unsigned char **data,
+                                                 int                  *n_bytes,
+                                                 int                  *offset,
+                                                 int                  *total);
 
 void        _dbus_message_lock                  (DBusMessage  *message);
 void        _dbus_message_unlock                (DBusMessage  *message);
@@ -84,6 +89,10 @@ void               _dbus_message_loader_set_max_message_unix_fds(DBusMessageLoad
                                                                  long                n);
 long               _dbus_message_loader_get_max_message_unix_fds(DBusMessageLoader  *loader);
 
+void               _dbus_message_loader_set_body_stream_threshold (DBusMessageLoader  *loader,
+                                                                   long                size);
+long               _dbus_message_loader_get_body_stream_threshold (DBusMessageLoader  *loader);
+
 DBUS_END_DECLS
 
 #endif /* DBUS_MESSAGE_INTERNAL_H */
@@ -68,6 +68,11 @@ struct DBusMessageLoader
   long max_message_size; /**< Maximum size of a message */
   long max_message_unix_fds; /**< Maximum unix fds in a message */
 
+  long body_stream_threshold; /**< Bodies of type "ay" at least this long are streamed in chunks, 0 to never stream */
+  DBusMessage *stream_message; /**< Header of the message whose body is being streamed, or #NULL */
+  int stream_offset; /**< Offset into the streamed byte array of the next chunk */
+  int stream_total; /**< Length of the streamed byte array */
+
   DBusValidity corruption_reason; /**< why we were corrupted */
 
   unsigned int corrupted : 1; /**< We got broken data, and are no longer working */
@@ -106,6 +111,8 @@ struct DBusMessage
 
   unsigned int locked : 1; /**< Message being sent, no modifications allowed. */
 
+  unsigned int stream_chunk : 1; /**< Body holds a slice of a streamed byte array, not a marshaled body */
+
 #ifndef DBUS_DISABLE_CHECKS
   unsigned int in_cache : 1; /**< Has been "freed" since it's in the cache (this is a debug feature) */
 #endif
@@ -117,6 +124,9 @@ struct DBusMessage
 
   DBusDataSlotList slot_list;   /**< Data stored by allocated integer ID */
 
+  int stream_offset; /**< If stream_chunk, offset of this slice in the byte array */
+  int stream_total; /**< If stream_chunk, length of the whole byte array */
+
 #ifndef DBUS_DISABLE_CHECKS
   int generation; /**< _dbus_current_generation when message was created */
 #endif
@@ -130,6 +140,10 @@ struct DBusMessage
   unsigned n_unix_fds_allocated; /**< Allocated size of the array */
 
   long unix_fd_counter_delta; /**< Size we incremented the unix fd counter by */
+
+#ifdef HAVE_MEMFD_CREATE
+  DBusList *mapped_blobs; /**< Sealed memory files mapped by dbus_message_iter_get_blob() */
+#endif
 #endif
 };
 
@@ -942,6 +942,881 @@ verify_test_message (DBusMessage *message)
     _dbus_assert_not_reached ("Didn't reach end of arguments");
 }
 
+typedef struct
+{
+  dbus_uint32_t a;
+  dbus_uint32_t b;
+  double d;
+} TestSample;
+
+static const int test_sample_offsets[] = {
+  _DBUS_STRUCT_OFFSET (TestSample, a),
+  _DBUS_STRUCT_OFFSET (TestSample, b),
+  _DBUS_STRUCT_OFFSET (TestSample, d)
+};
+
+/* TestSample with a boolean, which is canonicalized on the way */
+typedef struct
+{
+  dbus_uint32_t a;
+  dbus_uint32_t b;
+  double d;
+  dbus_bool_t f;
+} TestFlaggedSample;
+
+static const int test_flagged_sample_offsets[] = {
+  _DBUS_STRUCT_OFFSET (TestFlaggedSample, a),
+  _DBUS_STRUCT_OFFSET (TestFlaggedSample, b),
+  _DBUS_STRUCT_OFFSET (TestFlaggedSample, d),
+  _DBUS_STRUCT_OFFSET (TestFlaggedSample, f)
+};
+
+/* the same fields in a different order than on the wire */
+typedef struct
+{
+  double d;
+  dbus_uint32_t b;
+  dbus_uint32_t a;
+} TestSampleReordered;
+
+static const int test_sample_reordered_offsets[] = {
+  _DBUS_STRUCT_OFFSET (TestSampleReordered, a),
+  _DBUS_STRUCT_OFFSET (TestSampleReordered, b),
+  _DBUS_STRUCT_OFFSET (TestSampleReordered, d)
+};
+
+typedef struct
+{
+  dbus_int32_t i;
+  unsigned char y;
+  dbus_uint32_t u;
+  double d;
+  const char *s;
+  dbus_bool_t b;
+} TestRecord;
+
+/* "(iy(ud)sb)" */
+static const int test_record_offsets[] = {
+  _DBUS_STRUCT_OFFSET (TestRecord, i),
+  _DBUS_STRUCT_OFFSET (TestRecord, y),
+  _DBUS_STRUCT_OFFSET (TestRecord, u),
+  _DBUS_STRUCT_OFFSET (TestRecord, d),
+  _DBUS_STRUCT_OFFSET (TestRecord, s),
+  _DBUS_STRUCT_OFFSET (TestRecord, b)
+};
+
+static const char *test_record_strings[] = { "", "a", "hello", "woo woo woo woo" };
+
+#define N_TEST_SAMPLES 100
+
+static DBusMessage *
+new_struct_array_message (void)
+{
+  DBusMessage *message;
+
+  message = dbus_message_new_method_call ("org.freedesktop.DBus.TestService",
+                                          "/org/freedesktop/TestPath",
+                                          "Foo.TestInterface",
+                                          "StructArray");
+  if (message == NULL)
+    _dbus_assert_not_reached ("oom");
+
+  return message;
+}
+
+static void
+append_samples_one_by_one (DBusMessage      *message,
+                           const TestSample *samples,
+                           int               n_samples)
+{
+  DBusMessageIter iter, array_iter, struct_iter;
+  int i;
+
+  dbus_message_iter_init_append (message, &iter);
+  if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "(uud)",
+                                         &array_iter))
+    _dbus_assert_not_reached ("oom");
+
+  for (i = 0; i < n_samples; i++)
+    {
+      if (!dbus_message_iter_open_container (&array_iter, DBUS_TYPE_STRUCT,
+                                             NULL, &struct_iter) ||
+          !dbus_message_iter_append_basic (&struct_iter, DBUS_TYPE_UINT32,
+                                           &samples[i].a) ||
+          !dbus_message_iter_append_basic (&struct_iter, DBUS_TYPE_UINT32,
+                                           &samples[i].b) ||
+          !dbus_message_iter_append_basic (&struct_iter, DBUS_TYPE_DOUBLE,
+                                           &samples[i].d) ||
+          !dbus_message_iter_close_container (&array_iter, &struct_iter))
+        _dbus_assert_not_reached ("oom");
+    }
+
+  if (!dbus_message_iter_close_container (&iter, &array_iter))
+    _dbus_assert_not_reached ("oom");
+}
+
+static void
+append_struct_array (DBusMessage *message,
+                     const char  *element_signature,
+                     const void  *elements,
+                     int          n_elements,
+                     int          element_size,
+                     const int   *field_offsets)
+{
+  DBusMessageIter iter, array_iter;
+  int half;
+
+  dbus_message_iter_init_append (message, &iter);
+  if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+                                         element_signature, &array_iter))
+    _dbus_assert_not_reached ("oom");
+
+  /* in two calls, to check that they continue the same array */
+  half = n_elements / 2;
+  if (!dbus_message_iter_append_struct_array (&array_iter, elements, half,
+                                              element_size, field_offsets) ||
+      !dbus_message_iter_append_struct_array (&array_iter,
+                                              (const char *) elements + half * element_size,
+                                              n_elements - half,
+                                              element_size, field_offsets))
+    _dbus_assert_not_reached ("oom");
+
+  if (!dbus_message_iter_close_container (&iter, &array_iter))
+    _dbus_assert_not_reached ("oom");
+}
+
+/* Reads the array in chunks; small ones check that each picks up
+ * where the last one left off
+ */
+static int
+get_struct_array (DBusMessage *message,
+                  void        *elements,
+                  int          max_elements,
+                  int          chunk,
+                  int          element_size,
+                  const int   *field_offsets)
+{
+  DBusMessageIter iter, array_iter;
+  int n_read;
+  int n;
+
+  if (!dbus_message_iter_init (message, &iter))
+    _dbus_assert_not_reached ("no arguments");
+  _dbus_assert (dbus_message_iter_get_arg_type (&iter) == DBUS_TYPE_ARRAY);
+  dbus_message_iter_recurse (&iter, &array_iter);
+
+  n_read = 0;
+  while ((n = dbus_message_iter_get_struct_array (&array_iter,
+                                                  (char *) elements + n_read * element_size,
+                                                  MIN (chunk, max_elements - n_read),
+                                                  element_size,
+                                                  field_offsets)) > 0)
+    n_read += n;
+
+  _dbus_assert (dbus_message_iter_get_arg_type (&array_iter) == DBUS_TYPE_INVALID);
+
+  return n_read;
+}
+
+static void
+check_same_body (DBusMessage *lhs,
+                 DBusMessage *rhs)
+{
+  _dbus_assert (strcmp (dbus_message_get_signature (lhs),
+                        dbus_message_get_signature (rhs)) == 0);
+
+  if (!_dbus_string_equal (&lhs->body, &rhs->body))
+    {
+      _dbus_verbose_bytes_of_string (&lhs->body, 0, _dbus_string_get_length (&lhs->body));
+      _dbus_verbose_bytes_of_string (&rhs->body, 0, _dbus_string_get_length (&rhs->body));
+      _dbus_assert_not_reached ("struct array written in bulk differs");
+    }
+}
+
+static void
+check_struct_arrays (void)
+{
+  TestSample samples[N_TEST_SAMPLES];
+  TestSample samples_read[N_TEST_SAMPLES];
+  TestSampleReordered reordered[N_TEST_SAMPLES];
+  TestSampleReordered reordered_read[N_TEST_SAMPLES];
+  TestRecord records[N_TEST_SAMPLES];
+  TestRecord records_read[N_TEST_SAMPLES];
+  DBusMessage *one_by_one;
+  DBusMessage *bulk;
+  DBusMessageIter iter, array_iter, struct_iter, inner_iter;
+  int i;
+
+  for (i = 0; i < N_TEST_SAMPLES; i++)
+    {
+      samples[i].a = i;
+      samples[i].b = 0xdeadbeef - i;
+      samples[i].d = i * 0.5;
+
+      reordered[i].a = samples[i].a;
+      reordered[i].b = samples[i].b;
+      reordered[i].d = samples[i].d;
+
+      records[i].i = -i;
+      records[i].y = i;
+      records[i].u = i * 3;
+      records[i].d = -i * 0.25;
+      records[i].s = test_record_strings[i % _DBUS_N_ELEMENTS (test_record_strings)];
+      records[i].b = i % 3 == 0;
+    }
+
+  /* Same layout in C as on the wire, so copied as one block */
+  one_by_one = new_struct_array_message ();
+  append_samples_one_by_one (one_by_one, samples, N_TEST_SAMPLES);
+
+  bulk = new_struct_array_message ();
+  append_struct_array (bulk, "(uud)", samples, N_TEST_SAMPLES,
+                       sizeof (TestSample), test_sample_offsets);
+
+  check_same_body (one_by_one, bulk);
+
+  memset (samples_read, 0, sizeof (samples_read));
+  _dbus_assert (get_struct_array (one_by_one, samples_read, N_TEST_SAMPLES, 7,
+                                  sizeof (TestSample),
+                                  test_sample_offsets) == N_TEST_SAMPLES);
+  _dbus_assert (memcmp (samples, samples_read, sizeof (samples)) == 0);
+
+  dbus_message_unref (bulk);
+
+  /* A different layout in C, so copied field by field */
+  bulk = new_struct_array_message ();
+  append_struct_array (bulk, "(uud)", reordered, N_TEST_SAMPLES,
+                       sizeof (TestSampleReordered),
+                       test_sample_reordered_offsets);
+
+  check_same_body (one_by_one, bulk);
+
+  memset (reordered_read, 0, sizeof (reordered_read));
+  _dbus_assert (get_struct_array (bulk, reordered_read, N_TEST_SAMPLES, 7,
+                                  sizeof (TestSampleReordered),
+                                  test_sample_reordered_offsets) == N_TEST_SAMPLES);
+  _dbus_assert (memcmp (reordered, reordered_read, sizeof (reordered)) == 0);
+
+  dbus_message_unref (bulk);
+  dbus_message_unref (one_by_one);
+
+  /* Strings, booleans, padding and nested structs */
+  one_by_one = new_struct_array_message ();
+  dbus_message_iter_init_append (one_by_one, &iter);
+  if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "(iy(ud)sb)",
+                                         &array_iter))
+    _dbus_assert_not_reached ("oom");
+
+  for (i = 0; i < N_TEST_SAMPLES; i++)
+    {
+      if (!dbus_message_iter_open_container (&array_iter, DBUS_TYPE_STRUCT,
+                                             NULL, &struct_iter) ||
+          !dbus_message_iter_append_basic (&struct_iter, DBUS_TYPE_INT32,
+                                           &records[i].i) ||
+          !dbus_message_iter_append_basic (&struct_iter, DBUS_TYPE_BYTE,
+                                           &records[i].y) ||
+          !dbus_message_iter_open_container (&struct_iter, DBUS_TYPE_STRUCT,
+                                             NULL, &inner_iter) ||
+          !dbus_message_iter_append_basic (&inner_iter, DBUS_TYPE_UINT32,
+                                           &records[i].u) ||
+          !dbus_message_iter_append_basic (&inner_iter, DBUS_TYPE_DOUBLE,
+                                           &records[i].d) ||
+          !dbus_message_iter_close_container (&struct_iter, &inner_iter) ||
+          !dbus_message_iter_append_basic (&struct_iter, DBUS_TYPE_STRING,
+                                           &records[i].s) ||
+          !dbus_message_iter_append_basic (&struct_iter, DBUS_TYPE_BOOLEAN,
+                                           &records[i].b) ||
+          !dbus_message_iter_close_container (&array_iter, &struct_iter))
+        _dbus_assert_not_reached ("oom");
+    }
+
+  if (!dbus_message_iter_close_container (&iter, &array_iter))
+    _dbus_assert_not_reached ("oom");
+
+  bulk = new_struct_array_message ();
+  append_struct_array (bulk, "(iy(ud)sb)", records, N_TEST_SAMPLES,
+                       sizeof (TestRecord), test_record_offsets);
+
+  check_same_body (one_by_one, bulk);
+
+  memset (records_read, 0, sizeof (records_read));
+  _dbus_assert (get_struct_array (bulk, records_read, N_TEST_SAMPLES, 7,
+                                  sizeof (TestRecord),
+                                  test_record_offsets) == N_TEST_SAMPLES);
+
+  for (i = 0; i < N_TEST_SAMPLES; i++)
+    {
+      _dbus_assert (records_read[i].i == records[i].i);
+      _dbus_assert (records_read[i].y == records[i].y);
+      _dbus_assert (records_read[i].u == records[i].u);
+      _dbus_assert (records_read[i].d == records[i].d);
+      _dbus_assert (strcmp (records_read[i].s, records[i].s) == 0);
+      _dbus_assert (records_read[i].b == records[i].b);
+    }
+
+  dbus_message_unref (bulk);
+  dbus_message_unref (one_by_one);
+
+  /* Empty arrays */
+  bulk = new_struct_array_message ();
+  append_struct_array (bulk, "(uud)", samples, 0,
+                       sizeof (TestSample), test_sample_offsets);
+  _dbus_assert (get_struct_array (bulk, samples_read, N_TEST_SAMPLES, 7,
+                                  sizeof (TestSample),
+                                  test_sample_offsets) == 0);
+  dbus_message_unref (bulk);
+}
+
+/* In the other byte order, even a matching C layout has to be
+ * written and read field by field
+ */
+static void
+check_struct_arrays_swapped (void)
+{
+  TestFlaggedSample samples[N_TEST_SAMPLES];
+  TestFlaggedSample samples_read[N_TEST_SAMPLES];
+  DBusString signature, one_by_one, bulk;
+  DBusString element;
+  DBusTypeWriter writer, array_writer;
+  DBusTypeReader reader, array_reader;
+  int byte_order;
+  int i;
+
+  byte_order = DBUS_COMPILER_BYTE_ORDER == DBUS_LITTLE_ENDIAN ?
+    DBUS_BIG_ENDIAN : DBUS_LITTLE_ENDIAN;
+
+  memset (samples, 0, sizeof (samples));
+  memset (samples_read, 0, sizeof (samples_read));
+
+  for (i = 0; i < N_TEST_SAMPLES; i++)
+    {
+      samples[i].a = i;
+      samples[i].b = 0x01020304 * i;
+      samples[i].d = i * 1.5;
+      samples[i].f = i % 2;
+    }
+
+  if (!_dbus_string_init (&signature) ||
+      !_dbus_string_init (&one_by_one) ||
+      !_dbus_string_init (&bulk))
+    _dbus_assert_not_reached ("oom");
+
+  _dbus_string_init_const (&element, "(uudb)");
+
+  _dbus_type_writer_init (&writer, byte_order, &signature, 0, &one_by_one, 0);
+  if (!_dbus_type_writer_recurse (&writer, DBUS_TYPE_ARRAY, &element, 0,
+                                  &array_writer))
+    _dbus_assert_not_reached ("oom");
+
+  for (i = 0; i < N_TEST_SAMPLES; i++)
+    {
+      DBusTypeWriter struct_writer;
+
+      if (!_dbus_type_writer_recurse (&array_writer, DBUS_TYPE_STRUCT, NULL, 0,
+                                      &struct_writer) ||
+          !_dbus_type_writer_write_basic (&struct_writer, DBUS_TYPE_UINT32,
+                                          &samples[i].a) ||
+          !_dbus_type_writer_write_basic (&struct_writer, DBUS_TYPE_UINT32,
+                                          &samples[i].b) ||
+          !_dbus_type_writer_write_basic (&struct_writer, DBUS_TYPE_DOUBLE,
+                                          &samples[i].d) ||
+          !_dbus_type_writer_write_basic (&struct_writer, DBUS_TYPE_BOOLEAN,
+                                          &samples[i].f) ||
+          !_dbus_type_writer_unrecurse (&array_writer, &struct_writer))
+        _dbus_assert_not_reached ("oom");
+    }
+
+  if (!_dbus_type_writer_unrecurse (&writer, &array_writer))
+    _dbus_assert_not_reached ("oom");
+
+  _dbus_string_set_length (&signature, 0);
+  _dbus_type_writer_init (&writer, byte_order, &signature, 0, &bulk, 0);
+  if (!_dbus_type_writer_recurse (&writer, DBUS_TYPE_ARRAY, &element, 0,
+                                  &array_writer) ||
+      !_dbus_type_writer_write_struct_multi (&array_writer, samples,
+                                             N_TEST_SAMPLES,
+                                             sizeof (TestFlaggedSample),
+                                             test_flagged_sample_offsets) ||
+      !_dbus_type_writer_unrecurse (&writer, &array_writer))
+    _dbus_assert_not_reached ("oom");
+
+  _dbus_assert (_dbus_string_equal (&one_by_one, &bulk));
+
+  _dbus_type_reader_init (&reader, byte_order, &signature, 0, &bulk, 0);
+  _dbus_type_reader_recurse (&reader, &array_reader);
+  _dbus_assert (_dbus_type_reader_read_struct_multi (&array_reader, samples_read,
+                                                     N_TEST_SAMPLES,
+                                                     sizeof (TestFlaggedSample),
+                                                     test_flagged_sample_offsets) == N_TEST_SAMPLES);
+  _dbus_assert (memcmp (samples, samples_read, sizeof (samples)) == 0);
+
+  _dbus_string_free (&signature);
+  _dbus_string_free (&one_by_one);
+  _dbus_string_free (&bulk);
+}
+
+/* A prime period, so neither reads nor streamed pieces line up with it */
+#define STREAM_PATTERN_PERIOD 65537
+#define STREAM_READ_LEN 50000
+#define STREAM_THRESHOLD (1024 * 1024)
+#define N_STREAMED_MESSAGES 16
+
+static unsigned char *
+new_stream_pattern (void)
+{
+  unsigned char *pattern;
+  int i;
+
+  /* Twice the period, so any piece up to a period long can be compared
+   * with one memcmp()
+   */
+  pattern = dbus_malloc (STREAM_PATTERN_PERIOD * 2);
+  if (pattern == NULL)
+    _dbus_assert_not_reached ("no memory for stream pattern");
+
+  for (i = 0; i < STREAM_PATTERN_PERIOD * 2; i++)
+    {
+      int j = i % STREAM_PATTERN_PERIOD;
+
+      pattern[i] = (j * 167 + (j >> 8)) & 0xff;
+    }
+
+  return pattern;
+}
+
+/* A locked method call, or a reply, with signature "ay" whose header
+ * claims a byte array of array_len bytes; the body is left to the test
+ */
+static DBusMessage *
+new_stream_header (int message_type,
+                   int array_len)
+{
+  DBusMessage *message;
+  const unsigned char *no_bytes = NULL;
+
+  if (message_type == DBUS_MESSAGE_TYPE_METHOD_CALL)
+    message = dbus_message_new_method_call ("org.freedesktop.DBus.TestService",
+                                            "/org/freedesktop/TestPath",
+                                            "Foo.TestInterface",
+                                            "Upload");
+  else
+    {
+      message = dbus_message_new (message_type);
+      if (message != NULL &&
+          !dbus_message_set_reply_serial (message, 4321))
+        _dbus_assert_not_reached ("no memory");
+    }
+  if (message == NULL)
+    _dbus_assert_not_reached ("no memory");
+
+  if (!dbus_message_append_args (message,
+                                 DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE, &no_bytes, 0,
+                                 DBUS_TYPE_INVALID))
+    _dbus_assert_not_reached ("no memory");
+
+  dbus_message_set_serial (message, 1234);
+  dbus_message_lock (message);
+  _dbus_header_update_lengths (&message->header, 4 + array_len);
+
+  return message;
+}
+
+static void
+feed_loader (DBusMessageLoader *loader,
+             const void        *data,
+             int                len)
+{
+  DBusString *buffer;
+
+  _dbus_message_loader_get_buffer (loader, &buffer);
+  if (!_dbus_string_append_len (buffer, data, len))
+    _dbus_assert_not_reached ("no memory");
+  _dbus_message_loader_return_buffer (loader, buffer, len);
+}
+
+static void
+feed_stream_header (DBusMessageLoader *loader,
+                    DBusMessage       *message,
+                    dbus_uint32_t      array_len)
+{
+  feed_loader (loader, _dbus_string_get_const_data (&message->header.data),
+               _dbus_string_get_length (&message->header.data));
+
+  /* Our messages are in our byte order */
+  feed_loader (loader, &array_len, 4);
+}
+
+/* Pops the pieces of the streamed body the loader queued and checks
+ * they continue the array at *offset; returns how many there were
+ */
+static int
+check_stream_chunks (DBusMessageLoader   *loader,
+                     const unsigned char *pattern,
+                     int                 *offset,
+                     int                  total)
+{
+  DBusMessage *message;
+  int n_chunks;
+
+  if (!_dbus_message_loader_queue_messages (loader))
+    _dbus_assert_not_reached ("no memory to queue messages");
+
+  _dbus_assert (!_dbus_message_loader_get_is_corrupted (loader));
+
+  n_chunks = 0;
+  while ((message = _dbus_message_loader_pop_message (loader)) != NULL)
+    {
+      const unsigned char *data;
+      int n_bytes, chunk_offset, chunk_total;
+
+      if (!_dbus_message_get_body_stream_chunk (message, &data, &n_bytes,
+                                                &chunk_offset, &chunk_total))
+        _dbus_assert_not_reached ("loader queued a whole message while streaming");
+
+      _dbus_assert (chunk_offset == *offset);
+      _dbus_assert (chunk_total == total);
+      _dbus_assert (n_bytes > 0 || total == 0);
+      _dbus_assert (n_bytes <= STREAM_PATTERN_PERIOD);
+      _dbus_assert (chunk_offset + n_bytes <= total);
+      _dbus_assert (memcmp (data, pattern + chunk_offset % STREAM_PATTERN_PERIOD,
+                            n_bytes) == 0);
+
+      /* The header is that of the streamed message */
+      _dbus_assert (dbus_message_get_serial (message) == 1234);
+      _dbus_assert (dbus_message_is_method_call (message, "Foo.TestInterface",
+                                                 "Upload"));
+      _dbus_assert (strcmp (dbus_message_get_signature (message), "ay") == 0);
+
+      *offset += n_bytes;
+      n_chunks += 1;
+      dbus_message_unref (message);
+    }
+
+  return n_chunks;
+}
+
+/* Streams a gigabyte through the loader, as byte arrays of the
+ * largest size the protocol allows, and checks that the loader never
+ * buffers more than a piece and a read of it
+ */
+static void
+check_body_streaming (void)
+{
+  DBusMessageLoader *loader;
+  DBusMessage *message;
+  unsigned char *pattern;
+  int max_buffered;
+  int n_chunks;
+  int i;
+
+  pattern = new_stream_pattern ();
+
+  loader = _dbus_message_loader_new ();
+  if (loader == NULL)
+    _dbus_assert_not_reached ("no memory for loader");
+
+  _dbus_message_loader_set_body_stream_threshold (loader, STREAM_THRESHOLD);
+  _dbus_assert (_dbus_message_loader_get_body_stream_threshold (loader) ==
+                STREAM_THRESHOLD);
+
+  max_buffered = 0;
+  n_chunks = 0;
+
+  for (i = 0; i < N_STREAMED_MESSAGES; i++)
+    {
+      int fed, offset;
+
+      message = new_stream_header (DBUS_MESSAGE_TYPE_METHOD_CALL,
+                                   DBUS_MAXIMUM_ARRAY_LENGTH);
+      feed_stream_header (loader, message, DBUS_MAXIMUM_ARRAY_LENGTH);
+      dbus_message_unref (message);
+
+      fed = 0;
+      offset = 0;
+      while (fed < DBUS_MAXIMUM_ARRAY_LENGTH)
+        {
+          int len;
+
+          len = MIN (STREAM_READ_LEN, DBUS_MAXIMUM_ARRAY_LENGTH - fed);
+          feed_loader (loader, pattern + fed % STREAM_PATTERN_PERIOD, len);
+          fed += len;
+
+          max_buffered = MAX (max_buffered,
+                              _dbus_string_get_length (&loader->data));
+
+          n_chunks += check_stream_chunks (loader, pattern, &offset,
+                                           DBUS_MAXIMUM_ARRAY_LENGTH);
+        }
+
+      _dbus_assert (offset == DBUS_MAXIMUM_ARRAY_LENGTH);
+      _dbus_assert (loader->stream_message == NULL);
+      _dbus_assert (_dbus_string_get_length (&loader->data) == 0);
+    }
+
+  /* Each message arrives in more than one piece */
+  _dbus_assert (n_chunks > N_STREAMED_MESSAGES);
+  _dbus_assert (max_buffered < 2 * STREAM_PATTERN_PERIOD + STREAM_READ_LEN);
+
+  /* An empty array at the threshold is a single empty piece */
+  message = new_stream_header (DBUS_MESSAGE_TYPE_METHOD_CALL, 0);
+  _dbus_message_loader_set_body_stream_threshold (loader, 4);
+  feed_stream_header (loader, message, 0);
+  dbus_message_unref (message);
+  {
+    int offset = 0;
+
+    _dbus_assert (check_stream_chunks (loader, pattern, &offset, 0) == 1);
+    _dbus_assert (loader->stream_message == NULL);
+  }
+  _dbus_message_loader_set_body_stream_threshold (loader, STREAM_THRESHOLD);
+
+  /* Replies are loaded whole, pending calls need them */
+  message = new_stream_header (DBUS_MESSAGE_TYPE_METHOD_RETURN,
+                               STREAM_THRESHOLD);
+  feed_stream_header (loader, message, STREAM_THRESHOLD);
+  dbus_message_unref (message);
+  for (i = 0; i < STREAM_THRESHOLD; i += STREAM_READ_LEN)
+    feed_loader (loader, pattern + i % STREAM_PATTERN_PERIOD,
+                 MIN (STREAM_READ_LEN, STREAM_THRESHOLD - i));
+
+  if (!_dbus_message_loader_queue_messages (loader))
+    _dbus_assert_not_reached ("no memory to queue messages");
+  _dbus_assert (!_dbus_message_loader_get_is_corrupted (loader));
+
+  message = _dbus_message_loader_pop_message (loader);
+  _dbus_assert (message != NULL);
+  _dbus_assert (!message->stream_chunk);
+  _dbus_assert (dbus_message_get_reply_serial (message) == 4321);
+  _dbus_assert (_dbus_string_get_length (&message->body) ==
+                4 + STREAM_THRESHOLD);
+  dbus_message_unref (message);
+  _dbus_assert (_dbus_message_loader_pop_message (loader) == NULL);
+
+  _dbus_message_loader_unref (loader);
+
+  /* A wrong array length is caught before anything is delivered */
+  loader = _dbus_message_loader_new ();
+  if (loader == NULL)
+    _dbus_assert_not_reached ("no memory for loader");
+  _dbus_message_loader_set_body_stream_threshold (loader, STREAM_THRESHOLD);
+
+  message = new_stream_header (DBUS_MESSAGE_TYPE_METHOD_CALL,
+                               STREAM_THRESHOLD);
+  feed_stream_header (loader, message, STREAM_THRESHOLD + 1);
+  dbus_message_unref (message);
+
+  if (!_dbus_message_loader_queue_messages (loader))
+    _dbus_assert_not_reached ("no memory to queue messages");
+  _dbus_assert (_dbus_message_loader_get_is_corrupted (loader));
+  _dbus_assert (_dbus_message_loader_get_corruption_reason (loader) ==
+                DBUS_INVALID_NOT_ENOUGH_DATA);
+  _dbus_assert (_dbus_message_loader_pop_message (loader) == NULL);
+
+  _dbus_message_loader_unref (loader);
+
+  /* The loader doesn't leak a message it's in the middle of streaming */
+  loader = _dbus_message_loader_new ();
+  if (loader == NULL)
+    _dbus_assert_not_reached ("no memory for loader");
+  _dbus_message_loader_set_body_stream_threshold (loader, STREAM_THRESHOLD);
+
+  message = new_stream_header (DBUS_MESSAGE_TYPE_METHOD_CALL,
+                               STREAM_THRESHOLD);
+  feed_stream_header (loader, message, STREAM_THRESHOLD);
+  dbus_message_unref (message);
+  feed_loader (loader, pattern, STREAM_READ_LEN);
+
+  if (!_dbus_message_loader_queue_messages (loader))
+    _dbus_assert_not_reached ("no memory to queue messages");
+  _dbus_assert (loader->stream_message != NULL);
+
+  _dbus_message_loader_unref (loader);
+
+  dbus_free (pattern);
+}
+
+#define TEST_BLOB_SMALL 100
+#define TEST_BLOB_LARGE (256 * 1024 + 3)
+#define TEST_BLOB_SPILL 4096
+
+/* Reads back the blobs check_blobs() appends */
+static void
+check_blob_args (DBusMessage         *message,
+                 const unsigned char *bytes)
+{
+  static const int lengths[] = { TEST_BLOB_SMALL, TEST_BLOB_LARGE,
+                                 TEST_BLOB_LARGE, 0 };
+  DBusMessageIter iter;
+  DBusError error = DBUS_ERROR_INIT;
+  int i;
+
+  if (!dbus_message_iter_init (message, &iter))
+    _dbus_assert_not_reached ("no blobs in message");
+
+  for (i = 0; i < (int) _DBUS_N_ELEMENTS (lengths); i++)
+    {
+      const void *data;
+      int n_bytes;
+
+      if (!dbus_message_iter_get_blob (&iter, &data, &n_bytes, &error))
+        {
+          _dbus_warn ("could not get blob %d: %s\n", i, error.message);
+          _dbus_assert_not_reached ("could not get blob");
+        }
+
+      _dbus_assert (n_bytes == lengths[i]);
+      _dbus_assert (n_bytes == 0 || memcmp (data, bytes, n_bytes) == 0);
+
+      dbus_message_iter_next (&iter);
+    }
+
+  _dbus_assert (dbus_message_iter_get_arg_type (&iter) == DBUS_TYPE_INVALID);
+}
+
+/* Blobs come back the same whether they were spilled to a sealed
+ * memory file or not, also after going through a loader, and
+ * descriptors that aren't sealed memory files are refused
+ */
+static void
+check_blobs (void)
+{
+  DBusMessageLoader *loader;
+  DBusMessage *message;
+  DBusMessageIter iter;
+  DBusMessageIter variant_iter;
+  DBusError error = DBUS_ERROR_INIT;
+  unsigned char *bytes;
+  const char *s;
+  const void *data;
+  int n_bytes;
+  int i;
+
+  bytes = dbus_malloc (TEST_BLOB_LARGE);
+  if (bytes == NULL)
+    _dbus_assert_not_reached ("no memory for blob");
+
+  for (i = 0; i < TEST_BLOB_LARGE; i++)
+    bytes[i] = i % 253;
+
+  message = dbus_message_new_signal ("/org/freedesktop/TestPath",
+                                     "Foo.TestInterface",
+                                     "Blobs");
+  if (message == NULL)
+    _dbus_assert_not_reached ("no memory");
+
+  dbus_message_iter_init_append (message, &iter);
+  if (!dbus_message_iter_append_blob (&iter, bytes, TEST_BLOB_SMALL, TEST_BLOB_SPILL) ||
+      !dbus_message_iter_append_blob (&iter, bytes, TEST_BLOB_LARGE, TEST_BLOB_SPILL) ||
+      !dbus_message_iter_append_blob (&iter, bytes, TEST_BLOB_LARGE, 0) ||
+      !dbus_message_iter_append_blob (&iter, NULL, 0, TEST_BLOB_SPILL))
+    _dbus_assert_not_reached ("no memory to append blobs");
+
+  _dbus_assert (strcmp (dbus_message_get_signature (message), "vvvv") == 0);
+
+#if defined (HAVE_UNIX_FD_PASSING) && defined (HAVE_MEMFD_CREATE)
+  /* Only the large blob over the threshold left the body */
+  _dbus_assert (message->n_unix_fds == 1);
+  _dbus_assert (_dbus_string_get_length (&message->body) <
+                TEST_BLOB_SMALL + TEST_BLOB_LARGE + 64);
+#endif
+
+  check_blob_args (message, bytes);
+
+  /* Again on the other side of a loader */
+  dbus_message_set_serial (message, 1);
+  dbus_message_lock (message);
+
+  loader = _dbus_message_loader_new ();
+  if (loader == NULL)
+    _dbus_assert_not_reached ("no memory for loader");
+
+  feed_loader (loader, _dbus_string_get_const_data (&message->header.data),
+               _dbus_string_get_length (&message->header.data));
+  feed_loader (loader, _dbus_string_get_const_data (&message->body),
+               _dbus_string_get_length (&message->body));
+
+#ifdef HAVE_UNIX_FD_PASSING
+  for (i = 0; i < (int) message->n_unix_fds; i++)
+    {
+      int *unix_fds;
+      unsigned n_unix_fds;
+
+      if (!_dbus_message_loader_get_unix_fds (loader, &unix_fds, &n_unix_fds))
+        _dbus_assert_not_reached ("no memory for unix fds");
+      _dbus_assert (n_unix_fds > 0);
+      unix_fds[0] = _dbus_dup (message->unix_fds[i], NULL);
+      _dbus_assert (unix_fds[0] >= 0);
+      _dbus_message_loader_return_unix_fds (loader, unix_fds, 1);
+    }
+#endif
+
+  dbus_message_unref (message);
+
+  if (!_dbus_message_loader_queue_messages (loader))
+    _dbus_assert_not_reached ("no memory to queue messages");
+  _dbus_assert (!_dbus_message_loader_get_is_corrupted (loader));
+
+  message = _dbus_message_loader_pop_message (loader);
+  _dbus_assert (message != NULL);
+  _dbus_message_loader_unref (loader);
+
+  /* Each call maps the file again, all mappings last as long as the message */
+  check_blob_args (message, bytes);
+  check_blob_args (message, bytes);
+  dbus_message_unref (message);
+
+  /* Other arguments aren't blobs */
+  message = dbus_message_new_signal ("/org/freedesktop/TestPath",
+                                     "Foo.TestInterface",
+                                     "NotBlobs");
+  if (message == NULL)
+    _dbus_assert_not_reached ("no memory");
+
+  s = "not a blob";
+  dbus_message_iter_init_append (message, &iter);
+  if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_VARIANT,
+                                         DBUS_TYPE_STRING_AS_STRING,
+                                         &variant_iter) ||
+      !dbus_message_iter_append_basic (&variant_iter, DBUS_TYPE_STRING, &s) ||
+      !dbus_message_iter_close_container (&iter, &variant_iter) ||
+      !dbus_message_iter_append_basic (&iter, DBUS_TYPE_STRING, &s))
+    _dbus_assert_not_reached ("no memory");
+
+#ifdef HAVE_UNIX_FD_PASSING
+  {
+    int fd1, fd2;
+
+    /* A descriptor the sender could still write to */
+    if (!_dbus_full_duplex_pipe (&fd1, &fd2, TRUE, NULL))
+      _dbus_assert_not_reached ("could not create socket pair");
+
+    if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_VARIANT,
+                                           DBUS_TYPE_UNIX_FD_AS_STRING,
+                                           &variant_iter) ||
+        !dbus_message_iter_append_basic (&variant_iter, DBUS_TYPE_UNIX_FD, &fd1) ||
+        !dbus_message_iter_close_container (&iter, &variant_iter))
+      _dbus_assert_not_reached ("no memory");
+
+    _dbus_close (fd1, NULL);
+    _dbus_close (fd2, NULL);
+  }
+#endif
+
+  if (!dbus_message_iter_init (message, &iter))
+    _dbus_assert_not_reached ("no arguments");
+
+  do
+    {
+      _dbus_assert (!dbus_message_iter_get_blob (&iter, &data, &n_bytes, &error));
+      _dbus_assert (dbus_error_has_name (&error, DBUS_ERROR_INVALID_ARGS));
+      dbus_error_free (&error);
+    }
+  while (dbus_message_iter_next (&iter));
+
+  dbus_message_unref (message);
+  dbus_free (bytes);
+}
+
 /**
  * @ingroup DBusMessageInternals
  * Unit test for DBusMessage.
@@ -1424,6 +2299,13 @@ _dbus_message_test (const char *test_data_dir)
 
   dbus_message_unref (message);
 
+  check_struct_arrays ();
+  check_struct_arrays_swapped ();
+  check_body_streaming ();
+  check_blobs ();
+
+  check_memleaks ();
+
   /* Load all the sample messages from the message factory */
   {
     DBusMessageDataIter diter;
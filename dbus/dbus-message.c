@@ -188,6 +188,38 @@ void _dbus_message_get_unix_fds(DBusMessage *message,
 #endif
 }
 
+/**
+ * Gets the slice of a streamed byte array carried by a message the
+ * loader produced while streaming a large body, see
+ * _dbus_message_loader_set_body_stream_threshold(). Such a message
+ * has the header of the original message, but its body is only the
+ * raw bytes of the slice and must not be read with iterators.
+ *
+ * @param message the message
+ * @param data return location for the bytes of the slice
+ * @param n_bytes return location for the length of the slice
+ * @param offset return location for the offset of the slice in the array
+ * @param total return location for the length of the whole array
+ * @returns #FALSE if the message is an ordinary message
+ */
+dbus_bool_t
+_dbus_message_get_body_stream_chunk (DBusMessage          *message,
+                                     const unsigned char **data,
+                                     int                  *n_bytes,
+                                     int                  *offset,
+                                     int                  *total)
+{
+  if (!message->stream_chunk)
+    return FALSE;
+
+  *data = (const unsigned char *) _dbus_string_get_const_data (&message->body);
+  *n_bytes = _dbus_string_get_length (&message->body);
+  *offset = message->stream_offset;
+  *total = message->stream_total;
+
+  return TRUE;
+}
+
 /**
  * Sets the serial number of a message.
  * This can only be done once on a message.
@@ -561,6 +593,27 @@ close_unix_fds(int *fds, unsigned *n_fds)
 }
 #endif
 
+#if defined (HAVE_UNIX_FD_PASSING) && defined (HAVE_MEMFD_CREATE)
+/** A sealed memory file mapped by dbus_message_iter_get_blob() */
+typedef struct
+{
+  const void *data; /**< The mapped data */
+  int len;          /**< Length of the data */
+} DBusMappedBlob;
+
+static void
+unmap_blobs (DBusList **blobs)
+{
+  DBusMappedBlob *blob;
+
+  while ((blob = _dbus_list_pop_first (blobs)) != NULL)
+    {
+      _dbus_unmap_sealed_fd (blob->data, blob->len);
+      dbus_free (blob);
+    }
+}
+#endif
+
 static void
 free_counter (void *element,
               void *data)
@@ -600,6 +653,9 @@ dbus_message_cache_or_finalize (DBusMessage *message)
 
 #ifdef HAVE_UNIX_FD_PASSING
   close_unix_fds(message->unix_fds, &message->n_unix_fds);
+#ifdef HAVE_MEMFD_CREATE
+  unmap_blobs (&message->mapped_blobs);
+#endif
 #endif
 
   was_cached = FALSE;
@@ -1054,6 +1110,9 @@ dbus_message_finalize (DBusMessage *message)
 #ifdef HAVE_UNIX_FD_PASSING
   close_unix_fds(message->unix_fds, &message->n_unix_fds);
   dbus_free(message->unix_fds);
+#ifdef HAVE_MEMFD_CREATE
+  unmap_blobs (&message->mapped_blobs);
+#endif
 #endif
 
   _dbus_assert (message->refcount.value == 0);
@@ -1086,12 +1145,16 @@ dbus_message_new_empty_header (void)
 #ifdef HAVE_UNIX_FD_PASSING
       message->unix_fds = NULL;
       message->n_unix_fds_allocated = 0;
+#ifdef HAVE_MEMFD_CREATE
+      message->mapped_blobs = NULL;
+#endif
 #endif
     }
   
   message->refcount.value = 1;
   message->byte_order = DBUS_COMPILER_BYTE_ORDER;
   message->locked = FALSE;
+  message->stream_chunk = FALSE;
 #ifndef DBUS_DISABLE_CHECKS
   message->in_cache = FALSE;
 #endif
@@ -1451,6 +1514,9 @@ dbus_message_copy (const DBusMessage *message)
   retval->refcount.value = 1;
   retval->byte_order = message->byte_order;
   retval->locked = FALSE;
+  retval->stream_chunk = message->stream_chunk;
+  retval->stream_offset = message->stream_offset;
+  retval->stream_total = message->stream_total;
 #ifndef DBUS_DISABLE_CHECKS
   retval->generation = message->generation;
 #endif
@@ -1838,6 +1904,7 @@ dbus_message_get_args (DBusMessage     *message,
   va_list var_args;
 
   _dbus_return_val_if_fail (message != NULL, FALSE);
+  _dbus_return_val_if_fail (!message->stream_chunk, FALSE);
   _dbus_return_val_if_error_is_set (error, FALSE);
 
   va_start (var_args, first_arg_type);
@@ -1866,6 +1933,7 @@ dbus_message_get_args_valist (DBusMessage     *message,
   DBusMessageIter iter;
 
   _dbus_return_val_if_fail (message != NULL, FALSE);
+  _dbus_return_val_if_fail (!message->stream_chunk, FALSE);
   _dbus_return_val_if_error_is_set (error, FALSE);
 
   dbus_message_iter_init (message, &iter);
@@ -1921,6 +1989,7 @@ dbus_message_iter_init (DBusMessage     *message,
   int type_pos;
 
   _dbus_return_val_if_fail (message != NULL, FALSE);
+  _dbus_return_val_if_fail (!message->stream_chunk, FALSE);
   _dbus_return_val_if_fail (iter != NULL, FALSE);
 
   get_const_signature (&message->header, &type_str, &type_pos);
@@ -2256,6 +2325,175 @@ dbus_message_iter_get_fixed_array (DBusMessageIter  *iter,
                                       value, n_elements);
 }
 
+/**
+ * Reads elements of an array of structs into an array of C structs in
+ * one call, instead of recursing into each struct and reading its
+ * fields one by one. The elements must be structs or dict entries
+ * whose fields are basic types other than #DBUS_TYPE_UNIX_FD, or
+ * further such structs, e.g. "a(uud)" or "a{ss}".
+ *
+ * Each basic-typed field of the element signature, in order and
+ * including the fields of nested structs, is stored at the
+ * corresponding offset in field_offsets within each C struct, as
+ * dbus_message_iter_get_basic() would store it. Strings are stored as
+ * const char* pointing into the message. When the C struct has
+ * exactly the same layout as the elements have in the message, the
+ * whole block is copied at once.
+ *
+ * @code
+ * typedef struct { dbus_uint32_t a; dbus_uint32_t b; double d; } Sample;
+ * static const int sample_offsets[] = {
+ *   offsetof (Sample, a), offsetof (Sample, b), offsetof (Sample, d)
+ * };
+ * Sample buf[64];
+ * int n;
+ *
+ * dbus_message_iter_recurse (&iter, &array_iter);
+ * while ((n = dbus_message_iter_get_struct_array (&array_iter, buf, 64,
+ *                                                 sizeof (Sample),
+ *                                                 sample_offsets)) > 0)
+ *   handle_samples (buf, n);
+ * @endcode
+ *
+ * The message iter should be "in" the array, as for
+ * dbus_message_iter_get_fixed_array(). Elements are read from the
+ * current position, and the iterator is moved past the ones read, so
+ * a large array can be read in chunks.
+ *
+ * @param iter the iterator
+ * @param elements where to store the elements
+ * @param max_elements how many elements fit in elements
+ * @param element_size size of each C struct
+ * @param field_offsets offset of each field within the C struct
+ * @returns number of elements read, 0 at the end of the array
+ */
+int
+dbus_message_iter_get_struct_array (DBusMessageIter  *iter,
+                                    void             *elements,
+                                    int               max_elements,
+                                    int               element_size,
+                                    const int        *field_offsets)
+{
+  DBusMessageRealIter *real = (DBusMessageRealIter *)iter;
+
+  _dbus_return_val_if_fail (_dbus_message_iter_check (real), 0);
+  _dbus_return_val_if_fail (real->iter_type == DBUS_MESSAGE_ITER_TYPE_READER, 0);
+  _dbus_return_val_if_fail (elements != NULL || max_elements == 0, 0);
+  _dbus_return_val_if_fail (max_elements >= 0, 0);
+  _dbus_return_val_if_fail (element_size > 0, 0);
+  _dbus_return_val_if_fail (field_offsets != NULL, 0);
+  _dbus_return_val_if_fail (_dbus_type_struct_multi_supported (real->u.reader.type_str,
+                                                               real->u.reader.type_pos), 0);
+
+  return _dbus_type_reader_read_struct_multi (&real->u.reader,
+                                              elements, max_elements,
+                                              element_size, field_offsets);
+}
+
+/**
+ * Reads a blob appended with dbus_message_iter_append_blob(), that is
+ * a variant holding either a byte array or a sealed memory file.
+ * Either way the bytes are returned in place: a pointer into the
+ * message, or a read-only mapping of the memory file. The data stays
+ * valid until the message is freed.
+ *
+ * Fails if the argument is not such a variant, or if the file
+ * descriptor is not a memory file sealed against writing and
+ * resizing, since then the sender could still change the data.
+ *
+ * @param iter the iterator, pointing at the variant
+ * @param data return location for the data
+ * @param n_bytes return location for the length of the data
+ * @param error error to be filled in on failure
+ * @returns #FALSE if the error was set
+ */
+dbus_bool_t
+dbus_message_iter_get_blob (DBusMessageIter  *iter,
+                            const void      **data,
+                            int              *n_bytes,
+                            DBusError        *error)
+{
+  DBusMessageRealIter *real = (DBusMessageRealIter *)iter;
+  DBusMessageIter variant_iter;
+  DBusMessageIter array_iter;
+
+  _dbus_return_val_if_fail (_dbus_message_iter_check (real), FALSE);
+  _dbus_return_val_if_fail (real->iter_type == DBUS_MESSAGE_ITER_TYPE_READER, FALSE);
+  _dbus_return_val_if_fail (data != NULL, FALSE);
+  _dbus_return_val_if_fail (n_bytes != NULL, FALSE);
+  _dbus_return_val_if_error_is_set (error, FALSE);
+
+  if (dbus_message_iter_get_arg_type (iter) != DBUS_TYPE_VARIANT)
+    goto not_a_blob;
+
+  dbus_message_iter_recurse (iter, &variant_iter);
+
+  switch (dbus_message_iter_get_arg_type (&variant_iter))
+    {
+    case DBUS_TYPE_ARRAY:
+      if (dbus_message_iter_get_element_type (&variant_iter) != DBUS_TYPE_BYTE)
+        goto not_a_blob;
+
+      dbus_message_iter_recurse (&variant_iter, &array_iter);
+      dbus_message_iter_get_fixed_array (&array_iter, data, n_bytes);
+      return TRUE;
+
+#if defined (HAVE_UNIX_FD_PASSING) && defined (HAVE_MEMFD_CREATE)
+    case DBUS_TYPE_UNIX_FD:
+      {
+        DBusMappedBlob *blob;
+        dbus_bool_t mapped;
+        int fd;
+
+        blob = dbus_new (DBusMappedBlob, 1);
+        if (blob == NULL)
+          {
+            _DBUS_SET_OOM (error);
+            return FALSE;
+          }
+
+        /* get_basic() hands out a duplicate, the mapping outlives it */
+        dbus_message_iter_get_basic (&variant_iter, &fd);
+        if (fd < 0)
+          {
+            dbus_free (blob);
+            _DBUS_SET_OOM (error);
+            return FALSE;
+          }
+
+        mapped = _dbus_map_sealed_fd (fd, &blob->data, &blob->len, error);
+        _dbus_close (fd, NULL);
+
+        if (!mapped)
+          {
+            dbus_free (blob);
+            return FALSE;
+          }
+
+        if (!_dbus_list_append (&real->message->mapped_blobs, blob))
+          {
+            _dbus_unmap_sealed_fd (blob->data, blob->len);
+            dbus_free (blob);
+            _DBUS_SET_OOM (error);
+            return FALSE;
+          }
+
+        *data = blob->data;
+        *n_bytes = blob->len;
+        return TRUE;
+      }
+#endif
+
+    default:
+      break;
+    }
+
+ not_a_blob:
+  dbus_set_error_const (error, DBUS_ERROR_INVALID_ARGS,
+                        "Argument is not a variant holding a byte array or a file descriptor");
+  return FALSE;
+}
+
 /**
  * Initializes a #DBusMessageIter for appending arguments to the end
  * of a message.
@@ -2632,6 +2870,173 @@ dbus_message_iter_append_fixed_array (DBusMessageIter *iter,
   return ret;
 }
 
+/**
+ * Appends an array of C structs to an array of structs in one call,
+ * instead of opening a struct container for each element and appending
+ * its fields one by one. You must call dbus_message_iter_open_container()
+ * to open the array first; its element signature must be a struct or
+ * dict entry whose fields are basic types other than
+ * #DBUS_TYPE_UNIX_FD, or further such structs, e.g. "(uud)" or "{ss}".
+ * You may call this function multiple times for the same array.
+ *
+ * Each basic-typed field of the element signature, in order and
+ * including the fields of nested structs, is taken from the
+ * corresponding offset in field_offsets within each C struct, as
+ * dbus_message_iter_append_basic() would take it; so strings are
+ * const char* fields. When the C struct has exactly the same layout as
+ * the elements have in the message, the whole block is copied at once,
+ * which is as cheap as dbus_message_iter_append_fixed_array().
+ *
+ * @code
+ * typedef struct { dbus_uint32_t a; dbus_uint32_t b; double d; } Sample;
+ * static const int sample_offsets[] = {
+ *   offsetof (Sample, a), offsetof (Sample, b), offsetof (Sample, d)
+ * };
+ *
+ * dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "(uud)", &array_iter);
+ * dbus_message_iter_append_struct_array (&array_iter, samples, n_samples,
+ *                                        sizeof (Sample), sample_offsets);
+ * dbus_message_iter_close_container (&iter, &array_iter);
+ * @endcode
+ *
+ * @todo If this fails due to lack of memory, the message is hosed and
+ * you have to start over building the whole message.
+ *
+ * @param iter the append iterator
+ * @param elements the C structs
+ * @param n_elements the number of elements to append
+ * @param element_size size of each C struct
+ * @param field_offsets offset of each field within the C struct
+ * @returns #FALSE if not enough memory
+ */
+dbus_bool_t
+dbus_message_iter_append_struct_array (DBusMessageIter *iter,
+                                       const void      *elements,
+                                       int              n_elements,
+                                       int              element_size,
+                                       const int       *field_offsets)
+{
+  DBusMessageRealIter *real = (DBusMessageRealIter *)iter;
+
+  _dbus_return_val_if_fail (_dbus_message_iter_append_check (real), FALSE);
+  _dbus_return_val_if_fail (real->iter_type == DBUS_MESSAGE_ITER_TYPE_WRITER, FALSE);
+  _dbus_return_val_if_fail (real->u.writer.container_type == DBUS_TYPE_ARRAY, FALSE);
+  _dbus_return_val_if_fail (_dbus_type_struct_multi_supported (real->u.writer.type_str,
+                                                               real->u.writer.type_pos), FALSE);
+  _dbus_return_val_if_fail (elements != NULL || n_elements == 0, FALSE);
+  _dbus_return_val_if_fail (element_size > 0, FALSE);
+  _dbus_return_val_if_fail (field_offsets != NULL, FALSE);
+  _dbus_return_val_if_fail (n_elements >= 0, FALSE);
+  /* every element but the last takes at least 8 bytes */
+  _dbus_return_val_if_fail (n_elements <= DBUS_MAXIMUM_ARRAY_LENGTH / 8, FALSE);
+
+  return _dbus_type_writer_write_struct_multi (&real->u.writer, elements,
+                                               n_elements, element_size,
+                                               field_offsets);
+}
+
+/**
+ * Appends a block of bytes as a variant. Blocks of at least
+ * spill_threshold bytes are copied into a memory file that is sealed
+ * against further changes, and the variant holds that file's
+ * descriptor; the bus then forwards the descriptor rather than the
+ * bytes, and the receiver maps the file instead of copying it out of
+ * the message. Smaller blocks, and all blocks on platforms without
+ * sealed memory files, are appended as a byte array in the variant.
+ * Read the block back with dbus_message_iter_get_blob(), which
+ * handles both.
+ *
+ * Only spill when the connection the message goes out on can pass
+ * file descriptors, see dbus_connection_can_send_type(); pass 0 as
+ * the threshold to never spill. Spilled blocks are not limited to
+ * #DBUS_MAXIMUM_ARRAY_LENGTH, nor counted in the message size.
+ *
+ * @todo If this fails due to lack of memory, the message is hosed and
+ * you have to start over building the whole message.
+ *
+ * @param iter the append iterator
+ * @param data the bytes
+ * @param n_bytes the number of bytes
+ * @param spill_threshold the smallest block to pass as a memory file, or 0
+ * @returns #FALSE if not enough memory
+ */
+dbus_bool_t
+dbus_message_iter_append_blob (DBusMessageIter *iter,
+                               const void      *data,
+                               int              n_bytes,
+                               int              spill_threshold)
+{
+  DBusMessageRealIter *real = (DBusMessageRealIter *)iter;
+  DBusMessageIter variant_iter;
+  DBusMessageIter array_iter;
+
+  _dbus_return_val_if_fail (_dbus_message_iter_append_check (real), FALSE);
+  _dbus_return_val_if_fail (real->iter_type == DBUS_MESSAGE_ITER_TYPE_WRITER, FALSE);
+  _dbus_return_val_if_fail (data != NULL || n_bytes == 0, FALSE);
+  _dbus_return_val_if_fail (n_bytes >= 0, FALSE);
+  _dbus_return_val_if_fail (spill_threshold >= 0, FALSE);
+
+#if defined (HAVE_UNIX_FD_PASSING) && defined (HAVE_MEMFD_CREATE)
+  if (spill_threshold > 0 && n_bytes >= spill_threshold)
+    {
+      int fd;
+
+      /* If the kernel can't do it, fall back to inline bytes */
+      fd = _dbus_memfd_new_sealed ("dbus-blob", data, n_bytes, NULL);
+      if (fd >= 0)
+        {
+          dbus_bool_t appended;
+
+          if (!dbus_message_iter_open_container (iter, DBUS_TYPE_VARIANT,
+                                                 DBUS_TYPE_UNIX_FD_AS_STRING,
+                                                 &variant_iter))
+            {
+              _dbus_close (fd, NULL);
+              return FALSE;
+            }
+
+          /* append_basic() keeps a duplicate */
+          appended = dbus_message_iter_append_basic (&variant_iter,
+                                                     DBUS_TYPE_UNIX_FD, &fd);
+          _dbus_close (fd, NULL);
+
+          if (!appended)
+            {
+              dbus_message_iter_abandon_container (iter, &variant_iter);
+              return FALSE;
+            }
+
+          return dbus_message_iter_close_container (iter, &variant_iter);
+        }
+    }
+#endif
+
+  if (!dbus_message_iter_open_container (iter, DBUS_TYPE_VARIANT,
+                                         DBUS_TYPE_ARRAY_AS_STRING
+                                         DBUS_TYPE_BYTE_AS_STRING,
+                                         &variant_iter))
+    return FALSE;
+
+  if (!dbus_message_iter_open_container (&variant_iter, DBUS_TYPE_ARRAY,
+                                         DBUS_TYPE_BYTE_AS_STRING,
+                                         &array_iter))
+    {
+      dbus_message_iter_abandon_container (iter, &variant_iter);
+      return FALSE;
+    }
+
+  if (!dbus_message_iter_append_fixed_array (&array_iter, DBUS_TYPE_BYTE,
+                                             &data, n_bytes) ||
+      !dbus_message_iter_close_container (&variant_iter, &array_iter))
+    {
+      dbus_message_iter_abandon_container (&variant_iter, &array_iter);
+      dbus_message_iter_abandon_container (iter, &variant_iter);
+      return FALSE;
+    }
+
+  return dbus_message_iter_close_container (iter, &variant_iter);
+}
+
 /**
  * Appends a container-typed value to the message; you are required to
  * append the contents of the container using the returned
@@ -3659,6 +4064,14 @@ dbus_message_contains_unix_fds(DBusMessage *message)
  */
 #define INITIAL_LOADER_DATA_LEN 32
 
+/**
+ * The most bytes of a streamed body carried by one message, see
+ * _dbus_message_loader_set_body_stream_threshold(). The loader waits
+ * for this much of the body before queueing it, so that a slow
+ * sender doesn't cause a message per read.
+ */
+#define BODY_STREAM_CHUNK_LEN (64 * _DBUS_ONE_KILOBYTE)
+
 /**
  * Creates a new message loader. Returns #NULL if memory can't
  * be allocated.
@@ -3737,6 +4150,8 @@ _dbus_message_loader_unref (DBusMessageLoader *loader)
       close_unix_fds(loader->unix_fds, &loader->n_unix_fds);
       dbus_free(loader->unix_fds);
 #endif
+      if (loader->stream_message != NULL)
+        dbus_message_unref (loader->stream_message);
       _dbus_list_foreach (&loader->messages,
                           (DBusForeachFunction) dbus_message_unref,
                           NULL);
@@ -3974,9 +4389,13 @@ load_message (DBusMessageLoader *loader,
         {
           _dbus_verbose ("Failed to validate message body code %d\n", validity);
 
-          loader->corrupted = TRUE;
-          loader->corruption_reason = validity;
-          
+          if (validity == DBUS_VALIDITY_UNKNOWN_OOM_ERROR)
+            oom = TRUE;
+          else
+            {
+              loader->corrupted = TRUE;
+              loader->corruption_reason = validity;
+            }
           goto failed;
         }
     }
@@ -4088,10 +4507,206 @@ load_message (DBusMessageLoader *loader,
   return FALSE;
 }
 
+/*
+ * Called with the header and the array length of a message whose body
+ * is at least body_stream_threshold bytes at the start of
+ * loader->data. If the body is a byte array we can stream, loads the
+ * header into loader->stream_message and drops it from the buffer
+ * along with the array length, which is the only part of such a body
+ * that needs validating; otherwise leaves the message to
+ * load_message().
+ *
+ * Returns FALSE if not enough memory OR the loader was corrupted
+ */
+static dbus_bool_t
+start_body_stream (DBusMessageLoader *loader,
+                   int                byte_order,
+                   int                fields_array_len,
+                   int                header_len,
+                   int                body_len,
+                   dbus_bool_t       *started)
+{
+  DBusMessage *message;
+  DBusValidity validity;
+  dbus_uint32_t n_unix_fds;
+  dbus_uint32_t array_len;
+  int message_type;
+
+  *started = FALSE;
+
+  message = dbus_message_new_empty_header ();
+  if (message == NULL)
+    return FALSE;
+
+  if (!_dbus_header_load (&message->header,
+                          DBUS_VALIDATION_MODE_DATA_IS_UNTRUSTED,
+                          &validity,
+                          byte_order,
+                          fields_array_len,
+                          header_len,
+                          body_len,
+                          &loader->data, 0,
+                          header_len))
+    {
+      _dbus_verbose ("Failed to load header for streamed message code %d\n", validity);
+
+      _dbus_assert (validity != DBUS_VALID);
+
+      dbus_message_unref (message);
+
+      if (validity != DBUS_VALIDITY_UNKNOWN_OOM_ERROR)
+        {
+          loader->corrupted = TRUE;
+          loader->corruption_reason = validity;
+        }
+      return FALSE;
+    }
+
+  message->byte_order = byte_order;
+
+  /* Replies are left alone since pending calls need the whole
+   * message, and so are messages passing file descriptors
+   */
+  message_type = _dbus_header_get_message_type (&message->header);
+  n_unix_fds = 0;
+  _dbus_header_get_field_basic (&message->header,
+                                DBUS_HEADER_FIELD_UNIX_FDS,
+                                DBUS_TYPE_UINT32,
+                                &n_unix_fds);
+
+  if ((message_type != DBUS_MESSAGE_TYPE_METHOD_CALL &&
+       message_type != DBUS_MESSAGE_TYPE_SIGNAL) ||
+      n_unix_fds != 0 ||
+      strcmp (dbus_message_get_signature (message),
+              DBUS_TYPE_ARRAY_AS_STRING DBUS_TYPE_BYTE_AS_STRING) != 0)
+    {
+      dbus_message_unref (message);
+      return TRUE;
+    }
+
+  /* The array starts the body so it needs no padding, and bytes need
+   * no validating, so checking the claimed length is all that
+   * _dbus_validate_body_with_reason() would have done
+   */
+  array_len = _dbus_marshal_read_uint32 (&loader->data, header_len,
+                                         byte_order, NULL);
+
+  validity = DBUS_VALID;
+  if (array_len > DBUS_MAXIMUM_ARRAY_LENGTH)
+    validity = DBUS_INVALID_ARRAY_LENGTH_EXCEEDS_MAXIMUM;
+  else if (array_len > (dbus_uint32_t) (body_len - 4))
+    validity = DBUS_INVALID_NOT_ENOUGH_DATA;
+  else if (array_len < (dbus_uint32_t) (body_len - 4))
+    validity = DBUS_INVALID_TOO_MUCH_DATA;
+
+  if (validity != DBUS_VALID)
+    {
+      _dbus_verbose ("Streamed message has array length %u in body of %d, code %d\n",
+                     array_len, body_len, validity);
+
+      dbus_message_unref (message);
+
+      loader->corrupted = TRUE;
+      loader->corruption_reason = validity;
+      return FALSE;
+    }
+
+  _dbus_string_delete (&loader->data, 0, header_len + 4);
+
+  loader->stream_message = message;
+  loader->stream_offset = 0;
+  loader->stream_total = array_len;
+
+  _dbus_verbose ("Streaming body of %d bytes of message %p\n",
+                 loader->stream_total, message);
+
+  *started = TRUE;
+  return TRUE;
+}
+
+/*
+ * Queues as much of the streamed body as has arrived, in messages
+ * carrying the header of the streamed message and up to
+ * BODY_STREAM_CHUNK_LEN bytes of the array each, and finishes the
+ * stream once the last byte is queued. The final message of an empty
+ * array carries no bytes.
+ *
+ * Returns FALSE if not enough memory
+ */
+static dbus_bool_t
+queue_body_stream_chunks (DBusMessageLoader *loader)
+{
+  while (loader->stream_message != NULL)
+    {
+      DBusMessage *chunk;
+      DBusHeader header;
+      int len;
+
+      len = MIN (loader->stream_total - loader->stream_offset,
+                 BODY_STREAM_CHUNK_LEN);
+      if (_dbus_string_get_length (&loader->data) < len)
+        return TRUE;
+
+      chunk = dbus_message_new_empty_header ();
+      if (chunk == NULL)
+        return FALSE;
+
+      if (!_dbus_header_copy (&loader->stream_message->header, &header))
+        {
+          dbus_message_unref (chunk);
+          return FALSE;
+        }
+
+      /* _dbus_header_copy() resets the serial, but replies have to
+       * refer to the streamed message
+       */
+      _dbus_header_set_serial (&header,
+                               dbus_message_get_serial (loader->stream_message));
+      _dbus_header_free (&chunk->header);
+      chunk->header = header;
+      chunk->byte_order = loader->stream_message->byte_order;
+
+      if (!_dbus_list_append (&loader->messages, chunk))
+        {
+          dbus_message_unref (chunk);
+          return FALSE;
+        }
+
+      if (!_dbus_string_move_len (&loader->data, 0, len, &chunk->body, 0))
+        {
+          _dbus_list_remove_last (&loader->messages, chunk);
+          dbus_message_unref (chunk);
+          return FALSE;
+        }
+
+      chunk->stream_chunk = TRUE;
+      chunk->stream_offset = loader->stream_offset;
+      chunk->stream_total = loader->stream_total;
+
+      loader->stream_offset += len;
+
+      if (loader->stream_offset == loader->stream_total)
+        {
+          _dbus_verbose ("Finished streaming message %p\n",
+                         loader->stream_message);
+
+          dbus_message_unref (loader->stream_message);
+          loader->stream_message = NULL;
+        }
+    }
+
+  return TRUE;
+}
+
 /**
  * Converts buffered data into messages, if we have enough data.  If
  * we don't have enough data, does nothing.
  *
+ * If a body stream threshold is set, method calls and signals whose
+ * body is a byte array at least that long are not buffered whole;
+ * their body is queued in pieces as it arrives instead, see
+ * _dbus_message_loader_set_body_stream_threshold().
+ *
  * @todo we need to check that the proper named header fields exist
  * for each message type.
  *
@@ -4105,20 +4720,53 @@ load_message (DBusMessageLoader *loader,
 dbus_bool_t
 _dbus_message_loader_queue_messages (DBusMessageLoader *loader)
 {
-  while (!loader->corrupted &&
-         _dbus_string_get_length (&loader->data) >= DBUS_MINIMUM_HEADER_SIZE)
+  while (!loader->corrupted)
     {
       DBusValidity validity;
       int byte_order, fields_array_len, header_len, body_len;
+      dbus_bool_t have_message;
+
+      if (loader->stream_message != NULL)
+        {
+          if (!queue_body_stream_chunks (loader))
+            return FALSE;
+
+          if (loader->stream_message != NULL)
+            return TRUE;
+        }
+
+      if (_dbus_string_get_length (&loader->data) < DBUS_MINIMUM_HEADER_SIZE)
+        break;
+
+      have_message = _dbus_header_have_message_untrusted (loader->max_message_size,
+                                                          &validity,
+                                                          &byte_order,
+                                                          &fields_array_len,
+                                                          &header_len,
+                                                          &body_len,
+                                                          &loader->data, 0,
+                                                          _dbus_string_get_length (&loader->data));
+
+      if (validity == DBUS_VALID &&
+          loader->body_stream_threshold > 0 &&
+          body_len >= loader->body_stream_threshold &&
+          body_len >= 4)
+        {
+          dbus_bool_t started;
+
+          /* We need the header and the array length to decide */
+          if (_dbus_string_get_length (&loader->data) < header_len + 4)
+            return TRUE;
+
+          if (!start_body_stream (loader, byte_order, fields_array_len,
+                                  header_len, body_len, &started))
+            return loader->corrupted;
+
+          if (started)
+            continue;
+        }
 
-      if (_dbus_header_have_message_untrusted (loader->max_message_size,
-                                               &validity,
-                                               &byte_order,
-                                               &fields_array_len,
-                                               &header_len,
-                                               &body_len,
-                                               &loader->data, 0,
-                                               _dbus_string_get_length (&loader->data)))
+      if (have_message)
         {
           DBusMessage *message;
 
@@ -4309,6 +4957,39 @@ _dbus_message_loader_get_max_message_unix_fds (DBusMessageLoader  *loader)
   return loader->max_message_unix_fds;
 }
 
+/**
+ * Sets the body length from which the bodies of method calls and
+ * signals with signature "ay" are streamed: rather than buffering the
+ * whole message, the loader queues a message for each piece of the
+ * byte array as it arrives, see _dbus_message_get_body_stream_chunk().
+ * Only the array length needs validating for such a body, and that is
+ * done before the first piece is queued.
+ *
+ * @param loader the loader
+ * @param size the smallest body to stream, or 0 to never stream
+ */
+void
+_dbus_message_loader_set_body_stream_threshold (DBusMessageLoader  *loader,
+                                                long                size)
+{
+  _dbus_assert (size >= 0);
+
+  loader->body_stream_threshold = size;
+}
+
+/**
+ * Gets the value set by
+ * _dbus_message_loader_set_body_stream_threshold().
+ *
+ * @param loader the loader
+ * @returns the smallest body that is streamed, or 0
+ */
+long
+_dbus_message_loader_get_body_stream_threshold (DBusMessageLoader  *loader)
+{
+  return loader->body_stream_threshold;
+}
+
 static DBusDataSlotAllocator slot_allocator;
 _DBUS_DEFINE_GLOBAL_LOCK (message_slots);
 
@@ -237,6 +237,17 @@ DBUS_EXPORT
 void        dbus_message_iter_get_fixed_array  (DBusMessageIter *iter,
                                                 void            *value,
                                                 int             *n_elements);
+DBUS_EXPORT
+int         dbus_message_iter_get_struct_array (DBusMessageIter *iter,
+                                                void            *elements,
+                                                int              max_elements,
+                                                int              element_size,
+                                                const int       *field_offsets);
+DBUS_EXPORT
+dbus_bool_t dbus_message_iter_get_blob         (DBusMessageIter *iter,
+                                                const void     **data,
+                                                int             *n_bytes,
+                                                DBusError       *error);
 
 
 DBUS_EXPORT
@@ -252,6 +263,17 @@ dbus_bool_t dbus_message_iter_append_fixed_array (DBusMessageIter *iter,
                                                   const void      *value,
                                                   int              n_elements);
 DBUS_EXPORT
+dbus_bool_t dbus_message_iter_append_struct_array (DBusMessageIter *iter,
+                                                   const void      *elements,
+                                                   int              n_elements,
+                                                   int              element_size,
+                                                   const int       *field_offsets);
+DBUS_EXPORT
+dbus_bool_t dbus_message_iter_append_blob        (DBusMessageIter *iter,
+                                                  const void      *data,
+                                                  int              n_bytes,
+                                                  int              spill_threshold);
+DBUS_EXPORT
 dbus_bool_t dbus_message_iter_open_container     (DBusMessageIter *iter,
                                                   int              type,
                                                   const char      *contained_signature,
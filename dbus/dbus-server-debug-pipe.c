@@ -378,12 +378,14 @@ _dbus_server_listen_debug_pipe (DBusAddressEntry *entry,
  * Opens a debug pipe transport, used in the test suite.
  * 
  * @param entry the address entry to try opening as debug-pipe
+ * @param nonblocking ignored, debug pipes connect immediately
  * @param transport_p return location for the opened transport
  * @param error error to be set
  * @returns result of the attempt
  */
 DBusTransportOpenResult
 _dbus_transport_open_debug_pipe (DBusAddressEntry  *entry,
+                                 dbus_bool_t        nonblocking,
                                  DBusTransport    **transport_p,
                                  DBusError         *error)
 {
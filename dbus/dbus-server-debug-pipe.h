@@ -38,6 +38,7 @@ DBusServerListenResult  _dbus_server_listen_debug_pipe  (DBusAddressEntry  *entr
                                                          DBusServer       **server_p,
                                                          DBusError         *error);
 DBusTransportOpenResult _dbus_transport_open_debug_pipe (DBusAddressEntry  *entry,
+                                                         dbus_bool_t        nonblocking,
                                                          DBusTransport    **transport_p,
                                                          DBusError         *error);
 
@@ -37,6 +37,14 @@ DBUS_BEGIN_DECLS
 
 typedef struct DBusServerVTable DBusServerVTable;
 
+/**
+ * Called each time a server's listening socket becomes readable, to
+ * ask how many pending clients it may accept before returning to the
+ * main loop. Called with the server locked.
+ */
+typedef int (* DBusServerAcceptLimitFunction) (DBusServer *server,
+                                               void       *data);
+
 /**
  * Virtual table to be implemented by all server "subclasses"
  */
@@ -49,6 +57,12 @@ struct DBusServerVTable
   /**< Disconnect this server. */
 };
 
+/**
+ * Default for how many clients a server accepts per readable event
+ * on its listening socket.
+ */
+#define DBUS_SERVER_DEFAULT_MAX_ACCEPTS_PER_ITERATION 32
+
 /**
  * Internals of DBusServer object
  */
@@ -69,6 +83,9 @@ struct DBusServer
   
   int max_connections;                        /**< Max number of connections allowed at once. */
 
+  DBusServerAcceptLimitFunction accept_limit_function; /**< Limits clients accepted per readable event, or #NULL */
+  void *accept_limit_data;                    /**< Data for accept_limit_function */
+
   DBusDataSlotList slot_list;   /**< Data stored by allocated integer ID */
   
   DBusNewConnectionFunction  new_connection_function;
@@ -111,6 +128,11 @@ void        _dbus_server_toggle_timeout (DBusServer             *server,
 void        _dbus_server_ref_unlocked   (DBusServer             *server);
 void        _dbus_server_unref_unlocked (DBusServer             *server);
 
+void        _dbus_server_set_accept_limit_function     (DBusServer                    *server,
+                                                        DBusServerAcceptLimitFunction  function,
+                                                        void                          *data);
+int         _dbus_server_get_accept_limit_unlocked     (DBusServer                    *server);
+
 typedef enum
 {
   DBUS_SERVER_LISTEN_NOT_HANDLED, /**< we aren't in charge of this address type */
@@ -81,7 +81,9 @@ socket_finalize (DBusServer *server)
   dbus_free (server);
 }
 
-/* Return value is just for memory, not other failures. */
+/* Return value is just for memory, not other failures.
+ * client_fd must already be nonblocking.
+ */
 static dbus_bool_t
 handle_new_client_fd_and_unlock (DBusServer *server,
                                  int         client_fd)
@@ -97,12 +99,6 @@ handle_new_client_fd_and_unlock (DBusServer *server,
 
   HAVE_LOCK_CHECK (server);
 
-  if (!_dbus_set_fd_nonblocking (client_fd, NULL))
-    {
-      SERVER_UNLOCK (server);
-      return TRUE;
-    }
-
   transport = _dbus_transport_new_for_socket (client_fd, &server->guid_hex, FALSE);
   if (transport == NULL)
     {
@@ -156,6 +152,29 @@ handle_new_client_fd_and_unlock (DBusServer *server,
   return TRUE;
 }
 
+static int
+accept_nonblocking_client (DBusServerSocket *socket_server,
+                           int               listen_fd)
+{
+  int client_fd;
+
+  if (socket_server->noncefile == NULL)
+    return _dbus_accept_nonblocking (listen_fd);
+
+  /* The nonce is read with a blocking read, so the socket can only
+   * be made nonblocking once it has been checked
+   */
+  client_fd = _dbus_accept_with_noncefile (listen_fd, socket_server->noncefile);
+
+  if (client_fd >= 0 && !_dbus_set_fd_nonblocking (client_fd, NULL))
+    {
+      _dbus_close_socket (client_fd, NULL);
+      return -1;
+    }
+
+  return client_fd;
+}
+
 static dbus_bool_t
 socket_handle_watch (DBusWatch    *watch,
                    unsigned int  flags,
@@ -186,31 +205,59 @@ socket_handle_watch (DBusWatch    *watch,
     {
       int client_fd;
       int listen_fd;
+      int n_accepted;
+      int max_accepts;
 
       listen_fd = dbus_watch_get_socket (watch);
+      n_accepted = 0;
+      max_accepts = _dbus_server_get_accept_limit_unlocked (server);
+
+      /* Keep the server alive across the new connection callbacks,
+       * since we relock it after each one
+       */
+      _dbus_server_ref_unlocked (server);
+
+      /* Drain the backlog rather than taking one client per main loop
+       * iteration, but stop at the accept limit so that a
+       * connection storm can't starve everyone who is already connected.
+       * Whatever is left over makes the socket readable again.
+       */
+      while (TRUE)
+        {
+          client_fd = accept_nonblocking_client (socket_server, listen_fd);
 
-      if (socket_server->noncefile)
-          client_fd = _dbus_accept_with_noncefile (listen_fd, socket_server->noncefile);
-      else 
-          client_fd = _dbus_accept (listen_fd);
+          if (client_fd < 0)
+            {
+              /* EINTR handled for us */
 
-      if (client_fd < 0)
-        {
-          /* EINTR handled for us */
+              if (_dbus_get_is_errno_eagain_or_ewouldblock ())
+                _dbus_verbose ("No client available to accept after %d\n",
+                               n_accepted);
+              else
+                _dbus_verbose ("Failed to accept a client connection: %s\n",
+                               _dbus_strerror_from_errno ());
 
-          if (_dbus_get_is_errno_eagain_or_ewouldblock ())
-            _dbus_verbose ("No client available to accept after all\n");
-          else
-            _dbus_verbose ("Failed to accept a client connection: %s\n",
-                           _dbus_strerror_from_errno ());
+              break;
+            }
 
-          SERVER_UNLOCK (server);
-        }
-      else
-        {
           if (!handle_new_client_fd_and_unlock (server, client_fd))
             _dbus_verbose ("Rejected client connection due to lack of memory\n");
+
+          n_accepted += 1;
+
+          SERVER_LOCK (server);
+
+          if (server->disconnected ||
+              n_accepted >= max_accepts)
+            break;
         }
+
+      SERVER_UNLOCK (server);
+      dbus_server_unref (server);
+    }
+  else
+    {
+      SERVER_UNLOCK (server);
     }
 
   if (flags & DBUS_WATCH_ERROR)
@@ -132,6 +132,9 @@ _dbus_server_init_base (DBusServer             *server,
 
   _dbus_data_slot_list_init (&server->slot_list);
 
+  server->accept_limit_function = NULL;
+  server->accept_limit_data = NULL;
+
   _dbus_verbose ("Initialized server on address %s\n", server->address);
   
   return TRUE;
@@ -484,6 +487,54 @@ _dbus_server_unref_unlocked (DBusServer *server)
     }
 }
 
+/**
+ * Sets a function that decides, each time the listening socket
+ * becomes readable, how many pending clients the server accepts from
+ * its listen backlog. Accepting a whole burst of clients at once
+ * saves a main loop iteration per client, while the limit keeps a
+ * connection storm from starving the clients that are already
+ * connected. Without a function, up to
+ * #DBUS_SERVER_DEFAULT_MAX_ACCEPTS_PER_ITERATION are accepted.
+ *
+ * @param server the server.
+ * @param function the function, or #NULL for the default
+ * @param data data to pass to the function
+ */
+void
+_dbus_server_set_accept_limit_function (DBusServer                    *server,
+                                        DBusServerAcceptLimitFunction  function,
+                                        void                          *data)
+{
+  SERVER_LOCK (server);
+  server->accept_limit_function = function;
+  server->accept_limit_data = data;
+  SERVER_UNLOCK (server);
+}
+
+/**
+ * Gets how many pending clients to accept now that the listening
+ * socket is readable. This is always at least 1, so the backlog keeps
+ * moving, and at most #DBUS_SERVER_DEFAULT_MAX_ACCEPTS_PER_ITERATION.
+ *
+ * @param server the server, locked.
+ * @returns the number of clients to accept at most
+ */
+int
+_dbus_server_get_accept_limit_unlocked (DBusServer *server)
+{
+  int n;
+
+  HAVE_LOCK_CHECK (server);
+
+  n = DBUS_SERVER_DEFAULT_MAX_ACCEPTS_PER_ITERATION;
+
+  if (server->accept_limit_function != NULL)
+    n = MIN (n, (* server->accept_limit_function) (server,
+                                                    server->accept_limit_data));
+
+  return MAX (n, 1);
+}
+
 /** @} */
 
 /**
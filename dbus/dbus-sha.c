@@ -28,6 +28,18 @@
 #include "dbus-marshal-basic.h" /* for byteswap routines */
 #include <string.h>
 
+/* The SSSE3 and SHA-NI kernels are compiled with per-function target
+ * attributes, so the rest of the library doesn't need -msse flags, and
+ * only used if the CPU we end up running on has the instructions.
+ */
+#if (defined (__x86_64__) || defined (__i386__)) && \
+    ((defined (__GNUC__) && __GNUC__ >= 5 && !defined (__clang__)) || \
+     (defined (__clang_major__) && __clang_major__ >= 4))
+#define SHA_X86_KERNELS 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
 /* The following comments have the history of where this code
  * comes from. I actually copied it from GNet in GNOME CVS.
  * - hp@redhat.com
@@ -165,21 +177,20 @@ effort (for example the reengineering of a great many Capstone chips).
    and the size of the basic block.  It may be necessary to split it into
    sections, e.g. based on the four subrounds
 
-   Note that this corrupts the context->data area */
+   SHATransformExpanded() overwrites the data it is given, SHATransform()
+   works on a copy */
 
 static void
-SHATransform(dbus_uint32_t *digest, dbus_uint32_t *data)
+SHATransformExpanded(dbus_uint32_t *digest, dbus_uint32_t *eData)
 {
   dbus_uint32_t A, B, C, D, E;     /* Local vars */
-  dbus_uint32_t eData[16];       /* Expanded data */
 
-  /* Set up first buffer and local data buffer */
+  /* Set up first buffer */
   A = digest[0];
   B = digest[1];
   C = digest[2];
   D = digest[3];
   E = digest[4];
-  memmove (eData, data, SHA_DATASIZE);
 
   /* Heavy mangling, in 4 sub-rounds of 20 interations each. */
   subRound (A, B, C, D, E, f1, K1, eData[0]);
@@ -274,6 +285,15 @@ SHATransform(dbus_uint32_t *digest, dbus_uint32_t *data)
   digest[4] += E;
 }
 
+static void
+SHATransform(dbus_uint32_t *digest, const dbus_uint32_t *data)
+{
+  dbus_uint32_t eData[16];       /* Expanded data */
+
+  memmove (eData, data, SHA_DATASIZE);
+  SHATransformExpanded (digest, eData);
+}
+
 /* When run on a little-endian CPU we need to perform byte reversal on an
    array of longwords. */
 
@@ -293,9 +313,329 @@ swap_words (dbus_uint32_t *buffer,
 }
 #endif
 
+/* Hashes n_blocks consecutive SHA_DATASIZE-byte blocks into digest */
+typedef void (* SHABlocksFunction) (dbus_uint32_t       *digest,
+                                    const unsigned char *blocks,
+                                    int                  n_blocks);
+
+/* The original byte-oriented implementation, which copies each block
+ * and byte-swaps it in place. It is kept as the reference that the
+ * other implementations are checked against.
+ */
+static void
+sha_blocks_reference (dbus_uint32_t       *digest,
+                      const unsigned char *blocks,
+                      int                  n_blocks)
+{
+  dbus_uint32_t data[16];
+
+  while (n_blocks-- > 0)
+    {
+      memmove (data, blocks, SHA_DATASIZE);
+      swap_words (data, SHA_DATASIZE);
+      SHATransform (digest, data);
+      blocks += SHA_DATASIZE;
+    }
+}
+
+#define LOAD_BE32(p) (((dbus_uint32_t) (p)[0] << 24) | \
+                      ((dbus_uint32_t) (p)[1] << 16) | \
+                      ((dbus_uint32_t) (p)[2] << 8) |  \
+                      ((dbus_uint32_t) (p)[3]))
+
+#define STORE_BE32(p, v) ((p)[0] = (unsigned char) ((v) >> 24), \
+                          (p)[1] = (unsigned char) ((v) >> 16), \
+                          (p)[2] = (unsigned char) ((v) >> 8),  \
+                          (p)[3] = (unsigned char) (v))
+
+/* Portable word-oriented implementation: reads big-endian words
+ * straight out of the caller's buffer, whatever its alignment, into
+ * the expansion buffer.
+ */
+static void
+sha_blocks_generic (dbus_uint32_t       *digest,
+                    const unsigned char *blocks,
+                    int                  n_blocks)
+{
+  dbus_uint32_t data[16];
+  int i;
+
+  while (n_blocks-- > 0)
+    {
+      for (i = 0; i < 16; i++)
+        data[i] = LOAD_BE32 (blocks + i * 4);
+
+      SHATransformExpanded (digest, data);
+      blocks += SHA_DATASIZE;
+    }
+}
+
+#ifdef SHA_X86_KERNELS
+
+static dbus_bool_t
+sha_cpu_has_ssse3 (void)
+{
+  unsigned int eax, ebx, ecx, edx;
+
+  if (!__get_cpuid (1, &eax, &ebx, &ecx, &edx))
+    return FALSE;
+
+  return (ecx & bit_SSSE3) != 0;
+}
+
+static dbus_bool_t
+sha_cpu_has_sha_ni (void)
+{
+  unsigned int eax, ebx, ecx, edx;
+
+  if (__get_cpuid_max (0, NULL) < 7)
+    return FALSE;
+
+  if (!__get_cpuid (1, &eax, &ebx, &ecx, &edx) ||
+      (ecx & bit_SSSE3) == 0 || (ecx & bit_SSE4_1) == 0)
+    return FALSE;
+
+  __cpuid_count (7, 0, eax, ebx, ecx, edx);
+
+  return (ebx & (1 << 29)) != 0; /* SHA extensions */
+}
+
+#define ROTL_EPI32(x, n) _mm_or_si128 (_mm_slli_epi32 ((x), (n)), \
+                                       _mm_srli_epi32 ((x), 32 - (n)))
+
+/* SSSE3 implementation: the message schedule, with the round constants
+ * added, is computed four words at a time and the rounds stay scalar.
+ * Words 16 to 31 use the usual recurrence, where the last lane of each
+ * vector depends on the first and needs fixing up; from word 32 on the
+ * equivalent W[i] = ROTL(2, W[i-6] ^ W[i-16] ^ W[i-28] ^ W[i-32]) has
+ * no such dependency.
+ */
+__attribute__ ((target ("ssse3")))
+static void
+sha_blocks_ssse3 (dbus_uint32_t       *digest,
+                  const unsigned char *blocks,
+                  int                  n_blocks)
+{
+  const __m128i bswap = _mm_set_epi8 (12, 13, 14, 15, 8, 9, 10, 11,
+                                      4, 5, 6, 7, 0, 1, 2, 3);
+  __m128i w[20];
+  dbus_uint32_t wk[80];
+  dbus_uint32_t A, B, C, D, E;
+  int i;
+
+  while (n_blocks-- > 0)
+    {
+      for (i = 0; i < 4; i++)
+        w[i] = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (blocks + i * 16)),
+                                 bswap);
+
+      for (i = 4; i < 8; i++)
+        {
+          __m128i x, fixup;
+
+          /* W[i-3..i-1], 0 */
+          x = _mm_srli_si128 (w[i - 1], 4);
+          x = _mm_xor_si128 (x, w[i - 2]);
+          /* W[i-14..i-11] */
+          x = _mm_xor_si128 (x, _mm_alignr_epi8 (w[i - 3], w[i - 4], 8));
+          x = _mm_xor_si128 (x, w[i - 4]);
+          x = ROTL_EPI32 (x, 1);
+
+          fixup = _mm_slli_si128 (x, 12);
+          w[i] = _mm_xor_si128 (x, ROTL_EPI32 (fixup, 1));
+        }
+
+      for (i = 8; i < 20; i++)
+        {
+          __m128i x;
+
+          /* W[i-6..i-3] */
+          x = _mm_alignr_epi8 (w[i - 1], w[i - 2], 8);
+          x = _mm_xor_si128 (x, w[i - 4]);
+          x = _mm_xor_si128 (x, w[i - 7]);
+          x = _mm_xor_si128 (x, w[i - 8]);
+          w[i] = ROTL_EPI32 (x, 2);
+        }
+
+      for (i = 0; i < 20; i++)
+        {
+          dbus_uint32_t k;
+
+          k = i < 5 ? K1 : i < 10 ? K2 : i < 15 ? K3 : K4;
+          _mm_storeu_si128 ((__m128i *) (wk + i * 4),
+                            _mm_add_epi32 (w[i], _mm_set1_epi32 (k)));
+        }
+
+      A = digest[0];
+      B = digest[1];
+      C = digest[2];
+      D = digest[3];
+      E = digest[4];
+
+#define SSSE3_ROUNDS5(f, i)                             \
+      subRound (A, B, C, D, E, f, 0, wk[i]);            \
+      subRound (E, A, B, C, D, f, 0, wk[i + 1]);        \
+      subRound (D, E, A, B, C, f, 0, wk[i + 2]);        \
+      subRound (C, D, E, A, B, f, 0, wk[i + 3]);        \
+      subRound (B, C, D, E, A, f, 0, wk[i + 4])
+
+      for (i = 0; i < 20; i += 5)
+        {
+          SSSE3_ROUNDS5 (f1, i);
+        }
+      for (i = 20; i < 40; i += 5)
+        {
+          SSSE3_ROUNDS5 (f2, i);
+        }
+      for (i = 40; i < 60; i += 5)
+        {
+          SSSE3_ROUNDS5 (f3, i);
+        }
+      for (i = 60; i < 80; i += 5)
+        {
+          SSSE3_ROUNDS5 (f4, i);
+        }
+
+#undef SSSE3_ROUNDS5
+
+      digest[0] += A;
+      digest[1] += B;
+      digest[2] += C;
+      digest[3] += D;
+      digest[4] += E;
+
+      blocks += SHA_DATASIZE;
+    }
+}
+
+/* One group of four rounds using the SHA extensions, which also moves
+ * the message schedule along: M0 holds the words for these rounds, M1
+ * gets finished for the next group and M2, M3 are started for later.
+ */
+#define SHA_NI_ROUNDS4(E_USE, E_NEXT, M0, M1, M2, M3, f) \
+  E_USE = _mm_sha1nexte_epu32 (E_USE, M0);              \
+  E_NEXT = abcd;                                        \
+  M1 = _mm_sha1msg2_epu32 (M1, M0);                     \
+  abcd = _mm_sha1rnds4_epu32 (abcd, E_USE, f);          \
+  M3 = _mm_sha1msg1_epu32 (M3, M0);                     \
+  M2 = _mm_xor_si128 (M2, M0)
+
+#define SHA_NI_LOAD(i) \
+  _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) (blocks + (i) * 16)), bswap)
+
+/* Implementation using the SHA-NI instructions */
+__attribute__ ((target ("sha,ssse3,sse4.1")))
+static void
+sha_blocks_sha_ni (dbus_uint32_t       *digest,
+                   const unsigned char *blocks,
+                   int                  n_blocks)
+{
+  const __m128i bswap = _mm_set_epi64x (0x0001020304050607ULL,
+                                        0x08090a0b0c0d0e0fULL);
+  __m128i abcd, abcd_save, e0, e0_save, e1;
+  __m128i msg0, msg1, msg2, msg3;
+
+  abcd = _mm_shuffle_epi32 (_mm_loadu_si128 ((const __m128i *) digest), 0x1B);
+  e0 = _mm_set_epi32 (digest[4], 0, 0, 0);
+
+  while (n_blocks-- > 0)
+    {
+      abcd_save = abcd;
+      e0_save = e0;
+
+      /* Rounds 0-15 start the message schedule */
+      msg0 = SHA_NI_LOAD (0);
+      e0 = _mm_add_epi32 (e0, msg0);
+      e1 = abcd;
+      abcd = _mm_sha1rnds4_epu32 (abcd, e0, 0);
+
+      msg1 = SHA_NI_LOAD (1);
+      e1 = _mm_sha1nexte_epu32 (e1, msg1);
+      e0 = abcd;
+      abcd = _mm_sha1rnds4_epu32 (abcd, e1, 0);
+      msg0 = _mm_sha1msg1_epu32 (msg0, msg1);
+
+      msg2 = SHA_NI_LOAD (2);
+      e0 = _mm_sha1nexte_epu32 (e0, msg2);
+      e1 = abcd;
+      abcd = _mm_sha1rnds4_epu32 (abcd, e0, 0);
+      msg1 = _mm_sha1msg1_epu32 (msg1, msg2);
+      msg0 = _mm_xor_si128 (msg0, msg2);
+
+      msg3 = SHA_NI_LOAD (3);
+      e1 = _mm_sha1nexte_epu32 (e1, msg3);
+      e0 = abcd;
+      msg0 = _mm_sha1msg2_epu32 (msg0, msg3);
+      abcd = _mm_sha1rnds4_epu32 (abcd, e1, 0);
+      msg2 = _mm_sha1msg1_epu32 (msg2, msg3);
+      msg1 = _mm_xor_si128 (msg1, msg3);
+
+      SHA_NI_ROUNDS4 (e0, e1, msg0, msg1, msg2, msg3, 0); /* 16-19 */
+      SHA_NI_ROUNDS4 (e1, e0, msg1, msg2, msg3, msg0, 1); /* 20-23 */
+      SHA_NI_ROUNDS4 (e0, e1, msg2, msg3, msg0, msg1, 1);
+      SHA_NI_ROUNDS4 (e1, e0, msg3, msg0, msg1, msg2, 1);
+      SHA_NI_ROUNDS4 (e0, e1, msg0, msg1, msg2, msg3, 1);
+      SHA_NI_ROUNDS4 (e1, e0, msg1, msg2, msg3, msg0, 1);
+      SHA_NI_ROUNDS4 (e0, e1, msg2, msg3, msg0, msg1, 2); /* 40-43 */
+      SHA_NI_ROUNDS4 (e1, e0, msg3, msg0, msg1, msg2, 2);
+      SHA_NI_ROUNDS4 (e0, e1, msg0, msg1, msg2, msg3, 2);
+      SHA_NI_ROUNDS4 (e1, e0, msg1, msg2, msg3, msg0, 2);
+      SHA_NI_ROUNDS4 (e0, e1, msg2, msg3, msg0, msg1, 2);
+      SHA_NI_ROUNDS4 (e1, e0, msg3, msg0, msg1, msg2, 3); /* 60-63 */
+      SHA_NI_ROUNDS4 (e0, e1, msg0, msg1, msg2, msg3, 3);
+
+      /* Rounds 68-79 only finish off the schedule */
+      e1 = _mm_sha1nexte_epu32 (e1, msg1);
+      e0 = abcd;
+      msg2 = _mm_sha1msg2_epu32 (msg2, msg1);
+      abcd = _mm_sha1rnds4_epu32 (abcd, e1, 3);
+      msg3 = _mm_xor_si128 (msg3, msg1);
+
+      e0 = _mm_sha1nexte_epu32 (e0, msg2);
+      e1 = abcd;
+      msg3 = _mm_sha1msg2_epu32 (msg3, msg2);
+      abcd = _mm_sha1rnds4_epu32 (abcd, e0, 3);
+
+      e1 = _mm_sha1nexte_epu32 (e1, msg3);
+      e0 = abcd;
+      abcd = _mm_sha1rnds4_epu32 (abcd, e1, 3);
+
+      e0 = _mm_sha1nexte_epu32 (e0, e0_save);
+      abcd = _mm_add_epi32 (abcd, abcd_save);
+
+      blocks += SHA_DATASIZE;
+    }
+
+  abcd = _mm_shuffle_epi32 (abcd, 0x1B);
+  _mm_storeu_si128 ((__m128i *) digest, abcd);
+  digest[4] = _mm_extract_epi32 (e0, 3);
+}
+
+#endif /* SHA_X86_KERNELS */
+
+static SHABlocksFunction
+sha_select_blocks_function (void)
+{
+#ifdef SHA_X86_KERNELS
+  if (sha_cpu_has_sha_ni ())
+    return sha_blocks_sha_ni;
+
+  if (sha_cpu_has_ssse3 ())
+    return sha_blocks_ssse3;
+#endif
+
+  return sha_blocks_generic;
+}
+
+/* Picked on first use; threads racing to set it all pick the same one */
+static SHABlocksFunction sha_blocks = NULL;
+
 static void
 sha_init (DBusSHAContext *context)
 {
+  if (sha_blocks == NULL)
+    sha_blocks = sha_select_blocks_function ();
+
   /* Set the h-vars to their initial values */
   context->digest[0] = h0init;
   context->digest[1] = h1init;
@@ -309,6 +649,7 @@ sha_init (DBusSHAContext *context)
 
 static void
 sha_append (DBusSHAContext      *context,
+            SHABlocksFunction    blocks,
             const unsigned char *buffer,
             unsigned int         count)
 {
@@ -336,20 +677,17 @@ sha_append (DBusSHAContext      *context,
           return;
         }
       memmove (p, buffer, dataCount);
-      swap_words (context->data, SHA_DATASIZE);
-      SHATransform (context->digest, context->data);
+      (* blocks) (context->digest, (unsigned char *) context->data, 1);
       buffer += dataCount;
       count -= dataCount;
     }
 
-  /* Process data in SHA_DATASIZE chunks */
-  while (count >= SHA_DATASIZE)
+  /* Process whole blocks straight from the caller's buffer */
+  if (count >= SHA_DATASIZE)
     {
-      memmove (context->data, buffer, SHA_DATASIZE);
-      swap_words (context->data, SHA_DATASIZE);
-      SHATransform (context->digest, context->data);
-      buffer += SHA_DATASIZE;
-      count -= SHA_DATASIZE;
+      (* blocks) (context->digest, buffer, count / SHA_DATASIZE);
+      buffer += count - count % SHA_DATASIZE;
+      count %= SHA_DATASIZE;
     }
 
   /* Handle any remaining bytes of data. */
@@ -361,7 +699,9 @@ sha_append (DBusSHAContext      *context,
    1 0* (64-bit count of bits processed, MSB-first) */
 
 static void
-sha_finish (DBusSHAContext *context, unsigned char digest[20])
+sha_finish (DBusSHAContext    *context,
+            SHABlocksFunction  blocks,
+            unsigned char      digest[20])
 {
   int count;
   unsigned char *data_p;
@@ -383,8 +723,7 @@ sha_finish (DBusSHAContext *context, unsigned char digest[20])
     {
       /* Two lots of padding:  Pad the first block to 64 bytes */
       memset (data_p, 0, count);
-      swap_words (context->data, SHA_DATASIZE);
-      SHATransform (context->digest, context->data);
+      (* blocks) (context->digest, (unsigned char *) context->data, 1);
 
       /* Now fill the next block with 56 bytes */
       memset (context->data, 0, SHA_DATASIZE - 8);
@@ -394,11 +733,11 @@ sha_finish (DBusSHAContext *context, unsigned char digest[20])
     memset (data_p, 0, count - 8);
 
   /* Append length in bits and transform */
-  context->data[14] = context->count_hi;
-  context->data[15] = context->count_lo;
+  data_p = (unsigned char *) context->data + SHA_DATASIZE - 8;
+  STORE_BE32 (data_p, context->count_hi);
+  STORE_BE32 (data_p + 4, context->count_lo);
 
-  swap_words (context->data, SHA_DATASIZE - 8);
-  SHATransform (context->digest, context->data);
+  (* blocks) (context->digest, (unsigned char *) context->data, 1);
   swap_words (context->digest, SHA_DIGESTSIZE);
   memmove (digest, context->digest, SHA_DIGESTSIZE);
 }
@@ -438,7 +777,7 @@ _dbus_sha_update (DBusSHAContext   *context,
   input = (const unsigned char*) _dbus_string_get_const_data (data);
   inputLen = _dbus_string_get_length (data);
 
-  sha_append (context, input, inputLen);
+  sha_append (context, sha_blocks, input, inputLen);
 }
 
 /**
@@ -458,7 +797,7 @@ _dbus_sha_final (DBusSHAContext   *context,
 {
   unsigned char digest[20];
 
-  sha_finish (context, digest);
+  sha_finish (context, sha_blocks, digest);
 
   if (!_dbus_string_append_len (results, digest, 20))
     return FALSE;
@@ -920,6 +1259,138 @@ process_test_data (const char *test_data_dir)
   return retval;
 }
 
+typedef struct
+{
+  const char *name;
+  SHABlocksFunction blocks;
+  dbus_bool_t (* available) (void);
+} SHAImplementation;
+
+static dbus_bool_t
+sha_always_available (void)
+{
+  return TRUE;
+}
+
+static const SHAImplementation sha_implementations[] = {
+  { "reference", sha_blocks_reference, sha_always_available },
+  { "generic", sha_blocks_generic, sha_always_available },
+#ifdef SHA_X86_KERNELS
+  { "ssse3", sha_blocks_ssse3, sha_cpu_has_ssse3 },
+  { "sha-ni", sha_blocks_sha_ni, sha_cpu_has_sha_ni },
+#endif
+};
+
+/* Hashes the input in pieces of chunk_len bytes, or all at once if 0 */
+static void
+sha_digest_with (SHABlocksFunction    blocks,
+                 const unsigned char *input,
+                 int                  input_len,
+                 int                  chunk_len,
+                 unsigned char        digest[20])
+{
+  DBusSHAContext context;
+  int offset;
+
+  sha_init (&context);
+
+  if (chunk_len == 0)
+    chunk_len = input_len;
+
+  for (offset = 0; offset < input_len; offset += chunk_len)
+    sha_append (&context, blocks, input + offset,
+                MIN (chunk_len, input_len - offset));
+
+  sha_finish (&context, blocks, digest);
+}
+
+#define SHA_TEST_INPUT_LEN (1024 * 1024 + 13)
+
+/* Checks every implementation the CPU supports against the reference
+ * one, for all the lengths around a block or two, for large inputs,
+ * and when the input arrives in pieces that don't line up with blocks.
+ */
+static dbus_bool_t
+check_implementations_agree (const unsigned char *input)
+{
+  static const int chunk_lens[] = { 0, 1, 3, 63, 64, 65, 1000, 4096 };
+  unsigned char expected[20];
+  unsigned char digest[20];
+  int i, len, c;
+
+  for (i = 1; i < _DBUS_N_ELEMENTS (sha_implementations); i++)
+    {
+      const SHAImplementation *impl = &sha_implementations[i];
+
+      if (!(* impl->available) ())
+        {
+          printf ("SHA-1: %s implementation not supported by this CPU\n",
+                  impl->name);
+          continue;
+        }
+
+      for (len = 0; len <= 3 * SHA_DATASIZE; len++)
+        {
+          sha_digest_with (sha_blocks_reference, input, len, 0, expected);
+          sha_digest_with (impl->blocks, input, len, 0, digest);
+
+          if (memcmp (expected, digest, 20) != 0)
+            {
+              _dbus_warn ("SHA-1 %s implementation disagrees for %d bytes\n",
+                          impl->name, len);
+              return FALSE;
+            }
+        }
+
+      sha_digest_with (sha_blocks_reference, input, SHA_TEST_INPUT_LEN, 0,
+                       expected);
+
+      for (c = 0; c < _DBUS_N_ELEMENTS (chunk_lens); c++)
+        {
+          sha_digest_with (impl->blocks, input, SHA_TEST_INPUT_LEN,
+                           chunk_lens[c], digest);
+
+          if (memcmp (expected, digest, 20) != 0)
+            {
+              _dbus_warn ("SHA-1 %s implementation disagrees for %d bytes in pieces of %d\n",
+                          impl->name, SHA_TEST_INPUT_LEN, chunk_lens[c]);
+              return FALSE;
+            }
+        }
+
+      printf ("SHA-1: %s implementation agrees with the reference\n",
+              impl->name);
+    }
+
+  return TRUE;
+}
+
+static dbus_bool_t
+check_implementations (void)
+{
+  unsigned char *input;
+  dbus_uint32_t seed;
+  dbus_bool_t retval;
+  int i;
+
+  input = dbus_malloc (SHA_TEST_INPUT_LEN);
+  if (input == NULL)
+    _dbus_assert_not_reached ("no memory for SHA-1 input");
+
+  /* Same pseudo-random bytes every run */
+  seed = 0x12345678;
+  for (i = 0; i < SHA_TEST_INPUT_LEN; i++)
+    {
+      seed = seed * 1103515245 + 12345;
+      input[i] = seed >> 24;
+    }
+
+  retval = check_implementations_agree (input);
+
+  dbus_free (input);
+  return retval;
+}
+
 /**
  * @ingroup DBusSHAInternals
  * Unit test for SHA computation.
@@ -963,6 +1434,9 @@ _dbus_sha_test (const char *test_data_dir)
   CHECK ("12345678901234567890123456789012345678901234567890123456789012345678901234567890",
          "50abf5706a150990a08b2c5ea40fa0e585554732");
 
+  if (!check_implementations ())
+    return FALSE;
+
   return TRUE;
 }
 
@@ -38,9 +38,24 @@
 #ifdef HAVE_ERRNO_H
 #include <errno.h>
 #endif
+#ifdef HAVE_POSIX_SPAWN
+#include <spawn.h>
+#endif
+#if defined (DBUS_BUILD_TESTS) && defined (__linux__)
+#include <dirent.h>
+#endif
 
 extern char **environ;
 
+/* glibc 2.24 and later implement posix_spawn() with vfork() semantics,
+ * so it does not copy the caller's page tables, and report exec()
+ * failures from it, so we can tell the parent about them
+ */
+#if defined (HAVE_POSIX_SPAWN) && defined (__GLIBC__) && \
+  (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 24))
+#define USE_POSIX_SPAWN 1
+#endif
+
 /**
  * @addtogroup DBusInternalsUtils
  * @{
@@ -906,6 +921,85 @@ write_status_and_exit (int fd, int status)
   exit (0);
 }
 
+#ifdef DBUS_BUILD_TESTS
+static void
+check_close_on_exec (int fd)
+{
+  int retval;
+
+  retval = fcntl (fd, F_GETFD);
+
+  if (retval != -1 && !(retval & FD_CLOEXEC))
+    _dbus_warn ("Fd %d did not have the close-on-exec flag set!\n", fd);
+}
+
+/* Warns about each descriptor above stderr, other than skip_fd, that
+ * the child would inherit. On Linux we only look at the descriptors
+ * that are open, rather than at every number up to the descriptor
+ * limit.
+ */
+static void
+check_all_close_on_exec (int skip_fd)
+{
+  int i, max_open;
+
+#ifdef __linux__
+  DIR *d;
+
+  if ((d = opendir ("/proc/self/fd")))
+    {
+      struct dirent *de;
+
+      while ((de = readdir (d)))
+        {
+          long l;
+          char *e = NULL;
+
+          if (de->d_name[0] == '.')
+            continue;
+
+          errno = 0;
+          l = strtol (de->d_name, &e, 10);
+          _dbus_assert (errno == 0 && e && !*e);
+
+          if (l < 3 || l == dirfd (d) || l == skip_fd)
+            continue;
+
+          check_close_on_exec ((int) l);
+        }
+
+      closedir (d);
+      return;
+    }
+#endif
+
+  max_open = sysconf (_SC_OPEN_MAX);
+
+  for (i = 3; i < max_open; i++)
+    {
+      if (i == skip_fd)
+        continue;
+
+      check_close_on_exec (i);
+    }
+}
+#endif
+
+/* Runs just before the child is started: whatever the parent did not
+ * mark close-on-exec, the child must not inherit anyway. Only stdin,
+ * stdout and stderr are passed on.
+ */
+static void
+set_close_on_exec_above_stderr (void)
+{
+#if defined (HAVE_CLOSE_RANGE) && defined (CLOSE_RANGE_CLOEXEC)
+  /* Kernels older than 5.11 refuse the flag. We have already set
+   * close-on-exec on everything we opened ourselves, so ignore that.
+   */
+  close_range (3, ~0U, CLOSE_RANGE_CLOEXEC);
+#endif
+}
+
 static void
 do_exec (int                       child_err_report_fd,
 	 char                    **argv,
@@ -913,10 +1007,6 @@ do_exec (int                       child_err_report_fd,
 	 DBusSpawnChildSetupFunc   child_setup,
 	 void                     *user_data)
 {
-#ifdef DBUS_BUILD_TESTS
-  int i, max_open;
-#endif
-
   _dbus_verbose_reset ();
   _dbus_verbose ("Child process has PID " DBUS_PID_FORMAT "\n",
                  _dbus_getpid ());
@@ -925,22 +1015,11 @@ do_exec (int                       child_err_report_fd,
     (* child_setup) (user_data);
 
 #ifdef DBUS_BUILD_TESTS
-  max_open = sysconf (_SC_OPEN_MAX);
-  
-  for (i = 3; i < max_open; i++)
-    {
-      int retval;
-
-      if (i == child_err_report_fd)
-        continue;
-      
-      retval = fcntl (i, F_GETFD);
-
-      if (retval != -1 && !(retval & FD_CLOEXEC))
-	_dbus_warn ("Fd %d did not have the close-on-exec flag set!\n", i);
-    }
+  check_all_close_on_exec (child_err_report_fd);
 #endif
 
+  set_close_on_exec_above_stderr ();
+
   if (envp == NULL)
     {
       _dbus_assert (environ != NULL);
@@ -1089,6 +1168,52 @@ babysit (pid_t grandchild_pid,
   exit (1);
 }
 
+#ifdef USE_POSIX_SPAWN
+/* Starts the child without copying our address space, which is the
+ * parent's, and babysits it. There is no chance to run a child_setup
+ * function between fork() and exec() this way.
+ */
+static void
+spawn_and_babysit (int     child_err_report_fd,
+                   int     parent_pipe,
+                   char  **argv,
+                   char  **envp)
+{
+  pid_t grandchild_pid;
+  int ret;
+
+  if (envp == NULL)
+    {
+      _dbus_assert (environ != NULL);
+
+      envp = environ;
+    }
+
+#ifdef DBUS_BUILD_TESTS
+  check_all_close_on_exec (child_err_report_fd);
+#endif
+
+  /* This also marks our own copies, which is harmless since the
+   * babysitter never execs
+   */
+  set_close_on_exec_above_stderr ();
+
+  ret = posix_spawn (&grandchild_pid, argv[0], NULL, NULL, argv, envp);
+
+  if (ret != 0)
+    {
+      /* We can't tell whether the fork or the exec failed; either way
+       * the program never ran, which is what an exec failure means to
+       * the parent.
+       */
+      errno = ret;
+      write_err_and_exit (child_err_report_fd, CHILD_EXEC_FAILED);
+    }
+
+  babysit (grandchild_pid, parent_pipe);
+}
+#endif
+
 /**
  * Spawns a new process. The executable name and argv[0]
  * are the same, both are provided in argv[0]. The child_setup
@@ -1100,6 +1225,11 @@ babysit (pid_t grandchild_pid,
  * If the spawn fails, no babysitter is created.
  * If sitter_p is #NULL, no babysitter is kept.
  *
+ * The child inherits no file descriptors other than stdin, stdout
+ * and stderr. Where posix_spawn() can start it without copying the
+ * parent's address space, it is used unless there is a child_setup
+ * function to run.
+ *
  * @param sitter_p return location for babysitter or #NULL
  * @param argv the executable and arguments
  * @param env the environment (not used on unix yet)
@@ -1208,7 +1338,17 @@ _dbus_spawn_async_with_babysitter (DBusBabysitter          **sitter_p,
       /* Close the parent's end of the pipes. */
       close_and_invalidate (&child_err_report_pipe[READ_END]);
       close_and_invalidate (&babysitter_pipe[0]);
-      
+
+#ifdef USE_POSIX_SPAWN
+      if (child_setup == NULL)
+        {
+          spawn_and_babysit (child_err_report_pipe[WRITE_END],
+                             babysitter_pipe[1],
+                             argv, env);
+          _dbus_assert_not_reached ("Got to code after spawn_and_babysit()");
+        }
+#endif
+
       /* Create the child that will exec () */
       grandchild_pid = fork ();
       
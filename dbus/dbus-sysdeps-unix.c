@@ -72,6 +72,9 @@
 #ifdef HAVE_GETPEERUCRED
 #include <ucred.h>
 #endif
+#ifdef HAVE_MEMFD_CREATE
+#include <sys/mman.h>
+#endif
 
 #ifdef HAVE_ADT
 #include <bsm/adt.h>
@@ -1024,7 +1027,7 @@ _dbus_listen_unix_socket (const char     *path,
 
 #endif  /* android init managed sockets */
 
-  if (listen (listen_fd, 30 /* backlog */) < 0)
+  if (listen (listen_fd, SOMAXCONN) < 0)
     {
       dbus_set_error (error, _dbus_error_from_errno (errno),
                       "Failed to listen on socket \"%s\": %s",
@@ -1182,12 +1185,17 @@ _dbus_connect_tcp_socket (const char     *host,
     return _dbus_connect_tcp_socket_with_nonce (host, port, family, (const char*)NULL, error);
 }
 
-int
-_dbus_connect_tcp_socket_with_nonce (const char     *host,
-                                     const char     *port,
-                                     const char     *family,
-                                     const char     *noncefile,
-                                     DBusError      *error)
+/* If connect_pending is NULL, blocks until the connection is
+ * established; otherwise the socket is made nonblocking first and
+ * *connect_pending reports whether connect() is still in progress.
+ */
+static int
+connect_tcp_socket_internal (const char     *host,
+                             const char     *port,
+                             const char     *family,
+                             const char     *noncefile,
+                             dbus_bool_t    *connect_pending,
+                             DBusError      *error)
 {
   int saved_errno = 0;
   int fd = -1, res;
@@ -1195,6 +1203,10 @@ _dbus_connect_tcp_socket_with_nonce (const char     *host,
   struct addrinfo *ai, *tmp;
 
   _DBUS_ASSERT_ERROR_IS_CLEAR (error);
+  _dbus_assert (connect_pending == NULL || noncefile == NULL);
+
+  if (connect_pending != NULL)
+    *connect_pending = FALSE;
 
   if (!_dbus_open_tcp_socket (&fd, error))
     {
@@ -1244,8 +1256,22 @@ _dbus_connect_tcp_socket_with_nonce (const char     *host,
         }
       _DBUS_ASSERT_ERROR_IS_CLEAR(error);
 
+      if (connect_pending != NULL &&
+          !_dbus_set_fd_nonblocking (fd, error))
+        {
+          freeaddrinfo(ai);
+          _dbus_close (fd, NULL);
+          return -1;
+        }
+
       if (connect (fd, (struct sockaddr*) tmp->ai_addr, tmp->ai_addrlen) < 0)
         {
+          if (connect_pending != NULL && errno == EINPROGRESS)
+            {
+              *connect_pending = TRUE;
+              break;
+            }
+
           saved_errno = errno;
           _dbus_close(fd, NULL);
           fd = -1;
@@ -1281,7 +1307,8 @@ _dbus_connect_tcp_socket_with_nonce (const char     *host,
         }
     }
 
-  if (!_dbus_set_fd_nonblocking (fd, error))
+  if (connect_pending == NULL &&
+      !_dbus_set_fd_nonblocking (fd, error))
     {
       _dbus_close (fd, NULL);
       return -1;
@@ -1290,6 +1317,83 @@ _dbus_connect_tcp_socket_with_nonce (const char     *host,
   return fd;
 }
 
+int
+_dbus_connect_tcp_socket_with_nonce (const char     *host,
+                                     const char     *port,
+                                     const char     *family,
+                                     const char     *noncefile,
+                                     DBusError      *error)
+{
+  return connect_tcp_socket_internal (host, port, family, noncefile,
+                                      NULL, error);
+}
+
+/**
+ * Like _dbus_connect_tcp_socket(), but does not wait for the
+ * connection to be established. The socket is made nonblocking
+ * before connect() is called; if the connection cannot be completed
+ * immediately, *connect_pending is set to #TRUE and the caller must
+ * wait for the socket to become writable and then call
+ * _dbus_socket_finish_connect().
+ *
+ * The host name lookup is still synchronous.
+ *
+ * @param host the host name to connect to
+ * @param port the port to connect to
+ * @param family the address family to connect to, NULL for all
+ * @param connect_pending return location for whether connect is still in progress
+ * @param error return location for error code
+ * @returns connection file descriptor or -1 on error
+ */
+int
+_dbus_connect_tcp_socket_nonblocking (const char     *host,
+                                      const char     *port,
+                                      const char     *family,
+                                      dbus_bool_t    *connect_pending,
+                                      DBusError      *error)
+{
+  _dbus_assert (connect_pending != NULL);
+
+  return connect_tcp_socket_internal (host, port, family, NULL,
+                                      connect_pending, error);
+}
+
+/**
+ * Checks the outcome of a connect() that was started with
+ * _dbus_connect_tcp_socket_nonblocking() and reported as pending.
+ * Should be called once the socket has become writable.
+ *
+ * @param fd the socket
+ * @param error return location for the reason the connect failed
+ * @returns #TRUE if the socket is now connected
+ */
+dbus_bool_t
+_dbus_socket_finish_connect (int        fd,
+                             DBusError *error)
+{
+  int so_error;
+  socklen_t len;
+
+  _DBUS_ASSERT_ERROR_IS_CLEAR (error);
+
+  so_error = 0;
+  len = sizeof (so_error);
+
+  if (getsockopt (fd, SOL_SOCKET, SO_ERROR, &so_error, &len) < 0)
+    so_error = errno;
+
+  if (so_error != 0)
+    {
+      dbus_set_error (error,
+                      _dbus_error_from_errno (so_error),
+                      "Failed to connect to socket: %s",
+                      _dbus_strerror (so_error));
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
 /**
  * Creates a socket and binds it to the given path, then listens on
  * the socket. The socket is set to be nonblocking.  In case of port=0
@@ -1389,7 +1493,7 @@ _dbus_listen_tcp_socket (const char     *host,
           goto failed;
         }
 
-      if (listen (fd, 30 /* backlog */) < 0)
+      if (listen (fd, SOMAXCONN) < 0)
         {
           saved_errno = errno;
           _dbus_close (fd, NULL);
@@ -1826,23 +1930,15 @@ _dbus_send_credentials_socket  (int              server_fd,
     return FALSE;
 }
 
-/**
- * Accepts a connection on a listening socket.
- * Handles EINTR for you.
- *
- * This will enable FD_CLOEXEC for the returned socket.
- *
- * @param listen_fd the listen file descriptor
- * @returns the connection fd of the client, or -1 on error
- */
-int
-_dbus_accept  (int listen_fd)
+static int
+accept_with_flags (int         listen_fd,
+                   dbus_bool_t nonblocking)
 {
   int client_fd;
   struct sockaddr addr;
   socklen_t addrlen;
 #ifdef HAVE_ACCEPT4
-  dbus_bool_t cloexec_done;
+  dbus_bool_t flags_done;
 #endif
 
   addrlen = sizeof (addr);
@@ -1850,9 +1946,12 @@ _dbus_accept  (int listen_fd)
  retry:
 
 #ifdef HAVE_ACCEPT4
-  /* We assume that if accept4 is available SOCK_CLOEXEC is too */
-  client_fd = accept4 (listen_fd, &addr, &addrlen, SOCK_CLOEXEC);
-  cloexec_done = client_fd >= 0;
+  /* We assume that if accept4 is available SOCK_CLOEXEC and
+   * SOCK_NONBLOCK are too
+   */
+  client_fd = accept4 (listen_fd, &addr, &addrlen,
+                       SOCK_CLOEXEC | (nonblocking ? SOCK_NONBLOCK : 0));
+  flags_done = client_fd >= 0;
 
   if (client_fd < 0 && errno == ENOSYS)
 #endif
@@ -1864,20 +1963,58 @@ _dbus_accept  (int listen_fd)
     {
       if (errno == EINTR)
         goto retry;
+
+      return client_fd;
     }
 
   _dbus_verbose ("client fd %d accepted\n", client_fd);
 
 #ifdef HAVE_ACCEPT4
-  if (!cloexec_done)
+  if (!flags_done)
 #endif
     {
-      _dbus_fd_set_close_on_exec(client_fd);
+      _dbus_fd_set_close_on_exec (client_fd);
+
+      if (nonblocking && !_dbus_set_fd_nonblocking (client_fd, NULL))
+        {
+          _dbus_close_socket (client_fd, NULL);
+          return -1;
+        }
     }
 
   return client_fd;
 }
 
+/**
+ * Accepts a connection on a listening socket.
+ * Handles EINTR for you.
+ *
+ * This will enable FD_CLOEXEC for the returned socket.
+ *
+ * @param listen_fd the listen file descriptor
+ * @returns the connection fd of the client, or -1 on error
+ */
+int
+_dbus_accept  (int listen_fd)
+{
+  return accept_with_flags (listen_fd, FALSE);
+}
+
+/**
+ * Like _dbus_accept(), but the returned socket is also nonblocking.
+ * With accept4() both flags are set by the same system call that
+ * accepts the connection, saving the fcntl() round trips a server
+ * would otherwise make for every client.
+ *
+ * @param listen_fd the listen file descriptor
+ * @returns the nonblocking connection fd of the client, or -1 on error
+ */
+int
+_dbus_accept_nonblocking (int listen_fd)
+{
+  return accept_with_flags (listen_fd, TRUE);
+}
+
 /**
  * Checks to make sure the given directory is
  * private to the user
@@ -2502,18 +2639,18 @@ _dbus_poll (DBusPollFD *fds,
 }
 
 /**
- * Get current time, as in gettimeofday(). Use the monotonic clock if
- * available, to avoid problems when the system time changes.
+ * Get current time from a clock that never jumps, for measuring
+ * elapsed time and timeouts. Uses the monotonic clock if available,
+ * to avoid problems when the system time changes; otherwise this is
+ * the same as _dbus_get_real_time().
  *
  * @param tv_sec return location for number of seconds
- * @param tv_usec return location for number of microseconds (thousandths)
+ * @param tv_usec return location for number of microseconds
  */
 void
-_dbus_get_current_time (long *tv_sec,
-                        long *tv_usec)
+_dbus_get_monotonic_time (long *tv_sec,
+                          long *tv_usec)
 {
-  struct timeval t;
-
 #ifdef HAVE_MONOTONIC_CLOCK
   struct timespec ts;
   clock_gettime (CLOCK_MONOTONIC, &ts);
@@ -2523,13 +2660,30 @@ _dbus_get_current_time (long *tv_sec,
   if (tv_usec)
     *tv_usec = ts.tv_nsec / 1000;
 #else
+  _dbus_get_real_time (tv_sec, tv_usec);
+#endif
+}
+
+/**
+ * Get current time, as in gettimeofday(). Only use this for
+ * timestamps that are meaningful outside this process or across
+ * reboots; use _dbus_get_monotonic_time() to measure elapsed time.
+ *
+ * @param tv_sec return location for number of seconds
+ * @param tv_usec return location for number of microseconds
+ */
+void
+_dbus_get_real_time (long *tv_sec,
+                     long *tv_usec)
+{
+  struct timeval t;
+
   gettimeofday (&t, NULL);
 
   if (tv_sec)
     *tv_sec = t.tv_sec;
   if (tv_usec)
     *tv_usec = t.tv_usec;
-#endif
 }
 
 /**
@@ -2836,6 +2990,159 @@ _dbus_dup(int        fd,
   return new_fd;
 }
 
+#ifdef HAVE_MEMFD_CREATE
+#define SEALED_FD_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+
+/**
+ * Creates an anonymous memory file holding a copy of the given data,
+ * and seals it so that nobody can write to it, shrink it or grow it
+ * any more. A receiver can then map the file and use the data in
+ * place without worrying about the sender changing it underneath;
+ * see _dbus_map_sealed_fd().
+ *
+ * @param name name of the file, only used for debugging
+ * @param data the data
+ * @param len length of the data
+ * @param error address of error location.
+ * @returns the file descriptor, or -1 with error set
+ */
+int
+_dbus_memfd_new_sealed (const char *name,
+                        const void *data,
+                        int         len,
+                        DBusError  *error)
+{
+  const char *p = data;
+  int written;
+  int fd;
+
+  _DBUS_ASSERT_ERROR_IS_CLEAR (error);
+
+  fd = memfd_create (name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0)
+    {
+      dbus_set_error (error, _dbus_error_from_errno (errno),
+                      "Could not create memory file: %s",
+                      _dbus_strerror (errno));
+      return -1;
+    }
+
+  written = 0;
+  while (written < len)
+    {
+      ssize_t n;
+
+      n = write (fd, p + written, len - written);
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+
+          goto failed;
+        }
+
+      written += n;
+    }
+
+  if (fcntl (fd, F_ADD_SEALS, SEALED_FD_SEALS | F_SEAL_SEAL) < 0)
+    goto failed;
+
+  return fd;
+
+ failed:
+  dbus_set_error (error, _dbus_error_from_errno (errno),
+                  "Could not fill memory file: %s",
+                  _dbus_strerror (errno));
+  _dbus_close (fd, NULL);
+  return -1;
+}
+
+/**
+ * Maps the whole of a file created with _dbus_memfd_new_sealed(),
+ * read-only. Refuses files that are not sealed against writing,
+ * shrinking and growing, since their contents could change while in
+ * use, or the mapping could stop being backed and crash us. Unmap the
+ * data with _dbus_unmap_sealed_fd(); the descriptor itself can be
+ * closed right away.
+ *
+ * @param fd the file descriptor
+ * @param data return location for the mapped data, #NULL if the file is empty
+ * @param len return location for the length of the data
+ * @param error address of error location.
+ * @returns #FALSE if the file couldn't be mapped
+ */
+dbus_bool_t
+_dbus_map_sealed_fd (int          fd,
+                     const void **data,
+                     int         *len,
+                     DBusError   *error)
+{
+  struct stat sb;
+  void *mapped;
+  int seals;
+
+  _DBUS_ASSERT_ERROR_IS_CLEAR (error);
+
+  seals = fcntl (fd, F_GET_SEALS);
+  if (seals < 0 || (seals & SEALED_FD_SEALS) != SEALED_FD_SEALS)
+    {
+      dbus_set_error (error, DBUS_ERROR_INVALID_ARGS,
+                      "File descriptor %d is not a sealed memory file", fd);
+      return FALSE;
+    }
+
+  if (fstat (fd, &sb) < 0)
+    {
+      dbus_set_error (error, _dbus_error_from_errno (errno),
+                      "Could not stat memory file: %s",
+                      _dbus_strerror (errno));
+      return FALSE;
+    }
+
+  if (sb.st_size > _DBUS_INT32_MAX)
+    {
+      dbus_set_error (error, DBUS_ERROR_LIMITS_EXCEEDED,
+                      "Memory file of %ld bytes is too large to map",
+                      (long) sb.st_size);
+      return FALSE;
+    }
+
+  if (sb.st_size == 0)
+    {
+      *data = NULL;
+      *len = 0;
+      return TRUE;
+    }
+
+  mapped = mmap (NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapped == MAP_FAILED)
+    {
+      dbus_set_error (error, _dbus_error_from_errno (errno),
+                      "Could not map memory file: %s",
+                      _dbus_strerror (errno));
+      return FALSE;
+    }
+
+  *data = mapped;
+  *len = sb.st_size;
+  return TRUE;
+}
+
+/**
+ * Unmaps data mapped with _dbus_map_sealed_fd().
+ *
+ * @param data the mapped data
+ * @param len length of the data
+ */
+void
+_dbus_unmap_sealed_fd (const void *data,
+                       int         len)
+{
+  if (len > 0)
+    munmap ((void *) data, len);
+}
+#endif /* HAVE_MEMFD_CREATE */
+
 /**
  * Sets a file descriptor to be nonblocking.
  *
@@ -45,6 +45,19 @@ _dbus_close     (int               fd,
                  DBusError        *error);
 int _dbus_dup   (int               fd,
                  DBusError        *error);
+
+#ifdef HAVE_MEMFD_CREATE
+int         _dbus_memfd_new_sealed (const char   *name,
+                                    const void   *data,
+                                    int           len,
+                                    DBusError    *error);
+dbus_bool_t _dbus_map_sealed_fd    (int           fd,
+                                    const void  **data,
+                                    int          *len,
+                                    DBusError    *error);
+void        _dbus_unmap_sealed_fd  (const void   *data,
+                                    int           len);
+#endif
 int
 _dbus_read      (int               fd,
                  DBusString       *buffer,
@@ -1368,6 +1368,45 @@ _dbus_connect_tcp_socket_with_nonce (const char     *host,
   return fd;
 }
 
+/**
+ * Connects without blocking where the platform allows it; on Windows
+ * this currently falls back to a blocking connect and always reports
+ * the connection as established.
+ *
+ * @param host the host name to connect to
+ * @param port the port to connect to
+ * @param family the address family to connect to, NULL for all
+ * @param connect_pending return location for whether connect is still in progress
+ * @param error return location for error code
+ * @returns connection file descriptor or -1 on error
+ */
+int
+_dbus_connect_tcp_socket_nonblocking (const char     *host,
+                                      const char     *port,
+                                      const char     *family,
+                                      dbus_bool_t    *connect_pending,
+                                      DBusError      *error)
+{
+  *connect_pending = FALSE;
+
+  return _dbus_connect_tcp_socket_with_nonce (host, port, family, NULL, error);
+}
+
+/**
+ * Checks the outcome of a pending connect. Never called on Windows
+ * since _dbus_connect_tcp_socket_nonblocking() always completes.
+ *
+ * @param fd the socket
+ * @param error return location for the reason the connect failed
+ * @returns #TRUE if the socket is now connected
+ */
+dbus_bool_t
+_dbus_socket_finish_connect (int        fd,
+                             DBusError *error)
+{
+  return TRUE;
+}
+
 /**
  * Creates a socket and binds it to the given path, then listens on
  * the socket. The socket is set to be nonblocking.  In case of port=0
@@ -1469,7 +1508,7 @@ _dbus_listen_tcp_socket (const char     *host,
           goto failed;
     }
 
-      if (listen (fd, 30 /* backlog */) == SOCKET_ERROR)
+      if (listen (fd, SOMAXCONN) == SOCKET_ERROR)
         {
           DBUS_SOCKET_SET_ERRNO ();
           dbus_set_error (error, _dbus_error_from_errno (errno),
@@ -1598,6 +1637,29 @@ _dbus_accept  (int listen_fd)
   return client_fd;
 }
 
+/**
+ * Like _dbus_accept(), but the returned socket is also nonblocking.
+ *
+ * @param listen_fd the listen file descriptor
+ * @returns the nonblocking connection fd of the client, or -1 on error
+ */
+int
+_dbus_accept_nonblocking (int listen_fd)
+{
+  int client_fd;
+
+  client_fd = _dbus_accept (listen_fd);
+
+  if (!DBUS_SOCKET_IS_INVALID (client_fd) &&
+      !_dbus_set_fd_nonblocking (client_fd, NULL))
+    {
+      _dbus_close_socket (client_fd, NULL);
+      return -1;
+    }
+
+  return client_fd;
+}
+
 
 
 
@@ -1873,6 +1935,22 @@ _dbus_sleep_milliseconds (int milliseconds)
 }
 
 
+/**
+ * Get current time from a clock that never jumps, for measuring
+ * elapsed time and timeouts. There is no monotonic clock with
+ * microsecond resolution here, so this is the same as
+ * _dbus_get_real_time().
+ *
+ * @param tv_sec return location for number of seconds
+ * @param tv_usec return location for number of microseconds
+ */
+void
+_dbus_get_monotonic_time (long *tv_sec,
+                          long *tv_usec)
+{
+  _dbus_get_real_time (tv_sec, tv_usec);
+}
+
 /**
  * Get current time, as in gettimeofday().
  *
@@ -1880,8 +1958,8 @@ _dbus_sleep_milliseconds (int milliseconds)
  * @param tv_usec return location for number of microseconds
  */
 void
-_dbus_get_current_time (long *tv_sec,
-                        long *tv_usec)
+_dbus_get_real_time (long *tv_sec,
+                     long *tv_usec)
 {
   FILETIME ft;
   dbus_uint64_t time64;
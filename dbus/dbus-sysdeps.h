@@ -172,6 +172,13 @@ int _dbus_connect_tcp_socket_with_nonce  (const char     *host,
                                           const char     *family,
                                           const char     *noncefile,
                                           DBusError      *error);
+int _dbus_connect_tcp_socket_nonblocking (const char     *host,
+                                          const char     *port,
+                                          const char     *family,
+                                          dbus_bool_t    *connect_pending,
+                                          DBusError      *error);
+dbus_bool_t _dbus_socket_finish_connect  (int             fd,
+                                          DBusError      *error);
 int _dbus_listen_tcp_socket   (const char     *host,
                                const char     *port,
                                const char     *family,
@@ -179,6 +186,7 @@ int _dbus_listen_tcp_socket   (const char     *host,
                                int           **fds_p,
                                DBusError      *error);
 int _dbus_accept              (int             listen_fd);
+int _dbus_accept_nonblocking  (int             listen_fd);
 
 
 dbus_bool_t _dbus_read_credentials_socket (int               client_fd,
@@ -303,8 +311,11 @@ int _dbus_poll (DBusPollFD *fds,
 
 void _dbus_sleep_milliseconds (int milliseconds);
 
-void _dbus_get_current_time (long *tv_sec,
-                             long *tv_usec);
+void _dbus_get_monotonic_time (long *tv_sec,
+                               long *tv_usec);
+
+void _dbus_get_real_time (long *tv_sec,
+                          long *tv_usec);
 
 /**
  * directory interface
@@ -150,6 +150,8 @@ dbus_internal_do_not_use_run_tests (const char *test_data_dir, const char *speci
 
   run_test ("marshal-validate", specific_test, _dbus_marshal_validate_test);
 
+  run_test ("compiled-signature", specific_test, _dbus_compiled_signature_test);
+
   run_test ("marshal-header", specific_test, _dbus_marshal_header_test);
   
   run_data_test ("message", specific_test, _dbus_message_test, test_data_dir);
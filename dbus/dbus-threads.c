@@ -434,7 +434,9 @@ init_locks (void)
     LOCK_ADDR (system_users),
     LOCK_ADDR (message_cache),
     LOCK_ADDR (shared_connections),
-    LOCK_ADDR (machine_uuid)
+    LOCK_ADDR (machine_uuid),
+    LOCK_ADDR (keyrings),
+    LOCK_ADDR (compiled_signatures)
 #undef LOCK_ADDR
   };
 
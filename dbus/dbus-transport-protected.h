@@ -135,6 +135,7 @@ typedef enum
 } DBusTransportOpenResult;
 
 DBusTransportOpenResult _dbus_transport_open_platform_specific (DBusAddressEntry  *entry,
+                                                                dbus_bool_t        nonblocking,
                                                                 DBusTransport    **transport_p,
                                                                 DBusError         *error);
 
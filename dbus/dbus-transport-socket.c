@@ -66,6 +66,10 @@ struct DBusTransportSocket
   DBusString encoded_incoming;          /**< Encoded version of current
                                          *   incoming data.
                                          */
+
+  unsigned int connect_pending : 1;     /**< connect() was started without
+                                         *   blocking and has not completed
+                                         */
 };
 
 static void
@@ -118,6 +122,29 @@ socket_finalize (DBusTransport *transport)
   dbus_free (transport);
 }
 
+/* A pipelined client may start writing messages before the server
+ * has accepted its auth, once the auth bytes themselves are out.
+ * Messages carrying unix fds wait until we know whether fd passing
+ * was negotiated.
+ */
+static dbus_bool_t
+can_send_early (DBusTransport *transport)
+{
+  DBusMessage *message;
+  const int *unix_fds;
+  unsigned n;
+
+  if (transport->send_credentials_pending ||
+      !_dbus_auth_get_can_send_early (transport->auth) ||
+      !_dbus_connection_has_messages_to_send_unlocked (transport->connection))
+    return FALSE;
+
+  message = _dbus_connection_get_message_to_send (transport->connection);
+  _dbus_message_get_unix_fds (message, &unix_fds, &n);
+
+  return n == 0;
+}
+
 static void
 check_write_watch (DBusTransport *transport)
 {
@@ -135,7 +162,10 @@ check_write_watch (DBusTransport *transport)
   
   _dbus_transport_ref (transport);
 
-  if (_dbus_transport_get_is_authenticated (transport))
+  /* An in-progress connect() is reported as writability */
+  if (socket_transport->connect_pending)
+    needed = TRUE;
+  else if (_dbus_transport_get_is_authenticated (transport))
     needed = _dbus_connection_has_messages_to_send_unlocked (transport->connection);
   else
     {
@@ -155,7 +185,7 @@ check_write_watch (DBusTransport *transport)
               auth_state == DBUS_AUTH_STATE_WAITING_FOR_MEMORY)
             needed = TRUE;
           else
-            needed = FALSE;
+            needed = can_send_early (transport);
         }
     }
 
@@ -190,7 +220,9 @@ check_read_watch (DBusTransport *transport)
   
   _dbus_transport_ref (transport);
 
-  if (_dbus_transport_get_is_authenticated (transport))
+  if (socket_transport->connect_pending)
+    need_read_watch = FALSE;
+  else if (_dbus_transport_get_is_authenticated (transport))
     need_read_watch =
       (_dbus_counter_get_size_value (transport->live_messages) < transport->max_live_messages_size) &&
       (_dbus_counter_get_unix_fd_value (transport->live_messages) < transport->max_live_messages_unix_fds);
@@ -239,6 +271,35 @@ do_io_error (DBusTransport *transport)
   _dbus_transport_unref (transport);
 }
 
+/* Completes a connect() started by _dbus_connect_tcp_socket_nonblocking(),
+ * once the socket has become writable. Returns FALSE if the connect
+ * failed, in which case the transport has been disconnected.
+ */
+static dbus_bool_t
+finish_connect (DBusTransport *transport)
+{
+  DBusTransportSocket *socket_transport = (DBusTransportSocket*) transport;
+  DBusError error = DBUS_ERROR_INIT;
+
+  _dbus_assert (socket_transport->connect_pending);
+
+  if (!_dbus_socket_finish_connect (socket_transport->fd, &error))
+    {
+      _dbus_verbose ("Failed to complete connect: %s\n", error.message);
+      dbus_error_free (&error);
+      do_io_error (transport);
+      return FALSE;
+    }
+
+  _dbus_verbose ("Completed connect on fd %d\n", socket_transport->fd);
+
+  socket_transport->connect_pending = FALSE;
+
+  check_read_watch (transport);
+
+  return TRUE;
+}
+
 /* return value is whether we successfully read any new data. */
 static dbus_bool_t
 read_data_into_auth (DBusTransport *transport,
@@ -497,8 +558,9 @@ do_writing (DBusTransport *transport)
   DBusTransportSocket *socket_transport = (DBusTransportSocket*) transport;
   dbus_bool_t oom;
   
-  /* No messages without authentication! */
-  if (!_dbus_transport_get_is_authenticated (transport))
+  /* No messages without authentication, unless pipelining it */
+  if (!_dbus_transport_get_is_authenticated (transport) &&
+      !can_send_early (transport))
     {
       _dbus_verbose ("Not authenticated, not writing anything\n");
       return TRUE;
@@ -536,6 +598,14 @@ do_writing (DBusTransport *transport)
           goto out;
         }
       
+      if (socket_transport->message_bytes_written == 0 &&
+          !_dbus_transport_get_is_authenticated (transport) &&
+          !can_send_early (transport))
+        {
+          _dbus_verbose ("Not authenticated yet, holding back remaining messages\n");
+          goto out;
+        }
+
       message = _dbus_connection_get_message_to_send (transport->connection);
       _dbus_assert (message != NULL);
       dbus_message_lock (message);
@@ -947,6 +1017,10 @@ socket_handle_watch (DBusTransport *transport,
       _dbus_verbose ("handling write watch, have_outgoing_messages = %d\n",
                      _dbus_connection_has_messages_to_send_unlocked (transport->connection));
 #endif
+      if (socket_transport->connect_pending &&
+          !finish_connect (transport))
+        return TRUE;
+
       if (!do_authentication (transport, FALSE, TRUE, NULL))
         return FALSE;
       
@@ -1055,7 +1129,12 @@ socket_do_iteration (DBusTransport *transport,
   poll_fd.fd = socket_transport->fd;
   poll_fd.events = 0;
   
-  if (_dbus_transport_get_is_authenticated (transport))
+  if (socket_transport->connect_pending)
+    {
+      /* Nothing can be read or written until connect() completes */
+      poll_fd.events |= _DBUS_POLLOUT;
+    }
+  else if (_dbus_transport_get_is_authenticated (transport))
     {
       /* This is kind of a hack; if we have stuff to write, then try
        * to avoid the poll. This is probably about a 5% speedup on an
@@ -1101,6 +1180,9 @@ socket_do_iteration (DBusTransport *transport,
       if (transport->send_credentials_pending ||
           auth_state == DBUS_AUTH_STATE_HAVE_BYTES_TO_SEND)
 	poll_fd.events |= _DBUS_POLLOUT;
+      else if ((flags & DBUS_ITERATION_DO_WRITING) &&
+               can_send_early (transport))
+        poll_fd.events |= _DBUS_POLLOUT;
     }
 
   if (poll_fd.events)
@@ -1143,6 +1225,11 @@ socket_do_iteration (DBusTransport *transport,
           
           if (poll_fd.revents & _DBUS_POLLERR)
             do_io_error (transport);
+          else if (socket_transport->connect_pending)
+            {
+              if (poll_fd.revents & (_DBUS_POLLOUT | _DBUS_POLLHUP))
+                finish_connect (transport);
+            }
           else
             {
               dbus_bool_t need_read = (poll_fd.revents & _DBUS_POLLIN) > 0;
@@ -1294,10 +1381,16 @@ _dbus_transport_new_for_socket (int               fd,
  * Creates a new transport for the given hostname and port.
  * If host is NULL, it will default to localhost
  *
+ * If nonblocking is #TRUE and no nonce file is used, the transport is
+ * returned as soon as connect() has been started; the connection is
+ * completed from the main loop (or the next blocking iteration)
+ * before authentication begins.
+ *
  * @param host the host to connect to
  * @param port the port to connect to
  * @param family the address family to connect to
  * @param path to nonce file
+ * @param nonblocking #TRUE to avoid waiting for connect() to complete
  * @param error location to store reason for failure.
  * @returns a new transport, or #NULL on failure.
  */
@@ -1306,9 +1399,11 @@ _dbus_transport_new_for_tcp_socket (const char     *host,
                                     const char     *port,
                                     const char     *family,
                                     const char     *noncefile,
+                                    dbus_bool_t     nonblocking,
                                     DBusError      *error)
 {
   int fd;
+  dbus_bool_t connect_pending;
   DBusTransport *transport;
   DBusString address;
   
@@ -1344,7 +1439,15 @@ _dbus_transport_new_for_tcp_socket (const char     *host,
        !_dbus_string_append (&address, noncefile)))
     goto error;
 
-  fd = _dbus_connect_tcp_socket_with_nonce (host, port, family, noncefile, error);
+  /* The nonce has to be written right after connecting, so nonce-tcp
+   * always connects synchronously.
+   */
+  connect_pending = FALSE;
+  if (nonblocking && noncefile == NULL)
+    fd = _dbus_connect_tcp_socket_nonblocking (host, port, family,
+                                               &connect_pending, error);
+  else
+    fd = _dbus_connect_tcp_socket_with_nonce (host, port, family, noncefile, error);
   if (fd < 0)
     {
       _DBUS_ASSERT_ERROR_IS_SET (error);
@@ -1352,7 +1455,8 @@ _dbus_transport_new_for_tcp_socket (const char     *host,
       return NULL;
     }
 
-  _dbus_verbose ("Successfully connected to tcp socket %s:%s\n",
+  _dbus_verbose ("%s tcp socket %s:%s\n",
+                 connect_pending ? "Started connecting to" : "Successfully connected to",
                  host, port);
   
   transport = _dbus_transport_new_for_socket (fd, NULL, &address);
@@ -1363,6 +1467,8 @@ _dbus_transport_new_for_tcp_socket (const char     *host,
       _dbus_close_socket (fd, NULL);
       fd = -1;
     }
+  else
+    ((DBusTransportSocket*) transport)->connect_pending = connect_pending;
 
   return transport;
 
@@ -1376,12 +1482,14 @@ error:
  * Opens a TCP socket transport.
  * 
  * @param entry the address entry to try opening as a tcp transport.
+ * @param nonblocking #TRUE to avoid waiting for connect() to complete
  * @param transport_p return location for the opened transport
  * @param error error to be set
  * @returns result of the attempt
  */
 DBusTransportOpenResult
 _dbus_transport_open_socket(DBusAddressEntry  *entry,
+                            dbus_bool_t        nonblocking,
                             DBusTransport    **transport_p,                            
                             DBusError         *error)
 {
@@ -1413,7 +1521,8 @@ _dbus_transport_open_socket(DBusAddressEntry  *entry,
           return DBUS_TRANSPORT_OPEN_BAD_ADDRESS;
         }
 
-      *transport_p = _dbus_transport_new_for_tcp_socket (host, port, family, noncefile, error);
+      *transport_p = _dbus_transport_new_for_tcp_socket (host, port, family, noncefile,
+                                                         nonblocking, error);
       if (*transport_p == NULL)
         {
           _DBUS_ASSERT_ERROR_IS_SET (error);
@@ -34,8 +34,10 @@ DBusTransport*          _dbus_transport_new_for_tcp_socket (const char        *h
                                                             const char        *port,
                                                             const char        *family,
                                                             const char        *noncefile,
+                                                            dbus_bool_t        nonblocking,
                                                             DBusError         *error);
 DBusTransportOpenResult _dbus_transport_open_socket        (DBusAddressEntry  *entry,
+                                                            dbus_bool_t        nonblocking,
                                                             DBusTransport    **transport_p,
                                                             DBusError         *error);
 
@@ -111,12 +111,15 @@ _dbus_transport_new_for_domain_socket (const char     *path,
  * Opens platform specific transport types.
  * 
  * @param entry the address entry to try opening
+ * @param nonblocking ignored; connecting to a local socket does not
+ *   involve a network round trip
  * @param transport_p return location for the opened transport
  * @param error error to be set
  * @returns result of the attempt
  */
 DBusTransportOpenResult
 _dbus_transport_open_platform_specific (DBusAddressEntry  *entry,
+                                        dbus_bool_t        nonblocking,
                                         DBusTransport    **transport_p,
                                         DBusError         *error)
 {
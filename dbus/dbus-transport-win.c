@@ -42,12 +42,14 @@
  * Opens platform specific transport types.
  * 
  * @param entry the address entry to try opening
+ * @param nonblocking #TRUE to avoid waiting for connect() to complete
  * @param transport_p return location for the opened transport
  * @param error error to be set
  * @returns result of the attempt
  */
 DBusTransportOpenResult
 _dbus_transport_open_platform_specific (DBusAddressEntry  *entry,
+                                        dbus_bool_t        nonblocking,
                                         DBusTransport    **transport_p,
                                         DBusError         *error)
 {
@@ -73,7 +75,8 @@ _dbus_transport_open_platform_specific (DBusAddressEntry  *entry,
       return DBUS_TRANSPORT_OPEN_BAD_ADDRESS;
     }
 
-  *transport_p = _dbus_transport_new_for_tcp_socket (host, port, family, noncefile, error);
+  *transport_p = _dbus_transport_new_for_tcp_socket (host, port, family, noncefile,
+                                                     nonblocking, error);
   if (*transport_p == NULL)
     {
       _DBUS_ASSERT_ERROR_IS_SET (error);
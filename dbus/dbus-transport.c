@@ -238,11 +238,15 @@ _dbus_transport_finalize_base (DBusTransport *transport)
  * opened DBusTransport object. If it isn't, returns #NULL
  * and sets @p error.
  *
+ * @param address the address to try
+ * @param nonblocking #TRUE to avoid waiting for connect() to complete
  * @param error address where an error can be returned.
  * @returns a new transport, or #NULL on failure.
  */
 static DBusTransport*
-check_address (const char *address, DBusError *error)
+check_address (const char  *address,
+               dbus_bool_t  nonblocking,
+               DBusError   *error)
 {
   DBusAddressEntry **entries;
   DBusTransport *transport = NULL;
@@ -256,7 +260,7 @@ check_address (const char *address, DBusError *error)
 
   for (i = 0; i < len; i++)
     {
-      transport = _dbus_transport_open (entries[i], error);
+      transport = _dbus_transport_open (entries[i], nonblocking, error);
       if (transport != NULL)
         break;
     }
@@ -269,11 +273,13 @@ check_address (const char *address, DBusError *error)
  * Creates a new transport for the "autostart" method.
  * This creates a client-side of a transport.
  *
+ * @param nonblocking #TRUE to avoid waiting for connect() to complete
  * @param error address where an error can be returned.
  * @returns a new transport, or #NULL on failure.
  */
 static DBusTransport*
-_dbus_transport_new_for_autolaunch (DBusError      *error)
+_dbus_transport_new_for_autolaunch (dbus_bool_t     nonblocking,
+                                    DBusError      *error)
 {
   DBusString address;
   DBusTransport *result = NULL;
@@ -292,7 +298,8 @@ _dbus_transport_new_for_autolaunch (DBusError      *error)
       goto out;
     }
 
-  result = check_address (_dbus_string_get_const_data (&address), error);
+  result = check_address (_dbus_string_get_const_data (&address),
+                          nonblocking, error);
   if (result == NULL)
     _DBUS_ASSERT_ERROR_IS_SET (error);
   else
@@ -305,6 +312,7 @@ _dbus_transport_new_for_autolaunch (DBusError      *error)
 
 static DBusTransportOpenResult
 _dbus_transport_open_autolaunch (DBusAddressEntry  *entry,
+                                 dbus_bool_t        nonblocking,
                                  DBusTransport    **transport_p,
                                  DBusError         *error)
 {
@@ -315,7 +323,7 @@ _dbus_transport_open_autolaunch (DBusAddressEntry  *entry,
 
   if (strcmp (method, "autolaunch") == 0)
     {
-      *transport_p = _dbus_transport_new_for_autolaunch (error);
+      *transport_p = _dbus_transport_new_for_autolaunch (nonblocking, error);
 
       if (*transport_p == NULL)
         {
@@ -337,6 +345,7 @@ _dbus_transport_open_autolaunch (DBusAddressEntry  *entry,
 
 static const struct {
   DBusTransportOpenResult (* func) (DBusAddressEntry *entry,
+                                    dbus_bool_t       nonblocking,
                                     DBusTransport   **transport_p,
                                     DBusError        *error);
 } open_funcs[] = {
@@ -351,13 +360,19 @@ static const struct {
 /**
  * Try to open a new transport for the given address entry.  (This
  * opens a client-side-of-the-connection transport.)
+ *
+ * If nonblocking is #TRUE, transports that would otherwise wait for
+ * a network round trip in connect() return as soon as the connect
+ * has been started, and complete it from the main loop.
  * 
  * @param entry the address entry
+ * @param nonblocking #TRUE to avoid waiting for connect() to complete
  * @param error location to store reason for failure.
  * @returns new transport of #NULL on failure.
  */
 DBusTransport*
 _dbus_transport_open (DBusAddressEntry *entry,
+                      dbus_bool_t       nonblocking,
                       DBusError        *error)
 {
   DBusTransport *transport;
@@ -383,7 +398,7 @@ _dbus_transport_open (DBusAddressEntry *entry,
       DBusTransportOpenResult result;
 
       _DBUS_ASSERT_ERROR_CONTENT_IS_CLEAR (&tmp_error);
-      result = (* open_funcs[i].func) (entry, &transport, &tmp_error);
+      result = (* open_funcs[i].func) (entry, nonblocking, &transport, &tmp_error);
 
       switch (result)
         {
@@ -1191,6 +1206,19 @@ _dbus_transport_set_max_message_unix_fds (DBusTransport  *transport,
   _dbus_message_loader_set_max_message_unix_fds (transport->loader, n);
 }
 
+/**
+ * See dbus_connection_set_body_stream_function().
+ *
+ * @param transport the transport
+ * @param size the smallest body to stream, or 0 to never stream
+ */
+void
+_dbus_transport_set_body_stream_threshold (DBusTransport  *transport,
+                                           long            size)
+{
+  _dbus_message_loader_set_body_stream_threshold (transport->loader, size);
+}
+
 /**
  * See dbus_connection_get_max_message_size().
  *
@@ -1488,4 +1516,18 @@ _dbus_transport_set_allow_anonymous (DBusTransport              *transport,
   transport->allow_anonymous = value != FALSE;
 }
 
+/**
+ * See dbus_connection_set_pipelined_auth()
+ *
+ * @param transport the transport
+ * @param value #TRUE to pipeline the auth handshake
+ */
+void
+_dbus_transport_set_pipelined_auth (DBusTransport              *transport,
+                                    dbus_bool_t                 value)
+{
+  if (!transport->is_server)
+    _dbus_auth_set_pipelined (transport->auth, value);
+}
+
 /** @} */
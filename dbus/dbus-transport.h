@@ -33,6 +33,7 @@ DBUS_BEGIN_DECLS
 typedef struct DBusTransport DBusTransport;
 
 DBusTransport*     _dbus_transport_open                   (DBusAddressEntry           *entry,
+                                                           dbus_bool_t                 nonblocking,
                                                            DBusError                  *error);
 DBusTransport*     _dbus_transport_ref                    (DBusTransport              *transport);
 void               _dbus_transport_unref                  (DBusTransport              *transport);
@@ -58,6 +59,8 @@ dbus_bool_t        _dbus_transport_queue_messages         (DBusTransport
 void               _dbus_transport_set_max_message_size   (DBusTransport              *transport,
                                                            long                        size);
 long               _dbus_transport_get_max_message_size   (DBusTransport              *transport);
+void               _dbus_transport_set_body_stream_threshold (DBusTransport           *transport,
+                                                           long                        size);
 void               _dbus_transport_set_max_received_size  (DBusTransport              *transport,
                                                            long                        size);
 long               _dbus_transport_get_max_received_size  (DBusTransport              *transport);
@@ -96,6 +99,8 @@ dbus_bool_t        _dbus_transport_set_auth_mechanisms    (DBusTransport
                                                            const char                **mechanisms);
 void               _dbus_transport_set_allow_anonymous    (DBusTransport              *transport,
                                                            dbus_bool_t                 value);
+void               _dbus_transport_set_pipelined_auth     (DBusTransport              *transport,
+                                                           dbus_bool_t                 value);
 
 
 DBUS_END_DECLS
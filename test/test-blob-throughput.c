@@ -0,0 +1,220 @@
+/* Measures how fast large blocks of bytes get from one client to
+ * another through the bus, appended with dbus_message_iter_append_blob()
+ * either inline as a byte array, which the bus loads, validates and
+ * writes out again, or spilled into a sealed memory file, of which the
+ * bus only forwards the descriptor. The receiver reads every page of
+ * each block either way. Run it against a session bus, e.g. through
+ * tools/run-with-tmp-session-bus.sh.
+ */
+#include <config.h>
+#include "test-utils.h"
+
+#include <string.h>
+
+#define USAGE "[--address=ADDRESS] [MAX_MEGABYTES]"
+
+static void
+send_blob (DBusConnection      *sender,
+           const char          *destination,
+           const unsigned char *bytes,
+           int                  n_bytes,
+           int                  spill_threshold)
+{
+  DBusMessage *message;
+  DBusMessageIter iter;
+
+  message = dbus_message_new_signal ("/org/freedesktop/TestSuite",
+                                     "org.freedesktop.TestSuite",
+                                     "Blob");
+  if (message == NULL)
+    test_bench_die ("no memory\n");
+
+  dbus_message_iter_init_append (message, &iter);
+  if (!dbus_message_set_destination (message, destination) ||
+      !dbus_message_iter_append_blob (&iter, bytes, n_bytes, spill_threshold))
+    test_bench_die ("no memory\n");
+
+  if (!dbus_connection_send (sender, message, NULL))
+    test_bench_die ("no memory\n");
+
+  dbus_connection_flush (sender);
+  dbus_message_unref (message);
+}
+
+/* Waits for the next blob and touches each of its pages, as any
+ * consumer of the data would
+ */
+static void
+receive_blob (DBusConnection *receiver,
+              int             n_bytes)
+{
+  DBusMessage *message;
+
+  while (TRUE)
+    {
+      DBusMessageIter iter;
+      DBusError error;
+      const unsigned char *data;
+      const void *blob;
+      unsigned char sum;
+      int len;
+      int i;
+
+      dbus_connection_read_write (receiver, -1);
+
+      message = dbus_connection_pop_message (receiver);
+      if (message == NULL)
+        continue;
+
+      if (!dbus_message_is_signal (message, "org.freedesktop.TestSuite", "Blob"))
+        {
+          dbus_message_unref (message);
+          continue;
+        }
+
+      dbus_error_init (&error);
+
+      if (!dbus_message_iter_init (message, &iter) ||
+          !dbus_message_iter_get_blob (&iter, &blob, &len, &error))
+        {
+          fprintf (stderr, "*** Failed to get blob: %s\n",
+                   dbus_error_is_set (&error) ? error.message : "no arguments");
+          exit (1);
+        }
+
+      if (len != n_bytes)
+        test_bench_die ("blob has the wrong length\n");
+
+      data = blob;
+      sum = 0;
+      for (i = 0; i < len; i += 4096)
+        sum ^= data[i];
+
+      if (sum != (n_bytes / 4096) % 2)
+        test_bench_die ("blob has the wrong contents\n");
+
+      dbus_message_unref (message);
+      return;
+    }
+}
+
+static double
+megabytes_per_second (DBusConnection      *sender,
+                      DBusConnection      *receiver,
+                      const unsigned char *bytes,
+                      int                  n_bytes,
+                      int                  n_iterations,
+                      int                  spill_threshold)
+{
+  long start_sec, start_usec;
+  long end_sec, end_usec;
+  double elapsed;
+  int i;
+
+  _dbus_get_monotonic_time (&start_sec, &start_usec);
+
+  for (i = 0; i < n_iterations; i++)
+    {
+      send_blob (sender, dbus_bus_get_unique_name (receiver),
+                 bytes, n_bytes, spill_threshold);
+      receive_blob (receiver, n_bytes);
+    }
+
+  _dbus_get_monotonic_time (&end_sec, &end_usec);
+
+  elapsed = (end_sec - start_sec) + (end_usec - start_usec) / 1000000.0;
+
+  return ((double) n_bytes * n_iterations) / (1024 * 1024) / elapsed;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  const char *address;
+  DBusConnection *sender;
+  DBusConnection *receiver;
+  unsigned char *bytes;
+  dbus_bool_t can_spill;
+  int max_megabytes;
+  int megabytes;
+  int i;
+
+  test_bench_init ("test-blob-throughput");
+
+  address = getenv ("DBUS_SESSION_BUS_ADDRESS");
+  max_megabytes = 64;
+
+  for (i = 1; i < argc; i++)
+    {
+      const char *arg = argv[i];
+
+      if (strncmp (arg, "--address=", strlen ("--address=")) == 0)
+        address = arg + strlen ("--address=");
+      else if (arg[0] == '-')
+        test_bench_usage (USAGE);
+      else
+        max_megabytes = atoi (arg);
+    }
+
+  if (address == NULL)
+    test_bench_die ("no --address given and DBUS_SESSION_BUS_ADDRESS is not set\n");
+
+  /* A byte array can't be larger than this, so neither can inline blobs */
+  if (max_megabytes <= 0 ||
+      max_megabytes > DBUS_MAXIMUM_ARRAY_LENGTH / (1024 * 1024))
+    test_bench_usage (USAGE);
+
+  sender = test_bench_open_and_register (address);
+  receiver = test_bench_open_and_register (address);
+
+  /* The default of 63 MB would stop the receiver reading partway
+   * through the largest inline blobs
+   */
+  dbus_connection_set_max_received_size (receiver,
+                                         2 * DBUS_MAXIMUM_ARRAY_LENGTH);
+
+  can_spill = dbus_connection_can_send_type (sender, DBUS_TYPE_UNIX_FD) &&
+    dbus_connection_can_send_type (receiver, DBUS_TYPE_UNIX_FD);
+
+  bytes = dbus_malloc (max_megabytes * 1024 * 1024);
+  if (bytes == NULL)
+    test_bench_die ("no memory\n");
+
+  /* Every 4096th byte is 1, so the sum of the pages we touch says
+   * whether we got the right data
+   */
+  memset (bytes, 0, max_megabytes * 1024 * 1024);
+  for (i = 0; i < max_megabytes * 1024 * 1024; i += 4096)
+    bytes[i] = 1;
+
+  for (megabytes = 1; megabytes <= max_megabytes; megabytes *= 4)
+    {
+      int n_bytes = megabytes * 1024 * 1024;
+      int n_iterations = MAX (4, 256 / megabytes);
+      double inline_rate;
+
+      inline_rate = megabytes_per_second (sender, receiver, bytes, n_bytes,
+                                          n_iterations, 0);
+
+      if (can_spill)
+        printf ("%2d MB blobs, %d times: inline %.0f MB/s, sealed memory file %.0f MB/s\n",
+                megabytes, n_iterations, inline_rate,
+                megabytes_per_second (sender, receiver, bytes, n_bytes,
+                                      n_iterations, 1));
+      else
+        printf ("%2d MB blobs, %d times: inline %.0f MB/s, no fd passing\n",
+                megabytes, n_iterations, inline_rate);
+    }
+
+  dbus_free (bytes);
+
+  dbus_connection_close (sender);
+  dbus_connection_unref (sender);
+  dbus_connection_close (receiver);
+  dbus_connection_unref (receiver);
+
+  dbus_shutdown ();
+
+  return 0;
+}
@@ -0,0 +1,506 @@
+/* Measures how fast the bus routes messages: method call round trips,
+ * one-way throughput between two clients, signal fan-out to subscribers
+ * that each have a number of match rules, connection churn and the
+ * bandwidth of large messages. Unless --address is given it starts a
+ * dbus-daemon of its own with the system bus's policy and limits, from
+ * test/data/valid-config-files/tmp-session-like-system.conf, and stops
+ * it afterwards.
+ *
+ * Each result is printed as one line of tab-separated benchmark,
+ * metric, value and unit, so that runs can be compared by a script.
+ */
+#include <config.h>
+#include "test-utils.h"
+
+#include <string.h>
+
+#define BENCH_NAME "org.freedesktop.TestSuite.Bench"
+#define BENCH_PATH "/org/freedesktop/TestSuite/Bench"
+#define BENCH_INTERFACE "org.freedesktop.TestSuite.Bench"
+
+#define BURST 50
+
+#define USAGE "[--quick] [--subscribers=N] [--rules=M] [--daemon=PATH] [--config=FILE] [--address=ADDRESS]"
+
+static void
+report (const char *benchmark,
+        const char *metric,
+        double      value,
+        const char *unit)
+{
+  printf ("%s\t%s\t%.2f\t%s\n", benchmark, metric, value, unit);
+}
+
+/* Blocks until connection receives a message that accept() wants,
+ * dropping anything else, and returns it
+ */
+static DBusMessage *
+wait_for_message (DBusConnection *connection,
+                  dbus_bool_t (* accept) (DBusMessage *, const void *),
+                  const void     *data)
+{
+  while (TRUE)
+    {
+      DBusMessage *message;
+
+      message = dbus_connection_pop_message (connection);
+      if (message == NULL)
+        {
+          if (!dbus_connection_read_write (connection, -1))
+            test_bench_die ("disconnected from the bus\n");
+          continue;
+        }
+
+      if ((* accept) (message, data))
+        return message;
+
+      dbus_message_unref (message);
+    }
+}
+
+static dbus_bool_t
+is_bench_call (DBusMessage *message,
+               const void  *data)
+{
+  return dbus_message_is_method_call (message, BENCH_INTERFACE, data);
+}
+
+static dbus_bool_t
+is_bench_signal (DBusMessage *message,
+                 const void  *data)
+{
+  return dbus_message_is_signal (message, BENCH_INTERFACE, data);
+}
+
+static dbus_bool_t
+is_reply_to (DBusMessage *message,
+             const void  *data)
+{
+  return dbus_message_get_type (message) == DBUS_MESSAGE_TYPE_METHOD_RETURN &&
+    dbus_message_get_reply_serial (message) == *(const dbus_uint32_t *) data;
+}
+
+static void
+send_and_flush (DBusConnection *connection,
+                DBusMessage    *message,
+                dbus_uint32_t  *serial)
+{
+  if (!dbus_connection_send (connection, message, serial))
+    test_bench_die ("no memory\n");
+
+  dbus_connection_flush (connection);
+  dbus_message_unref (message);
+}
+
+static DBusMessage *
+new_bench_signal (const char *member,
+                  const char *destination)
+{
+  DBusMessage *message;
+
+  message = dbus_message_new_signal (BENCH_PATH, BENCH_INTERFACE, member);
+  if (message == NULL ||
+      (destination != NULL &&
+       !dbus_message_set_destination (message, destination)))
+    test_bench_die ("no memory\n");
+
+  return message;
+}
+
+static int
+compare_doubles (const void *a,
+                 const void *b)
+{
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+
+  return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/* A client calls a method on a service that owns BENCH_NAME and waits
+ * for each reply before making the next call
+ */
+static void
+bench_method_calls (const char *address,
+                    int         n_calls)
+{
+  DBusConnection *service;
+  DBusConnection *client;
+  DBusError error;
+  double *samples;
+  double total;
+  int i;
+
+  dbus_error_init (&error);
+
+  service = test_bench_open_and_register (address);
+  if (dbus_bus_request_name (service, BENCH_NAME, DBUS_NAME_FLAG_DO_NOT_QUEUE,
+                             &error) != DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER)
+    test_bench_die ("could not own " BENCH_NAME "\n");
+
+  client = test_bench_open_and_register (address);
+
+  samples = dbus_new (double, n_calls);
+  if (samples == NULL)
+    test_bench_die ("no memory\n");
+
+  total = 0;
+  for (i = 0; i < n_calls; i++)
+    {
+      DBusMessage *message;
+      dbus_uint32_t serial;
+      long start_sec, start_usec;
+
+      _dbus_get_monotonic_time (&start_sec, &start_usec);
+
+      message = dbus_message_new_method_call (BENCH_NAME, BENCH_PATH,
+                                              BENCH_INTERFACE, "Ping");
+      if (message == NULL)
+        test_bench_die ("no memory\n");
+      send_and_flush (client, message, &serial);
+
+      message = wait_for_message (service, is_bench_call, "Ping");
+      send_and_flush (service, dbus_message_new_method_return (message), NULL);
+      dbus_message_unref (message);
+
+      message = wait_for_message (client, is_reply_to, &serial);
+      dbus_message_unref (message);
+
+      samples[i] = test_bench_usec_since (start_sec, start_usec);
+      total += samples[i];
+    }
+
+  qsort (samples, n_calls, sizeof (double), compare_doubles);
+
+  report ("method-call", "calls", n_calls, "calls");
+  report ("method-call", "rtt-mean", total / n_calls, "usec");
+  report ("method-call", "rtt-p50", samples[(n_calls - 1) / 2], "usec");
+  report ("method-call", "rtt-p99", samples[(n_calls * 99 + 99) / 100 - 1],
+          "usec");
+  report ("method-call", "rtt-max", samples[n_calls - 1], "usec");
+
+  dbus_free (samples);
+  test_bench_close (client);
+  test_bench_close (service);
+}
+
+/* One client sends signals addressed to another as fast as the bus
+ * takes them, in bursts so neither side's queue grows without bound
+ */
+static void
+bench_unicast (const char *address,
+               int         n_messages)
+{
+  DBusConnection *sender;
+  DBusConnection *receiver;
+  const char *destination;
+  long start_sec, start_usec;
+  double elapsed;
+  int n_sent;
+
+  sender = test_bench_open_and_register (address);
+  receiver = test_bench_open_and_register (address);
+  destination = dbus_bus_get_unique_name (receiver);
+
+  _dbus_get_monotonic_time (&start_sec, &start_usec);
+
+  for (n_sent = 0; n_sent < n_messages; n_sent += BURST)
+    {
+      int burst = MIN (BURST, n_messages - n_sent);
+      int i;
+
+      for (i = 0; i < burst; i++)
+        {
+          DBusMessage *message = new_bench_signal ("Unicast", destination);
+          dbus_int32_t n = n_sent + i;
+
+          if (!dbus_message_append_args (message,
+                                         DBUS_TYPE_INT32, &n,
+                                         DBUS_TYPE_INVALID) ||
+              !dbus_connection_send (sender, message, NULL))
+            test_bench_die ("no memory\n");
+
+          dbus_message_unref (message);
+        }
+
+      dbus_connection_flush (sender);
+
+      for (i = 0; i < burst; i++)
+        dbus_message_unref (wait_for_message (receiver, is_bench_signal,
+                                              "Unicast"));
+    }
+
+  elapsed = test_bench_usec_since (start_sec, start_usec);
+
+  report ("unicast", "messages", n_messages, "messages");
+  report ("unicast", "throughput", n_messages / (elapsed / 1000000.0),
+          "messages/sec");
+  report ("unicast", "per-message", elapsed / n_messages, "usec");
+
+  test_bench_close (receiver);
+  test_bench_close (sender);
+}
+
+/* Every subscriber adds n_rules match rules, only the first of which
+ * matches the signal we broadcast, and must receive each of them
+ */
+static void
+bench_fanout (const char *address,
+              int         n_subscribers,
+              int         n_rules,
+              int         n_signals)
+{
+  DBusConnection *emitter;
+  DBusConnection **subscribers;
+  char **rules;
+  long start_sec, start_usec;
+  double elapsed;
+  int n_sent;
+  int i;
+
+  rules = dbus_new0 (char *, n_rules + 1);
+  if (rules == NULL)
+    test_bench_die ("no memory\n");
+
+  rules[0] = _dbus_strdup ("type='signal',interface='" BENCH_INTERFACE "',member='FanOut'");
+  if (rules[0] == NULL)
+    test_bench_die ("no memory\n");
+
+  for (i = 1; i < n_rules; i++)
+    {
+      DBusString str;
+
+      if (!_dbus_string_init (&str) ||
+          !_dbus_string_append_printf (&str,
+                                       "type='signal',interface='%s',member='Other%d'",
+                                       BENCH_INTERFACE, i) ||
+          !_dbus_string_steal_data (&str, &rules[i]))
+        test_bench_die ("no memory\n");
+
+      _dbus_string_free (&str);
+    }
+
+  subscribers = dbus_new0 (DBusConnection *, n_subscribers);
+  if (subscribers == NULL)
+    test_bench_die ("no memory\n");
+
+  for (i = 0; i < n_subscribers; i++)
+    {
+      DBusError error;
+
+      dbus_error_init (&error);
+
+      subscribers[i] = test_bench_open_and_register (address);
+
+      dbus_bus_add_matches (subscribers[i], (const char **) rules, n_rules,
+                            &error);
+      if (dbus_error_is_set (&error))
+        {
+          char message[1024];
+
+          snprintf (message, sizeof (message),
+                    "Failed to add match rules: %s\n", error.message);
+          dbus_error_free (&error);
+          test_bench_die (message);
+        }
+    }
+
+  emitter = test_bench_open_and_register (address);
+
+  _dbus_get_monotonic_time (&start_sec, &start_usec);
+
+  for (n_sent = 0; n_sent < n_signals; n_sent += BURST)
+    {
+      int burst = MIN (BURST, n_signals - n_sent);
+      int j;
+
+      for (j = 0; j < burst; j++)
+        {
+          DBusMessage *message = new_bench_signal ("FanOut", NULL);
+
+          if (!dbus_connection_send (emitter, message, NULL))
+            test_bench_die ("no memory\n");
+
+          dbus_message_unref (message);
+        }
+
+      dbus_connection_flush (emitter);
+
+      for (i = 0; i < n_subscribers; i++)
+        {
+          for (j = 0; j < burst; j++)
+            dbus_message_unref (wait_for_message (subscribers[i],
+                                                  is_bench_signal,
+                                                  "FanOut"));
+        }
+    }
+
+  elapsed = test_bench_usec_since (start_sec, start_usec);
+
+  report ("fanout", "subscribers", n_subscribers, "connections");
+  report ("fanout", "rules-per-subscriber", n_rules, "rules");
+  report ("fanout", "signals", n_signals, "signals");
+  report ("fanout", "per-signal", elapsed / n_signals, "usec");
+  report ("fanout", "deliveries",
+          ((double) n_signals * n_subscribers) / (elapsed / 1000000.0),
+          "messages/sec");
+
+  test_bench_close (emitter);
+  for (i = 0; i < n_subscribers; i++)
+    test_bench_close (subscribers[i]);
+  dbus_free (subscribers);
+  dbus_free_string_array (rules);
+}
+
+/* Connects, says Hello and disconnects, one connection after another */
+static void
+bench_churn (const char *address,
+             int         n_connections)
+{
+  long start_sec, start_usec;
+  double elapsed;
+  int i;
+
+  _dbus_get_monotonic_time (&start_sec, &start_usec);
+
+  for (i = 0; i < n_connections; i++)
+    test_bench_close (test_bench_open_and_register (address));
+
+  elapsed = test_bench_usec_since (start_sec, start_usec);
+
+  report ("churn", "connections", n_connections, "connections");
+  report ("churn", "rate", n_connections / (elapsed / 1000000.0),
+          "connections/sec");
+  report ("churn", "per-connection", elapsed / n_connections, "usec");
+}
+
+/* Sends byte arrays of growing size from one client to another, each
+ * read by the receiver before the next is sent
+ */
+static void
+bench_large_payloads (const char *address,
+                      int         max_megabytes)
+{
+  DBusConnection *sender;
+  DBusConnection *receiver;
+  const char *destination;
+  unsigned char *bytes;
+  int megabytes;
+
+  sender = test_bench_open_and_register (address);
+  receiver = test_bench_open_and_register (address);
+  destination = dbus_bus_get_unique_name (receiver);
+
+  bytes = dbus_malloc0 (max_megabytes * 1024 * 1024);
+  if (bytes == NULL)
+    test_bench_die ("no memory\n");
+
+  for (megabytes = 1; megabytes <= max_megabytes; megabytes *= 4)
+    {
+      int n_bytes = megabytes * 1024 * 1024;
+      int n_iterations = MAX (4, 64 / megabytes);
+      long start_sec, start_usec;
+      double elapsed;
+      char metric[64];
+      int i;
+
+      _dbus_get_monotonic_time (&start_sec, &start_usec);
+
+      for (i = 0; i < n_iterations; i++)
+        {
+          DBusMessage *message = new_bench_signal ("Payload", destination);
+
+          if (!dbus_message_append_args (message,
+                                         DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+                                         &bytes, n_bytes,
+                                         DBUS_TYPE_INVALID))
+            test_bench_die ("no memory\n");
+
+          send_and_flush (sender, message, NULL);
+
+          dbus_message_unref (wait_for_message (receiver, is_bench_signal,
+                                                "Payload"));
+        }
+
+      elapsed = test_bench_usec_since (start_sec, start_usec);
+
+      snprintf (metric, sizeof (metric), "bandwidth-%dmb", megabytes);
+      report ("large-payload", metric,
+              ((double) megabytes * n_iterations) / (elapsed / 1000000.0),
+              "MB/sec");
+    }
+
+  dbus_free (bytes);
+  test_bench_close (receiver);
+  test_bench_close (sender);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  const char *daemon;
+  const char *config;
+  char *address;
+  dbus_bool_t quick;
+  int n_subscribers;
+  int n_rules;
+  int scale;
+  int i;
+
+  test_bench_init ("test-bus-bench");
+
+  daemon = TEST_BUS_BINARY;
+  config = TEST_SESSION_LIKE_SYSTEM_CONFIG;
+  address = NULL;
+  quick = FALSE;
+  n_subscribers = 50;
+  n_rules = 20;
+
+  for (i = 1; i < argc; i++)
+    {
+      const char *arg = argv[i];
+
+      if (strcmp (arg, "--quick") == 0)
+        quick = TRUE;
+      else if (strncmp (arg, "--subscribers=", strlen ("--subscribers=")) == 0)
+        n_subscribers = atoi (arg + strlen ("--subscribers="));
+      else if (strncmp (arg, "--rules=", strlen ("--rules=")) == 0)
+        n_rules = atoi (arg + strlen ("--rules="));
+      else if (strncmp (arg, "--daemon=", strlen ("--daemon=")) == 0)
+        daemon = arg + strlen ("--daemon=");
+      else if (strncmp (arg, "--config=", strlen ("--config=")) == 0)
+        config = arg + strlen ("--config=");
+      else if (strncmp (arg, "--address=", strlen ("--address=")) == 0)
+        {
+          address = _dbus_strdup (arg + strlen ("--address="));
+          if (address == NULL)
+            test_bench_die ("no memory\n");
+        }
+      else
+        test_bench_usage (USAGE);
+    }
+
+  if (n_subscribers <= 0 || n_rules <= 0)
+    test_bench_usage (USAGE);
+
+  /* --quick is for checking the benchmarks still run, not for numbers */
+  scale = quick ? 10 : 1;
+
+  if (address == NULL)
+    address = test_bench_start_daemon (daemon, config);
+
+  bench_method_calls (address, 20000 / scale);
+  bench_unicast (address, 200000 / scale);
+  bench_fanout (address, n_subscribers, n_rules, 2000 / scale);
+  bench_churn (address, 2000 / scale);
+  bench_large_payloads (address, quick ? 4 : 16);
+
+  test_bench_stop_daemon ();
+
+  dbus_free (address);
+
+  dbus_shutdown ();
+
+  return 0;
+}
@@ -0,0 +1,240 @@
+/* Measures how long it takes to set up short-lived bus connections:
+ * open, authenticate, Hello, optionally emit one signal the way
+ * dbus-send does, disconnect. Listeners watching NameOwnerChanged can
+ * be added to see the cost of announcing each client, e.g. with and
+ * without <oneshot_connections/> in the bus config. With --storm all
+ * connections are opened at once instead, like at boot or login, which
+ * measures how quickly the bus drains its listen backlog. Run it against
+ * a session bus, e.g. through tools/run-with-tmp-session-bus.sh.
+ */
+#include <config.h>
+#include "test-utils.h"
+
+#include <string.h>
+
+#define USAGE "[--pipelined] [--signal] [--storm] [--listeners=N] [--address=ADDRESS] [N_CONNECTIONS]"
+
+static void
+connect_once (const char *address,
+              dbus_bool_t pipelined,
+              dbus_bool_t send_signal)
+{
+  DBusConnection *connection;
+
+  connection = test_bench_open (address, pipelined);
+  test_bench_register (connection);
+
+  if (send_signal)
+    {
+      DBusMessage *message;
+
+      message = dbus_message_new_signal ("/org/freedesktop/TestSuite",
+                                         "org.freedesktop.TestSuite",
+                                         "Churn");
+      if (message == NULL)
+        test_bench_die ("no memory\n");
+
+      if (!dbus_connection_send (connection, message, NULL))
+        test_bench_die ("no memory\n");
+
+      dbus_connection_flush (connection);
+      dbus_message_unref (message);
+    }
+
+  dbus_connection_close (connection);
+  dbus_connection_unref (connection);
+}
+
+/* Opens all the connections before registering any of them, so the
+ * bus finds them queued up in its listen backlog
+ */
+static void
+connect_storm (const char *address,
+               dbus_bool_t pipelined,
+               int         n_connections)
+{
+  DBusConnection **connections;
+  long start_sec, start_usec;
+  long opened_sec, opened_usec;
+  long end_sec, end_usec;
+  int i;
+
+  connections = dbus_new0 (DBusConnection *, n_connections);
+  if (connections == NULL)
+    test_bench_die ("no memory\n");
+
+  _dbus_get_monotonic_time (&start_sec, &start_usec);
+
+  /* Queue every Hello up front so that the bus, not a client round
+   * trip per connection, is what we are waiting for
+   */
+  for (i = 0; i < n_connections; i++)
+    {
+      DBusError error;
+
+      dbus_error_init (&error);
+
+      connections[i] = test_bench_open (address, pipelined);
+
+      if (!dbus_bus_register_async (connections[i], &error))
+        test_bench_die ("failed to queue Hello\n");
+
+      dbus_connection_read_write (connections[i], 0);
+    }
+
+  _dbus_get_monotonic_time (&opened_sec, &opened_usec);
+
+  for (i = 0; i < n_connections; i++)
+    test_bench_register (connections[i]);
+
+  _dbus_get_monotonic_time (&end_sec, &end_usec);
+
+  printf ("%d connections at once%s: %.0f usec until all connected, %.0f usec until all registered\n",
+          n_connections, pipelined ? " (pipelined auth)" : "",
+          (opened_sec - start_sec) * 1000000.0 + (opened_usec - start_usec),
+          (end_sec - start_sec) * 1000000.0 + (end_usec - start_usec));
+
+  for (i = 0; i < n_connections; i++)
+    {
+      dbus_connection_close (connections[i]);
+      dbus_connection_unref (connections[i]);
+    }
+  dbus_free (connections);
+}
+
+/* Keep listeners from backing up the bus's outgoing queues */
+static int
+drain_listeners (DBusConnection **listeners,
+                 int              n_listeners)
+{
+  int n_received;
+  int i;
+
+  n_received = 0;
+
+  for (i = 0; i < n_listeners; i++)
+    {
+      DBusMessage *message;
+
+      dbus_connection_read_write (listeners[i], 0);
+
+      while ((message = dbus_connection_pop_message (listeners[i])) != NULL)
+        {
+          n_received += 1;
+          dbus_message_unref (message);
+        }
+    }
+
+  return n_received;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  const char *address;
+  dbus_bool_t pipelined;
+  dbus_bool_t send_signal;
+  dbus_bool_t storm;
+  DBusConnection **listeners;
+  int n_listeners;
+  int n_received;
+  int n_connections;
+  long start_sec, start_usec;
+  long end_sec, end_usec;
+  double elapsed;
+  int i;
+
+  test_bench_init ("test-connect-churn");
+
+  address = getenv ("DBUS_SESSION_BUS_ADDRESS");
+  pipelined = FALSE;
+  send_signal = FALSE;
+  storm = FALSE;
+  n_listeners = 0;
+  n_connections = 1000;
+
+  for (i = 1; i < argc; i++)
+    {
+      const char *arg = argv[i];
+
+      if (strcmp (arg, "--pipelined") == 0)
+        pipelined = TRUE;
+      else if (strcmp (arg, "--signal") == 0)
+        send_signal = TRUE;
+      else if (strcmp (arg, "--storm") == 0)
+        storm = TRUE;
+      else if (strncmp (arg, "--listeners=", strlen ("--listeners=")) == 0)
+        n_listeners = atoi (arg + strlen ("--listeners="));
+      else if (strncmp (arg, "--address=", strlen ("--address=")) == 0)
+        address = arg + strlen ("--address=");
+      else if (arg[0] == '-')
+        test_bench_usage (USAGE);
+      else
+        n_connections = atoi (arg);
+    }
+
+  if (address == NULL)
+    test_bench_die ("no --address given and DBUS_SESSION_BUS_ADDRESS is not set\n");
+
+  if (n_connections <= 0 || n_listeners < 0)
+    test_bench_usage (USAGE);
+
+  if (storm)
+    {
+      connect_storm (address, pipelined, n_connections);
+      dbus_shutdown ();
+      return 0;
+    }
+
+  listeners = dbus_new0 (DBusConnection *, n_listeners + 1);
+  if (listeners == NULL)
+    test_bench_die ("no memory\n");
+
+  for (i = 0; i < n_listeners; i++)
+    {
+      DBusError error;
+
+      dbus_error_init (&error);
+
+      listeners[i] = test_bench_open_and_register (address);
+
+      dbus_bus_add_match (listeners[i],
+                          "type='signal',interface='" DBUS_INTERFACE_DBUS "',member='NameOwnerChanged'",
+                          &error);
+      if (dbus_error_is_set (&error))
+        test_bench_die ("failed to add match rule for listener\n");
+    }
+
+  /* Drop the announcements of the listeners themselves */
+  drain_listeners (listeners, n_listeners);
+  n_received = 0;
+
+  _dbus_get_monotonic_time (&start_sec, &start_usec);
+
+  for (i = 0; i < n_connections; i++)
+    {
+      connect_once (address, pipelined, send_signal);
+      n_received += drain_listeners (listeners, n_listeners);
+    }
+
+  _dbus_get_monotonic_time (&end_sec, &end_usec);
+
+  elapsed = (end_sec - start_sec) * 1000000.0 + (end_usec - start_usec);
+
+  printf ("%d connections%s%s, %d listeners: %.0f usec total, %.1f usec per connection, %d NameOwnerChanged received\n",
+          n_connections, pipelined ? " (pipelined auth)" : "",
+          send_signal ? " sending a signal" : "",
+          n_listeners, elapsed, elapsed / n_connections, n_received);
+
+  for (i = 0; i < n_listeners; i++)
+    {
+      dbus_connection_close (listeners[i]);
+      dbus_connection_unref (listeners[i]);
+    }
+  dbus_free (listeners);
+
+  dbus_shutdown ();
+
+  return 0;
+}
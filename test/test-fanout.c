@@ -0,0 +1,166 @@
+/* Measures how fast the bus delivers a broadcast signal to many
+ * subscribers: one client emits signals that every subscriber has a
+ * match rule for, and we wait until each subscriber has received all of
+ * them. Signals are sent in bursts, so the bus sees them back to back
+ * as it would from a busy emitter. Run it against a session bus, e.g.
+ * through tools/run-with-tmp-session-bus.sh.
+ */
+#include <config.h>
+#include "test-utils.h"
+
+#include <string.h>
+
+#define USAGE "[--subscribers=N] [--address=ADDRESS] [N_SIGNALS]"
+
+#define BURST 50
+
+static void
+send_burst (DBusConnection *emitter,
+            int             n_signals)
+{
+  int i;
+
+  for (i = 0; i < n_signals; i++)
+    {
+      DBusMessage *message;
+      dbus_int32_t n = i;
+
+      message = dbus_message_new_signal ("/org/freedesktop/TestSuite",
+                                         "org.freedesktop.TestSuite",
+                                         "FanOut");
+      if (message == NULL)
+        test_bench_die ("no memory\n");
+
+      if (!dbus_message_append_args (message,
+                                     DBUS_TYPE_INT32, &n,
+                                     DBUS_TYPE_INVALID))
+        test_bench_die ("no memory\n");
+
+      if (!dbus_connection_send (emitter, message, NULL))
+        test_bench_die ("no memory\n");
+
+      dbus_message_unref (message);
+    }
+
+  dbus_connection_flush (emitter);
+}
+
+/* Blocks until the subscriber has seen n_signals more of our signals */
+static void
+receive_burst (DBusConnection *subscriber,
+               int             n_signals)
+{
+  while (n_signals > 0)
+    {
+      DBusMessage *message;
+
+      message = dbus_connection_pop_message (subscriber);
+      if (message == NULL)
+        {
+          dbus_connection_read_write (subscriber, -1);
+          continue;
+        }
+
+      if (dbus_message_is_signal (message, "org.freedesktop.TestSuite", "FanOut"))
+        n_signals -= 1;
+
+      dbus_message_unref (message);
+    }
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  const char *address;
+  DBusConnection *emitter;
+  DBusConnection **subscribers;
+  int n_subscribers;
+  int n_signals;
+  int n_sent;
+  long start_sec, start_usec;
+  long end_sec, end_usec;
+  double elapsed;
+  int i;
+
+  test_bench_init ("test-fanout");
+
+  address = getenv ("DBUS_SESSION_BUS_ADDRESS");
+  n_subscribers = 500;
+  n_signals = 2000;
+
+  for (i = 1; i < argc; i++)
+    {
+      const char *arg = argv[i];
+
+      if (strncmp (arg, "--subscribers=", strlen ("--subscribers=")) == 0)
+        n_subscribers = atoi (arg + strlen ("--subscribers="));
+      else if (strncmp (arg, "--address=", strlen ("--address=")) == 0)
+        address = arg + strlen ("--address=");
+      else if (arg[0] == '-')
+        test_bench_usage (USAGE);
+      else
+        n_signals = atoi (arg);
+    }
+
+  if (address == NULL)
+    test_bench_die ("no --address given and DBUS_SESSION_BUS_ADDRESS is not set\n");
+
+  if (n_subscribers <= 0 || n_signals <= 0)
+    test_bench_usage (USAGE);
+
+  subscribers = dbus_new0 (DBusConnection *, n_subscribers);
+  if (subscribers == NULL)
+    test_bench_die ("no memory\n");
+
+  for (i = 0; i < n_subscribers; i++)
+    {
+      DBusError error;
+
+      dbus_error_init (&error);
+
+      subscribers[i] = test_bench_open_and_register (address);
+
+      dbus_bus_add_match (subscribers[i],
+                          "type='signal',interface='org.freedesktop.TestSuite',member='FanOut'",
+                          &error);
+      if (dbus_error_is_set (&error))
+        test_bench_die ("failed to add match rule for subscriber\n");
+    }
+
+  emitter = test_bench_open_and_register (address);
+
+  _dbus_get_monotonic_time (&start_sec, &start_usec);
+
+  for (n_sent = 0; n_sent < n_signals; n_sent += BURST)
+    {
+      int burst = MIN (BURST, n_signals - n_sent);
+
+      send_burst (emitter, burst);
+
+      for (i = 0; i < n_subscribers; i++)
+        receive_burst (subscribers[i], burst);
+    }
+
+  _dbus_get_monotonic_time (&end_sec, &end_usec);
+
+  elapsed = (end_sec - start_sec) * 1000000.0 + (end_usec - start_usec);
+
+  printf ("%d signals to %d subscribers: %.0f usec total, %.1f usec per signal, %.2f usec per delivery\n",
+          n_signals, n_subscribers, elapsed, elapsed / n_signals,
+          elapsed / ((double) n_signals * n_subscribers));
+
+  dbus_connection_close (emitter);
+  dbus_connection_unref (emitter);
+
+  for (i = 0; i < n_subscribers; i++)
+    {
+      dbus_connection_close (subscribers[i]);
+      dbus_connection_unref (subscribers[i]);
+    }
+  dbus_free (subscribers);
+
+  dbus_shutdown ();
+
+  return 0;
+}
@@ -0,0 +1,129 @@
+/* Measures what subscribing to signals costs an application at startup:
+ * each simulated application connects, registers and adds a set of
+ * match rules, either one AddMatch round trip at a time or all in one
+ * AddMatches call. Run it against a session bus, e.g. through
+ * tools/run-with-tmp-session-bus.sh.
+ */
+#include <config.h>
+#include "test-utils.h"
+
+#include <string.h>
+
+#define USAGE "[--rules=N] [--address=ADDRESS] [N_APPS]"
+
+/* Starts n_apps applications one after another and returns the mean
+ * time each took to connect and add its rules, in microseconds
+ */
+static double
+usec_per_startup (const char   *address,
+                  const char  **rules,
+                  int           n_rules,
+                  int           n_apps,
+                  dbus_bool_t   batched)
+{
+  long start_sec, start_usec;
+  long end_sec, end_usec;
+  int i, j;
+
+  _dbus_get_monotonic_time (&start_sec, &start_usec);
+
+  for (i = 0; i < n_apps; i++)
+    {
+      DBusConnection *connection;
+      DBusError error;
+
+      dbus_error_init (&error);
+
+      connection = test_bench_open_and_register (address);
+
+      if (batched)
+        {
+          dbus_bus_add_matches (connection, rules, n_rules, &error);
+        }
+      else
+        {
+          for (j = 0; j < n_rules && !dbus_error_is_set (&error); j++)
+            dbus_bus_add_match (connection, rules[j], &error);
+        }
+
+      if (dbus_error_is_set (&error))
+        {
+          fprintf (stderr, "*** Failed to add match rules: %s\n",
+                   error.message);
+          exit (1);
+        }
+
+      dbus_connection_close (connection);
+      dbus_connection_unref (connection);
+    }
+
+  _dbus_get_monotonic_time (&end_sec, &end_usec);
+
+  return ((end_sec - start_sec) * 1000000.0 + (end_usec - start_usec)) / n_apps;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  const char *address;
+  char **texts;
+  int n_rules;
+  int n_apps;
+  int i;
+
+  test_bench_init ("test-match-startup");
+
+  address = getenv ("DBUS_SESSION_BUS_ADDRESS");
+  n_rules = 100;
+  n_apps = 200;
+
+  for (i = 1; i < argc; i++)
+    {
+      const char *arg = argv[i];
+
+      if (strncmp (arg, "--rules=", strlen ("--rules=")) == 0)
+        n_rules = atoi (arg + strlen ("--rules="));
+      else if (strncmp (arg, "--address=", strlen ("--address=")) == 0)
+        address = arg + strlen ("--address=");
+      else if (arg[0] == '-')
+        test_bench_usage (USAGE);
+      else
+        n_apps = atoi (arg);
+    }
+
+  if (address == NULL)
+    test_bench_die ("no --address given and DBUS_SESSION_BUS_ADDRESS is not set\n");
+
+  if (n_rules <= 0 || n_apps <= 0)
+    test_bench_usage (USAGE);
+
+  texts = dbus_new0 (char *, n_rules + 1);
+  if (texts == NULL)
+    test_bench_die ("no memory\n");
+
+  for (i = 0; i < n_rules; i++)
+    {
+      DBusString str;
+
+      if (!_dbus_string_init (&str) ||
+          !_dbus_string_append_printf (&str,
+                                       "type='signal',interface='org.freedesktop.TestSuite%d',member='Changed'",
+                                       i) ||
+          !_dbus_string_steal_data (&str, &texts[i]))
+        test_bench_die ("no memory\n");
+
+      _dbus_string_free (&str);
+    }
+
+  printf ("%d apps adding %d match rules each: one at a time %.0f usec per app, batched %.0f usec per app\n",
+          n_apps, n_rules,
+          usec_per_startup (address, (const char **) texts, n_rules, n_apps, FALSE),
+          usec_per_startup (address, (const char **) texts, n_rules, n_apps, TRUE));
+
+  dbus_free_string_array (texts);
+
+  dbus_shutdown ();
+
+  return 0;
+}
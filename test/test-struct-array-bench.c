@@ -0,0 +1,245 @@
+/* Compares appending and reading an array of (uud) structs one element
+ * at a time through iterators with dbus_message_iter_append_struct_array()
+ * and dbus_message_iter_get_struct_array(), once for a C struct that
+ * matches the wire layout and once for one that doesn't. No bus is
+ * needed; the messages are only built and read in memory.
+ */
+#include <config.h>
+#include "test-utils.h"
+
+#include <string.h>
+
+#define USAGE "[N_ELEMENTS]"
+
+typedef struct
+{
+  dbus_uint32_t a;
+  dbus_uint32_t b;
+  double d;
+} Sample;
+
+static const int sample_offsets[] = {
+  _DBUS_STRUCT_OFFSET (Sample, a),
+  _DBUS_STRUCT_OFFSET (Sample, b),
+  _DBUS_STRUCT_OFFSET (Sample, d)
+};
+
+/* the same fields in a different order than on the wire */
+typedef struct
+{
+  double d;
+  dbus_uint32_t b;
+  dbus_uint32_t a;
+} SampleReordered;
+
+static const int sample_reordered_offsets[] = {
+  _DBUS_STRUCT_OFFSET (SampleReordered, a),
+  _DBUS_STRUCT_OFFSET (SampleReordered, b),
+  _DBUS_STRUCT_OFFSET (SampleReordered, d)
+};
+
+static DBusMessage *
+new_message (void)
+{
+  DBusMessage *message;
+
+  message = dbus_message_new_method_call ("org.freedesktop.DBus.TestService",
+                                          "/org/freedesktop/TestPath",
+                                          "Foo.TestInterface",
+                                          "StructArray");
+  if (message == NULL)
+    test_bench_die ("no memory\n");
+
+  return message;
+}
+
+static void
+append_one_by_one (DBusMessage  *message,
+                   const Sample *samples,
+                   int           n_samples)
+{
+  DBusMessageIter iter, array_iter, struct_iter;
+  int i;
+
+  dbus_message_iter_init_append (message, &iter);
+  if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "(uud)",
+                                         &array_iter))
+    test_bench_die ("no memory\n");
+
+  for (i = 0; i < n_samples; i++)
+    {
+      if (!dbus_message_iter_open_container (&array_iter, DBUS_TYPE_STRUCT,
+                                             NULL, &struct_iter) ||
+          !dbus_message_iter_append_basic (&struct_iter, DBUS_TYPE_UINT32,
+                                           &samples[i].a) ||
+          !dbus_message_iter_append_basic (&struct_iter, DBUS_TYPE_UINT32,
+                                           &samples[i].b) ||
+          !dbus_message_iter_append_basic (&struct_iter, DBUS_TYPE_DOUBLE,
+                                           &samples[i].d) ||
+          !dbus_message_iter_close_container (&array_iter, &struct_iter))
+        test_bench_die ("no memory\n");
+    }
+
+  if (!dbus_message_iter_close_container (&iter, &array_iter))
+    test_bench_die ("no memory\n");
+}
+
+static int
+read_one_by_one (DBusMessage *message,
+                 Sample      *samples)
+{
+  DBusMessageIter iter, array_iter, struct_iter;
+  int i;
+
+  dbus_message_iter_init (message, &iter);
+  dbus_message_iter_recurse (&iter, &array_iter);
+
+  i = 0;
+  while (dbus_message_iter_get_arg_type (&array_iter) == DBUS_TYPE_STRUCT)
+    {
+      dbus_message_iter_recurse (&array_iter, &struct_iter);
+      dbus_message_iter_get_basic (&struct_iter, &samples[i].a);
+      dbus_message_iter_next (&struct_iter);
+      dbus_message_iter_get_basic (&struct_iter, &samples[i].b);
+      dbus_message_iter_next (&struct_iter);
+      dbus_message_iter_get_basic (&struct_iter, &samples[i].d);
+      dbus_message_iter_next (&array_iter);
+      i++;
+    }
+
+  return i;
+}
+
+static void
+append_bulk (DBusMessage *message,
+             const void  *elements,
+             int          n_elements,
+             int          element_size,
+             const int   *field_offsets)
+{
+  DBusMessageIter iter, array_iter;
+
+  dbus_message_iter_init_append (message, &iter);
+  if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "(uud)",
+                                         &array_iter) ||
+      !dbus_message_iter_append_struct_array (&array_iter, elements,
+                                              n_elements, element_size,
+                                              field_offsets) ||
+      !dbus_message_iter_close_container (&iter, &array_iter))
+    test_bench_die ("no memory\n");
+}
+
+static int
+read_bulk (DBusMessage *message,
+           void        *elements,
+           int          max_elements,
+           int          element_size,
+           const int   *field_offsets)
+{
+  DBusMessageIter iter, array_iter;
+
+  dbus_message_iter_init (message, &iter);
+  dbus_message_iter_recurse (&iter, &array_iter);
+
+  return dbus_message_iter_get_struct_array (&array_iter, elements,
+                                             max_elements, element_size,
+                                             field_offsets);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Sample *samples;
+  SampleReordered *reordered;
+  DBusMessage *message;
+  long start_sec, start_usec;
+  double one_by_one_write, one_by_one_read;
+  double bulk_write, bulk_read;
+  double reordered_write, reordered_read;
+  int n_samples;
+  int n_read;
+  int i;
+
+  test_bench_init ("test-struct-array-bench");
+
+  n_samples = 100000;
+
+  if (argc > 2 || (argc == 2 && argv[1][0] == '-'))
+    test_bench_usage (USAGE);
+
+  if (argc == 2)
+    n_samples = atoi (argv[1]);
+
+  if (n_samples <= 0)
+    test_bench_usage (USAGE);
+
+  samples = dbus_new (Sample, n_samples);
+  reordered = dbus_new (SampleReordered, n_samples);
+  if (samples == NULL || reordered == NULL)
+    test_bench_die ("no memory\n");
+
+  for (i = 0; i < n_samples; i++)
+    {
+      samples[i].a = reordered[i].a = i;
+      samples[i].b = reordered[i].b = i * 7;
+      samples[i].d = reordered[i].d = i * 0.5;
+    }
+
+  message = new_message ();
+  _dbus_get_monotonic_time (&start_sec, &start_usec);
+  append_one_by_one (message, samples, n_samples);
+  one_by_one_write = test_bench_usec_since (start_sec, start_usec);
+
+  _dbus_get_monotonic_time (&start_sec, &start_usec);
+  n_read = read_one_by_one (message, samples);
+  one_by_one_read = test_bench_usec_since (start_sec, start_usec);
+  dbus_message_unref (message);
+
+  if (n_read != n_samples)
+    test_bench_die ("read back the wrong number of elements\n");
+
+  message = new_message ();
+  _dbus_get_monotonic_time (&start_sec, &start_usec);
+  append_bulk (message, samples, n_samples, sizeof (Sample), sample_offsets);
+  bulk_write = test_bench_usec_since (start_sec, start_usec);
+
+  _dbus_get_monotonic_time (&start_sec, &start_usec);
+  n_read = read_bulk (message, samples, n_samples, sizeof (Sample),
+                      sample_offsets);
+  bulk_read = test_bench_usec_since (start_sec, start_usec);
+  dbus_message_unref (message);
+
+  if (n_read != n_samples)
+    test_bench_die ("read back the wrong number of elements\n");
+
+  message = new_message ();
+  _dbus_get_monotonic_time (&start_sec, &start_usec);
+  append_bulk (message, reordered, n_samples, sizeof (SampleReordered),
+               sample_reordered_offsets);
+  reordered_write = test_bench_usec_since (start_sec, start_usec);
+
+  _dbus_get_monotonic_time (&start_sec, &start_usec);
+  n_read = read_bulk (message, reordered, n_samples, sizeof (SampleReordered),
+                      sample_reordered_offsets);
+  reordered_read = test_bench_usec_since (start_sec, start_usec);
+  dbus_message_unref (message);
+
+  if (n_read != n_samples)
+    test_bench_die ("read back the wrong number of elements\n");
+
+  printf ("%d (uud) structs:\n", n_samples);
+  printf ("  per-element iterators:   write %.0f usec, read %.0f usec\n",
+          one_by_one_write, one_by_one_read);
+  printf ("  bulk, wire layout:       write %.0f usec, read %.0f usec\n",
+          bulk_write, bulk_read);
+  printf ("  bulk, different layout:  write %.0f usec, read %.0f usec\n",
+          reordered_write, reordered_read);
+
+  dbus_free (samples);
+  dbus_free (reordered);
+
+  dbus_shutdown ();
+
+  return 0;
+}
@@ -1,6 +1,14 @@
 #include <config.h>
 #include "test-utils.h"
 
+#include <string.h>
+#ifdef DBUS_UNIX
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
 typedef struct
 {
   DBusLoop *loop;
@@ -342,3 +350,193 @@ test_server_shutdown (DBusLoop         *loop,
                                           NULL))
     _dbus_assert_not_reached ("setting timeout functions to NULL failed");  
 }
+
+static const char *bench_program_name = "test";
+#ifdef DBUS_UNIX
+static pid_t bench_daemon_pid = 0;
+#endif
+
+void
+test_bench_init (const char *program_name)
+{
+  bench_program_name = program_name;
+}
+
+void
+test_bench_die (const char *message)
+{
+  fprintf (stderr, "*** %s: %s", bench_program_name, message);
+
+#ifdef DBUS_UNIX
+  test_bench_stop_daemon ();
+#endif
+
+  exit (1);
+}
+
+void
+test_bench_usage (const char *arguments)
+{
+  fprintf (stderr, "Usage: %s %s\n", bench_program_name, arguments);
+  exit (1);
+}
+
+double
+test_bench_usec_since (long start_sec,
+                       long start_usec)
+{
+  long sec, usec;
+
+  _dbus_get_monotonic_time (&sec, &usec);
+
+  return (sec - start_sec) * 1000000.0 + (usec - start_usec);
+}
+
+#ifdef DBUS_UNIX
+/* Starts dbus-daemon with the given config file and returns the
+ * address it listens on. It runs until test_bench_stop_daemon(),
+ * which test_bench_die() also calls.
+ */
+char *
+test_bench_start_daemon (const char *daemon,
+                         const char *config)
+{
+  char buf[1024];
+  char *address;
+  int fds[2];
+  int len;
+  pid_t pid;
+
+  _dbus_assert (bench_daemon_pid == 0);
+
+  if (pipe (fds) < 0)
+    test_bench_die ("could not create a pipe\n");
+
+  pid = fork ();
+  if (pid < 0)
+    test_bench_die ("could not fork\n");
+
+  if (pid == 0)
+    {
+      char config_arg[1024];
+      char print_address_arg[64];
+
+      close (fds[0]);
+
+      snprintf (config_arg, sizeof (config_arg), "--config-file=%s", config);
+      snprintf (print_address_arg, sizeof (print_address_arg),
+                "--print-address=%d", fds[1]);
+
+      execl (daemon, daemon, config_arg, "--nofork", print_address_arg,
+             (char *) NULL);
+
+      fprintf (stderr, "*** %s: could not run %s\n", bench_program_name,
+               daemon);
+      _exit (1);
+    }
+
+  bench_daemon_pid = pid;
+
+  close (fds[1]);
+
+  len = 0;
+  while (len < (int) sizeof (buf) - 1)
+    {
+      ssize_t n = read (fds[0], buf + len, sizeof (buf) - 1 - len);
+
+      if (n <= 0)
+        break;
+
+      len += n;
+      if (memchr (buf, '\n', len) != NULL)
+        break;
+    }
+
+  close (fds[0]);
+
+  buf[len] = '\0';
+  if (strchr (buf, '\n') == NULL)
+    test_bench_die ("dbus-daemon did not print its address\n");
+
+  *strchr (buf, '\n') = '\0';
+
+  address = _dbus_strdup (buf);
+  if (address == NULL)
+    test_bench_die ("no memory\n");
+
+  return address;
+}
+
+void
+test_bench_stop_daemon (void)
+{
+  if (bench_daemon_pid == 0)
+    return;
+
+  kill (bench_daemon_pid, SIGTERM);
+  waitpid (bench_daemon_pid, NULL, 0);
+  bench_daemon_pid = 0;
+}
+#endif /* DBUS_UNIX */
+
+DBusConnection *
+test_bench_open (const char  *address,
+                 dbus_bool_t  pipelined)
+{
+  DBusConnection *connection;
+  DBusError error;
+
+  dbus_error_init (&error);
+
+  connection = dbus_connection_open_private (address, &error);
+  if (connection == NULL)
+    {
+      char message[1024];
+
+      snprintf (message, sizeof (message),
+                "Failed to open connection to %s: %s\n",
+                address, error.message);
+      dbus_error_free (&error);
+      test_bench_die (message);
+    }
+
+  dbus_connection_set_pipelined_auth (connection, pipelined);
+
+  return connection;
+}
+
+void
+test_bench_register (DBusConnection *connection)
+{
+  DBusError error;
+
+  dbus_error_init (&error);
+
+  if (!dbus_bus_register (connection, &error))
+    {
+      char message[1024];
+
+      snprintf (message, sizeof (message),
+                "Failed to register with the bus: %s\n", error.message);
+      dbus_error_free (&error);
+      test_bench_die (message);
+    }
+}
+
+DBusConnection *
+test_bench_open_and_register (const char *address)
+{
+  DBusConnection *connection;
+
+  connection = test_bench_open (address, FALSE);
+  test_bench_register (connection);
+
+  return connection;
+}
+
+void
+test_bench_close (DBusConnection *connection)
+{
+  dbus_connection_close (connection);
+  dbus_connection_unref (connection);
+}
@@ -22,4 +22,24 @@ dbus_bool_t test_server_setup                     (DBusLoop      *loop,
 void        test_server_shutdown                  (DBusLoop      *loop,
                                                    DBusServer    *server);
 
+/* Helpers for the benchmark programs, which talk to a bus directly.
+ * Fatal errors print the program name, stop a dbus-daemon started
+ * with test_bench_start_daemon() and exit.
+ */
+void            test_bench_init               (const char     *program_name);
+void            test_bench_die                (const char     *message);
+void            test_bench_usage              (const char     *arguments);
+double          test_bench_usec_since         (long            start_sec,
+                                               long            start_usec);
+#ifdef DBUS_UNIX
+char *          test_bench_start_daemon       (const char     *daemon,
+                                               const char     *config);
+void            test_bench_stop_daemon        (void);
+#endif
+DBusConnection *test_bench_open               (const char     *address,
+                                               dbus_bool_t     pipelined);
+void            test_bench_register           (DBusConnection *connection);
+DBusConnection *test_bench_open_and_register  (const char     *address);
+void            test_bench_close              (DBusConnection *connection);
+
 #endif
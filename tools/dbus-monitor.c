@@ -23,9 +23,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <signal.h>
 
 #ifdef DBUS_WIN
 #include <winsock2.h>
+#include <fcntl.h>
+#include <io.h>
 #undef interface
 #else
 #include <sys/time.h>
@@ -144,20 +147,12 @@ profile_print_with_attrs (const char *type, DBusMessage *message,
 }
 
 static void
-print_message_profile (DBusMessage *message)
+print_message_profile (DBusMessage *message, struct timeval *t)
 {
-  struct timeval t;
-
-  if (gettimeofday (&t, NULL) < 0)
-    {
-      printf ("un\n");
-      return;
-    }
-
   switch (dbus_message_get_type (message))
     {
       case DBUS_MESSAGE_TYPE_METHOD_CALL:
-	profile_print_with_attrs ("mc", message, &t,
+	profile_print_with_attrs ("mc", message, t,
 	  PROFILE_ATTRIBUTE_FLAG_SERIAL |
 	  PROFILE_ATTRIBUTE_FLAG_SENDER |
 	  PROFILE_ATTRIBUTE_FLAG_PATH |
@@ -165,58 +160,850 @@ print_message_profile (DBusMessage *message)
 	  PROFILE_ATTRIBUTE_FLAG_MEMBER);
 	break;
       case DBUS_MESSAGE_TYPE_METHOD_RETURN:
-	profile_print_with_attrs ("mr", message, &t,
+	profile_print_with_attrs ("mr", message, t,
 	  PROFILE_ATTRIBUTE_FLAG_SERIAL |
 	  PROFILE_ATTRIBUTE_FLAG_DESTINATION |
 	  PROFILE_ATTRIBUTE_FLAG_REPLY_SERIAL);
 	break;
       case DBUS_MESSAGE_TYPE_ERROR:
-	profile_print_with_attrs ("err", message, &t,
+	profile_print_with_attrs ("err", message, t,
 	  PROFILE_ATTRIBUTE_FLAG_SERIAL |
 	  PROFILE_ATTRIBUTE_FLAG_DESTINATION |
 	  PROFILE_ATTRIBUTE_FLAG_REPLY_SERIAL);
 	break;
       case DBUS_MESSAGE_TYPE_SIGNAL:
-	profile_print_with_attrs ("sig", message, &t,
+	profile_print_with_attrs ("sig", message, t,
 	  PROFILE_ATTRIBUTE_FLAG_SERIAL |
 	  PROFILE_ATTRIBUTE_FLAG_PATH |
 	  PROFILE_ATTRIBUTE_FLAG_INTERFACE |
 	  PROFILE_ATTRIBUTE_FLAG_MEMBER);
 	break;
       default:
-	printf (PROFILE_TIMED_FORMAT "\n", "tun", t.tv_sec, t.tv_usec);
+	printf (PROFILE_TIMED_FORMAT "\n", "tun", t->tv_sec, t->tv_usec);
 	break;
     }
 }
 
+/* --profile also pairs each method call with its reply, by the
+ * caller's name and the call's serial, and keeps a histogram per method
+ * of how long the replies took, along with how many messages each peer
+ * sent. These are printed as "lat" and "peer" lines when we stop, and
+ * every --interval seconds if one was given.
+ */
+
+/* Latencies in usec: exact below 16, then 8 buckets to each power of
+ * two, so a percentile is never more than 12.5% above the truth
+ */
+#define PROFILE_HISTOGRAM_BUCKETS (16 + 28 * 8)
+
+/* Calls whose callers went away never get a reply; once this many are
+ * waiting we forget those older than PROFILE_CALL_TIMEOUT seconds
+ */
+#define PROFILE_MAX_PENDING_CALLS 65536
+#define PROFILE_CALL_TIMEOUT 120
+
+typedef struct ProfileEntry ProfileEntry;
+
+struct ProfileEntry
+{
+  ProfileEntry *next;
+  char *key;
+  unsigned int hash;
+};
+
+typedef struct
+{
+  ProfileEntry **buckets;
+  unsigned int n_buckets;
+  unsigned int n_entries;
+} ProfileTable;
+
+/* Keyed by "destination\tinterface.member" */
+typedef struct
+{
+  ProfileEntry base;
+  unsigned long count;
+  unsigned long max_usec;
+  unsigned long histogram[PROFILE_HISTOGRAM_BUCKETS];
+} ProfileMethod;
+
+/* Keyed by "sender serial" */
+typedef struct
+{
+  ProfileEntry base;
+  struct timeval sent;
+  ProfileMethod *method;
+} ProfileCall;
+
+/* Keyed by the sender's name */
+typedef struct
+{
+  ProfileEntry base;
+  unsigned long n_messages;
+} ProfilePeer;
+
+static ProfileTable profile_methods;
+static ProfileTable profile_calls;
+static ProfileTable profile_peers;
+static struct timeval profile_window_start;
+static struct timeval profile_last;
+static dbus_bool_t profile_have_window = FALSE;
+static long profile_interval = 0;
+
+static void *
+profile_alloc (size_t size)
+{
+  void *p = calloc (1, size);
+
+  if (p == NULL)
+    {
+      fprintf (stderr, "dbus-monitor: out of memory\n");
+      exit (1);
+    }
+
+  return p;
+}
+
+static unsigned int
+profile_hash (const char *key)
+{
+  unsigned int hash = 5381;
+
+  while (*key)
+    hash = hash * 33 + (unsigned char) *key++;
+
+  return hash;
+}
+
+static ProfileEntry *
+profile_table_lookup (ProfileTable *table,
+                      const char   *key,
+                      unsigned int  hash)
+{
+  ProfileEntry *entry;
+
+  if (table->n_buckets == 0)
+    return NULL;
+
+  for (entry = table->buckets[hash % table->n_buckets];
+       entry != NULL;
+       entry = entry->next)
+    {
+      if (entry->hash == hash && strcmp (entry->key, key) == 0)
+        return entry;
+    }
+
+  return NULL;
+}
+
+/* Adds a zeroed entry of size bytes for key, which must not be in
+ * the table yet
+ */
+static ProfileEntry *
+profile_table_add (ProfileTable *table,
+                   const char   *key,
+                   unsigned int  hash,
+                   size_t        size)
+{
+  ProfileEntry *entry;
+
+  if (table->n_entries >= table->n_buckets)
+    {
+      unsigned int n_buckets = table->n_buckets ? table->n_buckets * 2 : 64;
+      ProfileEntry **buckets;
+      unsigned int i;
+
+      buckets = profile_alloc (n_buckets * sizeof (ProfileEntry *));
+
+      for (i = 0; i < table->n_buckets; i++)
+        {
+          while (table->buckets[i] != NULL)
+            {
+              entry = table->buckets[i];
+              table->buckets[i] = entry->next;
+              entry->next = buckets[entry->hash % n_buckets];
+              buckets[entry->hash % n_buckets] = entry;
+            }
+        }
+
+      free (table->buckets);
+      table->buckets = buckets;
+      table->n_buckets = n_buckets;
+    }
+
+  entry = profile_alloc (size);
+  entry->key = profile_alloc (strlen (key) + 1);
+  strcpy (entry->key, key);
+  entry->hash = hash;
+  entry->next = table->buckets[hash % table->n_buckets];
+  table->buckets[hash % table->n_buckets] = entry;
+  table->n_entries += 1;
+
+  return entry;
+}
+
+/* Frees every entry for which remove returns TRUE, or all of them if
+ * it is NULL
+ */
+static void
+profile_table_remove_if (ProfileTable *table,
+                         dbus_bool_t (* remove) (ProfileEntry *, void *),
+                         void         *data)
+{
+  unsigned int i;
+
+  for (i = 0; i < table->n_buckets; i++)
+    {
+      ProfileEntry **p = &table->buckets[i];
+
+      while (*p != NULL)
+        {
+          ProfileEntry *entry = *p;
+
+          if (remove == NULL || (* remove) (entry, data))
+            {
+              *p = entry->next;
+              table->n_entries -= 1;
+              free (entry->key);
+              free (entry);
+            }
+          else
+            p = &entry->next;
+        }
+    }
+}
+
+static void
+profile_table_remove (ProfileTable *table,
+                      ProfileEntry *entry)
+{
+  ProfileEntry **p;
+
+  for (p = &table->buckets[entry->hash % table->n_buckets];
+       *p != entry;
+       p = &(*p)->next)
+    ;
+
+  *p = entry->next;
+  table->n_entries -= 1;
+  free (entry->key);
+  free (entry);
+}
+
+static long
+profile_usec_between (struct timeval *start, struct timeval *end)
+{
+  return (end->tv_sec - start->tv_sec) * 1000000L +
+    (end->tv_usec - start->tv_usec);
+}
+
+static dbus_bool_t
+profile_call_expired (ProfileEntry *entry, void *data)
+{
+  ProfileCall *call = (ProfileCall *) entry;
+  struct timeval *now = data;
+
+  return now->tv_sec - call->sent.tv_sec > PROFILE_CALL_TIMEOUT;
+}
+
+static int
+profile_bucket (unsigned long usec)
+{
+  int octave;
+
+  if (usec < 16)
+    return usec;
+
+  if (usec > 0xffffffffUL)
+    usec = 0xffffffffUL;
+
+  for (octave = 4; (usec >> (octave + 1)) != 0; octave++)
+    ;
+
+  return 16 + (octave - 4) * 8 + ((usec >> (octave - 3)) & 7);
+}
+
+/* The largest latency that lands in the bucket */
+static unsigned long
+profile_bucket_limit (int bucket)
+{
+  int octave, sub;
+
+  if (bucket < 16)
+    return bucket;
+
+  octave = 4 + (bucket - 16) / 8;
+  sub = (bucket - 16) % 8;
+
+  return ((unsigned long) (8 + sub + 1) << (octave - 3)) - 1;
+}
+
+static unsigned long
+profile_percentile (ProfileMethod *method, int percent)
+{
+  unsigned long rank, seen;
+  int i;
+
+  /* The rank'th smallest latency, counting from 1 */
+  rank = (method->count * percent + 99) / 100;
+  if (rank == 0)
+    rank = 1;
+
+  seen = 0;
+  for (i = 0; i < PROFILE_HISTOGRAM_BUCKETS; i++)
+    {
+      seen += method->histogram[i];
+      if (seen >= rank)
+        {
+          unsigned long limit = profile_bucket_limit (i);
+
+          return limit < method->max_usec ? limit : method->max_usec;
+        }
+    }
+
+  return method->max_usec;
+}
+
+static void
+profile_account (DBusMessage *message, struct timeval *t)
+{
+  const char *sender;
+  const char *destination;
+  char key[1024];
+  ProfileEntry *entry;
+
+  if (!profile_have_window)
+    {
+      profile_window_start = *t;
+      profile_have_window = TRUE;
+    }
+  profile_last = *t;
+
+  sender = dbus_message_get_sender (message);
+  destination = dbus_message_get_destination (message);
+
+  if (sender != NULL)
+    {
+      unsigned int hash = profile_hash (sender);
+
+      entry = profile_table_lookup (&profile_peers, sender, hash);
+      if (entry == NULL)
+        entry = profile_table_add (&profile_peers, sender, hash,
+                                   sizeof (ProfilePeer));
+
+      ((ProfilePeer *) entry)->n_messages += 1;
+    }
+
+  switch (dbus_message_get_type (message))
+    {
+      case DBUS_MESSAGE_TYPE_METHOD_CALL:
+        {
+          const char *interface = dbus_message_get_interface (message);
+          ProfileMethod *method;
+          unsigned int hash;
+
+          /* We never see the bus driver's own replies, so calls to it
+           * would only wait here until they expired
+           */
+          if (sender == NULL || dbus_message_get_no_reply (message) ||
+              (destination != NULL &&
+               strcmp (destination, DBUS_SERVICE_DBUS) == 0))
+            break;
+
+          snprintf (key, sizeof (key), "%s\t%s%s%s",
+                    TRAP_NULL_STRING (destination),
+                    interface ? interface : "", interface ? "." : "",
+                    TRAP_NULL_STRING (dbus_message_get_member (message)));
+          hash = profile_hash (key);
+
+          entry = profile_table_lookup (&profile_methods, key, hash);
+          if (entry == NULL)
+            entry = profile_table_add (&profile_methods, key, hash,
+                                       sizeof (ProfileMethod));
+          method = (ProfileMethod *) entry;
+
+          snprintf (key, sizeof (key), "%s %u", sender,
+                    dbus_message_get_serial (message));
+          hash = profile_hash (key);
+
+          entry = profile_table_lookup (&profile_calls, key, hash);
+          if (entry == NULL)
+            {
+              if (profile_calls.n_entries >= PROFILE_MAX_PENDING_CALLS)
+                profile_table_remove_if (&profile_calls,
+                                         profile_call_expired, t);
+
+              if (profile_calls.n_entries >= PROFILE_MAX_PENDING_CALLS)
+                break;
+
+              entry = profile_table_add (&profile_calls, key, hash,
+                                         sizeof (ProfileCall));
+            }
+
+          ((ProfileCall *) entry)->sent = *t;
+          ((ProfileCall *) entry)->method = method;
+        }
+        break;
+
+      case DBUS_MESSAGE_TYPE_METHOD_RETURN:
+      case DBUS_MESSAGE_TYPE_ERROR:
+        {
+          ProfileCall *call;
+          long usec;
+
+          if (destination == NULL)
+            break;
+
+          snprintf (key, sizeof (key), "%s %u", destination,
+                    dbus_message_get_reply_serial (message));
+
+          call = (ProfileCall *) profile_table_lookup (&profile_calls, key,
+                                                       profile_hash (key));
+          if (call == NULL)
+            break;
+
+          usec = profile_usec_between (&call->sent, t);
+          if (usec < 0)
+            usec = 0;
+
+          call->method->count += 1;
+          call->method->histogram[profile_bucket (usec)] += 1;
+          if ((unsigned long) usec > call->method->max_usec)
+            call->method->max_usec = usec;
+
+          profile_table_remove (&profile_calls, &call->base);
+        }
+        break;
+
+      default:
+        break;
+    }
+}
+
+typedef struct
+{
+  ProfileEntry *entry;
+  unsigned long sort_key;
+} ProfileSummaryItem;
+
+/* Largest first */
+static int
+profile_compare_items (const void *a, const void *b)
+{
+  const ProfileSummaryItem *item_a = a;
+  const ProfileSummaryItem *item_b = b;
+
+  if (item_a->sort_key != item_b->sort_key)
+    return item_a->sort_key < item_b->sort_key ? 1 : -1;
+
+  return strcmp (item_a->entry->key, item_b->entry->key);
+}
+
+/* Collects the entries of table with a non-zero sort key, as chosen by
+ * get_sort_key, sorted largest first
+ */
+static ProfileSummaryItem *
+profile_sorted_items (ProfileTable  *table,
+                      unsigned long (* get_sort_key) (ProfileEntry *),
+                      int           *n_items)
+{
+  ProfileSummaryItem *items;
+  unsigned int i;
+  int n;
+
+  items = profile_alloc ((table->n_entries + 1) * sizeof (ProfileSummaryItem));
+
+  n = 0;
+  for (i = 0; i < table->n_buckets; i++)
+    {
+      ProfileEntry *entry;
+
+      for (entry = table->buckets[i]; entry != NULL; entry = entry->next)
+        {
+          items[n].entry = entry;
+          items[n].sort_key = (* get_sort_key) (entry);
+          if (items[n].sort_key != 0)
+            n++;
+        }
+    }
+
+  qsort (items, n, sizeof (ProfileSummaryItem), profile_compare_items);
+
+  *n_items = n;
+  return items;
+}
+
+static unsigned long
+profile_method_p99 (ProfileEntry *entry)
+{
+  ProfileMethod *method = (ProfileMethod *) entry;
+
+  if (method->count == 0)
+    return 0;
+
+  /* Keep methods that answered instantly */
+  return profile_percentile (method, 99) + 1;
+}
+
+static unsigned long
+profile_peer_messages (ProfileEntry *entry)
+{
+  return ((ProfilePeer *) entry)->n_messages;
+}
+
+/* Prints what we saw since the last summary, slowest methods and
+ * busiest peers first, and starts over
+ */
+static void
+profile_print_summary (struct timeval *now)
+{
+  ProfileSummaryItem *items;
+  double seconds;
+  int n_items;
+  int i;
+
+  if (!profile_have_window)
+    return;
+
+  items = profile_sorted_items (&profile_methods, profile_method_p99,
+                                &n_items);
+
+  for (i = 0; i < n_items; i++)
+    {
+      ProfileMethod *method = (ProfileMethod *) items[i].entry;
+
+      printf (PROFILE_TIMED_FORMAT "\t%s\t%lu\t%lu\t%lu\t%lu\n",
+              "lat", now->tv_sec, now->tv_usec, method->base.key,
+              method->count, profile_percentile (method, 50),
+              profile_percentile (method, 99), method->max_usec);
+
+      method->count = 0;
+      method->max_usec = 0;
+      memset (method->histogram, 0, sizeof (method->histogram));
+    }
+
+  free (items);
+
+  seconds = profile_usec_between (&profile_window_start, now) / 1000000.0;
+
+  items = profile_sorted_items (&profile_peers, profile_peer_messages,
+                                &n_items);
+
+  for (i = 0; i < n_items; i++)
+    {
+      ProfilePeer *peer = (ProfilePeer *) items[i].entry;
+
+      printf (PROFILE_TIMED_FORMAT "\t%s\t%lu\t%.1f\n",
+              "peer", now->tv_sec, now->tv_usec, peer->base.key,
+              peer->n_messages,
+              seconds > 0 ? peer->n_messages / seconds : 0.0);
+    }
+
+  free (items);
+
+  /* Peers that have gone away would pile up otherwise */
+  profile_table_remove_if (&profile_peers, NULL, NULL);
+
+  profile_window_start = *now;
+}
+
+static void
+profile_check_interval (struct timeval *now)
+{
+  if (profile_interval > 0 && profile_have_window &&
+      now->tv_sec - profile_window_start.tv_sec >= profile_interval)
+    profile_print_summary (now);
+}
+
 static DBusHandlerResult
 profile_filter_func (DBusConnection	*connection,
 		     DBusMessage	*message,
 		     void		*user_data)
 {
-  print_message_profile (message);
+  struct timeval t;
+
+  if (gettimeofday (&t, NULL) < 0)
+    {
+      printf ("un\n");
+      t.tv_sec = t.tv_usec = 0;
+    }
+  else
+    print_message_profile (message, &t);
 
   if (dbus_message_is_signal (message,
                               DBUS_INTERFACE_LOCAL,
                               "Disconnected"))
-    exit (0);
+    {
+      profile_print_summary (&t);
+      exit (0);
+    }
+
+  if (t.tv_sec != 0)
+    {
+      profile_check_interval (&t);
+      profile_account (message, &t);
+    }
 
   return DBUS_HANDLER_RESULT_HANDLED;
 }
 
+/* The binary capture format is a pcap file with one record per
+ * message, holding the message exactly as it went over the wire.
+ * Wireshark and other pcap readers know what to do with it; so does
+ * --decode.
+ */
+#define PCAP_MAGIC 0xa1b2c3d4
+#define PCAP_MAGIC_SWAPPED 0xd4c3b2a1
+#define PCAP_LINKTYPE_DBUS 231
+
+typedef struct
+{
+  dbus_uint32_t magic;
+  dbus_uint16_t version_major;
+  dbus_uint16_t version_minor;
+  dbus_int32_t thiszone;
+  dbus_uint32_t sigfigs;
+  dbus_uint32_t snaplen;
+  dbus_uint32_t linktype;
+} PcapFileHeader;
+
+typedef struct
+{
+  dbus_uint32_t ts_sec;
+  dbus_uint32_t ts_usec;
+  dbus_uint32_t incl_len;
+  dbus_uint32_t orig_len;
+} PcapRecordHeader;
+
+static void
+binary_write (const void *data, size_t len)
+{
+  if (fwrite (data, 1, len, stdout) != len)
+    {
+      perror ("dbus-monitor: failed to write capture");
+      exit (1);
+    }
+}
+
+static void
+binary_write_file_header (void)
+{
+  PcapFileHeader header;
+
+  header.magic = PCAP_MAGIC;
+  header.version_major = 2;
+  header.version_minor = 4;
+  header.thiszone = 0;
+  header.sigfigs = 0;
+  header.snaplen = DBUS_MAXIMUM_MESSAGE_LENGTH;
+  header.linktype = PCAP_LINKTYPE_DBUS;
+
+  binary_write (&header, sizeof (header));
+}
+
+static DBusHandlerResult
+binary_filter_func (DBusConnection     *connection,
+                    DBusMessage        *message,
+                    void               *user_data)
+{
+  PcapRecordHeader header;
+  struct timeval t;
+  char *data;
+  int len;
+
+  if (dbus_message_is_signal (message,
+                              DBUS_INTERFACE_LOCAL,
+                              "Disconnected"))
+    {
+      fflush (stdout);
+      exit (0);
+    }
+
+  if (gettimeofday (&t, NULL) < 0)
+    t.tv_sec = t.tv_usec = 0;
+
+  if (!dbus_message_marshal (message, &data, &len))
+    {
+      fprintf (stderr, "dbus-monitor: out of memory\n");
+      exit (1);
+    }
+
+  header.ts_sec = t.tv_sec;
+  header.ts_usec = t.tv_usec;
+  header.incl_len = len;
+  header.orig_len = len;
+
+  binary_write (&header, sizeof (header));
+  binary_write (data, len);
+
+  dbus_free (data);
+
+  return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+static dbus_uint32_t
+pcap_uint32 (dbus_uint32_t value, dbus_bool_t swapped)
+{
+  if (!swapped)
+    return value;
+
+  return ((value & 0x000000ffU) << 24) |
+         ((value & 0x0000ff00U) <<  8) |
+         ((value & 0x00ff0000U) >>  8) |
+         ((value & 0xff000000U) >> 24);
+}
+
+/* Reads a capture written by --binary and prints each message in it as
+ * the monitor or profile output would have, using the time it was
+ * captured at.
+ */
+static int
+decode_capture (const char *filename, dbus_bool_t profile)
+{
+  FILE *file;
+  PcapFileHeader header;
+  PcapRecordHeader record;
+  dbus_bool_t swapped;
+  char *data;
+  size_t allocated;
+  int retval;
+
+  if (strcmp (filename, "-") == 0)
+    {
+      file = stdin;
+#ifdef DBUS_WIN
+      _setmode (_fileno (stdin), _O_BINARY);
+#endif
+    }
+  else
+    file = fopen (filename, "rb");
+
+  if (file == NULL)
+    {
+      perror (filename);
+      return 1;
+    }
+
+  if (fread (&header, sizeof (header), 1, file) != 1 ||
+      (header.magic != PCAP_MAGIC && header.magic != PCAP_MAGIC_SWAPPED))
+    {
+      fprintf (stderr, "%s is not a pcap capture\n", filename);
+      fclose (file);
+      return 1;
+    }
+
+  swapped = header.magic == PCAP_MAGIC_SWAPPED;
+
+  if (pcap_uint32 (header.linktype, swapped) != PCAP_LINKTYPE_DBUS)
+    {
+      fprintf (stderr, "%s does not hold D-Bus messages\n", filename);
+      fclose (file);
+      return 1;
+    }
+
+  data = NULL;
+  allocated = 0;
+  retval = 0;
+
+  while (fread (&record, sizeof (record), 1, file) == 1)
+    {
+      DBusMessage *message;
+      DBusError error;
+      struct timeval t;
+      size_t len;
+
+      len = pcap_uint32 (record.incl_len, swapped);
+
+      if (len > DBUS_MAXIMUM_MESSAGE_LENGTH)
+        {
+          fprintf (stderr, "%s: record of %lu bytes is too long\n",
+                   filename, (unsigned long) len);
+          retval = 1;
+          break;
+        }
+
+      if (len > allocated)
+        {
+          char *bigger = realloc (data, len);
+
+          if (bigger == NULL)
+            {
+              fprintf (stderr, "dbus-monitor: out of memory\n");
+              retval = 1;
+              break;
+            }
+
+          data = bigger;
+          allocated = len;
+        }
+
+      if (fread (data, 1, len, file) != len)
+        {
+          fprintf (stderr, "%s: capture ends partway through a message\n",
+                   filename);
+          retval = 1;
+          break;
+        }
+
+      /* A message cut short by the snapshot length can't be decoded */
+      if (len != pcap_uint32 (record.orig_len, swapped))
+        continue;
+
+      dbus_error_init (&error);
+      message = dbus_message_demarshal (data, len, &error);
+      if (message == NULL)
+        {
+          fprintf (stderr, "%s: skipping a message that doesn't decode: %s\n",
+                   filename, error.message);
+          dbus_error_free (&error);
+          continue;
+        }
+
+      if (profile)
+        {
+          t.tv_sec = pcap_uint32 (record.ts_sec, swapped);
+          t.tv_usec = pcap_uint32 (record.ts_usec, swapped);
+          print_message_profile (message, &t);
+          profile_check_interval (&t);
+          profile_account (message, &t);
+        }
+      else
+        print_message (message, FALSE);
+
+      dbus_message_unref (message);
+    }
+
+  if (retval == 0 && ferror (file))
+    {
+      perror (filename);
+      retval = 1;
+    }
+
+  free (data);
+
+  if (file != stdin)
+    fclose (file);
+
+  if (profile)
+    profile_print_summary (&profile_last);
+
+  return retval;
+}
+
 static void
 usage (char *name, int ecode)
 {
-  fprintf (stderr, "Usage: %s [--system | --session | --address ADDRESS] [--monitor | --profile ] [watch expressions]\n", name);
+  fprintf (stderr, "Usage: %s [--system | --session | --address ADDRESS] [--monitor | --profile | --binary ] [--interval SECONDS] [watch expressions]\n"
+           "       %s [--monitor | --profile] [--interval SECONDS] --decode FILE\n", name, name);
   exit (ecode);
 }
 
-static dbus_bool_t sigint_received = FALSE;
+static volatile sig_atomic_t sigint_received = 0;
 
 static void
 sigint_handler (int signum)
 {
-  sigint_received = TRUE;
+  sigint_received = 1;
 }
 
 int
@@ -227,6 +1014,8 @@ main (int argc, char *argv[])
   DBusBusType type = DBUS_BUS_SESSION;
   DBusHandleMessageFunction filter_func = monitor_filter_func;
   char *address = NULL;
+  char *decode = NULL;
+  int timeout_milliseconds = -1;
   
   int i = 0, j = 0, numFilters = 0;
   char **filters = NULL;
@@ -266,6 +1055,28 @@ main (int argc, char *argv[])
 	filter_func = monitor_filter_func;
       else if (!strcmp (arg, "--profile"))
 	filter_func = profile_filter_func;
+      else if (!strcmp (arg, "--binary"))
+	filter_func = binary_filter_func;
+      else if (!strcmp (arg, "--interval"))
+	{
+	  if (i+1 < argc && atol (argv[i+1]) > 0)
+	    {
+	      profile_interval = atol (argv[i+1]);
+	      i++;
+	    }
+	  else
+	    usage (argv[0], 1);
+	}
+      else if (!strcmp (arg, "--decode"))
+	{
+	  if (i+1 < argc)
+	    {
+	      decode = argv[i+1];
+	      i++;
+	    }
+	  else
+	    usage (argv[0], 1);
+	}
       else if (!strcmp (arg, "--"))
 	continue;
       else if (arg[0] == '-')
@@ -279,6 +1090,27 @@ main (int argc, char *argv[])
       }
     }
 
+  if (decode != NULL)
+    {
+      if (filter_func == binary_filter_func || numFilters)
+        usage (argv[0], 1);
+
+      return decode_capture (decode, filter_func == profile_filter_func);
+    }
+
+  if (filter_func == binary_filter_func)
+    {
+      /* Nobody reads a capture a line at a time, and the fewer writes
+       * we make the less we fall behind the bus; stdout is flushed
+       * when we are interrupted or disconnected instead.
+       */
+#ifdef DBUS_WIN
+      _setmode (_fileno (stdout), _O_BINARY);
+#endif
+      setvbuf (stdout, NULL, _IOFBF, 64 * 1024);
+      binary_write_file_header ();
+    }
+
   dbus_error_init (&error);
   
   if (address != NULL)
@@ -367,8 +1199,37 @@ main (int argc, char *argv[])
     exit (1);
   }
 
-  while (dbus_connection_read_write_dispatch(connection, -1))
-    ;
+  if (filter_func == binary_filter_func ||
+      filter_func == profile_filter_func)
+    {
+      /* libdbus retries its poll when a signal interrupts it, so wake
+       * up now and then to see whether we were asked to stop, or it
+       * is time for a profile summary
+       */
+      signal (SIGINT, sigint_handler);
+      signal (SIGTERM, sigint_handler);
+      timeout_milliseconds = 250;
+    }
+
+  while (!sigint_received &&
+         dbus_connection_read_write_dispatch(connection, timeout_milliseconds))
+    {
+      struct timeval t;
+
+      if (filter_func == profile_filter_func &&
+          gettimeofday (&t, NULL) == 0)
+        profile_check_interval (&t);
+    }
+
+  if (filter_func == profile_filter_func)
+    {
+      struct timeval t;
+
+      if (gettimeofday (&t, NULL) == 0)
+        profile_print_summary (&t);
+    }
+
+  fflush (stdout);
   exit (0);
  lose:
   fprintf (stderr, "Error: %s\n", error.message);